@@ -0,0 +1,43 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __ALIGNEDMEMORY_H__
+#define __ALIGNEDMEMORY_H__
+
+#include <cstddef>
+
+// Allocates 'bytes' of uninitialized memory whose address is a multiple of 'alignment'.
+// 'alignment' has to be a power of two. Returns a nullptr if the allocation failed
+void* alignedMalloc(size_t bytes, size_t alignment);
+
+// Frees memory previously allocated with 'alignedMalloc'. It is safe to pass a nullptr
+void alignedFree(void* ptr);
+
+// Convenience function that allocates an aligned array of 'count' elements of type T. The
+// elements are not constructed, so this should only be used with trivial types
+template <typename T>
+T* alignedArray(size_t count, size_t alignment) {
+    return static_cast<T*>(alignedMalloc(count * sizeof(T), alignment));
+}
+
+#endif // __ALIGNEDMEMORY_H__
@@ -0,0 +1,125 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "allocationcounter.h"
+
+#ifndef NDEBUG
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#endif
+
+#ifndef NDEBUG
+
+namespace {
+    std::atomic<size_t> _totalAllocations(0);
+    thread_local size_t _threadAllocations = 0;
+
+    // Counts and performs an allocation with the semantics of the global operator new
+    void* countedMalloc(size_t bytes) {
+        allocationcounter::record();
+        // The operator new has to return a unique pointer even for 0 bytes
+        return std::malloc((bytes > 0) ? bytes : 1);
+    }
+}
+
+void* operator new(size_t bytes) {
+    void* ptr = countedMalloc(bytes);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](size_t bytes) {
+    void* ptr = countedMalloc(bytes);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept {
+    return countedMalloc(bytes);
+}
+
+void* operator new[](size_t bytes, const std::nothrow_t&) noexcept {
+    return countedMalloc(bytes);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+
+namespace allocationcounter {
+
+bool isEnabled() {
+    return true;
+}
+
+size_t total() {
+    return _totalAllocations;
+}
+
+size_t thisThread() {
+    return _threadAllocations;
+}
+
+void record() {
+    ++_totalAllocations;
+    ++_threadAllocations;
+}
+
+} // namespace allocationcounter
+
+#else // NDEBUG
+
+namespace allocationcounter {
+
+bool isEnabled() {
+    return false;
+}
+
+size_t total() {
+    return 0;
+}
+
+size_t thisThread() {
+    return 0;
+}
+
+void record() {}
+
+} // namespace allocationcounter
+
+#endif // NDEBUG
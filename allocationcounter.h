@@ -0,0 +1,48 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __ALLOCATIONCOUNTER_H__
+#define __ALLOCATIONCOUNTER_H__
+
+#include <cstddef>
+
+// In debug builds, the global operator new and 'alignedMalloc' count how often they are called,
+// so that code which is supposed to run without touching the heap can verify that it does. In
+// release builds (NDEBUG) nothing is counted and all functions return 0
+namespace allocationcounter {
+
+// Returns true if allocations are counted in this build
+bool isEnabled();
+
+// Returns the number of allocations that were made by all threads
+size_t total();
+
+// Returns the number of allocations that were made by the calling thread
+size_t thisThread();
+
+// Counts an allocation that does not go through the operator new
+void record();
+
+} // namespace allocationcounter
+
+#endif // __ALLOCATIONCOUNTER_H__
@@ -0,0 +1,15 @@
+#version 330
+
+in vec2 texCoord;
+in vec4 particleColor;
+
+uniform sampler2D _texture;
+
+out vec4 fragColor;
+
+void main() {
+    fragColor = texture(_texture, texCoord) * particleColor;
+    // The transparent corners of the quad should not hide the particles behind them
+    if (fragColor.a == 0.0)
+        discard;
+}
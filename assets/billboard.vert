@@ -0,0 +1,42 @@
+#version 330
+
+// Expands every particle into a quad that faces the camera. Each instance is one particle and
+// its four vertices are the corners of the quad that all instances share
+
+// The corner of the quad in [-1,1]^2, the same for every instance
+layout(location = 0) in vec2 in_corner;
+// The position of the particle, advancing once per instance
+layout(location = 1) in vec3 in_position;
+// The attribute channels of the particle, see particleattributes.h. Without a buffer they are
+// white, of the default size, and newborn
+layout(location = 2) in vec4 in_color;
+layout(location = 3) in float in_size;
+layout(location = 4) in float in_age;
+
+// The values shared by all programs, updated once per frame
+layout(std140) uniform Globals {
+    mat4 _viewProjectionMatrix;
+    vec4 _cameraPosition;
+    vec4 _lightPosition;
+    // The world space directions of the screen's x and y axes
+    vec4 _cameraRight;
+    vec4 _cameraUp;
+};
+
+// The edge length of a quad in world space
+uniform float _billboardSize;
+
+out vec2 texCoord;
+// The color the texture is tinted with; it fades out over the lifetime
+out vec4 particleColor;
+// The distance along the view direction, for the weights of the weighted blending
+out float viewDepth;
+
+void main() {
+    vec2 offset = in_corner * (0.5 * _billboardSize * in_size);
+    vec3 position = in_position + _cameraRight.xyz * offset.x + _cameraUp.xyz * offset.y;
+    texCoord = in_corner * 0.5 + 0.5;
+    particleColor = vec4(in_color.rgb, in_color.a * (1.0 - in_age));
+    gl_Position = _viewProjectionMatrix * vec4(position, 1.0);
+    viewDepth = gl_Position.w;
+}
@@ -0,0 +1,26 @@
+#version 330
+
+// Writes the billboards into the weighted blended accumulation target instead of blending them
+// directly, so that their order does not matter
+
+in vec2 texCoord;
+in vec4 particleColor;
+in float viewDepth;
+
+uniform sampler2D _texture;
+
+// Summed: the premultiplied color and the alpha, both weighted
+layout(location = 0) out vec4 accumulation;
+// Multiplied into the revealage as (1 - alpha)
+layout(location = 1) out vec4 revealage;
+
+void main() {
+    vec4 color = texture(_texture, texCoord) * particleColor;
+    if (color.a == 0.0)
+        discard;
+
+    // The weight function (9) of McGuire and Bavoil; closer fragments count more
+    float weight = color.a * clamp(0.03 / (1e-5 + pow(viewDepth / 200.0, 4.0)), 1e-2, 3e3);
+    accumulation = vec4(color.rgb * color.a, color.a) * weight;
+    revealage = vec4(color.a);
+}
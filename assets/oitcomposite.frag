@@ -0,0 +1,21 @@
+#version 330
+
+// Resolves the weighted blended accumulation into the average color of the fragments, whose
+// alpha is the coverage of all of them together
+
+uniform sampler2D _accumulation;
+uniform sampler2D _revealage;
+
+out vec4 fragColor;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float revealage = texelFetch(_revealage, pixel, 0).r;
+    // Nothing has been drawn into this pixel
+    if (revealage == 1.0)
+        discard;
+
+    vec4 accumulation = texelFetch(_accumulation, pixel, 0);
+    vec3 average = accumulation.rgb / max(accumulation.a, 1e-5);
+    fragColor = vec4(average, 1.0 - revealage);
+}
@@ -0,0 +1,41 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __ATTRIBUTESOURCE_H__
+#define __ATTRIBUTESOURCE_H__
+
+#include <ghoul/opengl/opengl>
+
+#include <cstddef>
+
+// Where the compute shaders of the ParticleCuller and the DepthSorter read the values of one
+// attribute channel from, see particleattributes.h. The value of particle i is the word at
+// 'first' + i * 'stride' words of 'buffer', so both the separate and the interleaved layout can
+// be read. A 'buffer' of 0 means that the channel is not read
+struct AttributeSource {
+    GLuint buffer;
+    size_t first;
+    size_t stride;
+};
+
+#endif // __ATTRIBUTESOURCE_H__
@@ -0,0 +1,584 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+// The headless benchmark. It runs scripted scenarios through the simulator, without the GUI or
+// an OpenGL context, and prints the results as JSON to the standard output, so that it can be
+// used on machines without a display. Usage:
+//   ParticleBench [--scenario name] [--emitters N] [--effects M] [--steps K] [--rate R]
+//                 [--capacity C] [--deltaT seconds] [--threads T]
+//                 [--kernel Scalar|SSE4|AVX2|NEON] [--snapshot file] [--replay file]
+//                 [--export none|float|quantized] [--metrics file] [--verify-threads T]
+//                 [--rank R --peers host:port,host:port,...]
+// '--scenario' selects one of the built-in scenarios (default: all of them), the other options
+// override the respective value of the selected scenarios. '--snapshot' starts the scenarios
+// from a snapshot saved by the GUI instead of an empty simulation, and '--replay' applies the
+// changes of a recording before the steps they were made at, with the recording's step size.
+// If either is given without '--scenario', only the empty "input" scenario is run. '--export'
+// writes the positions of every step into a buffer like the one of the renderer, as vec3s or as
+// QuantizedPositions, and reports the bytes per step and the largest quantization error.
+// '--metrics' keeps the counters of the running scenario in a file in the text format of
+// Prometheus, for example for the textfile collector of the node exporter. After the steps, each
+// scenario is removed and added again a number of times to measure the cost of a reset.
+// '--verify-threads' runs each scenario again with 1, 2, 4, ... up to T threads and reports
+// whether the checksum of the final state was the same for all of them. '--peers' runs the
+// scenarios distributed over one process per address, each started with its own '--rank', by
+// splitting space between them (see DistributedSimulation); the particle counts and rates are
+// then those of all ranks together
+
+#include <ghoul/logging/logging>
+
+#include "alignedmemory.h"
+#include "callbackrecorder.h"
+#include "distributedsimulation.h"
+#include "profiler.h"
+#include "simulation.h"
+#include "snapshot.h"
+#include "statschannel.h"
+#include "threadpool.h"
+#include "transport.h"
+#include "worldgeometry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace ghoul::logging;
+
+namespace {
+    const std::string _loggerCat = "ParticleBench";
+
+    // A scripted benchmark run
+    struct Scenario {
+        // The identifier used in the results and on the command line
+        std::string name;
+        // The number of point emitters, placed evenly on a circle around the origin
+        int numberOfEmitters;
+        // The number of effects, alternating between gravity and wind, placed evenly on a
+        // smaller circle than the emitters
+        int numberOfEffects;
+        // The number of steps that are measured
+        int numberOfSteps;
+        // The particles per second of each emitter
+        float rate;
+        // The maximum number of particles
+        size_t capacity;
+    };
+
+    // The built-in scenarios, from a quick smoke test to the full capacity of the GUI
+    const Scenario _scenarios[] = {
+        { "single", 1, 0, 600, 100000.f, 1000000 },
+        { "many", 16, 0, 600, 50000.f, 5000000 },
+        { "saturated", 8, 0, 600, 1000000.f, 5000000 },
+        { "effects", 8, 8, 600, 200000.f, 5000000 }
+    };
+
+    // The scenario for a snapshot or recording on its own, which brings all the emitters
+    const Scenario _inputScenario = { "input", 0, 0, 600, 0.f, 5000000 };
+
+    // The formats the positions can be exported in after each step
+    enum class ExportFormat {
+        None,
+        Float,
+        Quantized
+    };
+
+    // The number of steps between two updates of the metrics file
+    const int _metricsInterval = 60;
+
+    // The number of times the scene is reset and populated again after the steps
+    const int _numberOfResets = 1000;
+
+    // The radius of the circle the emitters are placed on
+    const float _emitterRadius = 0.5f;
+
+    // The radius of the circle the effects are placed on and their strength
+    const float _effectRadius = 0.25f;
+    const float _effectStrength = 5.f;
+
+    // The results of running a single scenario
+    struct Result {
+        // The sum of the number of particles over all steps
+        double particleSteps;
+        // The number of particles after the last step
+        size_t finalParticles;
+        // The wall clock time of all steps
+        double seconds;
+        // The statistics of the step durations
+        Profiler::Statistics step;
+        // The peak resident set size of the process after the scenario, in bytes
+        size_t peakResidentBytes;
+        // The time it took to restore the snapshot, if there is one
+        double restoreSeconds;
+        // The number of bytes exported by the last step
+        size_t exportBytes;
+        // The largest difference along an axis between a position of the last step and its
+        // quantized export, and the bound of the PositionQuantizer for it
+        float positionError;
+        float positionErrorBound;
+        // The hash of the state after the last step
+        uint64_t checksum;
+        // The average time of removing everything and adding the emitters and effects again
+        double resetMicroseconds;
+        // The particles on this rank after the last step, the average number that left this
+        // rank per step, the time spent communicating, and the decimated particles rank 0
+        // received for its display. Only used when the scenario is distributed
+        size_t localParticles;
+        double migratedPerStep;
+        double communicationSeconds;
+        size_t displayParticles;
+    };
+
+    // Returns the largest amount of physical memory the process has used so far in bytes
+    size_t peakResidentBytes() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return counters.PeakWorkingSetSize;
+        return 0;
+#else
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+            return 0;
+#ifdef __APPLE__
+        // macOS reports bytes
+        return static_cast<size_t>(usage.ru_maxrss);
+#else
+        // Linux reports kilobytes
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+    }
+
+    // Adds the emitters and effects of 'scenario' to 'simulation'. The z axis is up, so both
+    // circles lie in the x-y plane, the emitters on the ground and the effects above them
+    void populate(Simulation& simulation, const Scenario& scenario) {
+        for (int i = 0; i < scenario.numberOfEmitters; ++i) {
+            const float angle = 6.28318530718f * i / scenario.numberOfEmitters;
+            const glm::vec3 position(
+                _emitterRadius * std::cos(angle), _emitterRadius * std::sin(angle),
+                worldgeometry::GroundHeight
+            );
+            simulation.emitters().addEmitter(EmitterSystem::Type::Point, position, scenario.rate);
+        }
+        for (int i = 0; i < scenario.numberOfEffects; ++i) {
+            const float angle = 6.28318530718f * i / scenario.numberOfEffects;
+            const glm::vec3 position(
+                _effectRadius * std::cos(angle), _effectRadius * std::sin(angle),
+                worldgeometry::GroundHeight + 0.5f
+            );
+            const EffectSystem::Type type =
+                (i % 2 == 0) ? EffectSystem::Type::Gravity : EffectSystem::Type::Wind;
+            simulation.effects().addEffect(type, position, _effectStrength);
+        }
+    }
+
+    // Runs 'scenario' with time steps of 'deltaT' on 'pool' using the integration 'kernel'. If
+    // 'snapshot' is open, the scenario starts from it, and the recorded 'events' are applied
+    // before their steps. Each step exports the positions in 'format'. If 'metricsPath' is not
+    // empty, the counters are written into that file regularly. If 'transport' is not a
+    // nullptr, the scenario is distributed over its ranks
+    Result run(const Scenario& scenario, float deltaT, ThreadPool& pool, Integrator::Kernel kernel,
+        const Snapshot& snapshot, const std::vector<CallbackRecorder::Event>& events,
+        ExportFormat format, const std::string& metricsPath, Transport* transport)
+    {
+        Profiler profiler;
+        StatsChannel stats;
+        Simulation simulation(scenario.capacity, pool);
+        simulation.integrator().setKernel(kernel);
+        simulation.setProfiler(&profiler);
+        simulation.setStatsChannel(&stats);
+        const std::string labels = "scenario=\"" + scenario.name + "\"";
+
+        populate(simulation, scenario);
+
+        Result result;
+        result.restoreSeconds = 0.0;
+        if (snapshot.isOpen()) {
+            // The snapshot replaces the emitters and effects of the scenario
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            snapshot.restore(simulation);
+            const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            result.restoreSeconds = std::chrono::duration<double>(end - start).count();
+            // Every rank needs the emitters and effects, but the particles only once
+            if ((transport != nullptr) && (transport->rank() != 0))
+                simulation.store().clear();
+        }
+        DistributedSimulation* distributed = nullptr;
+        if (transport != nullptr)
+            distributed = new DistributedSimulation(simulation, *transport);
+
+        // Like the mapped buffer of the renderer, the export memory has room for all particles
+        glm::vec3* floatExport = nullptr;
+        QuantizedPosition* quantizedExport = nullptr;
+        if (format == ExportFormat::Float)
+            floatExport = alignedArray<glm::vec3>(scenario.capacity, ParticleStore::Alignment);
+        else if (format == ExportFormat::Quantized) {
+            quantizedExport = alignedArray<QuantizedPosition>(scenario.capacity,
+                ParticleStore::Alignment);
+        }
+
+        result.particleSteps = 0.0;
+        size_t nextEvent = 0;
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < scenario.numberOfSteps; ++i) {
+            while ((nextEvent < events.size()) &&
+                (events[nextEvent].step <= simulation.numberOfSteps()))
+            {
+                CallbackRecorder::apply(events[nextEvent], simulation);
+                ++nextEvent;
+            }
+            if (distributed != nullptr) {
+                if (!distributed->step(deltaT)) {
+                    LERROR("Lost the connection to the other ranks after " << i << " steps");
+                    break;
+                }
+            }
+            else if (quantizedExport != nullptr) {
+                simulation.step(deltaT, quantizedExport, 0.f);
+                stats.add(StatsChannel::Counter::UploadBytes,
+                    simulation.store().size() * sizeof(QuantizedPosition));
+            }
+            else if (floatExport != nullptr) {
+                simulation.step(deltaT, floatExport);
+                stats.add(StatsChannel::Counter::UploadBytes,
+                    simulation.store().size() * sizeof(glm::vec3));
+            }
+            else
+                simulation.step(deltaT);
+            result.particleSteps += (distributed != nullptr) ?
+                distributed->totalParticles() : simulation.store().size();
+
+            if (!metricsPath.empty() && ((i + 1) % _metricsInterval == 0))
+                stats.writePrometheusFile(metricsPath, labels);
+        }
+        const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        // The exports of the last step are not moved, so they are compared to the store as is
+        result.exportBytes = 0;
+        result.positionError = 0.f;
+        result.positionErrorBound = 0.f;
+        if (floatExport != nullptr)
+            result.exportBytes = simulation.store().size() * sizeof(glm::vec3);
+        if (quantizedExport != nullptr) {
+            const PositionQuantizer& quantizer = simulation.positionQuantizer();
+            const glm::vec3 bound = quantizer.maximumError();
+            result.exportBytes = simulation.store().size() * sizeof(QuantizedPosition);
+            result.positionErrorBound = std::max(bound.x, std::max(bound.y, bound.z));
+            const glm::vec3* positions = simulation.store().positions();
+            for (size_t i = 0; i < simulation.store().size(); ++i) {
+                if (quantizedExport[i].cell & PositionQuantizer::OutsideFlag)
+                    continue;
+                const glm::vec3 error = glm::abs(quantizer.decode(quantizedExport[i]) -
+                    positions[i]);
+                result.positionError = std::max(result.positionError,
+                    std::max(error.x, std::max(error.y, error.z)));
+            }
+        }
+        alignedFree(floatExport);
+        alignedFree(quantizedExport);
+        if (!metricsPath.empty())
+            stats.writePrometheusFile(metricsPath, labels);
+
+        result.seconds = std::chrono::duration<double>(end - start).count();
+        result.finalParticles = simulation.store().size();
+        result.localParticles = simulation.store().size();
+        result.migratedPerStep = 0.0;
+        result.communicationSeconds = 0.0;
+        result.displayParticles = 0;
+        if (distributed != nullptr) {
+            result.finalParticles = distributed->totalParticles();
+            result.migratedPerStep = static_cast<double>(distributed->migratedParticles()) /
+                std::max(scenario.numberOfSteps, 1);
+            result.communicationSeconds = distributed->communicationSeconds();
+            result.displayParticles = distributed->displayView().size();
+            delete distributed;
+        }
+        result.step = profiler.statistics(Profiler::Section::Step);
+        result.checksum = simulation.checksum();
+
+        // Measured last, as it replaces the state of the steps
+        const std::chrono::steady_clock::time_point resetStart = std::chrono::steady_clock::now();
+        for (int i = 0; i < _numberOfResets; ++i) {
+            simulation.removeAll();
+            populate(simulation, scenario);
+        }
+        const std::chrono::steady_clock::time_point resetEnd = std::chrono::steady_clock::now();
+        result.resetMicroseconds =
+            std::chrono::duration<double, std::micro>(resetEnd - resetStart).count() /
+            _numberOfResets;
+
+        result.peakResidentBytes = peakResidentBytes();
+        return result;
+    }
+
+    // Returns the kernel with the 'name', or false if there is no such kernel
+    bool parseKernel(const std::string& name, Integrator::Kernel& kernel) {
+        const Integrator::Kernel kernels[] = {
+            Integrator::Kernel::Scalar, Integrator::Kernel::SSE4,
+            Integrator::Kernel::AVX2, Integrator::Kernel::NEON
+        };
+        for (Integrator::Kernel k : kernels) {
+            if (Integrator::name(k) == name) {
+                kernel = k;
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+int main(int argc, char** argv) {
+    // Only warnings and errors, as the standard output is reserved for the results
+    LogManager::initialize(LogManager::LogLevelWarning);
+    LogMgr.addLog(new ConsoleLog);
+
+    std::string selectedScenario;
+    int numberOfEmitters = -1;
+    int numberOfEffects = -1;
+    int numberOfSteps = -1;
+    float rate = -1.f;
+    long long capacity = -1;
+    float deltaT = -1.f;
+    unsigned int numberOfWorkers = ThreadPool::defaultNumberOfWorkers();
+    std::string kernelName;
+    std::string snapshotPath;
+    std::string replayPath;
+    ExportFormat exportFormat = ExportFormat::None;
+    std::string exportName = "none";
+    std::string metricsPath;
+    int verifyThreads = 0;
+    int rank = 0;
+    std::vector<std::string> peers;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if (i + 1 >= argc) {
+            LFATAL("Missing value for argument '" << argument << "'");
+            return EXIT_FAILURE;
+        }
+        const char* value = argv[++i];
+        if (argument == "--scenario")
+            selectedScenario = value;
+        else if (argument == "--emitters")
+            numberOfEmitters = std::atoi(value);
+        else if (argument == "--effects")
+            numberOfEffects = std::atoi(value);
+        else if (argument == "--steps")
+            numberOfSteps = std::atoi(value);
+        else if (argument == "--rate")
+            rate = static_cast<float>(std::atof(value));
+        else if (argument == "--capacity")
+            capacity = std::atoll(value);
+        else if (argument == "--deltaT")
+            deltaT = static_cast<float>(std::atof(value));
+        else if (argument == "--threads") {
+            // The calling thread is working as well
+            const int threads = std::atoi(value);
+            numberOfWorkers = (threads > 1) ? static_cast<unsigned int>(threads - 1) : 0;
+        }
+        else if (argument == "--kernel")
+            kernelName = value;
+        else if (argument == "--snapshot")
+            snapshotPath = value;
+        else if (argument == "--replay")
+            replayPath = value;
+        else if (argument == "--export") {
+            exportName = value;
+            if (exportName == "none")
+                exportFormat = ExportFormat::None;
+            else if (exportName == "float")
+                exportFormat = ExportFormat::Float;
+            else if (exportName == "quantized")
+                exportFormat = ExportFormat::Quantized;
+            else {
+                LFATAL("Unknown export format '" << exportName << "'");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (argument == "--metrics")
+            metricsPath = value;
+        else if (argument == "--verify-threads")
+            verifyThreads = std::atoi(value);
+        else if (argument == "--rank")
+            rank = std::atoi(value);
+        else if (argument == "--peers") {
+            const std::string list = value;
+            std::string::size_type begin = 0;
+            while (begin <= list.size()) {
+                const std::string::size_type end = std::min(list.find(',', begin), list.size());
+                peers.push_back(list.substr(begin, end - begin));
+                begin = end + 1;
+            }
+        }
+        else {
+            LFATAL("Unknown argument '" << argument << "'");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The input files are loaded once and used by all scenarios
+    Snapshot snapshot;
+    if (!snapshotPath.empty() && !snapshot.open(snapshotPath))
+        return EXIT_FAILURE;
+    std::vector<CallbackRecorder::Event> events;
+    if (!replayPath.empty()) {
+        float stepSize = 0.f;
+        if (!CallbackRecorder::load(replayPath, events, stepSize))
+            return EXIT_FAILURE;
+        // The recording is only reproduced with the steps it was recorded with
+        if (deltaT < 0.f)
+            deltaT = stepSize;
+    }
+    if (deltaT < 0.f)
+        deltaT = 1.f / 60.f;
+
+    // Select and adjust the scenarios
+    std::vector<Scenario> candidates(std::begin(_scenarios), std::end(_scenarios));
+    const bool hasInput = snapshot.isOpen() || !replayPath.empty();
+    if (hasInput && selectedScenario.empty())
+        candidates.assign(1, _inputScenario);
+    else if (selectedScenario == _inputScenario.name)
+        candidates.push_back(_inputScenario);
+    std::vector<Scenario> scenarios;
+    for (const Scenario& scenario : candidates) {
+        if (!selectedScenario.empty() && (scenario.name != selectedScenario))
+            continue;
+        Scenario s = scenario;
+        if (numberOfEmitters >= 0)
+            s.numberOfEmitters = numberOfEmitters;
+        if (numberOfEffects >= 0)
+            s.numberOfEffects = numberOfEffects;
+        if (numberOfSteps >= 0)
+            s.numberOfSteps = numberOfSteps;
+        if (rate >= 0.f)
+            s.rate = rate;
+        if (capacity > 0)
+            s.capacity = static_cast<size_t>(capacity);
+        // All recorded changes have to be applied, and all particles of the snapshot must fit
+        if (!events.empty() && (numberOfSteps < 0))
+            s.numberOfSteps = std::max(s.numberOfSteps, static_cast<int>(events.back().step) + 1);
+        s.capacity = std::max(s.capacity, snapshot.numberOfParticles());
+        scenarios.push_back(s);
+    }
+    if (scenarios.empty()) {
+        LFATAL("Unknown scenario '" << selectedScenario << "'");
+        return EXIT_FAILURE;
+    }
+
+    ThreadPool pool(numberOfWorkers);
+    Integrator::Kernel kernel = Integrator().kernel();
+    if (!kernelName.empty()) {
+        if (!parseKernel(kernelName, kernel) || !Integrator::isSupported(kernel)) {
+            LFATAL("Kernel '" << kernelName << "' is not available");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // All ranks run the same scenarios in lockstep
+    Transport transport;
+    if (!peers.empty()) {
+        if ((exportFormat != ExportFormat::None) || (verifyThreads > 0)) {
+            LFATAL("'--export' and '--verify-threads' cannot be combined with '--peers'");
+            return EXIT_FAILURE;
+        }
+        if ((rank < 0) || !transport.connect(static_cast<size_t>(rank), peers, 60))
+            return EXIT_FAILURE;
+    }
+    Transport* distribution = peers.empty() ? nullptr : &transport;
+
+    std::printf("{\n");
+    std::printf("  \"kernel\": \"%s\",\n", Integrator::name(kernel).c_str());
+    std::printf("  \"threads\": %u,\n", pool.numberOfThreads());
+    std::printf("  \"deltaT\": %g,\n", deltaT);
+    std::printf("  \"snapshot\": \"%s\",\n", snapshotPath.c_str());
+    std::printf("  \"replay\": \"%s\",\n", replayPath.c_str());
+    std::printf("  \"export\": \"%s\",\n", exportName.c_str());
+    std::printf("  \"rank\": %zu,\n", transport.rank());
+    std::printf("  \"ranks\": %zu,\n", transport.numberOfRanks());
+    std::printf("  \"scenarios\": [\n");
+    for (size_t i = 0; i < scenarios.size(); ++i) {
+        const Scenario& s = scenarios[i];
+        const Result r = run(s, deltaT, pool, kernel, snapshot, events, exportFormat,
+            metricsPath, distribution);
+
+        // The same scenario with other numbers of threads has to end in the same state
+        const char* threadIndependent = "null";
+        if (verifyThreads > 0) {
+            bool identical = true;
+            for (int threads = 1; threads <= verifyThreads; threads *= 2) {
+                ThreadPool verifyPool(static_cast<unsigned int>(threads - 1));
+                const Result v = run(s, deltaT, verifyPool, kernel, snapshot, events,
+                    ExportFormat::None, "", nullptr);
+                identical = identical && (v.checksum == r.checksum);
+            }
+            threadIndependent = identical ? "true" : "false";
+        }
+        const double perSecond = (r.seconds > 0.0) ? r.particleSteps / r.seconds : 0.0;
+        const double perParticle =
+            (r.particleSteps > 0.0) ? (r.seconds * 1e9) / r.particleSteps : 0.0;
+
+        std::printf("    {\n");
+        std::printf("      \"name\": \"%s\",\n", s.name.c_str());
+        std::printf("      \"emitters\": %d,\n", s.numberOfEmitters);
+        std::printf("      \"effects\": %d,\n", s.numberOfEffects);
+        std::printf("      \"steps\": %d,\n", s.numberOfSteps);
+        std::printf("      \"rate\": %g,\n", s.rate);
+        std::printf("      \"capacity\": %zu,\n", s.capacity);
+        std::printf("      \"finalParticles\": %zu,\n", r.finalParticles);
+        std::printf("      \"seconds\": %.6f,\n", r.seconds);
+        std::printf("      \"particlesPerSecond\": %.1f,\n", perSecond);
+        std::printf("      \"nsPerParticleStep\": %.4f,\n", perParticle);
+        std::printf("      \"stepMillisecondsP50\": %.4f,\n", r.step.median);
+        std::printf("      \"stepMillisecondsP99\": %.4f,\n", r.step.percentile99);
+        std::printf("      \"restoreSeconds\": %.6f,\n", r.restoreSeconds);
+        std::printf("      \"exportBytesPerStep\": %zu,\n", r.exportBytes);
+        std::printf("      \"positionError\": %g,\n", r.positionError);
+        std::printf("      \"positionErrorBound\": %g,\n", r.positionErrorBound);
+        std::printf("      \"resetMicroseconds\": %.3f,\n", r.resetMicroseconds);
+        std::printf("      \"checksum\": \"%016llx\",\n",
+            static_cast<unsigned long long>(r.checksum));
+        std::printf("      \"threadIndependent\": %s,\n", threadIndependent);
+        std::printf("      \"localParticles\": %zu,\n", r.localParticles);
+        std::printf("      \"migratedPerStep\": %.1f,\n", r.migratedPerStep);
+        std::printf("      \"communicationSeconds\": %.6f,\n", r.communicationSeconds);
+        std::printf("      \"displayParticles\": %zu,\n", r.displayParticles);
+        std::printf("      \"peakResidentBytes\": %zu\n", r.peakResidentBytes);
+        std::printf("    }%s\n", (i + 1 < scenarios.size()) ? "," : "");
+        std::fflush(stdout);
+    }
+    std::printf("  ]\n");
+    std::printf("}\n");
+    return EXIT_SUCCESS;
+}
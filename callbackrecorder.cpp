@@ -0,0 +1,183 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "callbackrecorder.h"
+
+#include "simulation.h"
+
+#include <ghoul/logging/logging>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    const std::string _loggerCat = "CallbackRecorder";
+
+    // Identifies recording files
+    const char _magic[8] = { 'P', 'R', 'E', 'C', 'O', 'R', 'D', '\0' };
+    // Reads differently on a machine with the other byte order
+    const uint32_t _byteOrderMark = 0x01020304;
+
+    // The beginning of every recording; the events follow directly
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        // The duration of each step of the recorded simulation in seconds
+        float stepSize;
+        uint32_t unused;
+    };
+
+    // The highest rate of an emitter that is accepted. Spawning converts the particles of a
+    // step into an integer count, which this keeps far from overflowing
+    const float _maximumRate = 1e9f;
+}
+
+CallbackRecorder::CallbackRecorder()
+    : _file(nullptr)
+{}
+
+CallbackRecorder::~CallbackRecorder() {
+    close();
+}
+
+bool CallbackRecorder::open(const std::string& path, float stepSize) {
+    close();
+    _file = std::fopen(path.c_str(), "wb");
+    if (_file == nullptr) {
+        LERROR("Could not create recording '" << path << "'");
+        return false;
+    }
+
+    Header header;
+    std::memcpy(header.magic, _magic, sizeof(_magic));
+    header.version = Version;
+    header.byteOrder = _byteOrderMark;
+    header.stepSize = stepSize;
+    header.unused = 0;
+    std::fwrite(&header, sizeof(header), 1, _file);
+    std::fflush(_file);
+    LINFO("Recording into '" << path << "'");
+    return true;
+}
+
+void CallbackRecorder::close() {
+    if (_file != nullptr) {
+        std::fclose(_file);
+        _file = nullptr;
+    }
+}
+
+bool CallbackRecorder::isOpen() const {
+    return _file != nullptr;
+}
+
+void CallbackRecorder::record(const Event& event) {
+    if (_file == nullptr)
+        return;
+
+    // The events are rare, so flushing each one costs nothing and keeps the file complete
+    if ((std::fwrite(&event, sizeof(event), 1, _file) != 1) || (std::fflush(_file) != 0)) {
+        LERROR("Could not write to the recording. Recording stopped");
+        close();
+    }
+}
+
+bool CallbackRecorder::isValid(const Event& event) {
+    // The types are cast to the enumerations when the events are applied
+    const bool validType =
+        ((event.kind == Kind::Source) &&
+            (event.type <= static_cast<uint32_t>(EmitterSystem::Type::Cone))) ||
+        ((event.kind == Kind::Effect) &&
+            (event.type <= static_cast<uint32_t>(EffectSystem::Type::Wind))) ||
+        (event.kind == Kind::RemoveAll);
+    if (!validType)
+        return false;
+    if (event.kind == Kind::RemoveAll)
+        return true;
+
+    const bool finite = std::isfinite(event.position[0]) && std::isfinite(event.position[1]) &&
+        std::isfinite(event.position[2]) && std::isfinite(event.value);
+    if (!finite)
+        return false;
+    return (event.kind != Kind::Source) || ((event.value >= 0.f) && (event.value <= _maximumRate));
+}
+
+void CallbackRecorder::apply(const Event& event, Simulation& simulation) {
+    const glm::vec3 position(event.position[0], event.position[1], event.position[2]);
+    switch (event.kind) {
+    case Kind::Source:
+        simulation.emitters().addEmitter(static_cast<EmitterSystem::Type>(event.type), position,
+            event.value);
+        break;
+    case Kind::Effect:
+        simulation.effects().addEffect(static_cast<EffectSystem::Type>(event.type), position,
+            event.value);
+        break;
+    case Kind::RemoveAll:
+        simulation.removeAll();
+        break;
+    }
+}
+
+bool CallbackRecorder::load(const std::string& path, std::vector<Event>& events,
+    float& stepSize)
+{
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        LERROR("Could not open recording '" << path << "'");
+        return false;
+    }
+
+    Header header;
+    const char* error = nullptr;
+    if ((std::fread(&header, sizeof(header), 1, file) != 1) ||
+        (std::memcmp(header.magic, _magic, sizeof(_magic)) != 0))
+    {
+        error = "is not a recording";
+    }
+    else if (header.byteOrder != _byteOrderMark)
+        error = "was written on a machine with another byte order";
+    else if (header.version != Version)
+        error = "has an unsupported version";
+    else if (!(header.stepSize > 0.f))
+        error = "has an invalid step size";
+
+    events.clear();
+    Event event;
+    while ((error == nullptr) && (std::fread(&event, sizeof(event), 1, file) == 1)) {
+        const bool inOrder = events.empty() || (event.step >= events.back().step);
+        if (!isValid(event) || !inOrder)
+            error = "contains an invalid event";
+        else
+            events.push_back(event);
+    }
+    std::fclose(file);
+
+    if (error != nullptr) {
+        LERROR("File '" << path << "' " << error);
+        events.clear();
+        return false;
+    }
+    stepSize = header.stepSize;
+    return true;
+}
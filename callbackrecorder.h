@@ -0,0 +1,104 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __CALLBACKRECORDER_H__
+#define __CALLBACKRECORDER_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class Simulation;
+
+// The CallbackRecorder captures the changes that the GUI makes to the simulation, that is the
+// sources and effects that are added and the removal of everything, together with the step
+// before which each of them was applied. Since the steps have a fixed size, replaying the
+// events in a fresh simulation reproduces the session without clicking through the GUI. The
+// events are appended to a versioned binary file as they happen, so a recording survives a
+// crash of the program up to the last event
+class CallbackRecorder {
+public:
+    // The version of the file format. Files of other versions are rejected
+    static const uint32_t Version = 1;
+
+    // The kinds of changes that are recorded
+    enum class Kind : uint32_t {
+        // An emitter was added; 'type' is an EmitterSystem::Type, 'value' the rate
+        Source,
+        // An effect was added; 'type' is an EffectSystem::Type, 'value' the strength
+        Effect,
+        // All particles, emitters, and effects were removed
+        RemoveAll
+    };
+
+    // A single recorded change with a fixed layout, as it is stored in the file
+    struct Event {
+        // The number of steps the simulation had done when the change was applied
+        uint64_t step;
+        Kind kind;
+        uint32_t type;
+        float position[3];
+        float value;
+    };
+
+    // Creates a recorder without a file
+    CallbackRecorder();
+
+    // Closes the file, if one is open
+    ~CallbackRecorder();
+
+    // Starts a new recording in 'path' of a simulation whose steps are 'stepSize' seconds
+    // long. Returns false if the file cannot be created
+    bool open(const std::string& path, float stepSize);
+
+    // Ends the recording
+    void close();
+
+    // Returns true if a recording is in progress
+    bool isOpen() const;
+
+    // Appends 'event' to the recording. Does nothing if no recording is in progress
+    void record(const Event& event);
+
+    // Returns true if 'event' has a known kind and type and finite values that 'apply' can
+    // safely pass on. Events that come from a file or the network have to be checked first
+    static bool isValid(const Event& event);
+
+    // Applies the change of 'event' to 'simulation', which must be a valid event. Must not be
+    // called while a step is running
+    static void apply(const Event& event, Simulation& simulation);
+
+    // Reads the recording in 'path' into 'events' and the size of its steps into 'stepSize'.
+    // Returns false, and logs the reason, if the file is not a valid recording
+    static bool load(const std::string& path, std::vector<Event>& events, float& stepSize);
+
+private:
+    CallbackRecorder(const CallbackRecorder&) = delete;
+    CallbackRecorder& operator=(const CallbackRecorder&) = delete;
+
+    // The file the events are written to, or nullptr
+    std::FILE* _file;
+};
+
+#endif // __CALLBACKRECORDER_H__
@@ -0,0 +1,505 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "collisionsystem.h"
+
+#include "integrator.h"
+#include "particlestore.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define COLLISION_X86
+#include <immintrin.h>
+#endif
+
+// Only the loop over the batches is compiled for SSE 4.1, like the kernels of the Integrator
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE4 __attribute__((target("sse4.1")))
+#else
+#define TARGET_SSE4
+#endif
+
+// The batches treat the position and velocity arrays as flat float arrays
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "glm::vec3 must be tightly packed");
+
+namespace {
+    typedef CollisionSystem::Material Material;
+
+    // Reflects the velocity 'v' of a particle at a surface with the unit 'normal', if the
+    // particle is moving into it
+    void respond(glm::vec3& v, const glm::vec3& normal, const Material& material) {
+        const float normalVelocity = glm::dot(v, normal);
+        if (normalVelocity < 0.f) {
+            // v = (v - vn * n) * (1 - friction) - vn * n * restitution
+            const float keep = 1.f - material.friction;
+            v = v * keep - normal * (normalVelocity * (keep + material.restitution));
+        }
+    }
+
+    // Keeps the component 'axis' of the particle at 'p' with velocity 'v' within [minimum,
+    // maximum]. Returns true if it was outside
+    bool collideAxis(glm::vec3& p, glm::vec3& v, int axis, float minimum, float maximum,
+        const Material& material)
+    {
+        float normal;
+        if (p[axis] < minimum) {
+            p[axis] = minimum;
+            normal = 1.f;
+        }
+        else if (p[axis] > maximum) {
+            p[axis] = maximum;
+            normal = -1.f;
+        }
+        else
+            return false;
+
+        if (v[axis] * normal < 0.f) {
+            const float keep = 1.f - material.friction;
+            v[(axis + 1) % 3] *= keep;
+            v[(axis + 2) % 3] *= keep;
+            v[axis] *= -material.restitution;
+        }
+        return true;
+    }
+
+    // Resolves the collisions of the particle at 'p' with velocity 'v' with all colliders.
+    // Returns true if it collided with any of them
+    bool collideParticle(glm::vec3& p, glm::vec3& v,
+        const std::vector<CollisionSystem::Plane>& planes,
+        const std::vector<CollisionSystem::Bounds>& bounds,
+        const std::vector<CollisionSystem::Sphere>& spheres)
+    {
+        bool hit = false;
+        // The world is resolved last, so that a sphere cannot push a particle out of it
+        for (const CollisionSystem::Sphere& sphere : spheres) {
+            const glm::vec3 offset = p - sphere.center;
+            const float distanceSquared = glm::dot(offset, offset);
+            // A particle exactly at the center has no direction to be pushed out in
+            if ((distanceSquared < sphere.radius * sphere.radius) && (distanceSquared > 0.f)) {
+                const glm::vec3 normal = offset / std::sqrt(distanceSquared);
+                p = sphere.center + normal * sphere.radius;
+                respond(v, normal, sphere.material);
+                hit = true;
+            }
+        }
+        for (const CollisionSystem::Plane& plane : planes) {
+            const float distance = plane.distance(p);
+            if (distance < 0.f) {
+                p -= plane.normal * distance;
+                respond(v, plane.normal, plane.material);
+                hit = true;
+            }
+        }
+        for (const CollisionSystem::Bounds& box : bounds) {
+            for (int axis = 0; axis < 3; ++axis) {
+                hit |= collideAxis(p, v, axis, box.minimum[axis], box.maximum[axis],
+                    box.material);
+            }
+        }
+        return hit;
+    }
+
+    size_t collideScalar(glm::vec3* positions, glm::vec3* velocities, glm::vec3* exported,
+        size_t count, const std::vector<CollisionSystem::Plane>& planes,
+        const std::vector<CollisionSystem::Bounds>& bounds,
+        const std::vector<CollisionSystem::Sphere>& spheres)
+    {
+        size_t collisions = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (collideParticle(positions[i], velocities[i], planes, bounds, spheres)) {
+                if (exported != nullptr)
+                    exported[i] = positions[i];
+                ++collisions;
+            }
+        }
+        return collisions;
+    }
+
+#ifdef COLLISION_X86
+    // Loads the four vec3s at 'aos' into one register per component
+    TARGET_SSE4
+    inline void loadComponents(const float* aos, __m128& x, __m128& y, __m128& z) {
+        const __m128 a = _mm_loadu_ps(aos);     // x0 y0 z0 x1
+        const __m128 b = _mm_loadu_ps(aos + 4); // y1 z1 x2 y2
+        const __m128 c = _mm_loadu_ps(aos + 8); // z2 x3 y3 z3
+        const __m128 xy23 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2)); // x2 y2 x3 y3
+        const __m128 y01 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1));  // y0 y0 y1 y1
+        const __m128 z01 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));  // z0 z0 z1 z1
+        const __m128 z23 = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0));  // z2 z2 z3 z3
+        x = _mm_shuffle_ps(a, xy23, _MM_SHUFFLE(2, 0, 3, 0));
+        y = _mm_shuffle_ps(y01, xy23, _MM_SHUFFLE(3, 1, 2, 0));
+        z = _mm_shuffle_ps(z01, z23, _MM_SHUFFLE(2, 0, 2, 0));
+    }
+
+    // Stores the components 'x', 'y', and 'z' of four vec3s at 'aos'
+    TARGET_SSE4
+    inline void storeComponents(float* aos, __m128 x, __m128 y, __m128 z) {
+        const __m128 xy01 = _mm_unpacklo_ps(x, y);                            // x0 y0 x1 y1
+        const __m128 xy23 = _mm_unpackhi_ps(x, y);                            // x2 y2 x3 y3
+        const __m128 z0x1 = _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0));    // z0 z0 x1 x1
+        const __m128 y1z1 = _mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1));    // y1 y1 z1 z1
+        const __m128 z2x3 = _mm_shuffle_ps(z, xy23, _MM_SHUFFLE(2, 2, 2, 2)); // z2 z2 x3 x3
+        const __m128 y3z3 = _mm_shuffle_ps(xy23, z, _MM_SHUFFLE(3, 3, 3, 3)); // y3 y3 z3 z3
+        _mm_storeu_ps(aos, _mm_shuffle_ps(xy01, z0x1, _MM_SHUFFLE(2, 0, 1, 0)));
+        _mm_storeu_ps(aos + 4, _mm_shuffle_ps(y1z1, xy23, _MM_SHUFFLE(1, 0, 2, 0)));
+        _mm_storeu_ps(aos + 8, _mm_shuffle_ps(z2x3, y3z3, _MM_SHUFFLE(2, 0, 2, 0)));
+    }
+
+    // The vectorized 'respond' for the particles in 'contact' with the normals 'nx', 'ny', 'nz'
+    TARGET_SSE4
+    inline void respond4(__m128 contact, __m128 nx, __m128 ny, __m128 nz, __m128& vx,
+        __m128& vy, __m128& vz, const Material& material)
+    {
+        const __m128 normalVelocity = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, nx),
+            _mm_mul_ps(vy, ny)), _mm_mul_ps(vz, nz));
+        const __m128 approaching = _mm_and_ps(contact,
+            _mm_cmplt_ps(normalVelocity, _mm_setzero_ps()));
+        const float keep = 1.f - material.friction;
+        const __m128 k = _mm_set1_ps(keep);
+        const __m128 s = _mm_mul_ps(normalVelocity, _mm_set1_ps(keep + material.restitution));
+        vx = _mm_blendv_ps(vx, _mm_sub_ps(_mm_mul_ps(vx, k), _mm_mul_ps(nx, s)), approaching);
+        vy = _mm_blendv_ps(vy, _mm_sub_ps(_mm_mul_ps(vy, k), _mm_mul_ps(ny, s)), approaching);
+        vz = _mm_blendv_ps(vz, _mm_sub_ps(_mm_mul_ps(vz, k), _mm_mul_ps(nz, s)), approaching);
+    }
+
+    // The vectorized 'collideAxis' for the component 'a' with the velocity 'va', and the other
+    // two components 'vb' and 'vc' of the velocity. Returns the particles that were outside
+    TARGET_SSE4
+    inline __m128 collideAxis4(__m128& a, __m128& va, __m128& vb, __m128& vc, float minimum,
+        float maximum, const Material& material)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 lower = _mm_set1_ps(minimum);
+        const __m128 upper = _mm_set1_ps(maximum);
+        const __m128 below = _mm_cmplt_ps(a, lower);
+        const __m128 above = _mm_cmpgt_ps(a, upper);
+        a = _mm_blendv_ps(_mm_blendv_ps(a, lower, below), upper, above);
+
+        const __m128 approaching = _mm_or_ps(_mm_and_ps(below, _mm_cmplt_ps(va, zero)),
+            _mm_and_ps(above, _mm_cmpgt_ps(va, zero)));
+        const __m128 k = _mm_set1_ps(1.f - material.friction);
+        vb = _mm_blendv_ps(vb, _mm_mul_ps(vb, k), approaching);
+        vc = _mm_blendv_ps(vc, _mm_mul_ps(vc, k), approaching);
+        va = _mm_blendv_ps(va, _mm_mul_ps(va, _mm_set1_ps(-material.restitution)),
+            approaching);
+        return _mm_or_ps(below, above);
+    }
+
+    // Fills 'pattern' with the components of 'value' in the order in which they appear in
+    // the three registers of a batch that is loaded as it is stored
+    void componentPattern(float pattern[12], const glm::vec3& value) {
+        for (int i = 0; i < 12; ++i)
+            pattern[i] = value[i % 3];
+    }
+
+    TARGET_SSE4
+    size_t collideSSE4(glm::vec3* positions, glm::vec3* velocities, glm::vec3* exported,
+        size_t count, const std::vector<CollisionSystem::Plane>& planes,
+        const std::vector<CollisionSystem::Bounds>& bounds,
+        const std::vector<CollisionSystem::Sphere>& spheres, const glm::vec3& freeMinimum,
+        const glm::vec3& freeMaximum, bool onlyAxisAligned)
+    {
+        float pattern[12];
+        componentPattern(pattern, freeMinimum);
+        const __m128 lower0 = _mm_loadu_ps(pattern);
+        const __m128 lower1 = _mm_loadu_ps(pattern + 4);
+        const __m128 lower2 = _mm_loadu_ps(pattern + 8);
+        componentPattern(pattern, freeMaximum);
+        const __m128 upper0 = _mm_loadu_ps(pattern);
+        const __m128 upper1 = _mm_loadu_ps(pattern + 4);
+        const __m128 upper2 = _mm_loadu_ps(pattern + 8);
+
+        const __m128 zero = _mm_setzero_ps();
+        size_t collisions = 0;
+        const size_t batches = count / 4;
+        for (size_t b = 0; b < batches; ++b) {
+            float* p = reinterpret_cast<float*>(positions + b * 4);
+            float* v = reinterpret_cast<float*>(velocities + b * 4);
+
+            // The components are compared where they are, which needs neither the velocities
+            // nor a transposition, and most batches stop here
+            if (onlyAxisAligned) {
+                const __m128 p0 = _mm_loadu_ps(p);
+                const __m128 p1 = _mm_loadu_ps(p + 4);
+                const __m128 p2 = _mm_loadu_ps(p + 8);
+                const __m128 outside = _mm_or_ps(
+                    _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(p0, lower0), _mm_cmpgt_ps(p0, upper0)),
+                        _mm_or_ps(_mm_cmplt_ps(p1, lower1), _mm_cmpgt_ps(p1, upper1))),
+                    _mm_or_ps(_mm_cmplt_ps(p2, lower2), _mm_cmpgt_ps(p2, upper2)));
+                if (_mm_movemask_ps(outside) == 0)
+                    continue;
+            }
+
+            __m128 px, py, pz, vx, vy, vz;
+            loadComponents(p, px, py, pz);
+            loadComponents(v, vx, vy, vz);
+            __m128 hit = zero;
+
+            // In the same order as in 'collideParticle'
+            for (const CollisionSystem::Sphere& sphere : spheres) {
+                const __m128 cx = _mm_set1_ps(sphere.center.x);
+                const __m128 cy = _mm_set1_ps(sphere.center.y);
+                const __m128 cz = _mm_set1_ps(sphere.center.z);
+                const __m128 ox = _mm_sub_ps(px, cx);
+                const __m128 oy = _mm_sub_ps(py, cy);
+                const __m128 oz = _mm_sub_ps(pz, cz);
+                const __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox),
+                    _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz));
+                const __m128 inside = _mm_and_ps(
+                    _mm_cmplt_ps(distanceSquared, _mm_set1_ps(sphere.radius * sphere.radius)),
+                    _mm_cmpgt_ps(distanceSquared, zero));
+                // Most batches are far away from the sphere and skip the square root
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+                // The lanes outside of the sphere might divide by 0, but are not selected
+                const __m128 distance = _mm_sqrt_ps(distanceSquared);
+                const __m128 nx = _mm_div_ps(ox, distance);
+                const __m128 ny = _mm_div_ps(oy, distance);
+                const __m128 nz = _mm_div_ps(oz, distance);
+                const __m128 r = _mm_set1_ps(sphere.radius);
+                px = _mm_blendv_ps(px, _mm_add_ps(cx, _mm_mul_ps(nx, r)), inside);
+                py = _mm_blendv_ps(py, _mm_add_ps(cy, _mm_mul_ps(ny, r)), inside);
+                pz = _mm_blendv_ps(pz, _mm_add_ps(cz, _mm_mul_ps(nz, r)), inside);
+                respond4(inside, nx, ny, nz, vx, vy, vz, sphere.material);
+                hit = _mm_or_ps(hit, inside);
+            }
+
+            for (const CollisionSystem::Plane& plane : planes) {
+                const __m128 nx = _mm_set1_ps(plane.normal.x);
+                const __m128 ny = _mm_set1_ps(plane.normal.y);
+                const __m128 nz = _mm_set1_ps(plane.normal.z);
+                const __m128 distance = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, px),
+                    _mm_mul_ps(ny, py)), _mm_mul_ps(nz, pz)), _mm_set1_ps(plane.offset));
+                const __m128 inside = _mm_cmplt_ps(distance, zero);
+                px = _mm_blendv_ps(px, _mm_sub_ps(px, _mm_mul_ps(nx, distance)), inside);
+                py = _mm_blendv_ps(py, _mm_sub_ps(py, _mm_mul_ps(ny, distance)), inside);
+                pz = _mm_blendv_ps(pz, _mm_sub_ps(pz, _mm_mul_ps(nz, distance)), inside);
+                respond4(inside, nx, ny, nz, vx, vy, vz, plane.material);
+                hit = _mm_or_ps(hit, inside);
+            }
+
+            for (const CollisionSystem::Bounds& box : bounds) {
+                const Material& m = box.material;
+                hit = _mm_or_ps(hit,
+                    collideAxis4(px, vx, vy, vz, box.minimum.x, box.maximum.x, m));
+                hit = _mm_or_ps(hit,
+                    collideAxis4(py, vy, vz, vx, box.minimum.y, box.maximum.y, m));
+                hit = _mm_or_ps(hit,
+                    collideAxis4(pz, vz, vx, vy, box.minimum.z, box.maximum.z, m));
+            }
+
+            // Almost all batches are in free space and are left untouched
+            const int mask = _mm_movemask_ps(hit);
+            if (mask == 0)
+                continue;
+            for (int i = 0; i < 4; ++i)
+                collisions += (mask >> i) & 1;
+            storeComponents(p, px, py, pz);
+            storeComponents(v, vx, vy, vz);
+            if (exported != nullptr) {
+                float* e = reinterpret_cast<float*>(exported + b * 4);
+                __m128 ex, ey, ez;
+                loadComponents(e, ex, ey, ez);
+                storeComponents(e, _mm_blendv_ps(ex, px, hit), _mm_blendv_ps(ey, py, hit),
+                    _mm_blendv_ps(ez, pz, hit));
+            }
+        }
+
+        // The remaining particles that don't fill a whole batch
+        const size_t done = batches * 4;
+        glm::vec3* exportedRest = (exported != nullptr) ? exported + done : nullptr;
+        return collisions + collideScalar(positions + done, velocities + done, exportedRest,
+            count - done, planes, bounds, spheres);
+    }
+#endif // COLLISION_X86
+}
+
+CollisionSystem::CollisionSystem()
+    : _freeMinimum(0.f)
+    , _freeMaximum(0.f)
+    , _onlyAxisAligned(true)
+    , _vectorized(false)
+{
+    updateFreeBox();
+    setVectorized(true);
+}
+
+void CollisionSystem::addPlane(const glm::vec3& normal, float offset,
+    const Material& material)
+{
+    const Plane plane = { glm::normalize(normal), offset, material };
+    _planes.push_back(plane);
+    updateFreeBox();
+}
+
+void CollisionSystem::addBounds(const glm::vec3& minimum, const glm::vec3& maximum,
+    const Material& material)
+{
+    assert((minimum.x <= maximum.x) && (minimum.y <= maximum.y) && (minimum.z <= maximum.z));
+    const Bounds box = { minimum, maximum, material };
+    _bounds.push_back(box);
+    updateFreeBox();
+}
+
+void CollisionSystem::addSphere(const glm::vec3& center, float radius,
+    const Material& material)
+{
+    assert(radius > 0.f);
+    const Sphere sphere = { center, radius, material };
+    _spheres.push_back(sphere);
+    updateFreeBox();
+}
+
+void CollisionSystem::removeAll() {
+    _planes.clear();
+    _bounds.clear();
+    _spheres.clear();
+    updateFreeBox();
+}
+
+size_t CollisionSystem::numberOfColliders() const {
+    return _planes.size() + _bounds.size() + _spheres.size();
+}
+
+const std::vector<CollisionSystem::Plane>& CollisionSystem::planes() const {
+    return _planes;
+}
+
+const std::vector<CollisionSystem::Bounds>& CollisionSystem::bounds() const {
+    return _bounds;
+}
+
+const std::vector<CollisionSystem::Sphere>& CollisionSystem::spheres() const {
+    return _spheres;
+}
+
+void CollisionSystem::updateFreeBox() {
+    _freeMinimum = glm::vec3(-std::numeric_limits<float>::max());
+    _freeMaximum = glm::vec3(std::numeric_limits<float>::max());
+    _onlyAxisAligned = _spheres.empty();
+    for (const Bounds& box : _bounds) {
+        _freeMinimum = glm::max(_freeMinimum, box.minimum);
+        _freeMaximum = glm::min(_freeMaximum, box.maximum);
+    }
+    // The distance to a plane along an axis is exactly the difference of the component and
+    // the offset, so the box agrees with the full test down to the last bit
+    for (const Plane& plane : _planes) {
+        bool isAxis = false;
+        for (int axis = 0; axis < 3; ++axis) {
+            const glm::vec3& n = plane.normal;
+            if ((n[(axis + 1) % 3] != 0.f) || (n[(axis + 2) % 3] != 0.f))
+                continue;
+            if (n[axis] == 1.f)
+                _freeMinimum[axis] = std::max(_freeMinimum[axis], plane.offset);
+            else if (n[axis] == -1.f)
+                _freeMaximum[axis] = std::min(_freeMaximum[axis], -plane.offset);
+            else
+                continue;
+            isAxis = true;
+        }
+        _onlyAxisAligned &= isAxis;
+    }
+}
+
+bool CollisionSystem::setVectorized(bool vectorized) {
+#ifdef COLLISION_X86
+    // The batches need the blends of SSE 4.1
+    if (vectorized && !Integrator::isSupported(Integrator::Kernel::SSE4))
+        return false;
+#else
+    if (vectorized)
+        return false;
+#endif
+    _vectorized = vectorized;
+    return true;
+}
+
+bool CollisionSystem::isVectorized() const {
+    return _vectorized;
+}
+
+bool CollisionSystem::freeBox(glm::vec3& minimum, glm::vec3& maximum) const {
+    minimum = _freeMinimum;
+    maximum = _freeMaximum;
+    return _onlyAxisAligned;
+}
+
+size_t CollisionSystem::collide(ParticleStore& store, size_t begin, size_t end,
+    glm::vec3* exportPositions, const uint8_t* outside) const
+{
+    assert(begin <= end);
+    assert(end <= store.size());
+    if (numberOfColliders() == 0)
+        return 0;
+    if (outside == nullptr)
+        return collideRange(store, begin, end, exportPositions);
+
+    // Only the runs of flagged batches are resolved
+    assert(_onlyAxisAligned);
+    size_t collisions = 0;
+    const size_t numberOfBatches = (end - begin + 3) / 4;
+    size_t batch = 0;
+    while (batch < numberOfBatches) {
+        // Almost all flags are 0, so they are skipped eight at a time
+        uint64_t flags;
+        if (batch + sizeof(flags) <= numberOfBatches) {
+            std::memcpy(&flags, outside + batch, sizeof(flags));
+            if (flags == 0) {
+                batch += sizeof(flags);
+                continue;
+            }
+        }
+        if (outside[batch] == 0) {
+            ++batch;
+            continue;
+        }
+        size_t last = batch + 1;
+        while ((last < numberOfBatches) && (outside[last] != 0))
+            ++last;
+        collisions += collideRange(store, begin + batch * 4, std::min(begin + last * 4, end),
+            exportPositions);
+        batch = last;
+    }
+    return collisions;
+}
+
+size_t CollisionSystem::collideRange(ParticleStore& store, size_t begin, size_t end,
+    glm::vec3* exportPositions) const
+{
+    glm::vec3* positions = store.positions() + begin;
+    glm::vec3* velocities = store.velocities() + begin;
+    glm::vec3* exported = (exportPositions != nullptr) ? exportPositions + begin : nullptr;
+#ifdef COLLISION_X86
+    if (_vectorized) {
+        return collideSSE4(positions, velocities, exported, end - begin, _planes, _bounds,
+            _spheres, _freeMinimum, _freeMaximum, _onlyAxisAligned);
+    }
+#endif
+    return collideScalar(positions, velocities, exported, end - begin, _planes, _bounds,
+        _spheres);
+}
@@ -0,0 +1,155 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __COLLISIONSYSTEM_H__
+#define __COLLISIONSYSTEM_H__
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ParticleStore;
+
+// The CollisionSystem keeps the particles out of solid geometry that is described by analytic
+// signed distance functions. After the integration, every particle is tested against all
+// colliders: a particle with a negative distance is moved back onto the surface along the
+// normal, and if it was moving into the collider, the normal part of its velocity is reversed
+// and scaled by the restitution, while the tangential part loses the friction. Like in the
+// EffectSystem, the colliders are stored grouped by type so that each type has its own loop.
+// The spheres are resolved first and the planes and bounds, which make up the world, last, so
+// that no particle is pushed out of the world.
+// The particles are processed in batches of four. Almost all particles are in free space, so
+// each batch is first compared, as it is stored, against the box in which no bounds and no
+// axis-aligned plane can be touched. Only if that fails, or if there are other colliders, the
+// batch is transposed from the arrays of vec3 into one register per component, tested against
+// all colliders like in the scalar loop, and written back if any of its particles collided. As
+// every particle is handled on its own, the result does not depend on how the particles are
+// split into ranges
+class CollisionSystem {
+public:
+    // How the particles bounce off a collider
+    struct Material {
+        // The fraction of the normal velocity that is kept, reversed, after a bounce
+        float restitution;
+        // The fraction of the tangential velocity that is lost at a bounce
+        float friction;
+    };
+
+    // A solid half-space; the particles are kept on the side that the normal points to
+    struct Plane {
+        // The unit normal of the plane
+        glm::vec3 normal;
+        // The distance of the plane from the origin along the normal
+        float offset;
+        Material material;
+
+        // Returns the signed distance of 'position' from the plane
+        float distance(const glm::vec3& position) const {
+            return glm::dot(normal, position) - offset;
+        }
+    };
+
+    // An axis-aligned box that the particles are kept inside of; the outside is solid
+    struct Bounds {
+        glm::vec3 minimum;
+        glm::vec3 maximum;
+        Material material;
+    };
+
+    // A solid sphere that the particles bounce off
+    struct Sphere {
+        glm::vec3 center;
+        float radius;
+        Material material;
+    };
+
+    // Creates a system without any colliders. The vectorized loop is used if the CPU supports it
+    CollisionSystem();
+
+    // Adds a plane with the unit 'normal' at 'offset' from the origin along the normal
+    void addPlane(const glm::vec3& normal, float offset, const Material& material);
+
+    // Adds a box from 'minimum' to 'maximum' whose inside the particles cannot leave
+    void addBounds(const glm::vec3& minimum, const glm::vec3& maximum,
+        const Material& material);
+
+    // Adds a solid sphere around 'center'
+    void addSphere(const glm::vec3& center, float radius, const Material& material);
+
+    // Removes all colliders
+    void removeAll();
+
+    // Returns the number of colliders
+    size_t numberOfColliders() const;
+
+    // Returns the colliders of each type
+    const std::vector<Plane>& planes() const;
+    const std::vector<Bounds>& bounds() const;
+    const std::vector<Sphere>& spheres() const;
+
+    // Selects between the vectorized and the scalar loop. Returns false, and leaves the loop
+    // unchanged, if the CPU cannot run the vectorized one
+    bool setVectorized(bool vectorized);
+    bool isVectorized() const;
+
+    // Sets 'minimum' and 'maximum' to the box in which a particle cannot collide with any
+    // collider. Returns false if there is no such box, because there are colliders that are
+    // neither bounds nor axis-aligned planes
+    bool freeBox(glm::vec3& minimum, glm::vec3& maximum) const;
+
+    // Resolves the collisions of the particles [begin, end) of 'store'. If 'exportPositions'
+    // is not a nullptr, it holds the positions that were exported when the particles were
+    // integrated; those of the particles that collided are replaced by their new positions,
+    // as moving them along their reflected velocity could move them into the collider again.
+    // If 'outside' is not a nullptr, only the batches of 4 particles whose flag is not 0 are
+    // tested, with the flags laid out like those of Integrator::integrate for freeBox().
+    // Returns the number of particles that collided
+    size_t collide(ParticleStore& store, size_t begin, size_t end,
+        glm::vec3* exportPositions = nullptr, const uint8_t* outside = nullptr) const;
+
+private:
+    // Recomputes _freeMinimum, _freeMaximum, and _onlyAxisAligned from the colliders
+    void updateFreeBox();
+
+    // Resolves the collisions of the particles [begin, end) with the selected loop
+    size_t collideRange(ParticleStore& store, size_t begin, size_t end,
+        glm::vec3* exportPositions) const;
+
+    // The colliders grouped by type
+    std::vector<Plane> _planes;
+    std::vector<Bounds> _bounds;
+    std::vector<Sphere> _spheres;
+
+    // The box in which a particle touches none of the bounds and axis-aligned planes
+    glm::vec3 _freeMinimum;
+    glm::vec3 _freeMaximum;
+    // True if all colliders are bounds or axis-aligned planes, so that a particle inside the
+    // free box cannot collide at all
+    bool _onlyAxisAligned;
+
+    // Whether the batches are processed with vector instructions
+    bool _vectorized;
+};
+
+#endif // __COLLISIONSYSTEM_H__
@@ -0,0 +1,347 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "computesimulation.h"
+
+#include "drawcommand.h"
+#include "worldgeometry.h"
+
+#include <ghoul/filesystem/filesystem>
+#include <ghoul/logging/logging>
+#include <algorithm>
+
+using namespace ghoul::opengl;
+
+namespace {
+    const std::string _loggerCat = "ComputeSimulation";
+
+    // Has to match the local_size_x of particle.comp
+    const GLuint _workGroupSize = 256;
+
+    // The default maximum number of particles that can be spawned in one step
+    const size_t _defaultSpawnCapacity = 256 * 1024;
+
+    // The same ground and skybox as in the CPU Simulation
+    const CollisionSystem::Material _groundMaterial = {
+        worldgeometry::GroundRestitution, worldgeometry::GroundFriction };
+    const CollisionSystem::Material _wallMaterial = {
+        worldgeometry::WallRestitution, worldgeometry::WallFriction };
+
+    // Writes 'data' into 'buffer', which holds 'size' vec4s, and grows it if it is too small.
+    // A buffer is never empty, so that it can always be bound. Returns the new size
+    size_t uploadVectors(GLuint buffer, size_t size, const std::vector<glm::vec4>& data) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        if (data.size() > size) {
+            size = data.size();
+            glBufferData(GL_SHADER_STORAGE_BUFFER, size * sizeof(glm::vec4), &data[0],
+                GL_DYNAMIC_DRAW);
+        }
+        else if (!data.empty())
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, data.size() * sizeof(glm::vec4), &data[0]);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        return size;
+    }
+
+    // Appends the restitution and friction of 'material' as a vec4
+    void appendMaterial(std::vector<glm::vec4>& data, const CollisionSystem::Material& material) {
+        data.push_back(glm::vec4(material.restitution, material.friction, 0.f, 0.f));
+    }
+}
+
+ComputeSimulation::ComputeSimulation(size_t capacity)
+    : _capacity(capacity)
+    , _spawnCapacity(std::min(capacity, _defaultSpawnCapacity))
+    , _program(nullptr)
+    , _spawnPositionBuffer(0)
+    , _spawnVelocityBuffer(0)
+    , _effectBuffer(0)
+    , _colliderBuffer(0)
+    , _effectBufferSize(0)
+    , _colliderBufferSize(0)
+    , _current(0)
+    , _upperBound(0)
+    , _lastSpawnCount(0)
+    , _numberOfParticles(0)
+{
+    for (int i = 0; i < 2; ++i) {
+        _positionBuffers[i] = 0;
+        _velocityBuffers[i] = 0;
+        _counterBuffers[i] = 0;
+    }
+
+    const float extent = worldgeometry::SkyboxSize;
+    _collisions.addPlane(glm::vec3(0.f, 0.f, 1.f), worldgeometry::GroundHeight, _groundMaterial);
+    _collisions.addBounds(glm::vec3(-extent), glm::vec3(extent), _wallMaterial);
+}
+
+ComputeSimulation::~ComputeSimulation() {
+    glDeleteBuffers(2, _positionBuffers);
+    glDeleteBuffers(2, _velocityBuffers);
+    glDeleteBuffers(2, _counterBuffers);
+    glDeleteBuffers(1, &_spawnPositionBuffer);
+    glDeleteBuffers(1, &_spawnVelocityBuffer);
+    glDeleteBuffers(1, &_effectBuffer);
+    glDeleteBuffers(1, &_colliderBuffer);
+    delete _program;
+}
+
+bool ComputeSimulation::isSupported() {
+    return GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object &&
+        GLEW_ARB_shader_atomic_counters && GLEW_ARB_draw_indirect;
+}
+
+bool ComputeSimulation::initialize() {
+    if (!isSupported()) {
+        LERROR("Compute shaders are not supported by the driver");
+        return false;
+    }
+
+    // Errors that occur during compiling or linking will be written to the Logmanager by the
+    // ProgramObject and ShaderObject
+    _program = new ProgramObject("ParticleCompute");
+    _program->attachObject(new ShaderObject(ShaderObject::ShaderTypeCompute,
+        FileSys.absolutePath("${ASSETS}/particle.comp")));
+    if (!_program->compileShaderObjects() || !_program->linkProgramObject())
+        return false;
+
+    // Two sets of particle buffers that are used in turn as the input and output of a step
+    glGenBuffers(2, _positionBuffers);
+    glGenBuffers(2, _velocityBuffers);
+    glGenBuffers(2, _counterBuffers);
+    const DrawArraysIndirectCommand emptyCommand = { 0, 1, 0, 0 };
+    for (int i = 0; i < 2; ++i) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _positionBuffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, _capacity * sizeof(glm::vec4), nullptr,
+            GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _velocityBuffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, _capacity * sizeof(glm::vec4), nullptr,
+            GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _counterBuffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(emptyCommand), &emptyCommand,
+            GL_DYNAMIC_COPY);
+    }
+
+    // The staging buffers for the spawned particles are rewritten every step
+    glGenBuffers(1, &_spawnPositionBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _spawnPositionBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, _spawnCapacity * sizeof(glm::vec4), nullptr,
+        GL_STREAM_DRAW);
+    glGenBuffers(1, &_spawnVelocityBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _spawnVelocityBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, _spawnCapacity * sizeof(glm::vec4), nullptr,
+        GL_STREAM_DRAW);
+
+    // The effects and colliders grow with their number; start with room for one vec4 each
+    const glm::vec4 unused(0.f);
+    glGenBuffers(1, &_effectBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _effectBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unused), &unused, GL_DYNAMIC_DRAW);
+    glGenBuffers(1, &_colliderBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _colliderBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unused), &unused, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    _effectBufferSize = 1;
+    _colliderBufferSize = 1;
+
+    _spawnPositions.reserve(_spawnCapacity);
+    _spawnVelocities.reserve(_spawnCapacity);
+    return true;
+}
+
+void ComputeSimulation::spawn(const glm::vec3* positions, const glm::vec3* velocities,
+    const float* lifetimes, size_t count)
+{
+    // The age of a new particle is 0 and stored in the w component of the position
+    const size_t room = _spawnCapacity - _spawnPositions.size();
+    if (count > room) {
+        LWARNING("Dropping " << count - room << " particles that exceed the spawn capacity");
+        count = room;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        _spawnPositions.push_back(glm::vec4(positions[i], 0.f));
+        _spawnVelocities.push_back(glm::vec4(velocities[i], lifetimes[i]));
+    }
+}
+
+void ComputeSimulation::step(float deltaT) {
+    const int input = _current;
+    const int output = 1 - _current;
+
+    // The output counter still holds the result of the step before the last one, which the GPU
+    // has finished a while ago. Read it back, as this is our only information about the number
+    // of particles, and reset it for this step
+    glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, _counterBuffers[output]);
+    GLuint count = 0;
+    glGetBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &count);
+    _numberOfParticles = count;
+    const GLuint zero = 0;
+    glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &zero);
+    glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+
+    // The input can at most contain the particles we read back plus the ones spawned since
+    const size_t inputBound = std::min(_capacity, static_cast<size_t>(count) + _lastSpawnCount);
+    _upperBound = std::min(_upperBound, inputBound);
+
+    // Never spawn more particles than there is guaranteed room for
+    const size_t spawnCount = std::min(_spawnPositions.size(), _capacity - _upperBound);
+    if (spawnCount > 0) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _spawnPositionBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, spawnCount * sizeof(glm::vec4),
+            &_spawnPositions[0]);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _spawnVelocityBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, spawnCount * sizeof(glm::vec4),
+            &_spawnVelocities[0]);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+    _spawnPositions.clear();
+    _spawnVelocities.clear();
+
+    const size_t invocations = _upperBound + spawnCount;
+    if (invocations > 0) {
+        _program->activate();
+        _program->setUniform("_deltaT", deltaT);
+        _program->setUniform("_numberOfSpawns", static_cast<GLint>(spawnCount));
+        uploadEffects();
+        uploadColliders();
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _positionBuffers[input]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _velocityBuffers[input]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _positionBuffers[output]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _velocityBuffers[output]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _counterBuffers[input]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _spawnPositionBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, _spawnVelocityBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, _effectBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, _colliderBuffer);
+        glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, _counterBuffers[output]);
+
+        const GLuint numGroups =
+            static_cast<GLuint>((invocations + _workGroupSize - 1) / _workGroupSize);
+        glDispatchCompute(numGroups, 1, 1);
+
+        // The result is used as vertices, as an indirect command and as the next step's input
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT |
+            GL_COMMAND_BARRIER_BIT | GL_ATOMIC_COUNTER_BARRIER_BIT);
+
+        for (GLuint i = 0; i <= 8; ++i)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+        glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, 0);
+        _program->deactivate();
+    }
+
+    _current = output;
+    _upperBound = invocations;
+    _lastSpawnCount = spawnCount;
+}
+
+void ComputeSimulation::removeAll() {
+    // Resetting both counters empties both the last result and the next input
+    const GLuint zero = 0;
+    for (int i = 0; i < 2; ++i) {
+        glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, _counterBuffers[i]);
+        glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &zero);
+    }
+    glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+
+    _spawnPositions.clear();
+    _spawnVelocities.clear();
+    _effects.removeAll();
+    _upperBound = 0;
+    _lastSpawnCount = 0;
+    _numberOfParticles = 0;
+}
+
+void ComputeSimulation::uploadEffects() {
+    // Each effect is its position and strength, first the gravities, then the winds
+    _effectData.clear();
+    for (const EffectSystem::Gravity& gravity : _effects.gravities())
+        _effectData.push_back(glm::vec4(gravity.position, gravity.strength));
+    for (const EffectSystem::Wind& wind : _effects.winds())
+        _effectData.push_back(glm::vec4(wind.position, wind.strength));
+    _effectBufferSize = uploadVectors(_effectBuffer, _effectBufferSize, _effectData);
+
+    _program->setUniform("_numberOfGravities", static_cast<GLint>(_effects.gravities().size()));
+    _program->setUniform("_numberOfWinds", static_cast<GLint>(_effects.winds().size()));
+    _program->setUniform("_gravityRadius", EffectSystem::Gravity::Radius);
+    _program->setUniform("_gravitySoftening", EffectSystem::Gravity::Softening);
+    _program->setUniform("_windRadius", EffectSystem::Wind::Radius);
+}
+
+void ComputeSimulation::uploadColliders() {
+    // First the spheres, then the planes, then the bounds, each followed by its material
+    _colliderData.clear();
+    for (const CollisionSystem::Sphere& sphere : _collisions.spheres()) {
+        _colliderData.push_back(glm::vec4(sphere.center, sphere.radius));
+        appendMaterial(_colliderData, sphere.material);
+    }
+    for (const CollisionSystem::Plane& plane : _collisions.planes()) {
+        _colliderData.push_back(glm::vec4(plane.normal, plane.offset));
+        appendMaterial(_colliderData, plane.material);
+    }
+    for (const CollisionSystem::Bounds& box : _collisions.bounds()) {
+        _colliderData.push_back(glm::vec4(box.minimum, 0.f));
+        _colliderData.push_back(glm::vec4(box.maximum, 0.f));
+        appendMaterial(_colliderData, box.material);
+    }
+    _colliderBufferSize = uploadVectors(_colliderBuffer, _colliderBufferSize, _colliderData);
+
+    _program->setUniform("_numberOfSpheres", static_cast<GLint>(_collisions.spheres().size()));
+    _program->setUniform("_numberOfPlanes", static_cast<GLint>(_collisions.planes().size()));
+    _program->setUniform("_numberOfBounds", static_cast<GLint>(_collisions.bounds().size()));
+}
+
+EffectSystem& ComputeSimulation::effects() {
+    return _effects;
+}
+
+const EffectSystem& ComputeSimulation::effects() const {
+    return _effects;
+}
+
+CollisionSystem& ComputeSimulation::collisions() {
+    return _collisions;
+}
+
+const CollisionSystem& ComputeSimulation::collisions() const {
+    return _collisions;
+}
+
+unsigned int ComputeSimulation::numberOfParticles() const {
+    return _numberOfParticles;
+}
+
+size_t ComputeSimulation::upperBound() const {
+    return _upperBound;
+}
+
+GLuint ComputeSimulation::positionBuffer() const {
+    return _positionBuffers[_current];
+}
+
+GLuint ComputeSimulation::velocityBuffer() const {
+    return _velocityBuffers[_current];
+}
+
+GLuint ComputeSimulation::drawIndirectBuffer() const {
+    return _counterBuffers[_current];
+}
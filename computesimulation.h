@@ -0,0 +1,154 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __COMPUTESIMULATION_H__
+#define __COMPUTESIMULATION_H__
+
+// Need to include opengl first, as the other headers might include gl, but not glew
+#include <ghoul/opengl/opengl>
+
+#include "collisionsystem.h"
+#include "effectsystem.h"
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+// The ComputeSimulation is an alternative to the CPU Simulation in which the particle state
+// lives in shader storage buffer objects and is advanced by a compute shader. Each step reads
+// the particles of the last step from one pair of buffers, integrates them, and appends the
+// survivors together with the newly spawned particles to the other pair of buffers using an
+// atomic counter. That counter is also the instance count of an indirect draw command, so the
+// renderer can draw the result without knowing the number of particles on the CPU. The effects
+// and colliders are the same types as those of the CPU Simulation and are applied in the same
+// order; they are uploaded into their own buffers each step, which the shader loops over for
+// every particle. All functions have to be called with the OpenGL context current. Requires
+// OpenGL 4.3
+class ComputeSimulation {
+public:
+    // Creates an empty simulation; 'initialize' has to be called before it can be used
+    explicit ComputeSimulation(size_t capacity);
+
+    // Deletes all OpenGL objects
+    ~ComputeSimulation();
+
+    // Returns true if the driver supports everything the ComputeSimulation needs
+    static bool isSupported();
+
+    // Compiles the compute shader and creates the buffers. Returns false if anything failed
+    bool initialize();
+
+    // Queues 'count' new particles that will be added in the next step
+    void spawn(const glm::vec3* positions, const glm::vec3* velocities, const float* lifetimes,
+        size_t count);
+
+    // Advances the simulation by 'deltaT' seconds
+    void step(float deltaT);
+
+    // Removes all particles and effects
+    void removeAll();
+
+    // Returns the effects that change the velocities of the particles each step
+    EffectSystem& effects();
+    const EffectSystem& effects() const;
+
+    // Returns the colliders that the particles bounce off after each integration. They start
+    // with the ground and the walls of the skybox, and are not removed by 'removeAll'
+    CollisionSystem& collisions();
+    const CollisionSystem& collisions() const;
+
+    // Returns the number of particles. The value is read back from the atomic counter of the
+    // step before the last one, so that it never stalls the pipeline, and thus lags one step
+    unsigned int numberOfParticles() const;
+
+    // Returns an upper bound for the number of particles of the last step that is known on the
+    // CPU without reading anything back
+    size_t upperBound() const;
+
+    // Returns the buffer holding the positions of the last step. Each element is a vec4 with
+    // the position in xyz, so it can be used as a vertex buffer with a stride of 16 bytes
+    GLuint positionBuffer() const;
+
+    // Returns the buffer holding the velocities of the last step in the order of
+    // positionBuffer(). Each element is a vec4 with the velocity in xyz and the lifetime in w,
+    // which is drawn for each particle at its spawn and never changes afterwards
+    GLuint velocityBuffer() const;
+
+    // Returns the buffer holding the indirect draw command (count, 1, 0, 0) for the last step
+    GLuint drawIndirectBuffer() const;
+
+private:
+    ComputeSimulation(const ComputeSimulation&) = delete;
+    ComputeSimulation& operator=(const ComputeSimulation&) = delete;
+
+    // Writes the effects and colliders into their buffers and sets the uniforms that describe
+    // them. Has to be called with the program active
+    void uploadEffects();
+    void uploadColliders();
+
+    // The maximum number of particles
+    size_t _capacity;
+    // The maximum number of particles that can be spawned in a single step
+    size_t _spawnCapacity;
+
+    // The program with the compute shader
+    ghoul::opengl::ProgramObject* _program;
+
+    // The positions (xyz) and ages (w) of two steps; the buffers are used in turn
+    GLuint _positionBuffers[2];
+    // The velocities (xyz) and lifetimes (w) of two steps
+    GLuint _velocityBuffers[2];
+    // The indirect draw commands of two steps; the first element is the atomic counter
+    GLuint _counterBuffers[2];
+    // The staging buffers for newly spawned particles with the same layout as above
+    GLuint _spawnPositionBuffer;
+    GLuint _spawnVelocityBuffer;
+    // The effects and colliders as vec4s, see particle.comp, and their sizes in vec4s
+    GLuint _effectBuffer;
+    GLuint _colliderBuffer;
+    size_t _effectBufferSize;
+    size_t _colliderBufferSize;
+    // The index of the buffers that hold the result of the last step
+    int _current;
+
+    // The particles that have been queued since the last step
+    std::vector<glm::vec4> _spawnPositions;
+    std::vector<glm::vec4> _spawnVelocities;
+
+    // The forces acting on the particles
+    EffectSystem _effects;
+    // The geometry the particles cannot pass through
+    CollisionSystem _collisions;
+    // The effects and colliders in the layout of their buffers; reused between the steps
+    std::vector<glm::vec4> _effectData;
+    std::vector<glm::vec4> _colliderData;
+
+    // An upper bound for the number of particles of the last step, used for the dispatch size
+    size_t _upperBound;
+    // The number of particles that were spawned in the last step
+    size_t _lastSpawnCount;
+    // The particle count read back from the step before the last
+    unsigned int _numberOfParticles;
+};
+
+#endif // __COMPUTESIMULATION_H__
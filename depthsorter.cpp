@@ -0,0 +1,300 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "depthsorter.h"
+
+#include "drawcommand.h"
+
+#include <ghoul/filesystem/filesystem>
+#include <ghoul/logging/logging>
+#include <algorithm>
+
+using namespace ghoul::opengl;
+
+namespace {
+    const std::string _loggerCat = "DepthSorter";
+
+    // Has to match the local_size_x of the sort*.comp shaders, except for sortscan.comp, which
+    // runs as a single work group
+    const GLuint _blockSize = 256;
+
+    // The number of bits that are sorted per pass and the resulting number of digits; have to
+    // match sorthistogram.comp and sortscatter.comp
+    const int _bitsPerPass = 4;
+    const GLuint _numberOfDigits = 1 << _bitsPerPass;
+    // The keys have 16 bits
+    const int _numberOfPasses = 16 / _bitsPerPass;
+}
+
+DepthSorter::DepthSorter(size_t capacity)
+    : _capacity(capacity)
+    , _keyProgram(nullptr)
+    , _histogramProgram(nullptr)
+    , _scanProgram(nullptr)
+    , _scatterProgram(nullptr)
+    , _gatherProgram(nullptr)
+    , _histogramBuffer(0)
+    , _sortedBuffer(0)
+    , _commandBuffer(0)
+    , _countBuffer(0)
+{
+    for (int i = 0; i < 2; ++i) {
+        _keyBuffers[i] = 0;
+        _indexBuffers[i] = 0;
+    }
+    for (int i = 0; i < NumberOfAttributeChannels; ++i)
+        _attributeBuffers[i] = 0;
+}
+
+DepthSorter::~DepthSorter() {
+    glDeleteBuffers(2, _keyBuffers);
+    glDeleteBuffers(2, _indexBuffers);
+    glDeleteBuffers(1, &_histogramBuffer);
+    glDeleteBuffers(1, &_sortedBuffer);
+    glDeleteBuffers(NumberOfAttributeChannels, _attributeBuffers);
+    glDeleteBuffers(1, &_commandBuffer);
+    glDeleteBuffers(1, &_countBuffer);
+    delete _keyProgram;
+    delete _histogramProgram;
+    delete _scanProgram;
+    delete _scatterProgram;
+    delete _gatherProgram;
+}
+
+bool DepthSorter::isSupported() {
+    return GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object &&
+        GLEW_ARB_draw_indirect;
+}
+
+ProgramObject* DepthSorter::createProgram(const std::string& name, const std::string& file) {
+    // Errors that occur during compiling or linking will be written to the Logmanager by the
+    // ProgramObject and ShaderObject
+    ProgramObject* program = new ProgramObject(name);
+    program->attachObject(new ShaderObject(ShaderObject::ShaderTypeCompute,
+        FileSys.absolutePath("${ASSETS}/" + file)));
+    if (!program->compileShaderObjects() || !program->linkProgramObject()) {
+        delete program;
+        return nullptr;
+    }
+    return program;
+}
+
+bool DepthSorter::initialize() {
+    if (!isSupported()) {
+        LERROR("Compute shaders are not supported by the driver");
+        return false;
+    }
+
+    _keyProgram = createProgram("SortKeys", "sortkeys.comp");
+    _histogramProgram = createProgram("SortHistogram", "sorthistogram.comp");
+    _scanProgram = createProgram("SortScan", "sortscan.comp");
+    _scatterProgram = createProgram("SortScatter", "sortscatter.comp");
+    _gatherProgram = createProgram("SortGather", "sortgather.comp");
+    if ((_keyProgram == nullptr) || (_histogramProgram == nullptr) ||
+        (_scanProgram == nullptr) || (_scatterProgram == nullptr) || (_gatherProgram == nullptr))
+    {
+        return false;
+    }
+
+    glGenBuffers(2, _keyBuffers);
+    glGenBuffers(2, _indexBuffers);
+    for (int i = 0; i < 2; ++i) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _keyBuffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, _capacity * sizeof(GLuint), nullptr,
+            GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _indexBuffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, _capacity * sizeof(GLuint), nullptr,
+            GL_DYNAMIC_COPY);
+    }
+
+    const size_t maximumBlocks = std::max<size_t>((_capacity + _blockSize - 1) / _blockSize, 1);
+    const size_t histogramSize = maximumBlocks * _numberOfDigits * sizeof(GLuint);
+    glGenBuffers(1, &_histogramBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _histogramBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, histogramSize, nullptr, GL_DYNAMIC_COPY);
+
+    glGenBuffers(1, &_sortedBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _sortedBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, _capacity * sizeof(glm::vec4), nullptr, GL_DYNAMIC_COPY);
+
+    const ParticleDrawCommands commands = { { 0, 1, 0, 0 }, { 4, 0, 0, 0 } };
+    glGenBuffers(1, &_commandBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _commandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(commands), &commands, GL_DYNAMIC_COPY);
+
+    const GLuint zero = 0;
+    glGenBuffers(1, &_countBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _countBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), &zero, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return true;
+}
+
+void DepthSorter::setAttributeChannels(uint32_t channels) {
+    channels &= ~IdChannel;
+    for (int i = 0; i < NumberOfAttributeChannels; ++i) {
+        const bool gathered = ((channels & attributeChannel(i)) != 0);
+        if (gathered && (_attributeBuffers[i] == 0)) {
+            glGenBuffers(1, &_attributeBuffers[i]);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, _attributeBuffers[i]);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, _capacity * AttributeChannelSize, nullptr,
+                GL_DYNAMIC_COPY);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        }
+        else if (!gathered && (_attributeBuffers[i] != 0)) {
+            glDeleteBuffers(1, &_attributeBuffers[i]);
+            _attributeBuffers[i] = 0;
+        }
+    }
+}
+
+void DepthSorter::sort(GLuint buffer, size_t first, size_t stride, size_t count,
+    GLuint countBuffer, const glm::mat4& viewProjectionMatrix, float nearDepth, float farDepth,
+    const AttributeSource* attributes)
+{
+    count = std::min(count, _capacity);
+    if (countBuffer == 0) {
+        const GLuint exactCount = static_cast<GLuint>(count);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _countBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &exactCount);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        countBuffer = _countBuffer;
+    }
+
+    // The input and its count might just have been written by another compute shader
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_ATOMIC_COUNTER_BARRIER_BIT);
+
+    if (count > 0) {
+        const GLuint numberOfBlocks = static_cast<GLuint>((count + _blockSize - 1) / _blockSize);
+
+        _keyProgram->activate();
+        _keyProgram->setUniform("_first", static_cast<GLint>(first));
+        _keyProgram->setUniform("_stride", static_cast<GLint>(stride));
+        _keyProgram->setUniform("_viewProjectionMatrix", viewProjectionMatrix);
+        _keyProgram->setUniform("_nearDepth", nearDepth);
+        _keyProgram->setUniform("_farDepth", std::max(farDepth, nearDepth + 1e-3f));
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, countBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _keyBuffers[0]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _indexBuffers[0]);
+        glDispatchCompute(numberOfBlocks, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        _keyProgram->deactivate();
+
+        // An even number of passes leaves the result in the first buffers
+        for (int pass = 0; pass < _numberOfPasses; ++pass) {
+            const int input = pass % 2;
+            const int output = 1 - input;
+            const GLint shift = pass * _bitsPerPass;
+
+            _histogramProgram->activate();
+            _histogramProgram->setUniform("_shift", shift);
+            _histogramProgram->setUniform("_numberOfBlocks", static_cast<GLint>(numberOfBlocks));
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _keyBuffers[input]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, countBuffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _histogramBuffer);
+            glDispatchCompute(numberOfBlocks, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            _histogramProgram->deactivate();
+
+            _scanProgram->activate();
+            _scanProgram->setUniform("_size", static_cast<GLint>(numberOfBlocks * _numberOfDigits));
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _histogramBuffer);
+            glDispatchCompute(1, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            _scanProgram->deactivate();
+
+            _scatterProgram->activate();
+            _scatterProgram->setUniform("_shift", shift);
+            _scatterProgram->setUniform("_numberOfBlocks", static_cast<GLint>(numberOfBlocks));
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _keyBuffers[input]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _indexBuffers[input]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, countBuffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _histogramBuffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _keyBuffers[output]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _indexBuffers[output]);
+            glDispatchCompute(numberOfBlocks, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            _scatterProgram->deactivate();
+        }
+
+        _gatherProgram->activate();
+        _gatherProgram->setUniform("_first", static_cast<GLint>(first));
+        _gatherProgram->setUniform("_stride", static_cast<GLint>(stride));
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, countBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _indexBuffers[0]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _sortedBuffer);
+
+        // The channels are read from bindings 4 to 6 and gathered into bindings 7 to 9
+        GLint channels = 0;
+        glm::ivec3 attributeFirst(0);
+        glm::ivec3 attributeStride(0);
+        for (int i = 0; (attributes != nullptr) && (i < NumberOfAttributeChannels); ++i) {
+            if ((attributes[i].buffer == 0) || (_attributeBuffers[i] == 0))
+                continue;
+            channels |= static_cast<GLint>(attributeChannel(i));
+            attributeFirst[i] = static_cast<GLint>(attributes[i].first);
+            attributeStride[i] = static_cast<GLint>(attributes[i].stride);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4 + i, attributes[i].buffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7 + i, _attributeBuffers[i]);
+        }
+        _gatherProgram->setUniform("_attributeChannels", channels);
+        _gatherProgram->setUniform("_attributeFirst", attributeFirst);
+        _gatherProgram->setUniform("_attributeStride", attributeStride);
+        glDispatchCompute(numberOfBlocks, 1, 1);
+        _gatherProgram->deactivate();
+
+        for (GLuint i = 0; i <= 9; ++i)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+    }
+
+    // The sorted particles are as many as the input particles
+    glBindBuffer(GL_COPY_READ_BUFFER, countBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _commandBuffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+        offsetof(ParticleDrawCommands, points.count), sizeof(GLuint));
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+        offsetof(ParticleDrawCommands, billboards.instanceCount), sizeof(GLuint));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    // The result is used as vertices and as indirect commands
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+GLuint DepthSorter::sortedBuffer() const {
+    return _sortedBuffer;
+}
+
+GLuint DepthSorter::attributeBuffer(AttributeChannel channel) const {
+    for (int i = 0; i < NumberOfAttributeChannels; ++i) {
+        if (attributeChannel(i) == channel)
+            return _attributeBuffers[i];
+    }
+    return 0;
+}
+
+GLuint DepthSorter::commandBuffer() const {
+    return _commandBuffer;
+}
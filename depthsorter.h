@@ -0,0 +1,124 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __DEPTHSORTER_H__
+#define __DEPTHSORTER_H__
+
+// Need to include opengl first, as the other headers might include gl, but not glew
+#include <ghoul/opengl/opengl>
+
+#include "attributesource.h"
+#include "particleattributes.h"
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+// The DepthSorter orders the particles back to front on the GPU, so that alpha blending
+// composites them correctly. Each particle gets a 16 bit key from its view depth, and the keys
+// are sorted together with the particle indices by a least significant digit radix sort with
+// four passes of 4 bits. Each pass counts the digits per block of 256 particles, scans these
+// counts into global offsets, and scatters the particles stably. Finally the positions, and
+// optionally the attribute channels, are gathered in the sorted order into buffers of their
+// own. The number of particles can be known
+// on the GPU only, like for the ParticleCuller. All functions have to be called with the
+// OpenGL context current. Requires OpenGL 4.3
+class DepthSorter {
+public:
+    // Creates a sorter for at most 'capacity' particles; 'initialize' has to be called before
+    // it can be used
+    explicit DepthSorter(size_t capacity);
+
+    // Deletes all OpenGL objects
+    ~DepthSorter();
+
+    // Returns true if the driver supports everything the DepthSorter needs
+    static bool isSupported();
+
+    // Compiles the compute shaders and creates the buffers. Returns false if anything failed
+    bool initialize();
+
+    // Creates the buffers for gathering the attribute 'channels' and deletes those of the
+    // other channels. The IdChannel is only needed by the culler and never gathered
+    void setAttributeChannels(uint32_t channels);
+
+    // Sorts the particles of 'buffer' by decreasing distance to the camera into
+    // sortedBuffer(). The position of particle i consists of the three floats at 'first' +
+    // i * 'stride' floats. If 'countBuffer' is 0, 'count' is the number of particles;
+    // otherwise 'count' is only an upper bound and the number is read on the GPU from the
+    // first element of 'countBuffer'. The depths between 'nearDepth' and 'farDepth' are
+    // distinguished, all others are clamped. If 'attributes' is not a nullptr, it holds a
+    // source for every channel, and the channels of 'setAttributeChannels' whose source has a
+    // buffer are gathered as well
+    void sort(GLuint buffer, size_t first, size_t stride, size_t count, GLuint countBuffer,
+        const glm::mat4& viewProjectionMatrix, float nearDepth, float farDepth,
+        const AttributeSource* attributes = nullptr);
+
+    // Returns the buffer with the sorted positions as vec4s (xyz, 1)
+    GLuint sortedBuffer() const;
+
+    // Returns the buffer with the values of 'channel' of the sorted particles, one word each
+    // in the order of sortedBuffer(), or 0 if the channel is not gathered
+    GLuint attributeBuffer(AttributeChannel channel) const;
+
+    // Returns the buffer with the ParticleDrawCommands for the sorted particles
+    GLuint commandBuffer() const;
+
+private:
+    DepthSorter(const DepthSorter&) = delete;
+    DepthSorter& operator=(const DepthSorter&) = delete;
+
+    // Compiles and links the compute shader in 'file'. Returns nullptr if that failed
+    ghoul::opengl::ProgramObject* createProgram(const std::string& name,
+        const std::string& file);
+
+    // The maximum number of particles
+    size_t _capacity;
+
+    // Computes the keys and the initial indices
+    ghoul::opengl::ProgramObject* _keyProgram;
+    // Counts the digits of each block
+    ghoul::opengl::ProgramObject* _histogramProgram;
+    // Turns the counts into the offsets of each digit and block
+    ghoul::opengl::ProgramObject* _scanProgram;
+    // Moves the keys and indices to their place for the current digit
+    ghoul::opengl::ProgramObject* _scatterProgram;
+    // Copies the positions in the sorted order
+    ghoul::opengl::ProgramObject* _gatherProgram;
+
+    // The keys and indices, used in turn as the input and output of the passes
+    GLuint _keyBuffers[2];
+    GLuint _indexBuffers[2];
+    // The digit counts of each block, digit-major
+    GLuint _histogramBuffer;
+    // The sorted positions
+    GLuint _sortedBuffer;
+    // The sorted values of the attribute channels, 0 for the channels that are not gathered
+    GLuint _attributeBuffers[NumberOfAttributeChannels];
+    // The ParticleDrawCommands for the sorted particles
+    GLuint _commandBuffer;
+    // Holds the number of particles if it is known on the CPU
+    GLuint _countBuffer;
+};
+
+#endif // __DEPTHSORTER_H__
@@ -0,0 +1,301 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "distributedsimulation.h"
+
+#include "particlestore.h"
+#include "simulation.h"
+#include "spatialhash.h"
+#include "threadpool.h"
+#include "transport.h"
+
+#include <ghoul/logging/logging>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+    const std::string _loggerCat = "DistributedSimulation";
+
+    // The number of steps between two rebalancings of the partition
+    const size_t _rebalanceInterval = 60;
+    // The number of particles whose owners are determined as one job
+    const size_t _chunkSize = 16 * 1024;
+
+    // The beginning of the message that a rank sends to each other rank after a step
+    struct MessageHeader {
+        // The number of particles of the sending rank before the migration
+        uint64_t numberOfParticles;
+        // The number of MigratedParticles that follow the header
+        uint64_t numberOfMigrated;
+        // The number of display positions that follow the particles
+        uint64_t numberOfDisplayed;
+    };
+
+    // The complete state of a particle that moves to another rank
+    struct MigratedParticle {
+        glm::vec3 position;
+        glm::vec3 velocity;
+        float age;
+        float lifetime;
+    };
+}
+
+DistributedSimulation::DistributedSimulation(Simulation& simulation, Transport& transport,
+    size_t decimation)
+    : _simulation(simulation)
+    , _transport(transport)
+    , _decimation(std::max<size_t>(decimation, 1))
+    , _owners(simulation.store().capacity())
+    , _outgoing(transport.numberOfRanks())
+    , _incoming(transport.numberOfRanks())
+    , _outgoingCounts(transport.numberOfRanks())
+    , _displayData(nullptr)
+    , _displaySize(0)
+    , _displayVersion(0)
+    , _numberOfSteps(0)
+    , _totalParticles(0)
+    , _migratedParticles(0)
+    , _communicationSeconds(0.0)
+{
+    // Start with the same number of cells for every rank until the particles can be counted
+    const size_t ranks = _transport.numberOfRanks();
+    const size_t numberOfCells = _simulation.spatialHash().numberOfCells();
+    _partition.resize(ranks + 1);
+    for (size_t r = 0; r <= ranks; ++r)
+        _partition[r] = static_cast<uint32_t>(numberOfCells * r / ranks);
+
+    _simulation.emitters().setPartition(static_cast<uint32_t>(_transport.rank()),
+        static_cast<uint32_t>(ranks));
+}
+
+bool DistributedSimulation::step(float deltaT) {
+    _simulation.step(deltaT);
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool success = migrate();
+    ++_numberOfSteps;
+    if (success && (_numberOfSteps % _rebalanceInterval == 0))
+        success = rebalance();
+    const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    _communicationSeconds += duration.count();
+    return success;
+}
+
+size_t DistributedSimulation::owner(const glm::vec3& position) const {
+    const SpatialHash& grid = _simulation.spatialHash();
+    const uint32_t key = SpatialHash::key(grid.cell(position));
+    // The last entry is the number of cells, so every key finds a range
+    return std::upper_bound(_partition.begin(), _partition.end(), key) - _partition.begin() - 1;
+}
+
+bool DistributedSimulation::migrate() {
+    ParticleStore& store = _simulation.store();
+    const size_t rank = _transport.rank();
+    const size_t ranks = _transport.numberOfRanks();
+    const size_t size = store.size();
+
+    // 1. Find the owner of every particle
+    const glm::vec3* positions = store.positions();
+    uint32_t* owners = _owners.data();
+    _simulation.threadPool().parallelFor(0, size, _chunkSize,
+        [this, positions, owners](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+                owners[i] = static_cast<uint32_t>(owner(positions[i]));
+        }
+    );
+    std::fill(_outgoingCounts.begin(), _outgoingCounts.end(), 0);
+    for (size_t i = 0; i < size; ++i)
+        ++_outgoingCounts[owners[i]];
+
+    // 2. Size the messages. The display positions are sampled before any particle leaves,
+    //    so that each particle is sampled by exactly one rank
+    const size_t displayed = (size + _decimation - 1) / _decimation;
+    for (size_t r = 0; r < ranks; ++r) {
+        if (r == rank)
+            continue;
+        const size_t displayBytes = (r == 0) ? displayed * sizeof(glm::vec3) : 0;
+        _outgoing[r].resize(sizeof(MessageHeader) +
+            _outgoingCounts[r] * sizeof(MigratedParticle) + displayBytes);
+        const MessageHeader header = {
+            size, _outgoingCounts[r], (r == 0) ? displayed : 0
+        };
+        std::memcpy(_outgoing[r].data(), &header, sizeof(header));
+    }
+    if (rank == 0) {
+        _display.resize(displayed);
+        for (size_t i = 0; i < displayed; ++i)
+            _display[i] = positions[i * _decimation];
+    }
+    else {
+        char* display = _outgoing[0].data() + sizeof(MessageHeader) +
+            _outgoingCounts[0] * sizeof(MigratedParticle);
+        for (size_t i = 0; i < displayed; ++i) {
+            std::memcpy(display + i * sizeof(glm::vec3), &positions[i * _decimation],
+                sizeof(glm::vec3));
+        }
+    }
+
+    // 3. Move the particles that left this rank's region into the messages. Removing moves
+    //    the last particle into the hole, so its owner is moved along
+    std::fill(_outgoingCounts.begin(), _outgoingCounts.end(), 0);
+    size_t i = 0;
+    while (i < store.size()) {
+        const uint32_t destination = owners[i];
+        if (destination == rank) {
+            ++i;
+            continue;
+        }
+        const MigratedParticle particle = {
+            store.positions()[i], store.velocities()[i], store.ages()[i], store.lifetimes()[i]
+        };
+        char* target = _outgoing[destination].data() + sizeof(MessageHeader) +
+            _outgoingCounts[destination] * sizeof(MigratedParticle);
+        std::memcpy(target, &particle, sizeof(particle));
+        ++_outgoingCounts[destination];
+        owners[i] = owners[store.size() - 1];
+        store.remove(i);
+    }
+    _migratedParticles += size - store.size();
+
+    // 4. One round delivers the migrated particles and the display positions
+    if (!_transport.exchange(_outgoing, _incoming))
+        return false;
+
+    // 5. Adopt the particles that entered this rank's region
+    _totalParticles = size;
+    for (size_t r = 0; r < ranks; ++r) {
+        if (r == rank)
+            continue;
+        const std::vector<char>& message = _incoming[r];
+        MessageHeader header;
+        if (message.size() >= sizeof(header))
+            std::memcpy(&header, message.data(), sizeof(header));
+        if ((message.size() < sizeof(header)) || (message.size() != sizeof(header) +
+            header.numberOfMigrated * sizeof(MigratedParticle) +
+            header.numberOfDisplayed * sizeof(glm::vec3)))
+        {
+            LERROR("Received a malformed message from rank " << r);
+            return false;
+        }
+        _totalParticles += static_cast<size_t>(header.numberOfParticles);
+
+        const size_t migrated = static_cast<size_t>(header.numberOfMigrated);
+        const size_t added = store.allocate(migrated);
+        if (added < migrated)
+            LWARNING("The store is full, dropping " << migrated - added << " particles");
+        const char* particles = message.data() + sizeof(header);
+        const size_t first = store.size() - added;
+        for (size_t p = 0; p < added; ++p) {
+            MigratedParticle particle;
+            std::memcpy(&particle, particles + p * sizeof(particle), sizeof(particle));
+            store.positions()[first + p] = particle.position;
+            store.velocities()[first + p] = particle.velocity;
+            store.ages()[first + p] = particle.age;
+            store.lifetimes()[first + p] = particle.lifetime;
+        }
+
+        if ((rank == 0) && (header.numberOfDisplayed > 0)) {
+            const glm::vec3* display = reinterpret_cast<const glm::vec3*>(
+                particles + migrated * sizeof(MigratedParticle));
+            _display.insert(_display.end(), display,
+                display + static_cast<size_t>(header.numberOfDisplayed));
+        }
+    }
+
+    if (rank == 0) {
+        _displayData = _display.data();
+        _displaySize = _display.size();
+        ++_displayVersion;
+    }
+    return true;
+}
+
+bool DistributedSimulation::rebalance() {
+    const ParticleStore& store = _simulation.store();
+    const SpatialHash& grid = _simulation.spatialHash();
+    const size_t rank = _transport.rank();
+    const size_t ranks = _transport.numberOfRanks();
+    const size_t numberOfCells = grid.numberOfCells();
+
+    // The entry of this rank is not sent by 'exchange', so it serves as the local histogram
+    std::vector<char>& message = _outgoing[rank];
+    message.assign(numberOfCells * sizeof(uint32_t), 0);
+    uint32_t* counts = reinterpret_cast<uint32_t*>(message.data());
+    for (size_t i = 0; i < store.size(); ++i)
+        ++counts[SpatialHash::key(grid.cell(store.positions()[i]))];
+    if (!_transport.broadcast(message, _incoming))
+        return false;
+
+    // Every rank sums the same histograms, so they all arrive at the same partition
+    uint64_t total = 0;
+    for (size_t r = 0; r < ranks; ++r) {
+        if (r == rank)
+            continue;
+        if (_incoming[r].size() != message.size()) {
+            LERROR("Received a malformed histogram from rank " << r);
+            return false;
+        }
+        const uint32_t* other = reinterpret_cast<const uint32_t*>(_incoming[r].data());
+        for (size_t c = 0; c < numberOfCells; ++c)
+            counts[c] += other[c];
+    }
+    for (size_t c = 0; c < numberOfCells; ++c)
+        total += counts[c];
+    if (total == 0)
+        return true;
+
+    // Each rank receives the cells until the running sum reaches its share of the particles
+    size_t next = 1;
+    uint64_t sum = 0;
+    for (size_t c = 0; (c < numberOfCells) && (next < ranks); ++c) {
+        sum += counts[c];
+        while ((next < ranks) && (sum * ranks >= total * next)) {
+            _partition[next] = static_cast<uint32_t>(c + 1);
+            ++next;
+        }
+    }
+    for (; next < ranks; ++next)
+        _partition[next] = static_cast<uint32_t>(numberOfCells);
+    return true;
+}
+
+const std::vector<uint32_t>& DistributedSimulation::partition() const {
+    return _partition;
+}
+
+size_t DistributedSimulation::totalParticles() const {
+    return _totalParticles;
+}
+
+uint64_t DistributedSimulation::migratedParticles() const {
+    return _migratedParticles;
+}
+
+double DistributedSimulation::communicationSeconds() const {
+    return _communicationSeconds;
+}
+
+PositionView DistributedSimulation::displayView() const {
+    return PositionView(&_displayData, &_displaySize, &_displayVersion);
+}
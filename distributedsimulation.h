@@ -0,0 +1,129 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __DISTRIBUTEDSIMULATION_H__
+#define __DISTRIBUTEDSIMULATION_H__
+
+#include "positionview.h"
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Simulation;
+class Transport;
+
+// The DistributedSimulation splits a simulation over the ranks of a Transport by space. The
+// cells of the spatial hash are divided into contiguous ranges of their Morton keys, one range
+// per rank, so each rank owns a compact region and simulates the particles inside of it. After
+// every step, the particles that have left the region of a rank are sent to their new owner,
+// batched into a single message per rank. The effects only depend on the position of each
+// particle, so every rank applies all effects to its own particles and no halo cells have to
+// be exchanged. The emitters are split by their identifier instead of their position, so the
+// spawning is balanced as well; new particles reach their owner with the next migration. As
+// the particles do not interact, the ranks together simulate the same particles as a single
+// Simulation, only in another order. The regions are rebalanced regularly according to the
+// number of particles in each cell. Rank 0 is the display node: it also receives every
+// 'decimation'th particle of the other ranks, which can be rendered through displayView().
+// Every rank has to hold the same emitters and effects and make the same calls
+class DistributedSimulation {
+public:
+    // Distributes 'simulation' over the ranks of 'transport', which has to be connected. Rank
+    // 0 gathers every 'decimation'th particle for the display. Neither is owned
+    DistributedSimulation(Simulation& simulation, Transport& transport, size_t decimation = 16);
+
+    // Advances the local particles by 'deltaT' seconds and migrates the ones that changed
+    // their owner. Returns false if the communication with another rank failed
+    bool step(float deltaT);
+
+    // Returns the rank that owns the cell of 'position'
+    size_t owner(const glm::vec3& position) const;
+
+    // Returns the first Morton key of the cells of each rank, followed by the number of cells
+    const std::vector<uint32_t>& partition() const;
+
+    // Returns the number of particles of all ranks together at the beginning of the last
+    // migration
+    size_t totalParticles() const;
+
+    // Returns the number of particles that this rank has sent to other ranks so far
+    uint64_t migratedParticles() const;
+
+    // Returns the wall clock time this rank has spent migrating and waiting for the other
+    // ranks so far
+    double communicationSeconds() const;
+
+    // Returns a view onto the decimated positions of all ranks as of the last step. Only rank
+    // 0 receives them, on the other ranks the view stays empty. The version changes with
+    // every step
+    PositionView displayView() const;
+
+private:
+    DistributedSimulation(const DistributedSimulation&) = delete;
+    DistributedSimulation& operator=(const DistributedSimulation&) = delete;
+
+    // Sends the particles that are outside of this rank's region to their owners, receives
+    // the ones that entered it, and gathers the display positions
+    bool migrate();
+
+    // Recomputes the partition from the number of particles in each cell on all ranks
+    bool rebalance();
+
+    // The local part of the simulation
+    Simulation& _simulation;
+    // The connections to the other ranks
+    Transport& _transport;
+    // Only every this many particles is sent to the display node
+    size_t _decimation;
+
+    // The first Morton key owned by each rank and the number of cells
+    std::vector<uint32_t> _partition;
+    // The owner of each local particle during a migration; has one entry per particle of the
+    // store's capacity
+    std::vector<uint32_t> _owners;
+    // The messages of the current round to and from each rank. They keep their capacity, so
+    // a migration does not allocate once they have grown large enough
+    std::vector<std::vector<char>> _outgoing;
+    std::vector<std::vector<char>> _incoming;
+    // The number of particles that leave for each rank in the current migration
+    std::vector<size_t> _outgoingCounts;
+
+    // The decimated positions of all ranks, used on rank 0 only
+    std::vector<glm::vec3> _display;
+    // The data pointer and size of _display that displayView() follows
+    const glm::vec3* _displayData;
+    size_t _displaySize;
+    uint64_t _displayVersion;
+
+    // The number of steps so far, the same on all ranks
+    size_t _numberOfSteps;
+    // The number of particles of all ranks as of the last migration
+    size_t _totalParticles;
+    // The particles sent to other ranks so far
+    uint64_t _migratedParticles;
+    // The time spent communicating so far
+    double _communicationSeconds;
+};
+
+#endif // __DISTRIBUTEDSIMULATION_H__
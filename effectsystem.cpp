@@ -0,0 +1,155 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "effectsystem.h"
+
+#include "particlestore.h"
+#include "spatialhash.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <chrono>
+
+// The constants are used as values only, but C++11 still requires a definition for them
+constexpr float EffectSystem::Gravity::Radius;
+constexpr float EffectSystem::Gravity::Softening;
+constexpr float EffectSystem::Wind::Radius;
+
+namespace {
+    // The number of range jobs each thread should get for an effect, which lets work stealing
+    // balance out ranges of different sizes
+    const size_t _jobsPerThread = 4;
+
+    // Applies the single 'effect' to the particles [begin, end). The radius test is written as
+    // a factor, so that the loop does not branch on it
+    template <typename Effect>
+    void applyEffect(const Effect& effect, const glm::vec3* positions, glm::vec3* velocities,
+        size_t begin, size_t end, float deltaT)
+    {
+        const float radiusSquared = Effect::Radius * Effect::Radius;
+        for (size_t i = begin; i < end; ++i) {
+            const glm::vec3 offset = positions[i] - effect.position;
+            const float distanceSquared = glm::dot(offset, offset);
+            const float inside = (distanceSquared < radiusSquared) ? deltaT : 0.f;
+            velocities[i] += effect.acceleration(offset, distanceSquared) * inside;
+        }
+    }
+}
+
+EffectSystem::EffectSystem() {}
+
+void EffectSystem::addEffect(Type type, const glm::vec3& position, float strength) {
+    switch (type) {
+    case Type::Gravity:
+        {
+            Gravity gravity;
+            gravity.position = position;
+            gravity.strength = strength;
+            _gravities.push_back(gravity);
+        }
+        break;
+    case Type::Wind:
+        {
+            Wind wind;
+            wind.position = position;
+            wind.strength = strength;
+            _winds.push_back(wind);
+        }
+        break;
+    }
+    const Cost cost = { 0, 0.f };
+    _costs.push_back(cost);
+}
+
+void EffectSystem::removeAll() {
+    _gravities.clear();
+    _winds.clear();
+    _costs.clear();
+}
+
+size_t EffectSystem::numberOfEffects() const {
+    return _gravities.size() + _winds.size();
+}
+
+const std::vector<EffectSystem::Gravity>& EffectSystem::gravities() const {
+    return _gravities;
+}
+
+const std::vector<EffectSystem::Wind>& EffectSystem::winds() const {
+    return _winds;
+}
+
+const std::vector<EffectSystem::Cost>& EffectSystem::costs() const {
+    return _costs;
+}
+
+void EffectSystem::apply(ParticleStore& store, const SpatialHash& grid, ThreadPool& pool,
+    float deltaT)
+{
+    // Every range contains at least one cell, so this is enough for any radius and the
+    // steps after the first one do not allocate
+    if (_ranges.capacity() < grid.numberOfCells())
+        _ranges.reserve(grid.numberOfCells());
+
+    applyAll(_gravities, store, grid, pool, deltaT, _costs.data());
+    applyAll(_winds, store, grid, pool, deltaT, _costs.data() + _gravities.size());
+}
+
+template <typename Effect>
+void EffectSystem::applyAll(const std::vector<Effect>& effects, ParticleStore& store,
+    const SpatialHash& grid, ThreadPool& pool, float deltaT, Cost* costs)
+{
+    const glm::vec3* positions = store.positions();
+    glm::vec3* velocities = store.velocities();
+    for (size_t i = 0; i < effects.size(); ++i) {
+        const Effect& effect = effects[i];
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        // Only the particles in the cells around the effect can be affected
+        _ranges.clear();
+        size_t particles = 0;
+        grid.forEachInRadius(effect.position, Effect::Radius,
+            [this, &particles](size_t begin, size_t end) {
+                _ranges.push_back(std::make_pair(begin, end));
+                particles += end - begin;
+            }
+        );
+
+        const size_t grainSize =
+            std::max<size_t>(_ranges.size() / (pool.numberOfThreads() * _jobsPerThread), 1);
+        const std::pair<size_t, size_t>* ranges = _ranges.data();
+        pool.parallelFor(0, _ranges.size(), grainSize,
+            [&effect, ranges, positions, velocities, deltaT](size_t begin, size_t end) {
+                for (size_t r = begin; r < end; ++r) {
+                    applyEffect(effect, positions, velocities, ranges[r].first,
+                        ranges[r].second, deltaT);
+                }
+            }
+        );
+
+        const std::chrono::duration<float, std::milli> duration =
+            std::chrono::steady_clock::now() - start;
+        costs[i].particles = particles;
+        costs[i].milliseconds = duration.count();
+    }
+}
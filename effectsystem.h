@@ -0,0 +1,142 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __EFFECTSYSTEM_H__
+#define __EFFECTSYSTEM_H__
+
+#include <glm/glm.hpp>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+class ParticleStore;
+class SpatialHash;
+class ThreadPool;
+
+// The EffectSystem manages all effects that act on the particles. Each effect only influences
+// the particles within its radius, so the particles are found through the SpatialHash instead
+// of testing every particle against every effect. The effects are stored grouped by their type
+// and each type is applied by its own instantiation of 'applyEffect'. The hot loop therefore
+// contains neither a virtual call nor a switch and the constants of each type are folded into
+// it by the compiler. A new type only needs a struct with the same members as the existing
+// ones, a vector to hold its instances, and a line in 'apply'
+class EffectSystem {
+public:
+    // The kinds of effects that can be added
+    enum class Type {
+        // Attracts the particles towards its position
+        Gravity,
+        // Blows the particles away from its position
+        Wind
+    };
+
+    // Attracts particles with softened inverse-square gravity
+    struct Gravity {
+        // The distance beyond which the particles are not affected
+        static constexpr float Radius = 2.f;
+        // Keeps the acceleration finite for particles very close to the center
+        static constexpr float Softening = 0.05f;
+
+        glm::vec3 position;
+        // The acceleration at a distance of 1 in units per second squared
+        float strength;
+
+        // Returns the acceleration of a particle 'offset' away from the position, whose
+        // squared length is 'distanceSquared'
+        glm::vec3 acceleration(const glm::vec3& offset, float distanceSquared) const {
+            const float d = distanceSquared + Softening * Softening;
+            return offset * (-strength / (d * std::sqrt(d)));
+        }
+    };
+
+    // Pushes particles outwards; the push decreases linearly to 0 at the radius
+    struct Wind {
+        // The distance beyond which the particles are not affected
+        static constexpr float Radius = 1.5f;
+
+        glm::vec3 position;
+        // The acceleration at the center in units per second squared
+        float strength;
+
+        // Returns the acceleration of a particle 'offset' away from the position, whose
+        // squared length is 'distanceSquared'
+        glm::vec3 acceleration(const glm::vec3& offset, float distanceSquared) const {
+            const float distance = std::sqrt(distanceSquared);
+            // The particles directly at the center are not pushed in any direction
+            const float scale = (distance > 0.f) ?
+                strength * (1.f / distance - 1.f / Radius) : 0.f;
+            return offset * scale;
+        }
+    };
+
+    // The work that a single effect did during the last 'apply'
+    struct Cost {
+        // The number of particles in the cells around the effect that were tested
+        size_t particles;
+        // The wall clock time the effect took
+        float milliseconds;
+    };
+
+    // Creates a system without any effects
+    EffectSystem();
+
+    // Adds an effect of 'type' at 'position' and with a 'strength' in units per second squared
+    void addEffect(Type type, const glm::vec3& position, float strength);
+
+    // Removes all effects
+    void removeAll();
+
+    // Returns the number of effects
+    size_t numberOfEffects() const;
+
+    // Returns the effects of each type, for example to save them in a snapshot
+    const std::vector<Gravity>& gravities() const;
+    const std::vector<Wind>& winds() const;
+
+    // Returns the cost of each effect during the last 'apply', first those of the gravities,
+    // then those of the winds, each in the order of their vectors
+    const std::vector<Cost>& costs() const;
+
+    // Changes the velocities of the particles in 'store' by the accelerations of all effects
+    // over 'deltaT' seconds. 'grid' has to have been built for the current order of 'store'
+    void apply(ParticleStore& store, const SpatialHash& grid, ThreadPool& pool, float deltaT);
+
+private:
+    // Applies all 'effects' of one type
+    template <typename Effect>
+    void applyAll(const std::vector<Effect>& effects, ParticleStore& store,
+        const SpatialHash& grid, ThreadPool& pool, float deltaT, Cost* costs);
+
+    // The effects grouped by type
+    std::vector<Gravity> _gravities;
+    std::vector<Wind> _winds;
+    // The cost of each effect; grows with the effects so that applying does not allocate
+    std::vector<Cost> _costs;
+
+    // The particle ranges of the cells within the radius of the current effect. Reused between
+    // effects so that applying does not allocate once it has grown large enough
+    std::vector<std::pair<size_t, size_t>> _ranges;
+};
+
+#endif // __EFFECTSYSTEM_H__
@@ -0,0 +1,188 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "emittersystem.h"
+
+#include "particlestore.h"
+#include "philox.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // The number of particles that are filled as one job by the thread pool
+    const size_t _chunkSize = 16 * 1024;
+
+    // The range of the initial speed of the particles in units per second
+    const float _minimumSpeed = 0.5f;
+    const float _maximumSpeed = 1.5f;
+    // The range of the lifetime of the particles in seconds
+    const float _minimumLifetime = 2.f;
+    const float _maximumLifetime = 4.f;
+    // The half opening angle of cone emitters in radians
+    const float _coneAngle = 0.35f;
+
+    const float _twoPi = 6.28318530718f;
+    // The second half of the Philox key that separates the emitter streams from other users
+    const uint32_t _emitterStream = 0x454D4954;
+}
+
+EmitterSystem::EmitterSystem(uint32_t seed)
+    : _spawnOffsets(1, 0)
+    , _part(0)
+    , _numberOfParts(1)
+    , _nextId(0)
+    , _seed(seed)
+{}
+
+void EmitterSystem::addEmitter(Type type, const glm::vec3& position, float rate) {
+    Emitter emitter;
+    emitter.type = type;
+    emitter.position = position;
+    emitter.rate = std::max(rate, 0.f);
+    emitter.remainder = 0.f;
+    emitter.emitted = 0;
+    emitter.id = _nextId++;
+    _emitters.push_back(emitter);
+    _spawnOffsets.push_back(0);
+}
+
+void EmitterSystem::removeAll() {
+    _emitters.clear();
+    _spawnOffsets.assign(1, 0);
+}
+
+size_t EmitterSystem::numberOfEmitters() const {
+    return _emitters.size();
+}
+
+const std::vector<EmitterSystem::Emitter>& EmitterSystem::emitters() const {
+    return _emitters;
+}
+
+uint32_t EmitterSystem::seed() const {
+    return _seed;
+}
+
+uint32_t EmitterSystem::nextId() const {
+    return _nextId;
+}
+
+void EmitterSystem::restore(const Emitter* emitters, size_t count, uint32_t seed,
+    uint32_t nextId)
+{
+    _emitters.assign(emitters, emitters + count);
+    _spawnOffsets.assign(count + 1, 0);
+    _seed = seed;
+    _nextId = nextId;
+}
+
+void EmitterSystem::setPartition(uint32_t part, uint32_t numberOfParts) {
+    _numberOfParts = std::max(numberOfParts, 1u);
+    _part = part % _numberOfParts;
+}
+
+size_t EmitterSystem::spawn(ParticleStore& store, ThreadPool& pool, float deltaT) {
+    // Lay out the sub-ranges of the emitters one after the other. Clamping against the free
+    // space of the store drops the same particles as if each emitter allocated on its own
+    const size_t available = store.available();
+    for (size_t e = 0; e < _emitters.size(); ++e) {
+        Emitter& emitter = _emitters[e];
+        if (emitter.id % _numberOfParts != _part) {
+            _spawnOffsets[e + 1] = _spawnOffsets[e];
+            continue;
+        }
+        const float exact = emitter.rate * deltaT + emitter.remainder;
+        const float whole = std::floor(exact);
+        emitter.remainder = exact - whole;
+        _spawnOffsets[e + 1] =
+            std::min(_spawnOffsets[e] + static_cast<size_t>(whole), available);
+    }
+
+    // Reserve all slots at once; the store hands out contiguous memory without locking
+    const size_t total = store.allocate(_spawnOffsets.back());
+    if (total == 0)
+        return 0;
+    const size_t first = store.size() - total;
+
+    // A chunk can cover the end of one sub-range and the beginning of the next ones
+    pool.parallelFor(0, total, _chunkSize,
+        [this, &store, first](size_t begin, size_t end) {
+            size_t e = std::upper_bound(_spawnOffsets.begin(), _spawnOffsets.end(), begin) -
+                _spawnOffsets.begin() - 1;
+            for (size_t i = begin; i < end; ++e) {
+                const size_t rangeEnd = std::min(_spawnOffsets[e + 1], end);
+                if (rangeEnd > i) {
+                    const Emitter& emitter = _emitters[e];
+                    fill(emitter, store, first + i, first + rangeEnd,
+                        emitter.emitted + (i - _spawnOffsets[e]));
+                }
+                i = rangeEnd;
+            }
+        }
+    );
+
+    for (size_t e = 0; e < _emitters.size(); ++e)
+        _emitters[e].emitted += _spawnOffsets[e + 1] - _spawnOffsets[e];
+    return total;
+}
+
+void EmitterSystem::fill(const Emitter& emitter, ParticleStore& store, size_t begin, size_t end,
+    uint64_t firstNumber) const
+{
+    glm::vec3* positions = store.positions();
+    glm::vec3* velocities = store.velocities();
+    float* ages = store.ages();
+    float* lifetimes = store.lifetimes();
+
+    // Points sample the cosine of the polar angle in [-1, 1], cones only in [cos(angle), 1],
+    // which in both cases distributes the directions uniformly over the respective solid angle
+    const float minimumCosine = (emitter.type == Type::Cone) ? std::cos(_coneAngle) : -1.f;
+
+    for (size_t i = begin; i < end; ++i) {
+        const uint64_t number = firstNumber + (i - begin);
+        uint32_t random[philox::NumberOfWords] = {
+            static_cast<uint32_t>(number),
+            static_cast<uint32_t>(number >> 32),
+            emitter.id,
+            0
+        };
+        philox::generate(random, _seed, _emitterStream);
+
+        const float cosine = minimumCosine + (1.f - minimumCosine) * philox::toUnitFloat(random[0]);
+        const float sine = std::sqrt(std::max(1.f - cosine * cosine, 0.f));
+        const float azimuth = _twoPi * philox::toUnitFloat(random[1]);
+        const float speed =
+            _minimumSpeed + (_maximumSpeed - _minimumSpeed) * philox::toUnitFloat(random[2]);
+        const float lifetimeRange = _maximumLifetime - _minimumLifetime;
+        const float lifetime = _minimumLifetime + lifetimeRange * philox::toUnitFloat(random[3]);
+
+        // The z axis is up, so the cone opens around it
+        const glm::vec3 direction(sine * std::cos(azimuth), sine * std::sin(azimuth), cosine);
+        positions[i] = emitter.position;
+        velocities[i] = speed * direction;
+        ages[i] = 0.f;
+        lifetimes[i] = lifetime;
+    }
+}
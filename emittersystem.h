@@ -0,0 +1,123 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __EMITTERSYSTEM_H__
+#define __EMITTERSYSTEM_H__
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ParticleStore;
+class ThreadPool;
+
+// The EmitterSystem manages all particle sources and spawns their particles in bulk. Each step, the
+// new particles of all emitters are reserved in the ParticleStore with a single 'allocate', in
+// which every emitter owns a contiguous sub-range, and all sub-ranges are then filled by one
+// parallel loop, so the cost of dispatching the work does not grow with the number of emitters. The
+// random numbers come from the counter-based Philox generator keyed by the emitter and the running
+// number of the particle, so spawning needs neither a lock nor per-thread generator state, does not
+// allocate, and produces the same particles regardless of how the work is split across the threads
+class EmitterSystem {
+public:
+    // The shapes in which an emitter can launch its particles
+    enum class Type {
+        // Launches particles in all directions with the same probability
+        Point,
+        // Launches particles upwards inside a cone around the z axis
+        Cone
+    };
+
+    // The state of a single source
+    struct Emitter {
+        // The shape of the emitter
+        Type type;
+        // The location from which all particles are launched
+        glm::vec3 position;
+        // The number of particles per second
+        float rate;
+        // The fraction of a particle that was not spawned in the last step due to rounding
+        float remainder;
+        // The number of particles this emitter has spawned so far; the counter for the
+        // random numbers of the next particle
+        uint64_t emitted;
+        // Distinguishes the random streams of the emitters
+        uint32_t id;
+    };
+
+    // Creates an empty system whose random numbers are derived from 'seed'
+    explicit EmitterSystem(uint32_t seed = 0);
+
+    // Adds a new emitter of 'type' at 'position' that spawns 'rate' particles per second
+    void addEmitter(Type type, const glm::vec3& position, float rate);
+
+    // Removes all emitters
+    void removeAll();
+
+    // Returns the number of emitters
+    size_t numberOfEmitters() const;
+
+    // Returns the complete state of all emitters, for example to save it in a snapshot
+    const std::vector<Emitter>& emitters() const;
+    // Returns the seed of the random streams and the identifier of the next emitter
+    uint32_t seed() const;
+    uint32_t nextId() const;
+
+    // Replaces all emitters with the 'count' 'emitters', so that they continue to spawn the
+    // same particles as the system with 'seed' and 'nextId' they were taken from
+    void restore(const Emitter* emitters, size_t count, uint32_t seed, uint32_t nextId);
+
+    // Restricts spawning to the emitters whose identifier modulo 'numberOfParts' is 'part'; the
+    // others keep their state untouched. Several systems with the same emitters, each with
+    // another part, together spawn the same particles as a single system with all parts
+    void setPartition(uint32_t part, uint32_t numberOfParts);
+
+    // Spawns the particles of all emitters for a step of 'deltaT' seconds into 'store'. The
+    // emitters follow each other in the order they were added. If the store is full, the
+    // remaining particles of this step are dropped, starting with the last emitter. Returns
+    // the number of particles that were spawned
+    size_t spawn(ParticleStore& store, ThreadPool& pool, float deltaT);
+
+private:
+    // Fills the particles [begin, end) of 'store' for 'emitter', where 'begin' is the particle
+    // with the running number 'firstNumber'
+    void fill(const Emitter& emitter, ParticleStore& store, size_t begin, size_t end,
+        uint64_t firstNumber) const;
+
+    // All active emitters
+    std::vector<Emitter> _emitters;
+    // The start of the sub-range of each emitter within the particles spawned in the current
+    // step, followed by the total number; kept at one more element than _emitters, so that
+    // spawning does not allocate
+    std::vector<size_t> _spawnOffsets;
+    // Only the emitters with an identifier in this residue class spawn particles
+    uint32_t _part;
+    uint32_t _numberOfParts;
+    // The identifier that the next emitter will receive
+    uint32_t _nextId;
+    // The key shared by all random streams of this system
+    uint32_t _seed;
+};
+
+#endif // __EMITTERSYSTEM_H__
@@ -0,0 +1,93 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "fixedtimestep.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+FixedTimestep::FixedTimestep(float stepsPerSecond, int maximumSteps)
+    : _stepSize(1.f / stepsPerSecond)
+    , _maximumSteps(maximumSteps)
+    , _accumulator(0.0)
+    , _droppedTime(0.0)
+{
+    assert(stepsPerSecond > 0.f);
+    assert(maximumSteps >= 1);
+}
+
+void FixedTimestep::setStepsPerSecond(float stepsPerSecond) {
+    assert(stepsPerSecond > 0.f);
+    _stepSize = 1.f / stepsPerSecond;
+}
+
+float FixedTimestep::stepsPerSecond() const {
+    return 1.f / _stepSize;
+}
+
+float FixedTimestep::stepSize() const {
+    return _stepSize;
+}
+
+void FixedTimestep::setMaximumSteps(int maximumSteps) {
+    assert(maximumSteps >= 1);
+    _maximumSteps = maximumSteps;
+}
+
+int FixedTimestep::maximumSteps() const {
+    return _maximumSteps;
+}
+
+void FixedTimestep::accumulate(float elapsed) {
+    // A clock that goes backwards must not undo steps that have already been simulated
+    _accumulator += std::max(elapsed, 0.f);
+}
+
+int FixedTimestep::consumeSteps() {
+    return consumeSteps(_maximumSteps);
+}
+
+int FixedTimestep::consumeSteps(int limit) {
+    assert(limit >= 1);
+    // The fraction of a step always stays in the accumulator, so that the interpolation
+    // continues smoothly even if steps are dropped
+    const double dueSteps = std::floor(_accumulator / _stepSize);
+    const int maximumSteps = std::min(limit, _maximumSteps);
+    const int steps = static_cast<int>(std::min(dueSteps, static_cast<double>(maximumSteps)));
+    _accumulator -= dueSteps * _stepSize;
+    _droppedTime += (dueSteps - steps) * _stepSize;
+    return steps;
+}
+
+float FixedTimestep::interpolation() const {
+    return std::min(static_cast<float>(_accumulator / _stepSize), 1.f);
+}
+
+double FixedTimestep::droppedTime() const {
+    return _droppedTime;
+}
+
+void FixedTimestep::reset() {
+    _accumulator = 0.0;
+}
@@ -0,0 +1,82 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __FIXEDTIMESTEP_H__
+#define __FIXEDTIMESTEP_H__
+
+// The FixedTimestep divides the real time that passes into steps of a fixed size, so that the
+// simulation behaves the same regardless of how long the frames take. The time that is left
+// over after the whole steps is kept for later and tells the renderer how far it is between
+// the last two steps. If more steps are due than the maximum, for example after a long frame,
+// the surplus time is dropped. Otherwise a simulation that is slower than real time would have
+// to do more and more steps per frame and would never catch up
+class FixedTimestep {
+public:
+    // Creates a timestep of 1 / 'stepsPerSecond' seconds that hands out at most 'maximumSteps'
+    // steps at once
+    explicit FixedTimestep(float stepsPerSecond = 60.f, int maximumSteps = 4);
+
+    // Changes the number of steps per simulated second; the accumulated time is kept
+    void setStepsPerSecond(float stepsPerSecond);
+    float stepsPerSecond() const;
+
+    // Returns the duration of one step in seconds
+    float stepSize() const;
+
+    // Changes the maximum number of steps that 'consumeSteps' returns. Has to be at least 1
+    void setMaximumSteps(int maximumSteps);
+    int maximumSteps() const;
+
+    // Adds 'elapsed' seconds of real time
+    void accumulate(float elapsed);
+
+    // Returns the number of whole steps that are due and removes their time. If there are more
+    // than maximumSteps(), only as many are returned and the time of the others is dropped
+    int consumeSteps();
+
+    // Like consumeSteps(), but returns at most 'limit' steps if that is less than
+    // maximumSteps(). Has to be at least 1
+    int consumeSteps(int limit);
+
+    // Returns the fraction of a step in [0,1) that has accumulated since the last step
+    float interpolation() const;
+
+    // Returns the total time in seconds that was dropped because too many steps were due
+    double droppedTime() const;
+
+    // Discards the accumulated time
+    void reset();
+
+private:
+    // The duration of one step in seconds
+    float _stepSize;
+    // The maximum number of steps per call of consumeSteps
+    int _maximumSteps;
+    // The real time that has not been turned into steps yet. A double, so that adding small
+    // frame times to it does not lose precision
+    double _accumulator;
+    // The time that has been dropped so far
+    double _droppedTime;
+};
+
+#endif // __FIXEDTIMESTEP_H__
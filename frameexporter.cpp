@@ -0,0 +1,207 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "frameexporter.h"
+
+#include <ghoul/logging/logging>
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace {
+    const std::string _loggerCat = "FrameExporter";
+
+    // The positions start at this offset in the position buffers, after the GPU's count
+    const size_t _positionOffset = 16;
+
+    // The time in nanoseconds that a blocking wait for a frame is split into
+    const GLuint64 _waitTimeout = 100000000;
+}
+
+FrameExporter::FrameExporter(const FrameExportSettings& settings)
+    : _writer(settings)
+    , _current(0)
+    , _nextFrame(0)
+    , _isInitialized(false)
+{
+    for (Slot& slot : _slots) {
+        slot.pixelBuffer = 0;
+        slot.pixelBufferSize = 0;
+        slot.positionBuffer = 0;
+        slot.positionBufferSize = 0;
+        slot.fence = 0;
+        slot.frame = 0;
+        slot.width = 0;
+        slot.height = 0;
+        slot.count = 0;
+        slot.stride = 0;
+        slot.countOnGpu = false;
+        slot.pending = false;
+    }
+}
+
+FrameExporter::~FrameExporter() {
+    // The frames are handed over from the oldest to the newest
+    for (int i = 0; i < NumberOfFrames; ++i) {
+        Slot& slot = _slots[(_current + i) % NumberOfFrames];
+        if (slot.pending)
+            retire(slot, true);
+    }
+
+    if (_isInitialized) {
+        for (Slot& slot : _slots) {
+            glDeleteBuffers(1, &slot.pixelBuffer);
+            glDeleteBuffers(1, &slot.positionBuffer);
+        }
+    }
+}
+
+bool FrameExporter::initialize() {
+    if (!_writer.open())
+        return false;
+    for (Slot& slot : _slots) {
+        glGenBuffers(1, &slot.pixelBuffer);
+        glGenBuffers(1, &slot.positionBuffer);
+    }
+    _isInitialized = true;
+    return true;
+}
+
+void FrameExporter::capture(int width, int height, GLuint buffer, GLintptr offset,
+    GLsizei stride, size_t count, GLuint countBuffer)
+{
+    if (!_isInitialized)
+        return;
+
+    // The slot still holds the frame from NumberOfFrames frames ago if the GPU was that slow
+    Slot& slot = _slots[_current];
+    if (slot.pending)
+        retire(slot, true);
+
+    if (_writer.writesImages()) {
+        // The BGRA order with reversed components is the native format of most drivers
+        const size_t size = static_cast<size_t>(width) * height * 4;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+        if (slot.pixelBufferSize < size) {
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+            slot.pixelBufferSize = size;
+        }
+        glReadBuffer(GL_BACK);
+        glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    if (_writer.writesPositions()) {
+        const size_t size = _positionOffset + count * stride;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, slot.positionBuffer);
+        if (slot.positionBufferSize < size) {
+            glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_READ);
+            slot.positionBufferSize = size;
+        }
+        if (countBuffer != 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, countBuffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint));
+        }
+        if (count > 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset,
+                _positionOffset, count * stride);
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.frame = _nextFrame++;
+    slot.width = width;
+    slot.height = height;
+    slot.count = count;
+    slot.stride = stride;
+    slot.countOnGpu = (countBuffer != 0);
+    slot.pending = true;
+    _current = (_current + 1) % NumberOfFrames;
+
+    // Hand over the earlier frames that have finished in the meantime, from the oldest to the
+    // newest, as they finish in that order
+    for (int i = 0; i < NumberOfFrames; ++i) {
+        Slot& earlier = _slots[(_current + i) % NumberOfFrames];
+        if (earlier.pending && !retire(earlier, false))
+            break;
+    }
+}
+
+bool FrameExporter::retire(Slot& slot, bool wait) {
+    GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+        wait ? _waitTimeout : 0);
+    while (wait && (status == GL_TIMEOUT_EXPIRED))
+        status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, _waitTimeout);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+    slot.pending = false;
+    if (status == GL_WAIT_FAILED) {
+        LERROR("Waiting for frame " << slot.frame << " failed; it is not exported");
+        return true;
+    }
+
+    // The data is copied out of the mappings, so the buffers can be reused right away
+    if (_writer.writesImages()) {
+        const size_t size = static_cast<size_t>(slot.width) * slot.height * 4;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+        const char* pixels = static_cast<const char*>(
+            glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT));
+        if (pixels != nullptr) {
+            std::vector<char> image(pixels, pixels + size);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            _writer.writeImage(slot.frame, slot.width, slot.height, std::move(image));
+        }
+        else
+            LERROR("Could not map the pixels of frame " << slot.frame);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    if (_writer.writesPositions()) {
+        const size_t size = _positionOffset + slot.count * slot.stride;
+        glBindBuffer(GL_COPY_READ_BUFFER, slot.positionBuffer);
+        const char* data = static_cast<const char*>(
+            glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, GL_MAP_READ_BIT));
+        if (data != nullptr) {
+            size_t count = slot.count;
+            if (slot.countOnGpu) {
+                GLuint gpuCount = 0;
+                std::memcpy(&gpuCount, data, sizeof(gpuCount));
+                count = std::min(count, static_cast<size_t>(gpuCount));
+            }
+            std::vector<char> positions(data + _positionOffset,
+                data + _positionOffset + count * slot.stride);
+            glUnmapBuffer(GL_COPY_READ_BUFFER);
+            _writer.writePositions(slot.frame, count, slot.stride, std::move(positions));
+        }
+        else
+            LERROR("Could not map the positions of frame " << slot.frame);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+    return true;
+}
@@ -0,0 +1,107 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __FRAMEEXPORTER_H__
+#define __FRAMEEXPORTER_H__
+
+// Need to include opengl first, as the other headers might include gl, but not glew
+#include <ghoul/opengl/opengl>
+
+#include "framewriter.h"
+
+#include <cstddef>
+
+// The FrameExporter reads the rendered frames and the particle positions back without
+// stalling the GPU. Each frame is read into one of a ring of pixel buffer objects and copied
+// into a buffer of its own, followed by a fence. The buffers are only mapped once their fence
+// has been signaled, which is usually the case by the next frame, so the export lags one frame
+// behind the rendering. The mapped data is handed to a FrameWriter, which encodes and writes
+// it on its own threads. All functions have to be called with the OpenGL context current
+class FrameExporter {
+public:
+    // Creates an exporter that writes what 'settings' selects; 'initialize' has to be called
+    // before it can be used
+    explicit FrameExporter(const FrameExportSettings& settings);
+
+    // Hands over the frames that are still being read back and deletes all OpenGL objects.
+    // The writer finishes all frames before the destructor returns
+    ~FrameExporter();
+
+    // Creates the buffers and starts the writer. Returns false if anything failed
+    bool initialize();
+
+    // Reads back the 'width' x 'height' pixels of the back buffer and the particle positions,
+    // whose three floats start at 'offset' bytes into 'buffer' with 'stride' bytes between
+    // them. If 'countBuffer' is 0, 'count' is the number of particles; otherwise 'count' is
+    // only an upper bound and the number is read on the GPU from the first element of
+    // 'countBuffer'. Has to be called after the frame has been drawn and before the positions
+    // may change
+    void capture(int width, int height, GLuint buffer, GLintptr offset, GLsizei stride,
+        size_t count, GLuint countBuffer);
+
+private:
+    FrameExporter(const FrameExporter&) = delete;
+    FrameExporter& operator=(const FrameExporter&) = delete;
+
+    // The number of frames that can be read back at the same time
+    static const int NumberOfFrames = 3;
+
+    // A frame that is read back
+    struct Slot {
+        // The buffers that the pixels and the positions are read into, and their sizes
+        GLuint pixelBuffer;
+        size_t pixelBufferSize;
+        GLuint positionBuffer;
+        size_t positionBufferSize;
+        // Signaled once the copies into the buffers have finished
+        GLsync fence;
+        // The number of the frame
+        size_t frame;
+        int width;
+        int height;
+        // The number or upper bound of positions, and the bytes between them
+        size_t count;
+        size_t stride;
+        // True if the number of positions precedes the positions in positionBuffer
+        bool countOnGpu;
+        // True while the frame has not been handed to the writer
+        bool pending;
+    };
+
+    // Hands the frame of 'slot' to the writer if it has been read back. If 'wait' is true,
+    // waits for it to be read back. Returns true if the frame was handed over
+    bool retire(Slot& slot, bool wait);
+
+    // Encodes and writes the frames
+    FrameWriter _writer;
+    // The ring of frames
+    Slot _slots[NumberOfFrames];
+    // The slot that the next frame is read into
+    int _current;
+    // The number of the next frame
+    size_t _nextFrame;
+    // True once the buffers have been created
+    bool _isInitialized;
+};
+
+#endif // __FRAMEEXPORTER_H__
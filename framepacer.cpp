@@ -0,0 +1,125 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "framepacer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // The number of intervals that are needed before the refresh period is trusted
+    const int _minimumSamples = 16;
+
+    // The share of the refresh period that the work for a frame may use. The rest is left for
+    // the swap itself and the scheduling jitter of the GUI thread
+    const float _budgetShare = 0.9f;
+
+    // An interval that is longer than this many refresh periods missed its vertical blank
+    const float _missThreshold = 1.5f;
+
+    // If the carried time exceeds this many refresh periods, the estimate is wrong, for
+    // example because the window moved to another display, and the real time is used instead
+    const double _maximumCarry = 4.0;
+}
+
+FramePacer::FramePacer(Mode mode)
+    : _mode(mode)
+    , _hasSwapped(false)
+    , _lastSwap()
+    , _lastInterval(0.f)
+    , _intervals()
+    , _next(0)
+    , _count(0)
+    , _refreshPeriod(0.f)
+    , _carry(0.0)
+    , _missedFrames(0)
+{}
+
+FramePacer::Mode FramePacer::mode() const {
+    return _mode;
+}
+
+float FramePacer::frameSwapped(std::chrono::steady_clock::time_point now) {
+    if (!_hasSwapped) {
+        _hasSwapped = true;
+        _lastSwap = now;
+        return 0.f;
+    }
+    const std::chrono::duration<float> interval = now - _lastSwap;
+    _lastSwap = now;
+    _lastInterval = interval.count();
+    if (_mode == Mode::Unthrottled)
+        return _lastInterval;
+
+    _intervals[_next] = _lastInterval;
+    _next = (_next + 1) % NumberOfSamples;
+    _count = std::min(_count + 1, NumberOfSamples);
+    estimateRefreshPeriod();
+    if (_refreshPeriod == 0.f)
+        return _lastInterval;
+
+    if (_lastInterval > _missThreshold * _refreshPeriod)
+        ++_missedFrames;
+
+    // The frame was visible for a whole number of refresh periods, so that is the time that
+    // has passed for the viewer. The measured time that does not fit is handed out later
+    const double period = _refreshPeriod;
+    const double available = _carry + _lastInterval;
+    const double periods = std::max(std::floor(available / period + 0.5), 0.0);
+    _carry = available - periods * period;
+    if (std::abs(_carry) > _maximumCarry * period) {
+        _carry = 0.0;
+        return static_cast<float>(available);
+    }
+    return static_cast<float>(periods * period);
+}
+
+float FramePacer::lastInterval() const {
+    return _lastInterval;
+}
+
+float FramePacer::refreshPeriod() const {
+    return _refreshPeriod;
+}
+
+float FramePacer::frameBudget() const {
+    return _refreshPeriod * _budgetShare;
+}
+
+uint64_t FramePacer::numberOfMissedFrames() const {
+    return _missedFrames;
+}
+
+void FramePacer::estimateRefreshPeriod() {
+    if (_count < _minimumSamples) {
+        _refreshPeriod = 0.f;
+        return;
+    }
+    // The median ignores the frames that missed their vertical blank, as long as they are the
+    // minority; if most frames miss it, the median is the interval that is really achieved
+    std::array<float, NumberOfSamples> sorted;
+    std::copy(_intervals.begin(), _intervals.begin() + _count, sorted.begin());
+    const auto median = sorted.begin() + _count / 2;
+    std::nth_element(sorted.begin(), median, sorted.begin() + _count);
+    _refreshPeriod = *median;
+}
@@ -0,0 +1,109 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __FRAMEPACER_H__
+#define __FRAMEPACER_H__
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+// The FramePacer follows the rhythm in which the frames reach the display. With vertical
+// synchronization, the buffer swap blocks until the next vertical blank, so the render loop
+// needs no timer of its own and runs at the refresh rate of the display, whatever that is.
+// The pacer measures the time between the swaps and estimates the refresh period from the
+// median of the recent intervals, which a single late frame does not disturb. The elapsed
+// times are snapped to whole refresh periods, so that the timing jitter of the GUI thread does
+// not show up as uneven motion, and the rest is carried over to the following frames so that
+// no time is lost. The refresh period is the budget that the work for the next frame has to
+// fit into. In the unthrottled mode the frames are rendered as fast as possible for
+// benchmarking; the real elapsed times are passed on and there is no budget
+class FramePacer {
+public:
+    // How the frames are paced
+    enum class Mode {
+        // The buffer swaps wait for the vertical blank
+        VSync,
+        // The buffer swaps never wait
+        Unthrottled
+    };
+
+    // The number of frame intervals the refresh period is estimated from
+    static const int NumberOfSamples = 64;
+
+    // Creates a pacer that has not seen any frame yet
+    explicit FramePacer(Mode mode = Mode::VSync);
+
+    // Returns the mode this pacer was created with
+    Mode mode() const;
+
+    // Has to be called once per frame, right after the previous frame has been swapped at
+    // 'now'. Returns the time in seconds that the following update should advance by; 0 for
+    // the first frame
+    float frameSwapped(std::chrono::steady_clock::time_point now);
+
+    // Returns the interval in seconds between the last two swaps as it was measured
+    float lastInterval() const;
+
+    // Returns the estimated time in seconds between two vertical blanks, or 0 as long as
+    // there are too few frames or the pacer is unthrottled
+    float refreshPeriod() const;
+
+    // Returns the time in seconds that the work for the next frame may take without missing
+    // the vertical blank, or 0 if there is no limit
+    float frameBudget() const;
+
+    // Returns the number of frames that were shown for more than one refresh period
+    uint64_t numberOfMissedFrames() const;
+
+private:
+    // Recomputes _refreshPeriod from the recent intervals
+    void estimateRefreshPeriod();
+
+    // The way the frames are paced
+    Mode _mode;
+
+    // Whether _lastSwap holds the time of a swap
+    bool _hasSwapped;
+    // The time of the most recent swap
+    std::chrono::steady_clock::time_point _lastSwap;
+    // The most recently measured interval in seconds
+    float _lastInterval;
+
+    // The recent intervals in a ring buffer
+    std::array<float, NumberOfSamples> _intervals;
+    // The position the next interval is written to
+    int _next;
+    // The number of valid intervals; stops growing at NumberOfSamples
+    int _count;
+
+    // The estimated refresh period in seconds, 0 if unknown
+    float _refreshPeriod;
+    // The measured time in seconds that has not been handed out, because the elapsed times
+    // were snapped to whole refresh periods
+    double _carry;
+    // The number of frames that missed their vertical blank
+    uint64_t _missedFrames;
+};
+
+#endif // __FRAMEPACER_H__
@@ -0,0 +1,263 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "framewriter.h"
+
+#include <ghoul/logging/logging>
+#include <QImage>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#ifndef _WIN32
+#include <csignal>
+#endif
+
+namespace {
+    const std::string _loggerCat = "FrameWriter";
+
+    // The number of frames per thread that may be queued before queueing blocks
+    const size_t _queuedFramesPerThread = 2;
+
+    // The columns of the position dumps start at multiples of this many bytes
+    const uint64_t _columnAlignment = 64;
+
+    // Identifies the position dumps and the byte order they were written with
+    const char _positionMagic[8] = { 'P', 'C', 'O', 'L', 'U', 'M', 'N', 'S' };
+    const uint32_t _byteOrderMark = 0x01020304;
+
+    // The start of each position dump. The offsets are in bytes from the start of the file
+    struct PositionHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint64_t frame;
+        uint64_t numberOfPositions;
+        // The x, y, and z columns
+        uint64_t columns[3];
+    };
+
+    uint64_t align(uint64_t offset) {
+        return (offset + _columnAlignment - 1) / _columnAlignment * _columnAlignment;
+    }
+
+    // Returns the path of 'frame' for the printf 'pattern'
+    std::string framePath(const std::string& pattern, size_t frame) {
+        char path[4096];
+        std::snprintf(path, sizeof(path), pattern.c_str(), static_cast<int>(frame));
+        return path;
+    }
+}
+
+FrameWriter::FrameWriter(const FrameExportSettings& settings)
+    : _settings(settings)
+    , _pipe(nullptr)
+    , _nextPipeFrame(0)
+    , _quit(false)
+{
+    if (_settings.numberOfThreads == 0)
+        _settings.numberOfThreads = 1;
+}
+
+FrameWriter::~FrameWriter() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _wakeUp.notify_all();
+    for (std::thread& thread : _threads)
+        thread.join();
+
+    if (_pipe != nullptr) {
+#ifdef _WIN32
+        _pclose(_pipe);
+#else
+        pclose(_pipe);
+#endif
+    }
+}
+
+bool FrameWriter::open() {
+    if (!_settings.pipeCommand.empty()) {
+#ifdef _WIN32
+        _pipe = _popen(_settings.pipeCommand.c_str(), "wb");
+#else
+        // A pipe command that exits early must not terminate the renderer with SIGPIPE
+        std::signal(SIGPIPE, SIG_IGN);
+        _pipe = popen(_settings.pipeCommand.c_str(), "w");
+#endif
+        if (_pipe == nullptr) {
+            LERROR("Could not start the pipe command '" << _settings.pipeCommand << "'");
+            return false;
+        }
+        LINFO("Piping the frames into '" << _settings.pipeCommand << "'");
+    }
+
+    // Start the threads last, as they access the members
+    for (unsigned int i = 0; i < _settings.numberOfThreads; ++i)
+        _threads.push_back(std::thread(&FrameWriter::run, this));
+    return true;
+}
+
+bool FrameWriter::writesImages() const {
+    return !_settings.imagePattern.empty() || !_settings.pipeCommand.empty();
+}
+
+bool FrameWriter::writesPositions() const {
+    return !_settings.positionPattern.empty();
+}
+
+void FrameWriter::writeImage(size_t frame, int width, int height, std::vector<char> pixels) {
+    Job job;
+    job.isImage = true;
+    job.frame = frame;
+    job.width = width;
+    job.height = height;
+    job.count = 0;
+    job.stride = 0;
+    job.data = std::move(pixels);
+    push(std::move(job));
+}
+
+void FrameWriter::writePositions(size_t frame, size_t count, size_t stride,
+    std::vector<char> positions)
+{
+    Job job;
+    job.isImage = false;
+    job.frame = frame;
+    job.width = 0;
+    job.height = 0;
+    job.count = count;
+    job.stride = stride;
+    job.data = std::move(positions);
+    push(std::move(job));
+}
+
+void FrameWriter::push(Job job) {
+    // Without threads, nothing would ever take the job
+    if (_threads.empty())
+        return;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        const size_t maximumJobs = _queuedFramesPerThread * _threads.size();
+        _progress.wait(lock, [this, maximumJobs]() { return _jobs.size() < maximumJobs; });
+        _jobs.push_back(std::move(job));
+    }
+    _wakeUp.notify_one();
+}
+
+void FrameWriter::writeImage(const Job& job) {
+    // OpenGL returns the bottom row first, but images and videos start with the top row
+    const size_t rowSize = static_cast<size_t>(job.width) * 4;
+    std::vector<char> image(job.data.size());
+    for (int row = 0; row < job.height; ++row) {
+        std::memcpy(image.data() + row * rowSize,
+            job.data.data() + (job.height - 1 - row) * rowSize, rowSize);
+    }
+
+    if (!_settings.imagePattern.empty()) {
+        // The BGRA bytes are the layout of ARGB32 on all platforms, as they were read as
+        // GL_UNSIGNED_INT_8_8_8_8_REV
+        const QImage qimage(reinterpret_cast<const uchar*>(image.data()), job.width,
+            job.height, QImage::Format_ARGB32);
+        const std::string path = framePath(_settings.imagePattern, job.frame);
+        if (!qimage.save(QString::fromStdString(path)))
+            LERROR("Could not write the image '" << path << "'");
+    }
+
+    if (_settings.pipeCommand.empty())
+        return;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _progress.wait(lock, [this, &job]() { return _nextPipeFrame == job.frame; });
+    }
+    // Only the thread with the next frame gets here, so the pipe is never written concurrently
+    if ((_pipe != nullptr) && (std::fwrite(image.data(), 1, image.size(), _pipe) != image.size())) {
+        LERROR("Could not write into the pipe. Piping stopped");
+#ifdef _WIN32
+        _pclose(_pipe);
+#else
+        pclose(_pipe);
+#endif
+        _pipe = nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_nextPipeFrame;
+    }
+    _progress.notify_all();
+}
+
+void FrameWriter::writePositions(const Job& job) {
+    PositionHeader header;
+    std::memcpy(header.magic, _positionMagic, sizeof(_positionMagic));
+    header.version = PositionVersion;
+    header.byteOrder = _byteOrderMark;
+    header.frame = job.frame;
+    header.numberOfPositions = job.count;
+    const uint64_t columnSize = job.count * sizeof(float);
+    header.columns[0] = align(sizeof(header));
+    header.columns[1] = align(header.columns[0] + columnSize);
+    header.columns[2] = align(header.columns[1] + columnSize);
+
+    // The positions are split into the columns, and the padding is zeroed
+    std::vector<char> file(static_cast<size_t>(header.columns[2] + columnSize), 0);
+    std::memcpy(file.data(), &header, sizeof(header));
+    for (int c = 0; c < 3; ++c) {
+        float* column = reinterpret_cast<float*>(file.data() + header.columns[c]);
+        const char* position = job.data.data() + c * sizeof(float);
+        for (size_t i = 0; i < job.count; ++i, position += job.stride)
+            std::memcpy(column + i, position, sizeof(float));
+    }
+
+    const std::string path = framePath(_settings.positionPattern, job.frame);
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    bool success = (f != nullptr);
+    if (success) {
+        success = (std::fwrite(file.data(), 1, file.size(), f) == file.size());
+        success = (std::fclose(f) == 0) && success;
+    }
+    if (!success)
+        LERROR("Could not write the positions '" << path << "'");
+}
+
+void FrameWriter::run() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wakeUp.wait(lock, [this]() { return _quit || !_jobs.empty(); });
+            // The queued frames are still written when the writer is destroyed
+            if (_jobs.empty())
+                return;
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+        }
+        _progress.notify_all();
+
+        if (job.isImage)
+            writeImage(job);
+        else
+            writePositions(job);
+    }
+}
@@ -0,0 +1,143 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __FRAMEWRITER_H__
+#define __FRAMEWRITER_H__
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What the FrameExporter writes for every rendered frame. Empty strings disable the
+// respective output
+struct FrameExportSettings {
+    // The printf pattern of the numbered image files, for example "frame_%06d.png". The file
+    // format is chosen from the extension
+    std::string imagePattern;
+    // The command that receives the raw frames on its standard input, for example a video
+    // encoder. Each frame is width * height * 4 bytes in BGRA order, top row first
+    std::string pipeCommand;
+    // The printf pattern of the columnar particle position dumps, for example
+    // "positions_%06d.pcol"
+    std::string positionPattern;
+    // The number of threads that encode and write the frames
+    unsigned int numberOfThreads;
+};
+
+// The FrameWriter encodes and writes the frames read back by the FrameExporter on a pool of
+// threads, so that neither the encoding nor the disk stall the rendering. The images of
+// different frames are encoded in parallel, but the pipe receives the frames in their order.
+// Once more frames are queued than can be written in time, queueing a frame blocks instead of
+// dropping it, as every frame of an export is needed.
+// A position dump starts with a header (see framewriter.cpp) followed by the x, y, and z
+// coordinates of all particles as three separate arrays of floats, each aligned to 64 bytes
+class FrameWriter {
+public:
+    // Creates the writer for 'settings'; 'open' has to be called before frames are queued
+    explicit FrameWriter(const FrameExportSettings& settings);
+
+    // Writes all queued frames, closes the pipe and stops the threads
+    ~FrameWriter();
+
+    // The version of the position dumps that are written
+    static const unsigned int PositionVersion = 1;
+
+    // Starts the pipe command, if there is one, and the threads. Returns false if the pipe
+    // could not be started
+    bool open();
+
+    // Returns true if the rendered images are written
+    bool writesImages() const;
+
+    // Returns true if the particle positions are written
+    bool writesPositions() const;
+
+    // Queues the image of 'frame' with 'width' x 'height' pixels in BGRA order, bottom row
+    // first as they are read from OpenGL. The images have to be queued with the frames 0, 1,
+    // 2, and so on
+    void writeImage(size_t frame, int width, int height, std::vector<char> pixels);
+
+    // Queues the 'count' positions of 'frame' that are the first three floats of every
+    // 'stride' bytes of 'positions'
+    void writePositions(size_t frame, size_t count, size_t stride, std::vector<char> positions);
+
+private:
+    FrameWriter(const FrameWriter&) = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+
+    // A frame that is waiting to be written
+    struct Job {
+        // True for an image and false for positions
+        bool isImage;
+        size_t frame;
+        // The size of an image
+        int width;
+        int height;
+        // The number of positions and the distance between them in bytes
+        size_t count;
+        size_t stride;
+        // The pixels or the positions
+        std::vector<char> data;
+    };
+
+    // Queues 'job', waiting while too many jobs are queued already
+    void push(Job job);
+
+    // Encodes the image of 'job' into its file and sends it into the pipe
+    void writeImage(const Job& job);
+
+    // Writes the positions of 'job' into their file
+    void writePositions(const Job& job);
+
+    // The main function of each writer thread
+    void run();
+
+    // What is written
+    FrameExportSettings _settings;
+    // The standard input of the pipe command, or nullptr
+    std::FILE* _pipe;
+
+    // Guards all of the following members
+    std::mutex _mutex;
+    // Signaled when a job has been queued or the threads should quit
+    std::condition_variable _wakeUp;
+    // Signaled when a job has been taken from the queue or has been sent into the pipe
+    std::condition_variable _progress;
+    // The frames that have not been taken by a thread yet
+    std::deque<Job> _jobs;
+    // The frame that is sent into the pipe next. The threads take the images in order, so
+    // waiting for it never waits for an image that has not been taken yet
+    size_t _nextPipeFrame;
+    // Set when the threads should terminate
+    bool _quit;
+
+    // The threads that encode and write the frames
+    std::vector<std::thread> _threads;
+};
+
+#endif // __FRAMEWRITER_H__
@@ -0,0 +1,96 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "gputimer.h"
+
+#include <ghoul/logging/logging>
+
+namespace {
+    const std::string _loggerCat = "GpuTimer";
+}
+
+GpuTimer::GpuTimer()
+    : _current(0)
+    , _measuring(false)
+    , _isInitialized(false)
+{
+    for (int i = 0; i < NumberOfFrames; ++i) {
+        _queries[i][0] = 0;
+        _queries[i][1] = 0;
+        _pending[i] = false;
+    }
+}
+
+GpuTimer::~GpuTimer() {
+    if (_isInitialized)
+        glDeleteQueries(2 * NumberOfFrames, &_queries[0][0]);
+}
+
+bool GpuTimer::initialize() {
+    if (!GLEW_ARB_timer_query) {
+        LWARNING("Timestamp queries are not supported; GPU times will not be measured");
+        return false;
+    }
+    glGenQueries(2 * NumberOfFrames, &_queries[0][0]);
+    _isInitialized = true;
+    return true;
+}
+
+void GpuTimer::begin() {
+    // Skip this frame rather than waiting for the GPU if no measurement is free
+    _measuring = _isInitialized && !_pending[_current];
+    if (_measuring)
+        glQueryCounter(_queries[_current][0], GL_TIMESTAMP);
+}
+
+void GpuTimer::end() {
+    if (!_measuring)
+        return;
+    glQueryCounter(_queries[_current][1], GL_TIMESTAMP);
+    _pending[_current] = true;
+    _current = (_current + 1) % NumberOfFrames;
+    _measuring = false;
+}
+
+void GpuTimer::collect(Profiler& profiler, Profiler::Section section) {
+    // Go through the measurements from the oldest to the newest, as they finish in that order
+    for (int i = 0; i < NumberOfFrames; ++i) {
+        const int index = (_current + i) % NumberOfFrames;
+        if (!_pending[index])
+            continue;
+
+        // The end timestamp is written last, so if it is available, the start is as well
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(_queries[index][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available == GL_FALSE)
+            break;
+
+        GLuint64 start = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(_queries[index][0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(_queries[index][1], GL_QUERY_RESULT, &end);
+        _pending[index] = false;
+        // The timestamps are in nanoseconds
+        profiler.record(section, static_cast<float>(end - start) / 1000000.f);
+    }
+}
@@ -0,0 +1,76 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __GPUTIMER_H__
+#define __GPUTIMER_H__
+
+#include <ghoul/opengl/opengl>
+
+#include "profiler.h"
+
+// The GpuTimer measures how long the GPU takes for the commands between 'begin' and 'end' by
+// placing timestamp queries (ARB_timer_query) into the command stream. The results are only
+// read once the GPU reports them as available, which is usually a few frames later, so the
+// measurement never stalls the pipeline. The OpenGL context has to be current for all calls
+class GpuTimer {
+public:
+    // Creates a timer without any queries; 'initialize' has to be called with a current context
+    GpuTimer();
+
+    // Deletes the queries
+    ~GpuTimer();
+
+    // Creates the queries. Returns false if the driver does not support timestamp queries, in
+    // which case all other functions do nothing
+    bool initialize();
+
+    // Marks the start of the measured commands. If all queries are still waiting for their
+    // results, this frame is not measured
+    void begin();
+    // Marks the end of the measured commands
+    void end();
+
+    // Records the durations of all measurements whose results have become available as
+    // 'section' in 'profiler'
+    void collect(Profiler& profiler, Profiler::Section section);
+
+private:
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    // The number of measurements that can be in flight at the same time
+    static const int NumberOfFrames = 4;
+
+    // The start and end timestamp query of each measurement
+    GLuint _queries[NumberOfFrames][2];
+    // True for the measurements whose results have not been read yet
+    bool _pending[NumberOfFrames];
+    // The measurement that the next 'begin' uses
+    int _current;
+    // True between a 'begin' that placed a query and its 'end'
+    bool _measuring;
+    // True once the queries have been created
+    bool _isInitialized;
+};
+
+#endif // __GPUTIMER_H__
@@ -22,10 +22,13 @@
  *************************************************************************************************/
 
 #include "gui.h"
+#include "philox.h"
+#include "profiler.h"
 #include "renderer.h"
 
 #include "ghoul/logging/logmanager.h"
 #include <QCheckBox>
+#include <QComboBox>
 #include <QDoubleValidator>
 #include <QGridLayout>
 #include <QGLFormat>
@@ -37,8 +40,9 @@
 #include <QSignalMapper>
 #include <QSlider>
 #include <QTimer>
+#include <algorithm>
+#include <iterator>
 #include <string>
-#include <random>
 
 namespace {
     std::string _loggerCat = "GUI";
@@ -46,13 +50,35 @@ namespace {
     // The size of the render window inside the main widget
     const QSize _rendererSize = QSize(800, 600);
 
-    // Initialize the engine and the distribution of the random number generator
-    // Which random number generator is chosen is up to the implementation
-    std::default_random_engine _generator;
-    std::uniform_real_distribution<float> _distributionPosition(-1.f, 1.f);
+    // The random positions come from the same counter-based generator as the particles, so
+    // that the sequence is the same on every platform, which std::default_random_engine does
+    // not guarantee. The counter is the number of positions that were drawn so far
+    uint64_t _numberOfRandomPositions = 0;
+    // The second half of the Philox key that separates the positions from the emitter streams
+    const uint32_t _positionStream = 0x47554920;
+
+    // Returns the next random position in [-1, 1) along each axis
+    glm::vec3 randomPosition() {
+        uint32_t random[philox::NumberOfWords] = {
+            static_cast<uint32_t>(_numberOfRandomPositions),
+            static_cast<uint32_t>(_numberOfRandomPositions >> 32),
+            0,
+            0
+        };
+        philox::generate(random, 0, _positionStream);
+        ++_numberOfRandomPositions;
+        return glm::vec3(
+            -1.f + 2.f * philox::toUnitFloat(random[0]),
+            -1.f + 2.f * philox::toUnitFloat(random[1]),
+            -1.f + 2.f * philox::toUnitFloat(random[2])
+        );
+    }
+
+    // The time between two refreshes of the labels with the statistics (4 Hz)
+    const std::chrono::milliseconds _statsInterval(250);
 }
 
-GUI::GUI(QWidget* parent, Qt::WindowFlags f)
+GUI::GUI(FramePacer::Mode pacing, QWidget* parent, Qt::WindowFlags f)
     : QWidget(parent, f)
     , _layout(nullptr)
     , _renderer(nullptr)
@@ -72,12 +98,20 @@ GUI::GUI(QWidget* parent, Qt::WindowFlags f)
     , _effectLabel(nullptr)
     , _effectGravityButton(nullptr)
     , _effectWindButton(nullptr)
+    , _profilerLabel(nullptr)
     , _timer(nullptr)
+    , _framePacer(pacing)
     , _sourceAddedCallback([](SourceType, glm::vec3, float){}) // initialize function pointer with empty lambda expressions
     , _effectAddedCallback([](EffectType, glm::vec3, float){}) // initialize function pointer with empty lambda expressions
     , _updateCallback([](float){}) // initialize function pointer with empty lambda expressions
     , _removeAllCallback([](){}) // initialize function pointer with empty lambda expressions
+    , _snapshotCallback([](){}) // initialize function pointer with empty lambda expressions
+    , _profiler(nullptr)
+    , _stats(nullptr)
 {
+    for (uint64_t& counter : _refreshedCounters)
+        counter = 0;
+
     //   -----------------------------------------------------------
     //   |                                         |               |
     //   |                                         |    Source     | row 0
@@ -89,6 +123,7 @@ GUI::GUI(QWidget* parent, Qt::WindowFlags f)
     //   |                Renderer                 |---------------|
     //   |                                         |               |
     //   |                                         |   Removeall   | row 2
+    //   |                                         |   Snapshot    |
     //   |                                         |               |
     //   |                                         |---------------|
     //   |                                         |               |
@@ -110,14 +145,25 @@ GUI::GUI(QWidget* parent, Qt::WindowFlags f)
 
     QPushButton* removeAll = new QPushButton("Remove all");
     connect(removeAll, SIGNAL(clicked(bool)), this, SLOT(handleRemoveAll()));
-    _layout->addWidget(removeAll, 2, 1, 1, 1);
+    // Saves the current state, so that it can be restored with '--snapshot'
+    QPushButton* saveSnapshot = new QPushButton("Save snapshot");
+    connect(saveSnapshot, SIGNAL(clicked(bool)), this, SLOT(handleSaveSnapshot()));
+    QHBoxLayout* buttonLayout = new QHBoxLayout;
+    buttonLayout->addWidget(removeAll);
+    buttonLayout->addWidget(saveSnapshot);
+    _layout->addLayout(buttonLayout, 2, 1, 1, 1);
 
     createRenderingBox();
 
-    // Create the timer that will drive the rendering and update rate of 60Hz
+    // Create the timer that will drive the rendering. A timer without an interval fires
+    // whenever the event loop has no other events to process, so it never sleeps. With vsync,
+    // the buffer swap at the end of each rendering waits for the vertical blank, which paces
+    // the frames at the refresh rate of the display; otherwise they are rendered as fast as
+    // possible
     _timer = new QTimer(this);
     connect(_timer, SIGNAL(timeout()), this, SLOT(handleUpdate()));
-    _timer->start(16); // 16ms = 60Hz refresh rate
+    _timer->start(0);
+    _lastStatsRefresh = std::chrono::steady_clock::now();
 }
 
 void GUI::createRenderer() {
@@ -125,6 +171,8 @@ void GUI::createRenderer() {
     QGLFormat format(QGL::DoubleBuffer | QGL::DepthBuffer | QGL::Rgba);
     // Core profile ftw
     format.setProfile(QGLFormat::CoreProfile);
+    // Letting the swap wait for the vertical blank is what paces the render loop
+    format.setSwapInterval((_framePacer.mode() == FramePacer::Mode::VSync) ? 1 : 0);
 
     // Check if the computer supports at least OpenGL 4.0
     // The renderer is written for > 4.0, so this is a hard requirement
@@ -319,9 +367,34 @@ void GUI::createRenderingBox() {
     connect(limitCameraPosition, SIGNAL(toggled(bool)), _renderer, SLOT(limitCameraPosition(bool)));
     boxLayout->addWidget(limitCameraPosition);
 
+    // Allows comparing the point sprites and the instanced billboards on the same scene
+    QCheckBox* enableBillboards = new QCheckBox("Render particles as billboards");
+    enableBillboards->setChecked(false);
+    connect(enableBillboards, SIGNAL(toggled(bool)), _renderer, SLOT(showBillboardRendering(bool)));
+    boxLayout->addWidget(enableBillboards);
+
+    // Only draws the particles in the view frustum, fewer of them with increasing distance
+    QCheckBox* enableCulling = new QCheckBox("Cull invisible particles");
+    enableCulling->setChecked(true);
+    connect(enableCulling, SIGNAL(toggled(bool)), _renderer, SLOT(enableCulling(bool)));
+    boxLayout->addWidget(enableCulling);
+
+    // The entries are in the order of Renderer::BlendMode. Comparing the draw timings of the
+    // entries on the same scene shows what sorting and weighted blending cost
+    QComboBox* blendMode = new QComboBox;
+    blendMode->addItem("Unsorted blending");
+    blendMode->addItem("Sorted blending");
+    blendMode->addItem("Weighted blending (billboards)");
+    connect(blendMode, SIGNAL(currentIndexChanged(int)), _renderer, SLOT(setBlendMode(int)));
+    boxLayout->addWidget(blendMode);
+
     _numParticlesLabel = new QLabel("Number of Particles:\n");
     boxLayout->addWidget(_numParticlesLabel);
 
+    // The rolling median and 99th percentile of each measured section in milliseconds
+    _profilerLabel = new QLabel("");
+    boxLayout->addWidget(_profilerLabel);
+
     renderingBox->setLayout(boxLayout);
     _layout->addWidget(renderingBox, 3, 1, 1, 1, Qt::AlignBottom);
 }
@@ -343,17 +416,90 @@ void GUI::handleButtonPress() {
         LFATAL("Missing handler for button press");
 }
 void GUI::handleUpdate() {
-    const int interval = _timer->interval(); // in ms
-    _updateCallback(interval / 1000.f); // in s
+    // The previous rendering has just returned from its buffer swap, so this is when its frame
+    // was handed to the display
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    const float elapsed = _framePacer.frameSwapped(now);
+    if ((_profiler != nullptr) && (_framePacer.lastInterval() > 0.f))
+        _profiler->record(Profiler::Section::Frame, _framePacer.lastInterval() * 1000.f);
+    {
+        Profiler::ScopedTimer timer(_profiler, Profiler::Section::Update);
+        _updateCallback(elapsed); // in s
+    }
 
     // Update the data of the renderer after the update callback has returned
     _renderer->updateData();
-    // Update the label showing the amount of particles
-    _numParticlesLabel->setText(QString("Number of Particles:\n%1").arg(_renderer->numberOfParticles()));
+    // Formatting the labels costs more than reading the values, so they are only rewritten at
+    // a rate that can still be read
+    const std::chrono::duration<float> sinceRefresh = now - _lastStatsRefresh;
+    if (sinceRefresh >= _statsInterval) {
+        refreshStats(sinceRefresh.count());
+        _lastStatsRefresh = now;
+    }
     // Trigger a new rendering
     _renderer->updateGL();
 }
 
+void GUI::refreshStats(float elapsed) {
+    // Update the label showing the amount of particles and, if there is a channel, the rates
+    // since the last refresh. Only the totals are shown, so the cost does not depend on the
+    // number of emitters and effects
+    QString text = QString("Number of Particles:\n%1").arg(_renderer->numberOfParticles());
+    if (_stats != nullptr) {
+        uint64_t counters[StatsChannel::NumberOfCounters];
+        for (int i = 0; i < StatsChannel::NumberOfCounters; ++i)
+            counters[i] = _stats->value(static_cast<StatsChannel::Counter>(i));
+        const auto rate = [this, &counters, elapsed](StatsChannel::Counter counter) {
+            const int i = static_cast<int>(counter);
+            return (counters[i] - _refreshedCounters[i]) / elapsed;
+        };
+        const int effects = static_cast<int>(StatsChannel::Counter::EffectNanoseconds);
+        const int steps = static_cast<int>(StatsChannel::Counter::Steps);
+        const uint64_t newSteps = counters[steps] - _refreshedCounters[steps];
+        const float effectMilliseconds = (newSteps > 0) ?
+            (counters[effects] - _refreshedCounters[effects]) * 1e-6f / newSteps : 0.f;
+
+        text += QString("\nSpawned: %1/s\nExpired: %2/s\nUpload: %3 MB/s\n"
+            "Effects: %4 ms/step")
+            .arg(rate(StatsChannel::Counter::Spawned), 0, 'f', 0)
+            .arg(rate(StatsChannel::Counter::Expired), 0, 'f', 0)
+            .arg(rate(StatsChannel::Counter::UploadBytes) / (1024.f * 1024.f), 0, 'f', 1)
+            .arg(effectMilliseconds, 0, 'f', 2);
+        // Only a remote viewer receives a stream
+        const int streamBytes = static_cast<int>(StatsChannel::Counter::StreamBytes);
+        if (counters[streamBytes] > 0) {
+            const int latency = static_cast<int>(StatsChannel::Counter::StreamLatencyMicroseconds);
+            text += QString("\nStream: %1 MB/s, %2 ms")
+                .arg(rate(StatsChannel::Counter::StreamBytes) / (1024.f * 1024.f), 0, 'f', 1)
+                .arg(counters[latency] * 1e-3f, 0, 'f', 1);
+        }
+        std::copy(std::begin(counters), std::end(counters), std::begin(_refreshedCounters));
+    }
+    // The refresh rate is only estimated while the frames wait for the vertical blank
+    const float refreshPeriod = _framePacer.refreshPeriod();
+    if (refreshPeriod > 0.f) {
+        text += QString("\nDisplay: %1 Hz, %2 missed")
+            .arg(1.f / refreshPeriod, 0, 'f', 0)
+            .arg(static_cast<qulonglong>(_framePacer.numberOfMissedFrames()));
+    }
+    _numParticlesLabel->setText(text);
+
+    // Update the label showing the timings
+    if (_profiler != nullptr) {
+        QString timings("Timings (p50 / p99 ms):");
+        for (int i = 0; i < Profiler::NumberOfSections; ++i) {
+            const Profiler::Section section = static_cast<Profiler::Section>(i);
+            const Profiler::Statistics stats = _profiler->statistics(section);
+            if (stats.numberOfSamples == 0)
+                continue;
+            timings += QString("\n%1: %2 / %3")
+                .arg(QString::fromStdString(Profiler::name(section)))
+                .arg(stats.median, 0, 'f', 2).arg(stats.percentile99, 0, 'f', 2);
+        }
+        _profilerLabel->setText(timings);
+    }
+}
+
 void GUI::handleSourceSlider() {
     // Get the source slider value and set it as the text label
     const float t = sourceValue();
@@ -388,14 +534,14 @@ void GUI::handleRemoveAll() {
     _removeAllCallback();
 }
 
+void GUI::handleSaveSnapshot() {
+    _snapshotCallback();
+}
+
 glm::vec3 GUI::sourcePosition() const {
     const bool randomize = _sourcePositionRandomize->isChecked();
     if (randomize) {
-        // Generate three random number in the domain determined by _distribution
-        const float x = _distributionPosition(_generator);
-        const float y = _distributionPosition(_generator);
-        const float z = _distributionPosition(_generator);
-        return glm::vec3(x, y, z);
+        return randomPosition();
     }
     else {
         const float x = _sourcePositionXText->text().toFloat();
@@ -418,11 +564,7 @@ float GUI::sourceValue() const {
 glm::vec3 GUI::effectPosition() const {
     const bool randomize = _effectPositionRandomize->isChecked();
     if (randomize) {
-        // Generate three random number in the domain determined by _distribution
-        const float x = _distributionPosition(_generator);
-        const float y = _distributionPosition(_generator);
-        const float z = _distributionPosition(_generator);
-        return glm::vec3(x, y, z);
+        return randomPosition();
     }
     else {
         const float x = _effectPositionXText->text().toFloat();
@@ -442,9 +584,57 @@ float GUI::effectValue() const {
     return (static_cast<float>(currentValue) - minValue) / (maxValue - minValue);
 }
 
-void GUI::setData(std::vector<glm::vec3>* particleData) {
+void GUI::setData(PositionView particleData, size_t maximumNumberOfParticles) {
     // just forwarding the data to the renderer
-    _renderer->setData(particleData);
+    _renderer->setData(particleData, maximumNumberOfParticles);
+}
+
+void GUI::setSimulationBackend(SimulationBackend backend) {
+    _renderer->requestComputeSimulation(backend == SimulationBackend::GPU);
+}
+
+void GUI::setFrameExport(const FrameExportSettings& settings) {
+    _renderer->requestFrameExport(settings);
+}
+
+void GUI::setPositionQuantizer(const PositionQuantizer& quantizer) {
+    _renderer->requestQuantizedPositions(quantizer);
+}
+
+void GUI::setAttributes(AttributeView attributes, uint32_t channels, AttributeLayout layout,
+    bool benchmarkLayouts)
+{
+    _renderer->requestAttributes(attributes, channels, layout, benchmarkLayouts);
+}
+
+uint32_t GUI::attributeChannels() const {
+    return _renderer->attributeChannels();
+}
+
+ComputeSimulation* GUI::computeSimulation() {
+    return _renderer->computeSimulation();
+}
+
+const FramePacer& GUI::framePacer() const {
+    return _framePacer;
+}
+
+PositionSink* GUI::positionSink() {
+    return _renderer;
+}
+
+void GUI::setProfiler(Profiler* profiler) {
+    _profiler = profiler;
+    _renderer->setProfiler(profiler);
+}
+
+void GUI::setStatsChannel(StatsChannel* stats) {
+    _stats = stats;
+    _renderer->setStatsChannel(stats);
+    if (_stats != nullptr) {
+        for (int i = 0; i < StatsChannel::NumberOfCounters; ++i)
+            _refreshedCounters[i] = _stats->value(static_cast<StatsChannel::Counter>(i));
+    }
 }
 
 void GUI::setCallbacks(
@@ -458,3 +648,7 @@ void GUI::setCallbacks(
     _updateCallback = updateCallback;
     _removeAllCallback = removeAllCallback;
 }
+
+void GUI::setSnapshotCallback(std::function<void()> snapshotCallback) {
+    _snapshotCallback = snapshotCallback;
+}
@@ -24,11 +24,22 @@
 #ifndef __GUI_H__
 #define __GUI_H__
 
+#include "framepacer.h"
+#include "particleattributes.h"
+#include "positionview.h"
+#include "statschannel.h"
+
 #include <QWidget>
 #include <glm/glm.hpp>
+#include <chrono>
 #include <functional>
 
+class ComputeSimulation;
+class PositionQuantizer;
+class PositionSink;
+class Profiler;
 class Renderer;
+struct FrameExportSettings;
 class QCheckBox;
 class QGridLayout;
 class QLabel;
@@ -41,22 +52,68 @@ class QTimer;
 enum class EffectType { Gravity, Wind };
 // A strongly-typed enumeration of the possible sources that can be sent to the callback function
 enum class SourceType { Point, Cone };
+// A strongly-typed enumeration of where the particles are simulated
+enum class SimulationBackend { CPU, GPU };
 
 class GUI : public QWidget {
 Q_OBJECT
 public:
     // The constructor will create create and layout all of the subwidgets and initialize them, as
-    // well as starting the timer that will trigger the update callbacks and the rendering
-    GUI(QWidget* parent = 0, Qt::WindowFlags f = 0);
+    // well as starting the render loop that will trigger the update callbacks and the rendering.
+    // 'pacing' determines whether the buffer swaps wait for the vertical blank
+    GUI(FramePacer::Mode pacing = FramePacer::Mode::VSync, QWidget* parent = 0,
+        Qt::WindowFlags f = 0);
+
+    // Pass a view onto the data that should be used for rendering the particles. Each element in
+    // the view is one particle at a specific position. The data is not copied.
+    // 'maximumNumberOfParticles' is the highest number of particles the view will ever contain
+    void setData(PositionView particleData, size_t maximumNumberOfParticles);
+
+    // Selects where the particles should be simulated. Has to be called before the GUI is shown.
+    // If the GPU backend is not supported, the CPU backend is used instead
+    void setSimulationBackend(SimulationBackend backend);
+
+    // Exports every rendered frame as selected by 'settings'. Has to be called before the GUI
+    // is shown
+    void setFrameExport(const FrameExportSettings& settings);
+
+    // Lets the renderer receive the positions quantized by 'quantizer'. Has to be called
+    // before the GUI is shown
+    void setPositionQuantizer(const PositionQuantizer& quantizer);
+
+    // Streams the attribute 'channels' of 'attributes', which accompany the data of 'setData',
+    // to the shaders in 'layout'; if 'benchmarkLayouts' is true, the faster layout is picked
+    // after measuring both. Has to be called before the GUI is shown
+    void setAttributes(AttributeView attributes, uint32_t channels, AttributeLayout layout,
+        bool benchmarkLayouts);
+
+    // Returns the attribute channels that the renderer streams out of those of 'setAttributes'.
+    // Only known once the OpenGL context has been initialized
+    uint32_t attributeChannels() const;
 
-    // Pass a pointer to the data that should be used for rendering the particles. Each element in
-    // the vector is one particle at a specific position
-    void setData(std::vector<glm::vec3>* particleData);
+    // Returns the GPU simulation if it is in use, or nullptr if the CPU backend is used
+    ComputeSimulation* computeSimulation();
+
+    // Returns the pacer that measures the frames and knows the budget of the next one
+    const FramePacer& framePacer() const;
+
+    // Returns the sink through which the simulation can write positions directly into the
+    // renderer's buffers without going through the data passed in 'setData'
+    PositionSink* positionSink();
+
+    // Sets the profiler whose statistics are shown in the rendering box and in which the update,
+    // upload, and draw times are recorded. Pass a nullptr to disable the profiling
+    void setProfiler(Profiler* profiler);
+
+    // Sets the channel whose counters are shown in the rendering box and in which the renderer
+    // publishes its uploads. Pass a nullptr to only show the number of rendered particles
+    void setStatsChannel(StatsChannel* stats);
 
     // Pass functions into these callbacks that will be called whenever the appropriate action
     // happens. 'sourceAddedCallback' will be called when one of the source buttons has been
     // pressed, 'effectAddedCallback' will be called when one of the effect buttons has been
-    // pressed, and 'updateCallback' is called whenever the timer signals an update
+    // pressed, and 'updateCallback' is called whenever the timer signals an update with the real
+    // time in seconds that has passed since the last update
     void setCallbacks(
         std::function<void(SourceType, glm::vec3, float)> sourceAddedCallback,
         std::function<void(EffectType, glm::vec3, float)> effectAddedCallback,
@@ -64,10 +121,14 @@ public:
         std::function<void()> removeAllCallback
         );
 
+    // Pass a function that will be called when the button for saving a snapshot is pressed
+    void setSnapshotCallback(std::function<void()> snapshotCallback);
+
 private slots:
     // This slot will be called when any of the buttons in the interface is pressed
     void handleButtonPress();
-    // This slot is activated by the timer and will call the update callback and trigger a rendering
+    // This slot is activated by the render loop and will call the update callback and trigger a
+    // rendering
     void handleUpdate();
     // This slot handles the connection between source slider and source label value
     void handleSourceSlider();
@@ -79,6 +140,8 @@ private slots:
     void handleEffectRandomize();
     // This slot handles when the removeAll button has been pressed
     void handleRemoveAll();
+    // This slot handles when the snapshot button has been pressed
+    void handleSaveSnapshot();
 
 private:
     // Creates the renderer window with the correct OpenGL parameters
@@ -98,6 +161,10 @@ private:
     glm::vec3 effectPosition() const;
     // Returns the current value of the effect slider in the domain [0,1]
     float effectValue() const;
+
+    // Rewrites the labels of the rendering box; 'elapsed' seconds have passed since the last
+    // time
+    void refreshStats(float elapsed);
     
     // The main layout of the whole widget
     QGridLayout* _layout;
@@ -127,15 +194,29 @@ private:
 
     // Widgets for the rendering feedback
     QLabel* _numParticlesLabel;
+    QLabel* _profilerLabel;
 
-    // The timer that will trigger updates and renderings
+    // The timer that will trigger updates and renderings whenever the event loop is idle
     QTimer* _timer;
+    // Measures the time between the buffer swaps that the updates advance by
+    FramePacer _framePacer;
+    // The time the labels were last rewritten; they are refreshed far less often than the
+    // frames are rendered
+    std::chrono::steady_clock::time_point _lastStatsRefresh;
 
     // Callback functions
     std::function<void(SourceType, glm::vec3, float)> _sourceAddedCallback;
     std::function<void(EffectType, glm::vec3, float)> _effectAddedCallback;
     std::function<void(float)> _updateCallback;
     std::function<void()> _removeAllCallback;
+    std::function<void()> _snapshotCallback;
+
+    // The statistics that are shown in _profilerLabel, or nullptr
+    Profiler* _profiler;
+    // The counters that are shown in _numParticlesLabel, or nullptr
+    StatsChannel* _stats;
+    // The counters at the last refresh, to show their rates
+    uint64_t _refreshedCounters[StatsChannel::NumberOfCounters];
 };
 
 #endif // __GUI_H__
\ No newline at end of file
@@ -0,0 +1,485 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "integrator.h"
+
+#include "particlestore.h"
+
+#include <cassert>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define INTEGRATOR_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define INTEGRATOR_NEON
+#include <arm_neon.h>
+#endif
+
+// GCC and Clang only emit vector instructions that are enabled for the translation unit. Instead
+// of compiling the whole program for AVX2 (which would then crash on older CPUs), only the
+// kernels are compiled for their instruction set and the right one is picked at runtime
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE4 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define TARGET_SSE4
+#define TARGET_AVX2
+#endif
+
+// The kernels treat the position and velocity arrays as flat float arrays
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "glm::vec3 must be tightly packed");
+
+namespace {
+    // Each batch of particles has 3 floats per particle in the position and velocity arrays. As
+    // the acceleration and the box are (x,y,z)-periodic, a vector register starting at float i
+    // of the batch has to contain their components in the order i%3, (i+1)%3, ... This fills
+    // 'pattern' with 'n' floats of that sequence of 'value' starting at component 'first'
+    void componentPattern(float* pattern, int n, int first, const glm::vec3& value) {
+        for (int i = 0; i < n; ++i)
+            pattern[i] = value[(first + i) % 3];
+    }
+
+    void integrateScalar(float* positions, float* velocities, float* ages, float* exported,
+        size_t count, const glm::vec3& acceleration, float deltaT, float exportOffset,
+        const glm::vec3* box, uint8_t* outside)
+    {
+        glm::vec3* p = reinterpret_cast<glm::vec3*>(positions);
+        glm::vec3* v = reinterpret_cast<glm::vec3*>(velocities);
+        const glm::vec3 deltaV = acceleration * deltaT;
+        for (size_t i = 0; i < count; ++i) {
+            v[i] += deltaV;
+            p[i] += v[i] * deltaT;
+        }
+        if (exported != nullptr) {
+            glm::vec3* e = reinterpret_cast<glm::vec3*>(exported);
+            for (size_t i = 0; i < count; ++i)
+                e[i] = p[i] + v[i] * exportOffset;
+        }
+        for (size_t i = 0; i < count; ++i)
+            ages[i] += deltaT;
+        if (outside != nullptr) {
+            for (size_t i = 0; i < (count + 3) / 4; ++i)
+                outside[i] = 0;
+            for (size_t i = 0; i < count; ++i) {
+                const bool isOutside = (p[i].x < box[0].x) || (p[i].y < box[0].y) ||
+                    (p[i].z < box[0].z) || (p[i].x > box[1].x) || (p[i].y > box[1].y) ||
+                    (p[i].z > box[1].z);
+                outside[i / 4] |= isOutside ? 1 : 0;
+            }
+        }
+    }
+
+#ifdef INTEGRATOR_X86
+    // Returns the lanes of 'p' that are below 'lower' or above 'upper'
+    TARGET_SSE4
+    inline __m128 outside4(__m128 p, __m128 lower, __m128 upper) {
+        return _mm_or_ps(_mm_cmplt_ps(p, lower), _mm_cmpgt_ps(p, upper));
+    }
+
+    TARGET_AVX2
+    inline __m256 outside8(__m256 p, __m256 lower, __m256 upper) {
+        return _mm256_or_ps(_mm256_cmp_ps(p, lower, _CMP_LT_OQ),
+            _mm256_cmp_ps(p, upper, _CMP_GT_OQ));
+    }
+
+    TARGET_SSE4
+    void integrateSSE4(float* positions, float* velocities, float* ages, float* exported,
+        size_t count, const glm::vec3& acceleration, float deltaT, float exportOffset,
+        const glm::vec3* box, uint8_t* outside)
+    {
+        // 4 particles are 12 floats, that is 3 registers for the positions and velocities each
+        float pattern[12];
+        componentPattern(pattern, 12, 0, acceleration * deltaT);
+        const __m128 dv0 = _mm_loadu_ps(pattern);
+        const __m128 dv1 = _mm_loadu_ps(pattern + 4);
+        const __m128 dv2 = _mm_loadu_ps(pattern + 8);
+        const __m128 dt = _mm_set1_ps(deltaT);
+        const __m128 offset = _mm_set1_ps(exportOffset);
+        __m128 lower[3];
+        __m128 upper[3];
+        if (outside != nullptr) {
+            float lowerPattern[12];
+            float upperPattern[12];
+            componentPattern(lowerPattern, 12, 0, box[0]);
+            componentPattern(upperPattern, 12, 0, box[1]);
+            for (int i = 0; i < 3; ++i) {
+                lower[i] = _mm_loadu_ps(lowerPattern + 4 * i);
+                upper[i] = _mm_loadu_ps(upperPattern + 4 * i);
+            }
+        }
+
+        const size_t batches = count / 4;
+        for (size_t b = 0; b < batches; ++b) {
+            float* p = positions + b * 12;
+            float* v = velocities + b * 12;
+
+            const __m128 v0 = _mm_add_ps(_mm_loadu_ps(v), dv0);
+            const __m128 v1 = _mm_add_ps(_mm_loadu_ps(v + 4), dv1);
+            const __m128 v2 = _mm_add_ps(_mm_loadu_ps(v + 8), dv2);
+            _mm_storeu_ps(v, v0);
+            _mm_storeu_ps(v + 4, v1);
+            _mm_storeu_ps(v + 8, v2);
+
+            const __m128 p0 = _mm_add_ps(_mm_loadu_ps(p), _mm_mul_ps(v0, dt));
+            const __m128 p1 = _mm_add_ps(_mm_loadu_ps(p + 4), _mm_mul_ps(v1, dt));
+            const __m128 p2 = _mm_add_ps(_mm_loadu_ps(p + 8), _mm_mul_ps(v2, dt));
+            _mm_storeu_ps(p, p0);
+            _mm_storeu_ps(p + 4, p1);
+            _mm_storeu_ps(p + 8, p2);
+            if (exported != nullptr) {
+                float* e = exported + b * 12;
+                _mm_storeu_ps(e, _mm_add_ps(p0, _mm_mul_ps(v0, offset)));
+                _mm_storeu_ps(e + 4, _mm_add_ps(p1, _mm_mul_ps(v1, offset)));
+                _mm_storeu_ps(e + 8, _mm_add_ps(p2, _mm_mul_ps(v2, offset)));
+            }
+            if (outside != nullptr) {
+                const __m128 out = _mm_or_ps(_mm_or_ps(outside4(p0, lower[0], upper[0]),
+                    outside4(p1, lower[1], upper[1])), outside4(p2, lower[2], upper[2]));
+                outside[b] = (_mm_movemask_ps(out) != 0) ? 1 : 0;
+            }
+
+            float* a = ages + b * 4;
+            _mm_storeu_ps(a, _mm_add_ps(_mm_loadu_ps(a), dt));
+        }
+
+        // The remaining particles that don't fill a whole batch
+        const size_t done = batches * 4;
+        float* exportedRest = (exported != nullptr) ? exported + done * 3 : nullptr;
+        uint8_t* outsideRest = (outside != nullptr) ? outside + batches : nullptr;
+        integrateScalar(positions + done * 3, velocities + done * 3, ages + done, exportedRest,
+            count - done, acceleration, deltaT, exportOffset, box, outsideRest);
+    }
+
+    TARGET_AVX2
+    void integrateAVX2(float* positions, float* velocities, float* ages, float* exported,
+        size_t count, const glm::vec3& acceleration, float deltaT, float exportOffset,
+        const glm::vec3* box, uint8_t* outside)
+    {
+        // 8 particles are 24 floats, that is 3 registers for the positions and velocities each
+        float pattern[24];
+        componentPattern(pattern, 24, 0, acceleration * deltaT);
+        const __m256 dv0 = _mm256_loadu_ps(pattern);
+        const __m256 dv1 = _mm256_loadu_ps(pattern + 8);
+        const __m256 dv2 = _mm256_loadu_ps(pattern + 16);
+        const __m256 dt = _mm256_set1_ps(deltaT);
+        const __m256 offset = _mm256_set1_ps(exportOffset);
+        __m256 lower[3];
+        __m256 upper[3];
+        if (outside != nullptr) {
+            float lowerPattern[24];
+            float upperPattern[24];
+            componentPattern(lowerPattern, 24, 0, box[0]);
+            componentPattern(upperPattern, 24, 0, box[1]);
+            for (int i = 0; i < 3; ++i) {
+                lower[i] = _mm256_loadu_ps(lowerPattern + 8 * i);
+                upper[i] = _mm256_loadu_ps(upperPattern + 8 * i);
+            }
+        }
+
+        const size_t batches = count / 8;
+        for (size_t b = 0; b < batches; ++b) {
+            float* p = positions + b * 24;
+            float* v = velocities + b * 24;
+
+            const __m256 v0 = _mm256_add_ps(_mm256_loadu_ps(v), dv0);
+            const __m256 v1 = _mm256_add_ps(_mm256_loadu_ps(v + 8), dv1);
+            const __m256 v2 = _mm256_add_ps(_mm256_loadu_ps(v + 16), dv2);
+            _mm256_storeu_ps(v, v0);
+            _mm256_storeu_ps(v + 8, v1);
+            _mm256_storeu_ps(v + 16, v2);
+
+            const __m256 p0 = _mm256_fmadd_ps(v0, dt, _mm256_loadu_ps(p));
+            const __m256 p1 = _mm256_fmadd_ps(v1, dt, _mm256_loadu_ps(p + 8));
+            const __m256 p2 = _mm256_fmadd_ps(v2, dt, _mm256_loadu_ps(p + 16));
+            _mm256_storeu_ps(p, p0);
+            _mm256_storeu_ps(p + 8, p1);
+            _mm256_storeu_ps(p + 16, p2);
+            if (exported != nullptr) {
+                float* e = exported + b * 24;
+                _mm256_storeu_ps(e, _mm256_fmadd_ps(v0, offset, p0));
+                _mm256_storeu_ps(e + 8, _mm256_fmadd_ps(v1, offset, p1));
+                _mm256_storeu_ps(e + 16, _mm256_fmadd_ps(v2, offset, p2));
+            }
+            if (outside != nullptr) {
+                const int m0 = _mm256_movemask_ps(outside8(p0, lower[0], upper[0]));
+                const int m1 = _mm256_movemask_ps(outside8(p1, lower[1], upper[1]));
+                const int m2 = _mm256_movemask_ps(outside8(p2, lower[2], upper[2]));
+                // The first 4 particles are the floats 0 to 11, the others 12 to 23
+                outside[2 * b] = ((m0 | (m1 & 0x0F)) != 0) ? 1 : 0;
+                outside[2 * b + 1] = (((m1 & 0xF0) | m2) != 0) ? 1 : 0;
+            }
+
+            float* a = ages + b * 8;
+            _mm256_storeu_ps(a, _mm256_add_ps(_mm256_loadu_ps(a), dt));
+        }
+
+        // The remaining particles that don't fill a whole batch
+        const size_t done = batches * 8;
+        float* exportedRest = (exported != nullptr) ? exported + done * 3 : nullptr;
+        uint8_t* outsideRest = (outside != nullptr) ? outside + 2 * batches : nullptr;
+        integrateScalar(positions + done * 3, velocities + done * 3, ages + done, exportedRest,
+            count - done, acceleration, deltaT, exportOffset, box, outsideRest);
+    }
+
+    // Executes CPUID with the 'leaf' and 'subleaf' and stores eax, ebx, ecx, edx in 'regs'
+    void cpuid(int leaf, int subleaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+        int r[4];
+        __cpuidex(r, leaf, subleaf);
+        for (int i = 0; i < 4; ++i)
+            regs[i] = static_cast<unsigned int>(r[i]);
+#else
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    // Returns true if the operating system saves the AVX registers on a context switch
+    bool osSupportsAVX() {
+        unsigned int regs[4];
+        cpuid(1, 0, regs);
+        const bool osxsave = (regs[2] & (1u << 27)) != 0;
+        if (!osxsave)
+            return false;
+#ifdef _MSC_VER
+        const unsigned long long xcr0 = _xgetbv(0);
+#else
+        unsigned int eax, edx;
+        __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        const unsigned long long xcr0 = (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+        // Both the SSE (bit 1) and AVX (bit 2) state have to be enabled
+        return (xcr0 & 0x6) == 0x6;
+    }
+
+    bool cpuSupportsSSE4() {
+        unsigned int regs[4];
+        cpuid(1, 0, regs);
+        return (regs[2] & (1u << 19)) != 0; // SSE4.1
+    }
+
+    bool cpuSupportsAVX2() {
+        unsigned int regs[4];
+        cpuid(0, 0, regs);
+        if (regs[0] < 7)
+            return false;
+
+        cpuid(1, 0, regs);
+        const bool fma = (regs[2] & (1u << 12)) != 0;
+        const bool avx = (regs[2] & (1u << 28)) != 0;
+        cpuid(7, 0, regs);
+        const bool avx2 = (regs[1] & (1u << 5)) != 0;
+        return fma && avx && avx2 && osSupportsAVX();
+    }
+#endif // INTEGRATOR_X86
+
+#ifdef INTEGRATOR_NEON
+    // Returns the lanes of 'p' that are below 'lower' or above 'upper'
+    inline uint32x4_t outside4(float32x4_t p, float32x4_t lower, float32x4_t upper) {
+        return vorrq_u32(vcltq_f32(p, lower), vcgtq_f32(p, upper));
+    }
+
+    void integrateNEON(float* positions, float* velocities, float* ages, float* exported,
+        size_t count, const glm::vec3& acceleration, float deltaT, float exportOffset,
+        const glm::vec3* box, uint8_t* outside)
+    {
+        // 4 particles are 12 floats, that is 3 registers for the positions and velocities each
+        float pattern[12];
+        componentPattern(pattern, 12, 0, acceleration * deltaT);
+        const float32x4_t dv0 = vld1q_f32(pattern);
+        const float32x4_t dv1 = vld1q_f32(pattern + 4);
+        const float32x4_t dv2 = vld1q_f32(pattern + 8);
+        const float32x4_t dt = vdupq_n_f32(deltaT);
+        const float32x4_t offset = vdupq_n_f32(exportOffset);
+        float32x4_t lower[3];
+        float32x4_t upper[3];
+        if (outside != nullptr) {
+            float lowerPattern[12];
+            float upperPattern[12];
+            componentPattern(lowerPattern, 12, 0, box[0]);
+            componentPattern(upperPattern, 12, 0, box[1]);
+            for (int i = 0; i < 3; ++i) {
+                lower[i] = vld1q_f32(lowerPattern + 4 * i);
+                upper[i] = vld1q_f32(upperPattern + 4 * i);
+            }
+        }
+
+        const size_t batches = count / 4;
+        for (size_t b = 0; b < batches; ++b) {
+            float* p = positions + b * 12;
+            float* v = velocities + b * 12;
+
+            const float32x4_t v0 = vaddq_f32(vld1q_f32(v), dv0);
+            const float32x4_t v1 = vaddq_f32(vld1q_f32(v + 4), dv1);
+            const float32x4_t v2 = vaddq_f32(vld1q_f32(v + 8), dv2);
+            vst1q_f32(v, v0);
+            vst1q_f32(v + 4, v1);
+            vst1q_f32(v + 8, v2);
+
+            const float32x4_t p0 = vmlaq_f32(vld1q_f32(p), v0, dt);
+            const float32x4_t p1 = vmlaq_f32(vld1q_f32(p + 4), v1, dt);
+            const float32x4_t p2 = vmlaq_f32(vld1q_f32(p + 8), v2, dt);
+            vst1q_f32(p, p0);
+            vst1q_f32(p + 4, p1);
+            vst1q_f32(p + 8, p2);
+            if (exported != nullptr) {
+                float* e = exported + b * 12;
+                vst1q_f32(e, vmlaq_f32(p0, v0, offset));
+                vst1q_f32(e + 4, vmlaq_f32(p1, v1, offset));
+                vst1q_f32(e + 8, vmlaq_f32(p2, v2, offset));
+            }
+            if (outside != nullptr) {
+                const uint32x4_t out = vorrq_u32(vorrq_u32(outside4(p0, lower[0], upper[0]),
+                    outside4(p1, lower[1], upper[1])), outside4(p2, lower[2], upper[2]));
+                const uint32x2_t folded = vorr_u32(vget_low_u32(out), vget_high_u32(out));
+                outside[b] = ((vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1)) != 0) ? 1 : 0;
+            }
+
+            float* a = ages + b * 4;
+            vst1q_f32(a, vaddq_f32(vld1q_f32(a), dt));
+        }
+
+        // The remaining particles that don't fill a whole batch
+        const size_t done = batches * 4;
+        float* exportedRest = (exported != nullptr) ? exported + done * 3 : nullptr;
+        uint8_t* outsideRest = (outside != nullptr) ? outside + batches : nullptr;
+        integrateScalar(positions + done * 3, velocities + done * 3, ages + done, exportedRest,
+            count - done, acceleration, deltaT, exportOffset, box, outsideRest);
+    }
+#endif // INTEGRATOR_NEON
+}
+
+Integrator::Integrator()
+    : _kernel(Kernel::Scalar)
+    , _function(integrateScalar)
+{
+    // Try the kernels from the fastest to the slowest
+    if (!setKernel(Kernel::AVX2) && !setKernel(Kernel::NEON))
+        setKernel(Kernel::SSE4);
+}
+
+Integrator::Kernel Integrator::kernel() const {
+    return _kernel;
+}
+
+bool Integrator::setKernel(Kernel kernel) {
+    if (!isSupported(kernel))
+        return false;
+
+    _kernel = kernel;
+    _function = function(kernel);
+    return true;
+}
+
+bool Integrator::isSupported(Kernel kernel) {
+    switch (kernel) {
+    case Kernel::Scalar:
+        return true;
+#ifdef INTEGRATOR_X86
+    case Kernel::SSE4:
+        return cpuSupportsSSE4();
+    case Kernel::AVX2:
+        return cpuSupportsAVX2();
+#endif
+#ifdef INTEGRATOR_NEON
+    case Kernel::NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+std::string Integrator::name(Kernel kernel) {
+    switch (kernel) {
+    case Kernel::Scalar:
+        return "Scalar";
+    case Kernel::SSE4:
+        return "SSE4";
+    case Kernel::AVX2:
+        return "AVX2";
+    case Kernel::NEON:
+        return "NEON";
+    default:
+        return "Unknown";
+    }
+}
+
+Integrator::KernelFunction Integrator::function(Kernel kernel) {
+    switch (kernel) {
+#ifdef INTEGRATOR_X86
+    case Kernel::SSE4:
+        return integrateSSE4;
+    case Kernel::AVX2:
+        return integrateAVX2;
+#endif
+#ifdef INTEGRATOR_NEON
+    case Kernel::NEON:
+        return integrateNEON;
+#endif
+    default:
+        return integrateScalar;
+    }
+}
+
+void Integrator::integrate(ParticleStore& store, size_t begin, size_t end,
+    const glm::vec3& acceleration, float deltaT, glm::vec3* exportPositions,
+    float exportOffset) const
+{
+    run(store, begin, end, acceleration, deltaT, exportPositions, exportOffset, nullptr,
+        nullptr);
+}
+
+void Integrator::integrate(ParticleStore& store, size_t begin, size_t end,
+    const glm::vec3& acceleration, float deltaT, glm::vec3* exportPositions,
+    float exportOffset, const glm::vec3& minimum, const glm::vec3& maximum,
+    uint8_t* outside) const
+{
+    assert(outside != nullptr);
+    const glm::vec3 box[2] = { minimum, maximum };
+    run(store, begin, end, acceleration, deltaT, exportPositions, exportOffset, box, outside);
+}
+
+void Integrator::run(ParticleStore& store, size_t begin, size_t end,
+    const glm::vec3& acceleration, float deltaT, glm::vec3* exportPositions,
+    float exportOffset, const glm::vec3* box, uint8_t* outside) const
+{
+    assert(begin <= end);
+    assert(end <= store.size());
+
+    // glm::vec3 is three tightly packed floats, so the position and velocity arrays can be
+    // treated as flat float arrays by the kernels
+    float* positions = reinterpret_cast<float*>(store.positions() + begin);
+    float* velocities = reinterpret_cast<float*>(store.velocities() + begin);
+    float* ages = store.ages() + begin;
+    float* exported = (exportPositions != nullptr) ?
+        reinterpret_cast<float*>(exportPositions + begin) : nullptr;
+    _function(positions, velocities, ages, exported, end - begin, acceleration, deltaT,
+        exportOffset, box, outside);
+}
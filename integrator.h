@@ -0,0 +1,105 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __INTEGRATOR_H__
+#define __INTEGRATOR_H__
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class ParticleStore;
+
+// The Integrator advances the particles of a ParticleStore by one timestep using semi-implicit
+// Euler integration. The work is done by one of several kernels that process a batch of
+// particles at once with the vector instructions of the CPU. On construction, the fastest kernel
+// that is supported by the CPU the program is running on is chosen with CPUID
+class Integrator {
+public:
+    // The available implementations of the integration
+    enum class Kernel {
+        Scalar, // Plain C++, always available
+        SSE4,   // 4 particles per iteration using 128 bit registers
+        AVX2,   // 8 particles per iteration using 256 bit registers and FMA
+        NEON    // 4 particles per iteration on ARM
+    };
+
+    // Detects the instruction sets of the CPU and selects the fastest available kernel
+    Integrator();
+
+    // Returns the kernel that is currently in use
+    Kernel kernel() const;
+
+    // Forces the use of 'kernel'. Returns false, and leaves the current kernel unchanged, if the
+    // CPU does not support it
+    bool setKernel(Kernel kernel);
+
+    // Returns true if 'kernel' can be used on this CPU
+    static bool isSupported(Kernel kernel);
+
+    // Returns a human readable name for 'kernel'
+    static std::string name(Kernel kernel);
+
+    // Advances the particles [begin, end) of 'store' by 'deltaT' seconds. The velocity is changed
+    // by the constant 'acceleration', the position by the new velocity and the age by 'deltaT'.
+    // If 'exportPositions' is not a nullptr, the new positions are also written to the same
+    // indices of that array in the same pass, which saves a separate copy for the renderer. The
+    // exported positions are moved along the new velocity by 'exportOffset' seconds
+    void integrate(ParticleStore& store, size_t begin, size_t end,
+        const glm::vec3& acceleration, float deltaT, glm::vec3* exportPositions = nullptr,
+        float exportOffset = 0.f) const;
+
+    // Like the other 'integrate', but also tests the new positions against the box from
+    // 'minimum' to 'maximum' in the same pass, while they are still in the registers.
+    // outside[i] becomes 1 if any of the particles begin + 4i to begin + 4i + 3 is outside of
+    // the box, and 0 otherwise. 'outside' needs room for (end - begin + 3) / 4 values
+    void integrate(ParticleStore& store, size_t begin, size_t end,
+        const glm::vec3& acceleration, float deltaT, glm::vec3* exportPositions,
+        float exportOffset, const glm::vec3& minimum, const glm::vec3& maximum,
+        uint8_t* outside) const;
+
+private:
+    // The signature of each kernel. 'positions', 'velocities' and 'exported' point to 3 * 'count'
+    // floats, 'ages' to 'count' floats. 'exported' may be a nullptr. If 'outside' is not a
+    // nullptr, the flags of the batches of 4 particles are written into it for the box from
+    // box[0] to box[1]
+    typedef void (*KernelFunction)(float* positions, float* velocities, float* ages,
+        float* exported, size_t count, const glm::vec3& acceleration, float deltaT,
+        float exportOffset, const glm::vec3* box, uint8_t* outside);
+
+    // Runs the selected kernel on the particles [begin, end) of 'store'
+    void run(ParticleStore& store, size_t begin, size_t end, const glm::vec3& acceleration,
+        float deltaT, glm::vec3* exportPositions, float exportOffset, const glm::vec3* box,
+        uint8_t* outside) const;
+
+    // Returns the function implementing 'kernel'
+    static KernelFunction function(Kernel kernel);
+
+    // The kernel that is currently selected
+    Kernel _kernel;
+    // The function belonging to _kernel
+    KernelFunction _function;
+};
+
+#endif // __INTEGRATOR_H__
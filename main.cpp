@@ -28,8 +28,24 @@
 #include <QApplication>
 #include <ghoul/filesystem/filesystem>
 #include <ghoul/logging/logging>
+#include <cstdlib>
+#include <string>
 
+#include "callbackrecorder.h"
+#include "computesimulation.h"
+#include "emittersystem.h"
+#include "fixedtimestep.h"
+#include "framewriter.h"
 #include "gui.h"
+#include "particlestore.h"
+#include "profiler.h"
+#include "simulation.h"
+#include "simulationscheduler.h"
+#include "snapshot.h"
+#include "snapshotwriter.h"
+#include "statschannel.h"
+#include "streamclient.h"
+#include "threadpool.h"
 
 using namespace ghoul::filesystem;
 using namespace ghoul::logging;
@@ -37,44 +53,237 @@ using namespace ghoul::logging;
 namespace {
     const std::string _loggerCat = "ParticleSystem";
 
-    // This vector should contain the positions of the particles at the end of the update callback
-    std::vector<glm::vec3> _particleData;
+    // The maximum number of particles that can exist at the same time
+    const size_t _maximumNumberOfParticles = 5000000;
+
+    // Collects the durations of the subsystems for the statistics in the GUI
+    Profiler* _profiler = nullptr;
+
+    // The counters that the simulation and the renderer publish and the GUI shows
+    StatsChannel* _stats = nullptr;
+
+    // The worker threads that the simulation splits its particle range across
+    ThreadPool* _threadPool = nullptr;
+
+    // The complete state of the CPU simulation. Not created for the GPU simulation, unless that
+    // turns out not to be available
+    Simulation* _simulation = nullptr;
+
+    // Runs the simulation on its own thread one step ahead of the renderer. Its front buffer is
+    // handed to the renderer and contains the positions of the most recently collected step
+    SimulationScheduler* _scheduler = nullptr;
+
+    // The GUI, which owns the GPU simulation if that backend is used
+    GUI* _gui = nullptr;
+
+    // Writes the snapshots of the CPU simulation in the background
+    SnapshotWriter* _snapshotWriter = nullptr;
+    // Records the changes to the CPU simulation if '--record' is given. Only used on the
+    // simulation thread while the scheduler is running
+    CallbackRecorder* _recorder = nullptr;
+
+    // Receives the positions from a ParticleServer if '--connect' is given, in which case there
+    // is no local simulation and all changes are sent to the server
+    StreamClient* _streamClient = nullptr;
+    // The number of seconds to wait for the server to accept the connection
+    const int _connectTimeout = 10;
+
+    // The number of particles per second that a source emits if its slider is at the maximum
+    const float _maximumEmissionRate = 1000000.f;
+
+    // The acceleration in units per second squared of an effect if its slider is at the maximum
+    const float _maximumEffectStrength = 10.f;
+
+    // The sources that feed the GPU simulation. They spawn into '_gpuSpawnStaging', which is
+    // then handed to the GPU simulation as a whole
+    EmitterSystem* _gpuEmitters = nullptr;
+    ParticleStore* _gpuSpawnStaging = nullptr;
+    // The number of particles the GPU simulation is able to spawn per step
+    const size_t _gpuSpawnCapacity = 256 * 1024;
+    // Divides the real time into the steps of the GPU simulation. The CPU simulation uses the
+    // timestep of the scheduler instead
+    FixedTimestep* _gpuTimestep = nullptr;
+
+    // Whether the scheduler only exports the attribute channels that the renderer streams. The
+    // renderer only decides on them when it is initialized, after the scheduler has been set up
+    bool _attributeChannelsSettled = false;
+
+    // While the frames are exported, every frame advances the simulation by this many seconds
+    // instead of the real time, so that the exported sequence plays at the right speed no
+    // matter how long the export takes. 0 if nothing is exported
+    float _exportFrameTime = 0.f;
+}
+
+// Applies 'event' to the CPU simulation on its thread before the next step and records it, or
+// sends it to the server that runs the simulation
+void enqueueEvent(CallbackRecorder::Event event) {
+    if (_streamClient != nullptr) {
+        _streamClient->send(event);
+        return;
+    }
+    if (_scheduler == nullptr) {
+        LWARNING("The simulation has not been started yet");
+        return;
+    }
+    _scheduler->enqueue([event]() mutable {
+        event.step = _simulation->numberOfSteps();
+        CallbackRecorder::apply(event, *_simulation);
+        _recorder->record(event);
+    });
 }
 
 void addNewSource(SourceType source, const glm::vec3& pos, float value) {
+    EmitterSystem::Type type = EmitterSystem::Type::Point;
     switch (source) {
     case SourceType::Point:
         LINFO("Point Source button pressed. (" << pos.x << "," << pos.y << "," << pos.z << ") [" << value << "]");
+        type = EmitterSystem::Type::Point;
         break;
     case SourceType::Cone:
         LINFO("Cone Source button pressed. (" << pos.x << "," << pos.y << "," << pos.z << ") [" << value << "]");
+        type = EmitterSystem::Type::Cone;
         break;
     default:
         LFATAL("Missing case in source handler");
+        return;
+    }
+
+    const float rate = value * _maximumEmissionRate;
+    if (_gui->computeSimulation() != nullptr)
+        _gpuEmitters->addEmitter(type, pos, rate);
+    else {
+        const CallbackRecorder::Event event = { 0, CallbackRecorder::Kind::Source,
+            static_cast<uint32_t>(type), { pos.x, pos.y, pos.z }, rate };
+        enqueueEvent(event);
     }
 }
 
 void addNewEffect(EffectType effect, const glm::vec3& pos, float value) {
+    EffectSystem::Type type = EffectSystem::Type::Gravity;
     switch (effect) {
         case EffectType::Gravity:
             LINFO("Gravity Effect button pressed. (" << pos.x << "," << pos.y << "," << pos.z << ") [" << value << "]");
+            type = EffectSystem::Type::Gravity;
             break;
         case EffectType::Wind:
             LINFO("Wind Effects button pressed. (" << pos.x << "," << pos.y << "," << pos.z << ") [" << value << "]");
+            type = EffectSystem::Type::Wind;
             break;
         default:
             LFATAL("Missing case in effect handler");
+            return;
+    }
+
+    const float strength = value * _maximumEffectStrength;
+    ComputeSimulation* computeSimulation = _gui->computeSimulation();
+    if (computeSimulation != nullptr)
+        computeSimulation->effects().addEffect(type, pos, strength);
+    else {
+        const CallbackRecorder::Event event = { 0, CallbackRecorder::Kind::Effect,
+            static_cast<uint32_t>(type), { pos.x, pos.y, pos.z }, strength };
+        enqueueEvent(event);
     }
 }
 
+// Creates the CPU simulation and the scheduler that runs it with 'timestep'
+void createSimulation(const FixedTimestep& timestep) {
+    _simulation = new Simulation(_maximumNumberOfParticles, *_threadPool);
+    _simulation->setProfiler(_profiler);
+    _simulation->setStatsChannel(_stats);
+    _scheduler = new SimulationScheduler(*_simulation);
+    _scheduler->timestep() = timestep;
+    LINFO("Using " << Integrator::name(_simulation->integrator().kernel()) <<
+        " integrator kernel on " << _threadPool->numberOfThreads() << " threads");
+    LINFO("Simulating " << timestep.stepsPerSecond() << " steps per second with at most " <<
+        timestep.maximumSteps() << " steps per frame");
+}
+
 // This method is called an undefined number of times per second. 'deltaT' is the time in seconds
-// that have passed since the last call.
+// that have passed since the last call. The simulations advance in fixed steps, so 'deltaT' is
+// only accumulated until a whole step has passed
 void update(float deltaT) {
-    
+    if (_exportFrameTime > 0.f)
+        deltaT = _exportFrameTime;
+
+    // The GPU simulation runs on the GUI thread, as it needs the OpenGL context. Its positions
+    // are drawn straight from its buffers, so they are not interpolated between the steps
+    ComputeSimulation* computeSimulation = _gui->computeSimulation();
+    if (computeSimulation != nullptr) {
+        _gpuTimestep->accumulate(deltaT);
+        const int numberOfSteps = _gpuTimestep->consumeSteps();
+        const float stepSize = _gpuTimestep->stepSize();
+        for (int i = 0; i < numberOfSteps; ++i) {
+            _gpuEmitters->spawn(*_gpuSpawnStaging, *_threadPool, stepSize);
+            computeSimulation->spawn(_gpuSpawnStaging->positions(),
+                _gpuSpawnStaging->velocities(), _gpuSpawnStaging->lifetimes(),
+                _gpuSpawnStaging->size());
+            _gpuSpawnStaging->clear();
+            computeSimulation->step(stepSize);
+        }
+        return;
+    }
+
+    // The GPU simulation was requested, but the renderer could not create it, so the CPU
+    // simulation takes over. The renderer is already initialized, so it neither gets the
+    // quantized positions nor the attributes
+    if ((_streamClient == nullptr) && (_scheduler == nullptr)) {
+        createSimulation(*_gpuTimestep);
+        _gui->setData(_scheduler->positionView(), _simulation->store().capacity());
+        _scheduler->setPositionSink(_gui->positionSink());
+    }
+
+    // The frames of a remote simulation are received like the steps of the local one
+    if (_streamClient != nullptr) {
+        _streamClient->collect();
+        _streamClient->requestFrame();
+        return;
+    }
+
+    // The ids are only streamed if the renderer has a culler, and the other channels only if a
+    // program reads them. No step has been requested yet, so the arrays can be replaced
+    if (!_attributeChannelsSettled) {
+        _scheduler->setAttributeChannels(_gui->attributeChannels());
+        _attributeChannelsSettled = true;
+    }
+
+    // Hand the result of the last finished step to the renderer and immediately start computing
+    // the next steps in the background. Neither call waits for the simulation thread. The steps
+    // are collected in the next frame, so they have to fit into its budget. An exported
+    // sequence has to contain every step, no matter how long the frames take
+    _scheduler->collect();
+    _scheduler->setStepBudget((_exportFrameTime > 0.f) ? 0.f : _gui->framePacer().frameBudget());
+    _scheduler->requestStep(deltaT);
 }
 
 void removeAll() {
     LINFO("Remove all buttons pressed");
+    ComputeSimulation* computeSimulation = _gui->computeSimulation();
+    if (computeSimulation != nullptr) {
+        computeSimulation->removeAll();
+        _gpuEmitters->removeAll();
+    }
+    else {
+        // The simulation may only be modified from the simulation thread
+        const CallbackRecorder::Event event = { 0, CallbackRecorder::Kind::RemoveAll, 0,
+            { 0.f, 0.f, 0.f }, 0.f };
+        enqueueEvent(event);
+    }
+}
+
+void saveSnapshot() {
+    LINFO("Save snapshot button pressed");
+    if (_scheduler == nullptr) {
+        LWARNING("Snapshots are only supported by the local CPU simulation");
+        return;
+    }
+
+    // The state is copied between two steps on the simulation thread and written in the
+    // background
+    _scheduler->enqueue([]() {
+        const std::string path =
+            "snapshot_" + std::to_string(_simulation->numberOfSteps()) + ".psnap";
+        _snapshotWriter->save(*_simulation, path);
+    });
 }
 
 int main(int argc, char** argv) {
@@ -92,12 +301,254 @@ int main(int argc, char** argv) {
 
     QApplication app(argc, argv);
 
-    GUI gui;
-    gui.setData(&_particleData);
-    gui.setCallbacks(addNewSource, addNewEffect, update, removeAll);
-    gui.show();
+    // The simulation runs on the CPU unless the GPU backend is requested with '--gpu'. Its
+    // number of steps per second is independent of the display rate and can be set with
+    // '--rate', the maximum number of steps to catch up in one frame with '--substeps'.
+    // '--snapshot' starts the CPU simulation from a saved snapshot and '--record' records all
+    // changes to it into a file that the benchmark can replay. '--export-images' writes every
+    // frame into the numbered files of a printf pattern, '--export-pipe' pipes the raw frames
+    // into a command, '--export-positions' writes the positions of every frame into columnar
+    // files, '--export-threads' sets the number of writer threads, and '--export-rate' the
+    // number of exported frames per second of simulated time. '--compact-positions' hands the
+    // positions to the renderer quantized to 8 bytes per particle. '--connect' renders the
+    // simulation of a ParticleServer at "host:port" instead of a local one, receiving
+    // '--stream-rate' frames per second with at most '--bandwidth' megabytes per second.
+    // '--attributes' streams the comma separated attribute channels (color, size, age, all)
+    // to the shaders, laid out as '--attribute-layout' separate, interleaved, or benchmark,
+    // which measures both and keeps the faster one. The frames wait for the vertical blank
+    // unless '--unthrottled' renders them as fast as possible for benchmarking
+    SimulationBackend backend = SimulationBackend::CPU;
+    FixedTimestep timestep;
+    std::string snapshotPath;
+    std::string recordingPath;
+    FrameExportSettings exportSettings;
+    exportSettings.numberOfThreads = 4;
+    float exportRate = 60.f;
+    bool compactPositions = false;
+    std::string serverAddress;
+    float streamRate = 30.f;
+    float bandwidth = 0.f;
+    uint32_t attributeChannels = 0;
+    AttributeLayout attributeLayout = AttributeLayout::Separate;
+    bool benchmarkLayouts = false;
+    FramePacer::Mode pacing = FramePacer::Mode::VSync;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        const bool hasValue = (i + 1 < argc);
+        if (argument == "--gpu")
+            backend = SimulationBackend::GPU;
+        else if ((argument == "--rate") && hasValue) {
+            const float rate = static_cast<float>(std::atof(argv[++i]));
+            if (rate > 0.f)
+                timestep.setStepsPerSecond(rate);
+            else
+                LWARNING("Ignoring the invalid simulation rate " << argv[i]);
+        }
+        else if ((argument == "--substeps") && hasValue) {
+            const int substeps = std::atoi(argv[++i]);
+            if (substeps >= 1)
+                timestep.setMaximumSteps(substeps);
+            else
+                LWARNING("Ignoring the invalid number of substeps " << argv[i]);
+        }
+        else if ((argument == "--snapshot") && hasValue)
+            snapshotPath = argv[++i];
+        else if ((argument == "--record") && hasValue)
+            recordingPath = argv[++i];
+        else if ((argument == "--export-images") && hasValue)
+            exportSettings.imagePattern = argv[++i];
+        else if ((argument == "--export-pipe") && hasValue)
+            exportSettings.pipeCommand = argv[++i];
+        else if ((argument == "--export-positions") && hasValue)
+            exportSettings.positionPattern = argv[++i];
+        else if ((argument == "--export-threads") && hasValue) {
+            const int threads = std::atoi(argv[++i]);
+            if (threads >= 1)
+                exportSettings.numberOfThreads = static_cast<unsigned int>(threads);
+            else
+                LWARNING("Ignoring the invalid number of export threads " << argv[i]);
+        }
+        else if ((argument == "--export-rate") && hasValue) {
+            const float rate = static_cast<float>(std::atof(argv[++i]));
+            if (rate > 0.f)
+                exportRate = rate;
+            else
+                LWARNING("Ignoring the invalid export rate " << argv[i]);
+        }
+        else if (argument == "--compact-positions")
+            compactPositions = true;
+        else if ((argument == "--connect") && hasValue)
+            serverAddress = argv[++i];
+        else if ((argument == "--stream-rate") && hasValue) {
+            const float rate = static_cast<float>(std::atof(argv[++i]));
+            if (rate > 0.f)
+                streamRate = rate;
+            else
+                LWARNING("Ignoring the invalid stream rate " << argv[i]);
+        }
+        else if ((argument == "--bandwidth") && hasValue) {
+            const float megabytes = static_cast<float>(std::atof(argv[++i]));
+            if (megabytes > 0.f)
+                bandwidth = megabytes;
+            else
+                LWARNING("Ignoring the invalid bandwidth " << argv[i]);
+        }
+        else if ((argument == "--attributes") && hasValue) {
+            if (!parseAttributeChannels(argv[++i], attributeChannels))
+                LWARNING("Ignoring the unknown attribute channels " << argv[i]);
+        }
+        else if ((argument == "--attribute-layout") && hasValue) {
+            const std::string layout = argv[++i];
+            if (layout == "separate")
+                attributeLayout = AttributeLayout::Separate;
+            else if (layout == "interleaved")
+                attributeLayout = AttributeLayout::Interleaved;
+            else if (layout == "benchmark")
+                benchmarkLayouts = true;
+            else
+                LWARNING("Ignoring the unknown attribute layout " << layout);
+        }
+        else if (argument == "--unthrottled")
+            pacing = FramePacer::Mode::Unthrottled;
+    }
+    const bool exportsFrames = !exportSettings.imagePattern.empty() ||
+        !exportSettings.pipeCommand.empty() || !exportSettings.positionPattern.empty();
+    if (exportsFrames)
+        _exportFrameTime = 1.f / exportRate;
 
-    // Create and enable your simulator code here. 'app.exec()' will start the rendering loop
+    // Create the simulator before the GUI, as the renderer will reference its data
+    _profiler = new Profiler;
+    _threadPool = new ThreadPool;
+    _stats = new StatsChannel;
+    if (!serverAddress.empty()) {
+        // The server owns the simulation, so nothing is simulated here
+        if (backend == SimulationBackend::GPU) {
+            LWARNING("The GPU simulation is not used with '--connect'");
+            backend = SimulationBackend::CPU;
+        }
+        if (!snapshotPath.empty() || !recordingPath.empty())
+            LWARNING("Snapshots and recordings are not used with '--connect'");
+        if (attributeChannels != 0) {
+            LWARNING("The attribute channels are not streamed with '--connect'");
+            attributeChannels = 0;
+        }
+        _streamClient = new StreamClient(*_threadPool);
+        _streamClient->setStatsChannel(_stats);
+        const uint32_t bytesPerSecond = static_cast<uint32_t>(bandwidth * 1024.f * 1024.f);
+        if (!_streamClient->connect(serverAddress, streamRate, bytesPerSecond,
+            _connectTimeout))
+        {
+            LFATAL("Could not connect to the server at " << serverAddress);
+            delete _streamClient;
+            delete _stats;
+            delete _threadPool;
+            delete _profiler;
+            return EXIT_FAILURE;
+        }
+    }
+    else if (backend == SimulationBackend::GPU) {
+        // The particles live on the GPU, so neither the CPU simulation nor its thread is needed
+        if (!snapshotPath.empty() || !recordingPath.empty())
+            LWARNING("Snapshots and recordings are only supported by the CPU simulation");
+        if (attributeChannels != 0) {
+            LWARNING("The attribute channels are not available for the GPU simulation");
+            attributeChannels = 0;
+        }
+        _snapshotWriter = new SnapshotWriter;
+        _recorder = new CallbackRecorder;
+        _gpuEmitters = new EmitterSystem;
+        _gpuSpawnStaging = new ParticleStore(_gpuSpawnCapacity);
+        _gpuTimestep = new FixedTimestep(timestep);
+    }
+    else {
+        createSimulation(timestep);
+        if (!snapshotPath.empty()) {
+            // The simulation takes a copy, so the mapping is not needed afterwards
+            Snapshot snapshot;
+            if (snapshot.open(snapshotPath) && snapshot.restore(*_simulation)) {
+                LINFO("Restored " << snapshot.numberOfParticles() <<
+                    " particles from the snapshot");
+            }
+        }
+        _snapshotWriter = new SnapshotWriter;
+        _recorder = new CallbackRecorder;
+        if (!recordingPath.empty())
+            _recorder->open(recordingPath, timestep.stepSize());
+        // The quantized positions need the mapped buffer, which only the separate layout keeps
+        const bool orphansAttributes = (attributeLayout == AttributeLayout::Interleaved) ||
+            benchmarkLayouts;
+        if ((attributeChannels != 0) && orphansAttributes && compactPositions) {
+            LWARNING("The positions are not quantized, as the interleaved attributes are "
+                "streamed by orphaning");
+        }
+        // The culler thins out the far away particles by their ids. The renderer only sees the
+        // channels that have arrays, so they are all allocated until it has picked its own
+        _scheduler->setAttributeChannels(attributeChannels | IdChannel);
+    }
+
+    int result = 0;
+    {
+        GUI gui(pacing);
+        _gui = &gui;
+        gui.setSimulationBackend(backend);
+        if (exportsFrames)
+            gui.setFrameExport(exportSettings);
+        gui.setProfiler(_profiler);
+        gui.setStatsChannel(_stats);
+        if (_streamClient != nullptr) {
+            // The frames arrive quantized, so they are decoded straight into the mapped VBO
+            gui.setPositionQuantizer(_streamClient->quantizer());
+            gui.setData(_streamClient->positionView(), _streamClient->capacity());
+            _streamClient->setPositionSink(gui.positionSink());
+        }
+        else if (_scheduler == nullptr) {
+            // The GPU simulation is drawn from its own buffers
+            gui.setData(PositionView(), _maximumNumberOfParticles);
+        }
+        else {
+            if (compactPositions)
+                gui.setPositionQuantizer(_simulation->positionQuantizer());
+            gui.setData(_scheduler->positionView(), _simulation->store().capacity());
+            // The ids alone are not worth a layout other than the default one
+            const bool streamsAttributes = (attributeChannels != 0);
+            gui.setAttributes(_scheduler->attributeView(), attributeChannels | IdChannel,
+                streamsAttributes ? attributeLayout : AttributeLayout::Separate,
+                streamsAttributes && benchmarkLayouts);
+            // If the renderer supports it, the simulation writes straight into the mapped VBO
+            _scheduler->setPositionSink(gui.positionSink());
+        }
+        gui.setCallbacks(addNewSource, addNewEffect, update, removeAll);
+        gui.setSnapshotCallback(saveSnapshot);
+        gui.show();
+
+        // 'app.exec()' will start the rendering loop
+        result = app.exec();
+
+        // The running step or frame might still write into the renderer's buffer, which is
+        // destroyed together with the GUI
+        if (_streamClient != nullptr) {
+            _streamClient->setPositionSink(nullptr);
+            _streamClient->finish();
+        }
+        else if (_scheduler != nullptr) {
+            _scheduler->setPositionSink(nullptr);
+            _scheduler->finish();
+        }
+        _gui = nullptr;
+    }
 
-    return app.exec();
+    // The GUI is gone, so nobody references the position buffers anymore
+    delete _gpuTimestep;
+    delete _gpuSpawnStaging;
+    delete _gpuEmitters;
+    delete _scheduler;
+    delete _streamClient;
+    // Writes the snapshots that are still queued
+    delete _snapshotWriter;
+    delete _recorder;
+    delete _simulation;
+    delete _threadPool;
+    delete _stats;
+    delete _profiler;
+    return result;
 }
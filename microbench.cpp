@@ -0,0 +1,614 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+// The microbenchmarks of the hot kernels of the simulator. Where ParticleBench runs whole
+// scenarios, each benchmark here times a single kernel on a prepared ParticleStore, for every
+// combination of a range of particle counts and thread counts, in the manner of Google
+// Benchmark: an iteration is repeated until '--min-time' seconds (default 0.5) have passed,
+// which is done '--repetitions' times (default 5), and the median and the standard deviation
+// of the time of an iteration over all repetitions are reported. The results are printed as
+// JSON to the standard output. Usage:
+//   ParticleMicrobench [--filter text] [--min-count N] [--max-count N] [--threads T,T,...]
+//                      [--min-time seconds] [--repetitions R] [--save file]
+//                      [--baseline file] [--tolerance fraction]
+// '--filter' only runs the benchmarks whose name contains the text. The counts go from
+// '--min-count' to '--max-count' (default 1e3 to 1e7, up to 1e8 needs about 10 GB) in powers
+// of ten, the thread counts default to one and all threads. '--save' also writes the results
+// into a file that can be used as the baseline of later runs: with '--baseline', every
+// benchmark whose median takes more than '--tolerance' (default 0.05) longer than in the
+// baseline, and more than three times the noise of the two runs longer, is flagged as a
+// regression. The noise is the combined standard deviation of the repetitions of the baseline
+// and the current run, so that the jitter of a busy machine does not count as a regression.
+// The program exits with 1 if there is any, so that it can fail a CI job. Only benchmarks with
+// the same name are compared, so the baseline has to come from the same machine
+
+#include <ghoul/logging/logging>
+
+#include "alignedmemory.h"
+#include "emittersystem.h"
+#include "particlestore.h"
+#include "positioncodec.h"
+#include "simulation.h"
+#include "spatialhash.h"
+#include "threadpool.h"
+#include "worldgeometry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace ghoul::logging;
+
+namespace {
+    const std::string _loggerCat = "ParticleMicrobench";
+
+    // The number of particles that a job of the thread pool processes, like in the Simulation
+    const size_t _chunkSize = 16 * 1024;
+    // The time step of the kernels that advance the particles
+    const float _deltaT = 1.f / 60.f;
+    // Half the edge length of the box the spatial hash covers, like in the Simulation
+    const float _domainExtent = worldgeometry::SkyboxSize;
+    // The fraction of the particles that have expired before a compaction
+    const size_t _expiredInterval = 10;
+    // The precision of the offsets of the streamed positions, like in the ParticleServer
+    const int _codecPrecisionBits = 8;
+    // The number of standard deviations of the noise by which a benchmark has to be slower
+    // than the baseline to count as a regression
+    const double _noiseThreshold = 3.0;
+
+    // Everything a benchmark works on, created once per particle count and thread count. The
+    // store of the simulation is the one that is benchmarked; the grid is a copy of the
+    // simulation's own, as building it needs write access
+    struct Fixture {
+        Fixture(size_t count, ThreadPool& pool)
+            : count(count)
+            , pool(pool)
+            , simulation(count, pool)
+            , grid(glm::vec3(-_domainExtent), glm::vec3(_domainExtent))
+            , codec(simulation.positionQuantizer(), _codecPrecisionBits)
+        {
+            const size_t capacity = simulation.store().capacity();
+            positions = alignedArray<glm::vec3>(capacity, ParticleStore::Alignment);
+            quantizedPositions =
+                alignedArray<QuantizedPosition>(capacity, ParticleStore::Alignment);
+            colors = alignedArray<uint32_t>(capacity, ParticleStore::Alignment);
+            sizes = alignedArray<float>(capacity, ParticleStore::Alignment);
+            ages = alignedArray<float>(capacity, ParticleStore::Alignment);
+            ids = alignedArray<uint32_t>(capacity, ParticleStore::Alignment);
+            outsideFlags.resize((capacity + 3) / 4);
+        }
+
+        ~Fixture() {
+            alignedFree(positions);
+            alignedFree(quantizedPositions);
+            alignedFree(colors);
+            alignedFree(sizes);
+            alignedFree(ages);
+            alignedFree(ids);
+        }
+
+        ParticleStore& store() {
+            return simulation.store();
+        }
+
+        // The number of particles the benchmarks work on
+        size_t count;
+        ThreadPool& pool;
+        Simulation simulation;
+        SpatialHash grid;
+        PositionCodec codec;
+        // The targets of the packing kernels
+        glm::vec3* positions;
+        QuantizedPosition* quantizedPositions;
+        uint32_t* colors;
+        float* sizes;
+        float* ages;
+        uint32_t* ids;
+        std::vector<char> frame;
+        // The batches that left the free box of the colliders, filled by the integration
+        std::vector<uint8_t> outsideFlags;
+
+    private:
+        Fixture(const Fixture&) = delete;
+        Fixture& operator=(const Fixture&) = delete;
+    };
+
+    // A kernel that is measured. 'setup' is called once before the measurement, 'prepare'
+    // before every iteration without being timed, and 'run' is the timed iteration
+    struct Benchmark {
+        std::string name;
+        std::function<void(Fixture&)> setup;
+        std::function<void(Fixture&)> prepare;
+        std::function<void(Fixture&)> run;
+    };
+
+    // Maps 'i' to a uniformly distributed number in [0,1), the same for every run
+    float random(uint32_t i) {
+        i ^= i >> 16;
+        i *= 0x7feb352du;
+        i ^= i >> 15;
+        i *= 0x846ca68bu;
+        i ^= i >> 16;
+        return static_cast<float>(i >> 8) * (1.f / 16777216.f);
+    }
+
+    // Replaces the particles of the fixture with 'count' particles that are spread over the
+    // unit cube around the origin and move in all directions. Every 'expiredInterval'th of
+    // them has reached its lifetime if that is not 0
+    void fill(Fixture& fixture, size_t expiredInterval = 0) {
+        ParticleStore& store = fixture.store();
+        store.clear();
+        store.allocate(fixture.count);
+        glm::vec3* positions = store.positions();
+        glm::vec3* velocities = store.velocities();
+        float* ages = store.ages();
+        float* lifetimes = store.lifetimes();
+        for (size_t i = 0; i < store.size(); ++i) {
+            const uint32_t seed = static_cast<uint32_t>(i) * 6;
+            positions[i] = glm::vec3(random(seed), random(seed + 1), random(seed + 2)) * 2.f -
+                1.f;
+            velocities[i] = glm::vec3(random(seed + 3), random(seed + 4), random(seed + 5)) -
+                0.5f;
+            lifetimes[i] = 1000.f;
+            const bool expired = (expiredInterval != 0) && (i % expiredInterval == 0);
+            ages[i] = expired ? lifetimes[i] : 0.f;
+        }
+    }
+
+    // Returns all kernels that are measured
+    std::vector<Benchmark> benchmarks() {
+        std::vector<Benchmark> result;
+        const std::function<void(Fixture&)> none;
+        const std::function<void(Fixture&)> filled = [](Fixture& f) { fill(f); };
+
+        result.push_back({ "integrate", filled, none, [](Fixture& f) {
+            ParticleStore& store = f.store();
+            const Integrator& integrator = f.simulation.integrator();
+            f.pool.parallelFor(0, store.size(), _chunkSize,
+                [&store, &integrator](size_t begin, size_t end) {
+                    integrator.integrate(store, begin, end, glm::vec3(0.f), _deltaT);
+                }
+            );
+        }});
+
+        // The particles below the ground are only moved in the first iteration; afterwards the
+        // test against the ground and the walls finds no collisions, like for most particles in
+        // the simulation. 'collide' is the test on its own, 'integrate_collide' the
+        // integration that also finds the batches outside of the free box and the test of only
+        // those, as in the simulation
+        result.push_back({ "collide", filled, none, [](Fixture& f) {
+            ParticleStore& store = f.store();
+            const CollisionSystem& collisions = f.simulation.collisions();
+            f.pool.parallelFor(0, store.size(), _chunkSize,
+                [&store, &collisions](size_t begin, size_t end) {
+                    collisions.collide(store, begin, end);
+                }
+            );
+        }});
+        result.push_back({ "integrate_collide", filled, none, [](Fixture& f) {
+            ParticleStore& store = f.store();
+            const Integrator& integrator = f.simulation.integrator();
+            const CollisionSystem& collisions = f.simulation.collisions();
+            glm::vec3 minimum;
+            glm::vec3 maximum;
+            collisions.freeBox(minimum, maximum);
+            uint8_t* flags = f.outsideFlags.data();
+            f.pool.parallelFor(0, store.size(), _chunkSize,
+                [&store, &integrator, &collisions, &minimum, &maximum, flags]
+                (size_t begin, size_t end) {
+                    uint8_t* outside = flags + begin / 4;
+                    integrator.integrate(store, begin, end, glm::vec3(0.f), _deltaT, nullptr,
+                        0.f, minimum, maximum, outside);
+                    collisions.collide(store, begin, end, nullptr, outside);
+                }
+            );
+        }});
+
+        // Every iteration spawns the full count into the empty store
+        const EmitterSystem::Type emitterTypes[] = {
+            EmitterSystem::Type::Point, EmitterSystem::Type::Cone
+        };
+        const char* const emitterNames[] = { "emit_point", "emit_cone" };
+        for (int i = 0; i < 2; ++i) {
+            const EmitterSystem::Type type = emitterTypes[i];
+            result.push_back({ emitterNames[i], [type](Fixture& f) {
+                f.simulation.emitters().removeAll();
+                f.simulation.emitters().addEmitter(type, glm::vec3(0.f), f.count / _deltaT);
+            }, [](Fixture& f) {
+                f.store().clear();
+            }, [](Fixture& f) {
+                f.simulation.emitters().spawn(f.store(), f.pool, _deltaT);
+            }});
+        }
+
+        // A single effect in the middle of the particles, which visits them through the grid
+        const EffectSystem::Type effectTypes[] = {
+            EffectSystem::Type::Gravity, EffectSystem::Type::Wind
+        };
+        const char* const effectNames[] = { "apply_gravity", "apply_wind" };
+        for (int i = 0; i < 2; ++i) {
+            const EffectSystem::Type type = effectTypes[i];
+            result.push_back({ effectNames[i], [type](Fixture& f) {
+                fill(f);
+                f.grid.build(f.store(), f.pool);
+                f.simulation.effects().removeAll();
+                f.simulation.effects().addEffect(type, glm::vec3(0.f), 5.f);
+            }, none, [](Fixture& f) {
+                f.simulation.effects().apply(f.store(), f.grid, f.pool, _deltaT);
+            }});
+        }
+
+        // After the first iteration, the particles are sorted already, as they are in the
+        // steady state of the simulation
+        result.push_back({ "spatial_hash", filled, none, [](Fixture& f) {
+            f.grid.build(f.store(), f.pool);
+        }});
+
+        result.push_back({ "compact", none, [](Fixture& f) {
+            fill(f, _expiredInterval);
+        }, [](Fixture& f) {
+            f.store().removeExpired();
+        }});
+
+        // The packing of the data that is uploaded to the renderer or streamed to a viewer
+        result.push_back({ "pack_float", filled, none, [](Fixture& f) {
+            f.simulation.exportPositions(f.positions, -_deltaT);
+        }});
+        result.push_back({ "pack_quantized", filled, none, [](Fixture& f) {
+            f.simulation.exportPositions(f.quantizedPositions, -_deltaT);
+        }});
+        result.push_back({ "pack_attributes", filled, none, [](Fixture& f) {
+            f.simulation.exportAttributes(f.colors, f.sizes, f.ages, f.ids);
+        }});
+        result.push_back({ "pack_codec", [](Fixture& f) {
+            fill(f);
+            f.simulation.exportPositions(f.quantizedPositions, 0.f);
+        }, [](Fixture& f) {
+            f.frame.clear();
+        }, [](Fixture& f) {
+            f.codec.encode(f.quantizedPositions, f.store().size(), 1, f.pool, f.frame);
+        }});
+        return result;
+    }
+
+    // The result of measuring one benchmark
+    struct Measurement {
+        std::string name;
+        size_t count;
+        unsigned int threads;
+        // The number of timed iterations over all repetitions
+        size_t iterations;
+        // The median over the repetitions of the average time of an iteration
+        double nanoseconds;
+        // The standard deviation of the average time of an iteration over the repetitions
+        double stddev;
+    };
+
+    // The times of a benchmark in the baseline
+    struct BaselineTime {
+        double nanoseconds;
+        // 0 if the baseline was saved with a single repetition
+        double stddev;
+    };
+
+    // Measures 'benchmark' on 'fixture'
+    Measurement measure(const Benchmark& benchmark, Fixture& fixture, double minimumSeconds,
+        int repetitions)
+    {
+        if (benchmark.setup)
+            benchmark.setup(fixture);
+
+        Measurement result;
+        result.count = fixture.count;
+        result.threads = fixture.pool.numberOfThreads();
+        result.iterations = 0;
+        std::vector<double> averages;
+        for (int r = 0; r < repetitions; ++r) {
+            // Only the iterations themselves are timed, not their preparation
+            double seconds = 0.0;
+            size_t iterations = 0;
+            while ((iterations == 0) || (seconds < minimumSeconds)) {
+                if (benchmark.prepare)
+                    benchmark.prepare(fixture);
+                const std::chrono::steady_clock::time_point start =
+                    std::chrono::steady_clock::now();
+                benchmark.run(fixture);
+                const std::chrono::steady_clock::time_point end =
+                    std::chrono::steady_clock::now();
+                seconds += std::chrono::duration<double>(end - start).count();
+                ++iterations;
+            }
+            averages.push_back(seconds * 1e9 / iterations);
+            result.iterations += iterations;
+        }
+        std::sort(averages.begin(), averages.end());
+        result.nanoseconds = averages[averages.size() / 2];
+
+        double sum = 0.0;
+        for (double average : averages)
+            sum += average;
+        const double mean = sum / averages.size();
+        double squares = 0.0;
+        for (double average : averages)
+            squares += (average - mean) * (average - mean);
+        result.stddev = (averages.size() > 1) ? std::sqrt(squares / (averages.size() - 1)) : 0.0;
+        return result;
+    }
+
+    // Returns the unique name of 'measurement', for example "integrate/1000/threads:4"
+    std::string fullName(const Measurement& measurement) {
+        return measurement.name + "/" + std::to_string(measurement.count) + "/threads:" +
+            std::to_string(measurement.threads);
+    }
+
+    // Reads the times of the benchmarks from a file written with '--save' into 'times'. Each
+    // benchmark is on a line of its own, so only the name, the time, and the standard
+    // deviation of each line are read
+    bool loadBaseline(const std::string& path, std::map<std::string, BaselineTime>& times) {
+        std::ifstream file(path);
+        if (!file.good()) {
+            LERROR("Could not open the baseline '" << path << "'");
+            return false;
+        }
+        const std::string nameKey = "\"name\": \"";
+        const std::string timeKey = "\"real_time\": ";
+        const std::string stddevKey = "\"stddev\": ";
+        std::string line;
+        while (std::getline(file, line)) {
+            const std::string::size_type name = line.find(nameKey);
+            const std::string::size_type time = line.find(timeKey);
+            if ((name == std::string::npos) || (time == std::string::npos))
+                continue;
+            const std::string::size_type nameBegin = name + nameKey.size();
+            const std::string::size_type nameEnd = line.find('"', nameBegin);
+            if (nameEnd == std::string::npos)
+                continue;
+            BaselineTime& entry = times[line.substr(nameBegin, nameEnd - nameBegin)];
+            entry.nanoseconds = std::atof(line.c_str() + time + timeKey.size());
+            const std::string::size_type stddev = line.find(stddevKey);
+            entry.stddev = (stddev == std::string::npos) ?
+                0.0 : std::atof(line.c_str() + stddev + stddevKey.size());
+        }
+        if (times.empty()) {
+            LERROR("The baseline '" << path << "' does not contain any benchmarks");
+            return false;
+        }
+        return true;
+    }
+
+    // Returns whether a cone emitter launches its particles upwards. As the z axis is up, the
+    // mean direction of the particles lies on it, at (1 + cos(angle)) / 2 for the half angle of
+    // the cone, which is more than 0.5 for every cone narrower than a hemisphere. Run before the
+    // measurements, so that a benchmark of wrong results fails the CI job as well
+    bool checkConeDirection() {
+        const size_t count = 64 * 1024;
+        ThreadPool pool(0);
+        ParticleStore store(count);
+        EmitterSystem emitters;
+        emitters.addEmitter(EmitterSystem::Type::Cone, glm::vec3(0.f), count / _deltaT);
+        emitters.spawn(store, pool, _deltaT);
+        if (store.size() == 0)
+            return false;
+
+        const glm::vec3* velocities = store.velocities();
+        glm::vec3 mean(0.f);
+        for (size_t i = 0; i < store.size(); ++i)
+            mean += glm::normalize(velocities[i]);
+        mean /= static_cast<float>(store.size());
+        // The sideways components average out to a few thousandths for this many particles
+        const float tolerance = 0.02f;
+        return (std::abs(mean.x) < tolerance) && (std::abs(mean.y) < tolerance) &&
+            (mean.z > 0.5f);
+    }
+
+    // Splits the comma separated 'list' of thread counts into 'threads'
+    bool parseThreads(const std::string& list, std::vector<unsigned int>& threads) {
+        threads.clear();
+        std::string::size_type begin = 0;
+        while (begin <= list.size()) {
+            const std::string::size_type end = std::min(list.find(',', begin), list.size());
+            const int value = std::atoi(list.substr(begin, end - begin).c_str());
+            if (value < 1)
+                return false;
+            threads.push_back(static_cast<unsigned int>(value));
+            begin = end + 1;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    // Only warnings and errors, as the standard output is reserved for the results
+    LogManager::initialize(LogManager::LogLevelWarning);
+    LogMgr.addLog(new ConsoleLog);
+
+    std::string filter;
+    double minimumCount = 1e3;
+    double maximumCount = 1e7;
+    // The calling thread is working as well
+    std::vector<unsigned int> threads = { 1, ThreadPool::defaultNumberOfWorkers() + 1 };
+    double minimumSeconds = 0.5;
+    int repetitions = 5;
+    std::string savePath;
+    std::string baselinePath;
+    double tolerance = 0.05;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if (i + 1 >= argc) {
+            LFATAL("Missing value for argument '" << argument << "'");
+            return EXIT_FAILURE;
+        }
+        const char* value = argv[++i];
+        if (argument == "--filter")
+            filter = value;
+        else if (argument == "--min-count")
+            minimumCount = std::atof(value);
+        else if (argument == "--max-count")
+            maximumCount = std::atof(value);
+        else if (argument == "--threads") {
+            if (!parseThreads(value, threads)) {
+                LFATAL("Invalid thread counts '" << value << "'");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (argument == "--min-time")
+            minimumSeconds = std::atof(value);
+        else if (argument == "--repetitions")
+            repetitions = std::max(std::atoi(value), 1);
+        else if (argument == "--save")
+            savePath = value;
+        else if (argument == "--baseline")
+            baselinePath = value;
+        else if (argument == "--tolerance")
+            tolerance = std::atof(value);
+        else {
+            LFATAL("Unknown argument '" << argument << "'");
+            return EXIT_FAILURE;
+        }
+    }
+    std::sort(threads.begin(), threads.end());
+    threads.erase(std::unique(threads.begin(), threads.end()), threads.end());
+
+    std::vector<size_t> counts;
+    for (double count = std::max(minimumCount, 1.0); count <= maximumCount * 1.000001;
+        count *= 10.0)
+    {
+        counts.push_back(static_cast<size_t>(count + 0.5));
+    }
+    std::vector<Benchmark> selected;
+    for (const Benchmark& benchmark : benchmarks()) {
+        if (benchmark.name.find(filter) != std::string::npos)
+            selected.push_back(benchmark);
+    }
+    if (selected.empty() || counts.empty()) {
+        LFATAL("No benchmarks match the filter and counts");
+        return EXIT_FAILURE;
+    }
+
+    if (!checkConeDirection()) {
+        LFATAL("The cone emitter does not launch its particles along the z axis");
+        return EXIT_FAILURE;
+    }
+
+    std::map<std::string, BaselineTime> baseline;
+    if (!baselinePath.empty() && !loadBaseline(baselinePath, baseline))
+        return EXIT_FAILURE;
+
+    // The results are collected first, so that they can be written into the file as well
+    std::string results = "{\n";
+    results += "  \"context\": {\n";
+    results += "    \"kernel\": \"" + Integrator::name(Integrator().kernel()) + "\",\n";
+    results += "    \"minTime\": " + std::to_string(minimumSeconds) + ",\n";
+    results += "    \"repetitions\": " + std::to_string(repetitions) + ",\n";
+    results += "    \"baseline\": \"" + baselinePath + "\",\n";
+    results += "    \"tolerance\": " + std::to_string(tolerance) + ",\n";
+    results += "    \"noiseThreshold\": " + std::to_string(_noiseThreshold) + "\n";
+    results += "  },\n";
+    results += "  \"benchmarks\": [\n";
+    int numberOfRegressions = 0;
+    bool first = true;
+    for (unsigned int numberOfThreads : threads) {
+        ThreadPool pool(numberOfThreads - 1);
+        for (size_t count : counts) {
+            Fixture fixture(count, pool);
+            for (const Benchmark& benchmark : selected) {
+                Measurement measurement = measure(benchmark, fixture, minimumSeconds,
+                    repetitions);
+                measurement.name = benchmark.name;
+                const std::string name = fullName(measurement);
+
+                // A benchmark that is not in the baseline cannot regress. The change and its
+                // noise are relative to the time of the baseline
+                char comparison[192] =
+                    "\"baseline_time\": null, \"change\": null, \"noise\": null";
+                char progress[64] = "";
+                bool regression = false;
+                const std::map<std::string, BaselineTime>::const_iterator it =
+                    baseline.find(name);
+                if ((it != baseline.end()) && (it->second.nanoseconds > 0.0)) {
+                    const BaselineTime& before = it->second;
+                    const double change = measurement.nanoseconds / before.nanoseconds - 1.0;
+                    const double noise = std::sqrt(before.stddev * before.stddev +
+                        measurement.stddev * measurement.stddev) / before.nanoseconds;
+                    regression = (change > tolerance) && (change > _noiseThreshold * noise);
+                    std::snprintf(comparison, sizeof(comparison),
+                        "\"baseline_time\": %.2f, \"change\": %.4f, \"noise\": %.4f",
+                        before.nanoseconds, change, noise);
+                    std::snprintf(progress, sizeof(progress), " (%+.1f%% +- %.1f%%)",
+                        change * 100.0, noise * 100.0);
+                }
+                if (regression) {
+                    LWARNING(name << " has become slower than the baseline");
+                    ++numberOfRegressions;
+                }
+
+                char line[512];
+                std::snprintf(line, sizeof(line),
+                    "    {\"name\": \"%s\", \"particles\": %zu, \"threads\": %u, "
+                    "\"iterations\": %zu, \"real_time\": %.2f, \"stddev\": %.2f, "
+                    "\"time_unit\": \"ns\", "
+                    "\"ns_per_particle\": %.4f, \"items_per_second\": %.1f, %s, "
+                    "\"regression\": %s}",
+                    name.c_str(), measurement.count, measurement.threads,
+                    measurement.iterations, measurement.nanoseconds, measurement.stddev,
+                    measurement.nanoseconds / measurement.count,
+                    measurement.count * 1e9 / measurement.nanoseconds, comparison,
+                    regression ? "true" : "false");
+                if (!first)
+                    results += ",\n";
+                results += line;
+                first = false;
+                // The progress goes to the standard error, so that long runs can be followed
+                std::fprintf(stderr, "%s: %.2f +- %.2f ns%s\n", name.c_str(),
+                    measurement.nanoseconds, measurement.stddev, progress);
+            }
+        }
+    }
+    results += "\n  ],\n";
+    results += "  \"regressions\": " + std::to_string(numberOfRegressions) + "\n";
+    results += "}\n";
+
+    std::fputs(results.c_str(), stdout);
+    if (!savePath.empty()) {
+        std::ofstream file(savePath);
+        file << results;
+        if (!file.good()) {
+            LERROR("Could not write the results into '" << savePath << "'");
+            return EXIT_FAILURE;
+        }
+    }
+    if (numberOfRegressions > 0) {
+        LERROR(numberOfRegressions << " benchmarks are more than " << tolerance * 100.0 <<
+            "% and " << _noiseThreshold << " standard deviations slower than the baseline");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,76 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "particleattributes.h"
+
+#include <algorithm>
+
+namespace {
+    // The names of the channels in the order of their bits
+    const char* const _channelNames[NumberOfAttributeChannels] = {
+        "color", "size", "age", "id"
+    };
+}
+
+int numberOfAttributeChannels(uint32_t channels) {
+    int count = 0;
+    for (int i = 0; i < NumberOfAttributeChannels; ++i) {
+        if ((channels & attributeChannel(i)) != 0)
+            ++count;
+    }
+    return count;
+}
+
+bool parseAttributeChannels(const std::string& names, uint32_t& channels) {
+    uint32_t result = 0;
+    std::string::size_type begin = 0;
+    while (begin <= names.size()) {
+        const std::string::size_type end = std::min(names.find(',', begin), names.size());
+        const std::string name = names.substr(begin, end - begin);
+        begin = end + 1;
+
+        if (name == "all") {
+            result |= AllAttributeChannels;
+            continue;
+        }
+        const char* const* channel =
+            std::find(_channelNames, _channelNames + NumberOfAttributeChannels, name);
+        if (channel == _channelNames + NumberOfAttributeChannels)
+            return false;
+        result |= attributeChannel(static_cast<int>(channel - _channelNames));
+    }
+    channels = result;
+    return true;
+}
+
+std::string attributeChannelNames(uint32_t channels) {
+    std::string names;
+    for (int i = 0; i < NumberOfAttributeChannels; ++i) {
+        if ((channels & attributeChannel(i)) == 0)
+            continue;
+        if (!names.empty())
+            names += ",";
+        names += _channelNames[i];
+    }
+    return names.empty() ? "none" : names;
+}
@@ -0,0 +1,153 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __PARTICLEATTRIBUTES_H__
+#define __PARTICLEATTRIBUTES_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// The per-particle values besides the position that can be streamed to the shaders. Each
+// channel is one bit, so that a set of channels is a mask, and each value is one 32 bit word
+enum AttributeChannel : uint32_t {
+    // The color as RGBA8 in one word, red in the lowest byte; derived from the speed
+    ColorChannel = 1 << 0,
+    // The edge length of the sprite as a factor of the default size
+    SizeChannel = 1 << 1,
+    // The age as a fraction of the lifetime in [0,1]
+    AgeChannel = 1 << 2,
+    // A number that stays the same for the whole life of the particle. No program draws it;
+    // the culler skips the far away particles by it, so that it skips the same ones every frame
+    IdChannel = 1 << 3
+};
+// The number of values in AttributeChannel
+const int NumberOfAttributeChannels = 4;
+// The mask of all channels
+const uint32_t AllAttributeChannels = ColorChannel | SizeChannel | AgeChannel | IdChannel;
+// The number of bytes of a single value of any channel
+const size_t AttributeChannelSize = 4;
+
+// The ways in which the channels are laid out in the vertex buffers
+enum class AttributeLayout {
+    // Structure of arrays: every channel has a tightly packed buffer of its own, next to the
+    // positions
+    Separate,
+    // Array of structures: the position and the channels of a particle follow each other in
+    // one vertex, which is padded to a multiple of 16 bytes
+    Interleaved
+};
+
+// Returns the channel with the index 'index' in [0, NumberOfAttributeChannels)
+inline AttributeChannel attributeChannel(int index) {
+    return static_cast<AttributeChannel>(1u << index);
+}
+
+// Returns the index in [0, NumberOfAttributeChannels) of 'channel'
+inline int attributeChannelIndex(AttributeChannel channel) {
+    int index = 0;
+    while (attributeChannel(index) != channel)
+        ++index;
+    return index;
+}
+
+// Returns the number of channels in 'channels'
+int numberOfAttributeChannels(uint32_t channels);
+
+// Parses the comma separated channel names in 'names' ("color", "size", "age", "id", or
+// "all") into 'channels'. Returns false, and leaves 'channels' unchanged, if a name is unknown
+bool parseAttributeChannels(const std::string& names, uint32_t& channels);
+
+// Returns the comma separated names of 'channels', or "none"
+std::string attributeChannelNames(uint32_t channels);
+
+// A non-owning, read-only view onto one array per channel, which hold the values of the
+// particles in the same order as the positions they accompany, like the PositionView. A
+// channel whose array is not available has a nullptr. The owner has to outlive every view
+class AttributeView {
+public:
+    // Creates an empty view without any channels
+    AttributeView()
+        : _colors(nullptr)
+        , _sizes(nullptr)
+        , _ages(nullptr)
+        , _ids(nullptr)
+    {}
+
+    // Creates a view onto the arrays pointed to by the arguments, each of which can be a
+    // nullptr if the owner does not provide that channel
+    AttributeView(const uint32_t* const* colors, const float* const* sizes,
+        const float* const* ages, const uint32_t* const* ids)
+        : _colors(colors)
+        , _sizes(sizes)
+        , _ages(ages)
+        , _ids(ids)
+    {}
+
+    // Returns the channels for which arrays are available at the moment
+    uint32_t channels() const {
+        uint32_t channels = 0;
+        for (int i = 0; i < NumberOfAttributeChannels; ++i) {
+            if (data(attributeChannel(i)) != nullptr)
+                channels |= attributeChannel(i);
+        }
+        return channels;
+    }
+
+    // Returns the array of 'channel' as raw words, or a nullptr if it is not available
+    const void* data(AttributeChannel channel) const {
+        switch (channel) {
+            case ColorChannel:
+                return colors();
+            case SizeChannel:
+                return sizes();
+            case AgeChannel:
+                return ages();
+            case IdChannel:
+                return ids();
+        }
+        return nullptr;
+    }
+
+    // Returns the individual arrays, a nullptr if they are not available
+    const uint32_t* colors() const {
+        return (_colors != nullptr) ? *_colors : nullptr;
+    }
+    const float* sizes() const {
+        return (_sizes != nullptr) ? *_sizes : nullptr;
+    }
+    const float* ages() const {
+        return (_ages != nullptr) ? *_ages : nullptr;
+    }
+    const uint32_t* ids() const {
+        return (_ids != nullptr) ? *_ids : nullptr;
+    }
+
+private:
+    const uint32_t* const* _colors;
+    const float* const* _sizes;
+    const float* const* _ages;
+    const uint32_t* const* _ids;
+};
+
+#endif // __PARTICLEATTRIBUTES_H__
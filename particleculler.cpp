@@ -0,0 +1,257 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "particleculler.h"
+
+#include "drawcommand.h"
+#include "positionquantizer.h"
+
+#include <ghoul/filesystem/filesystem>
+#include <ghoul/logging/logging>
+#include <algorithm>
+
+using namespace ghoul::opengl;
+
+namespace {
+    const std::string _loggerCat = "ParticleCuller";
+
+    // Has to match the local_size_x of cull.comp
+    const GLuint _workGroupSize = 256;
+
+    // The particles closer than this to the camera are always drawn
+    const float _defaultLodStart = 2.f;
+    // From this distance on only _defaultLodMinimumFraction of the particles are drawn
+    const float _defaultLodEnd = 8.f;
+    const float _defaultLodMinimumFraction = 0.25f;
+}
+
+ParticleCuller::ParticleCuller(size_t capacity)
+    : _capacity(capacity)
+    , _program(nullptr)
+    , _visibleBuffer(0)
+    , _commandBuffer(0)
+    , _countBuffer(0)
+    , _lodStart(_defaultLodStart)
+    , _lodEnd(_defaultLodEnd)
+    , _lodMinimumFraction(_defaultLodMinimumFraction)
+{
+    for (int i = 0; i < NumberOfAttributeChannels; ++i)
+        _attributeBuffers[i] = 0;
+}
+
+ParticleCuller::~ParticleCuller() {
+    glDeleteBuffers(1, &_visibleBuffer);
+    glDeleteBuffers(NumberOfAttributeChannels, _attributeBuffers);
+    glDeleteBuffers(1, &_commandBuffer);
+    glDeleteBuffers(1, &_countBuffer);
+    delete _program;
+}
+
+bool ParticleCuller::isSupported() {
+    return GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object &&
+        GLEW_ARB_shader_atomic_counters && GLEW_ARB_draw_indirect;
+}
+
+bool ParticleCuller::initialize() {
+    if (!isSupported()) {
+        LERROR("Compute shaders are not supported by the driver");
+        return false;
+    }
+
+    // Errors that occur during compiling or linking will be written to the Logmanager by the
+    // ProgramObject and ShaderObject
+    _program = new ProgramObject("ParticleCull");
+    _program->attachObject(new ShaderObject(ShaderObject::ShaderTypeCompute,
+        FileSys.absolutePath("${ASSETS}/cull.comp")));
+    if (!_program->compileShaderObjects() || !_program->linkProgramObject())
+        return false;
+
+    glGenBuffers(1, &_visibleBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _visibleBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, _capacity * sizeof(glm::vec4), nullptr, GL_DYNAMIC_COPY);
+
+    const ParticleDrawCommands commands = { { 0, 1, 0, 0 }, { 4, 0, 0, 0 } };
+    glGenBuffers(1, &_commandBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _commandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(commands), &commands, GL_DYNAMIC_COPY);
+
+    const GLuint zero = 0;
+    glGenBuffers(1, &_countBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _countBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), &zero, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return true;
+}
+
+void ParticleCuller::setLevelOfDetail(float start, float end, float minimumFraction) {
+    _lodStart = start;
+    // The shader divides by the length of the transition
+    _lodEnd = std::max(end, start + 1e-3f);
+    _lodMinimumFraction = std::min(std::max(minimumFraction, 0.f), 1.f);
+}
+
+void ParticleCuller::setAttributeChannels(uint32_t channels) {
+    channels &= ~IdChannel;
+    for (int i = 0; i < NumberOfAttributeChannels; ++i) {
+        const bool compacted = ((channels & attributeChannel(i)) != 0);
+        if (compacted && (_attributeBuffers[i] == 0)) {
+            glGenBuffers(1, &_attributeBuffers[i]);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, _attributeBuffers[i]);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, _capacity * AttributeChannelSize, nullptr,
+                GL_DYNAMIC_COPY);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        }
+        else if (!compacted && (_attributeBuffers[i] != 0)) {
+            glDeleteBuffers(1, &_attributeBuffers[i]);
+            _attributeBuffers[i] = 0;
+        }
+    }
+}
+
+void ParticleCuller::cull(GLuint buffer, size_t first, size_t stride, size_t count,
+    GLuint countBuffer, const glm::mat4& viewProjectionMatrix, const glm::vec3& cameraPosition,
+    const AttributeSource* attributes)
+{
+    dispatch(buffer, first, stride, count, countBuffer, nullptr, true, viewProjectionMatrix,
+        cameraPosition, attributes);
+}
+
+void ParticleCuller::cullQuantized(GLuint buffer, size_t first, size_t count,
+    const PositionQuantizer& quantizer, bool onlyVisible, const glm::mat4& viewProjectionMatrix,
+    const glm::vec3& cameraPosition, const AttributeSource* attributes)
+{
+    // Each QuantizedPosition is two words
+    const size_t words = sizeof(QuantizedPosition) / sizeof(GLuint);
+    dispatch(buffer, first * words, words, count, 0, &quantizer, onlyVisible,
+        viewProjectionMatrix, cameraPosition, attributes);
+}
+
+void ParticleCuller::dispatch(GLuint buffer, size_t first, size_t stride, size_t count,
+    GLuint countBuffer, const PositionQuantizer* quantizer, bool onlyVisible,
+    const glm::mat4& viewProjectionMatrix, const glm::vec3& cameraPosition,
+    const AttributeSource* attributes)
+{
+    // Start with an empty result. The counter is the vertex count of the first command
+    const GLuint zero = 0;
+    glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, _commandBuffer);
+    glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, offsetof(ParticleDrawCommands, points.count),
+        sizeof(GLuint), &zero);
+    glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+
+    count = std::min(count, _capacity);
+    if (countBuffer == 0) {
+        const GLuint exactCount = static_cast<GLuint>(count);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _countBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &exactCount);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        countBuffer = _countBuffer;
+    }
+
+    if (count > 0) {
+        _program->activate();
+        _program->setUniform("_first", static_cast<GLint>(first));
+        _program->setUniform("_stride", static_cast<GLint>(stride));
+        _program->setUniform("_viewProjectionMatrix", viewProjectionMatrix);
+        _program->setUniform("_cameraPosition", cameraPosition);
+        _program->setUniform("_lodStart", _lodStart);
+        _program->setUniform("_lodEnd", _lodEnd);
+        _program->setUniform("_lodMinimumFraction", _lodMinimumFraction);
+        _program->setUniform("_cullInvisible", static_cast<GLint>(onlyVisible ? 1 : 0));
+        _program->setUniform("_quantized", static_cast<GLint>((quantizer != nullptr) ? 1 : 0));
+        if (quantizer != nullptr) {
+            _program->setUniform("_gridMinimum", quantizer->minimum());
+            _program->setUniform("_cellSize", quantizer->cellSize());
+            _program->setUniform("_resolutionBits",
+                static_cast<GLint>(quantizer->resolutionBits()));
+        }
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, countBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _visibleBuffer);
+        glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, _commandBuffer);
+
+        // The channels are read from bindings 3 to 5 and compacted into bindings 6 to 8
+        GLint channels = 0;
+        glm::ivec3 attributeFirst(0);
+        glm::ivec3 attributeStride(0);
+        for (int i = 0; (attributes != nullptr) && (i < NumberOfAttributeChannels); ++i) {
+            if ((attributes[i].buffer == 0) || (_attributeBuffers[i] == 0))
+                continue;
+            channels |= static_cast<GLint>(attributeChannel(i));
+            attributeFirst[i] = static_cast<GLint>(attributes[i].first);
+            attributeStride[i] = static_cast<GLint>(attributes[i].stride);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3 + i, attributes[i].buffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6 + i, _attributeBuffers[i]);
+        }
+        _program->setUniform("_attributeChannels", channels);
+        _program->setUniform("_attributeFirst", attributeFirst);
+        _program->setUniform("_attributeStride", attributeStride);
+
+        // The ids are read from binding 9; a stride of 0 hashes the indices instead
+        const AttributeSource* ids =
+            (attributes != nullptr) ? &attributes[attributeChannelIndex(IdChannel)] : nullptr;
+        const bool hasIds = (ids != nullptr) && (ids->buffer != 0);
+        _program->setUniform("_idFirst", static_cast<GLint>(hasIds ? ids->first : 0));
+        _program->setUniform("_idStride", static_cast<GLint>(hasIds ? ids->stride : 0));
+        if (hasIds)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, ids->buffer);
+
+        const GLuint numGroups = static_cast<GLuint>((count + _workGroupSize - 1) / _workGroupSize);
+        glDispatchCompute(numGroups, 1, 1);
+
+        for (GLuint i = 0; i <= 9; ++i)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+        glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, 0);
+        _program->deactivate();
+    }
+
+    // The counter has to be complete before it is copied into the instance count of the
+    // billboard command
+    glMemoryBarrier(GL_ATOMIC_COUNTER_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, _commandBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _commandBuffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+        offsetof(ParticleDrawCommands, points.count),
+        offsetof(ParticleDrawCommands, billboards.instanceCount), sizeof(GLuint));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    // The result is used as vertices and as indirect commands
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+GLuint ParticleCuller::visibleBuffer() const {
+    return _visibleBuffer;
+}
+
+GLuint ParticleCuller::attributeBuffer(AttributeChannel channel) const {
+    for (int i = 0; i < NumberOfAttributeChannels; ++i) {
+        if (attributeChannel(i) == channel)
+            return _attributeBuffers[i];
+    }
+    return 0;
+}
+
+GLuint ParticleCuller::commandBuffer() const {
+    return _commandBuffer;
+}
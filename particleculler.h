@@ -0,0 +1,133 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __PARTICLECULLER_H__
+#define __PARTICLECULLER_H__
+
+// Need to include opengl first, as the other headers might include gl, but not glew
+#include <ghoul/opengl/opengl>
+
+#include "attributesource.h"
+#include "particleattributes.h"
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+class PositionQuantizer;
+
+// The ParticleCuller runs a compute shader over the particle positions before they are drawn
+// and compacts the particles that are inside the view frustum into a separate buffer, using an
+// atomic counter that doubles as the vertex count of an indirect draw command. Far away
+// particles are additionally thinned out stochastically (level of detail), so the number of
+// vertices depends on what is visible rather than on the number of particles. The attribute
+// channels of the visible particles can be compacted along with their positions. The CPU never
+// reads the result back. All functions have to be called with the OpenGL context current.
+// Requires OpenGL 4.3
+class ParticleCuller {
+public:
+    // Creates a culler for at most 'capacity' particles; 'initialize' has to be called before
+    // it can be used
+    explicit ParticleCuller(size_t capacity);
+
+    // Deletes all OpenGL objects
+    ~ParticleCuller();
+
+    // Returns true if the driver supports everything the ParticleCuller needs
+    static bool isSupported();
+
+    // Compiles the compute shader and creates the buffers. Returns false if anything failed
+    bool initialize();
+
+    // Sets the camera distances between which the fraction of particles that are drawn falls
+    // linearly from 1 to 'minimumFraction'. Beyond 'end' that fraction is drawn
+    void setLevelOfDetail(float start, float end, float minimumFraction);
+
+    // Creates the buffers for compacting the attribute 'channels' and deletes those of the
+    // other channels. The IdChannel is only read, never compacted
+    void setAttributeChannels(uint32_t channels);
+
+    // Compacts the visible particles of 'buffer' into visibleBuffer(). The position of
+    // particle i consists of the three floats at 'first' + i * 'stride' floats. If
+    // 'countBuffer' is 0, 'count' is the number of particles; otherwise 'count' is only an
+    // upper bound and the number is read on the GPU from the first element of 'countBuffer'.
+    // If 'attributes' is not a nullptr, it holds a source for every channel, and the channels
+    // of 'setAttributeChannels' whose source has a buffer are compacted as well. The far away
+    // particles are skipped by the words of the IdChannel source, or by their index if it has
+    // no buffer, in which case the skipped ones change whenever the particles are reordered
+    void cull(GLuint buffer, size_t first, size_t stride, size_t count, GLuint countBuffer,
+        const glm::mat4& viewProjectionMatrix, const glm::vec3& cameraPosition,
+        const AttributeSource* attributes = nullptr);
+
+    // Like 'cull', but reads the QuantizedPositions that 'buffer' holds from particle 'first'
+    // on and decodes them with 'quantizer'. The particles outside of the quantizer's grid are
+    // always dropped. If 'onlyVisible' is false, all other particles are kept, so that the
+    // positions are only decoded
+    void cullQuantized(GLuint buffer, size_t first, size_t count,
+        const PositionQuantizer& quantizer, bool onlyVisible,
+        const glm::mat4& viewProjectionMatrix, const glm::vec3& cameraPosition,
+        const AttributeSource* attributes = nullptr);
+
+    // Returns the buffer with the positions of the visible particles as vec4s (xyz, 1)
+    GLuint visibleBuffer() const;
+
+    // Returns the buffer with the values of 'channel' of the visible particles, one word each
+    // in the order of visibleBuffer(), or 0 if the channel is not compacted
+    GLuint attributeBuffer(AttributeChannel channel) const;
+
+    // Returns the buffer with the ParticleDrawCommands for the visible particles
+    GLuint commandBuffer() const;
+
+private:
+    ParticleCuller(const ParticleCuller&) = delete;
+    ParticleCuller& operator=(const ParticleCuller&) = delete;
+
+    // Runs the compute shader; the positions are decoded with 'quantizer' if it is not a
+    // nullptr, in which case 'first' and 'stride' count 32 bit words instead of floats
+    void dispatch(GLuint buffer, size_t first, size_t stride, size_t count, GLuint countBuffer,
+        const PositionQuantizer* quantizer, bool onlyVisible,
+        const glm::mat4& viewProjectionMatrix, const glm::vec3& cameraPosition,
+        const AttributeSource* attributes);
+
+    // The maximum number of particles
+    size_t _capacity;
+
+    // The program with the compute shader
+    ghoul::opengl::ProgramObject* _program;
+
+    // The compacted positions of the visible particles
+    GLuint _visibleBuffer;
+    // The compacted values of the attribute channels, 0 for the channels that are not compacted
+    GLuint _attributeBuffers[NumberOfAttributeChannels];
+    // The ParticleDrawCommands; the first element is the atomic counter
+    GLuint _commandBuffer;
+    // Holds the number of particles if it is known on the CPU
+    GLuint _countBuffer;
+
+    // The level of detail parameters, see 'setLevelOfDetail'
+    float _lodStart;
+    float _lodEnd;
+    float _lodMinimumFraction;
+};
+
+#endif // __PARTICLECULLER_H__
@@ -0,0 +1,263 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "particlestore.h"
+
+#include "alignedmemory.h"
+
+#include <ghoul/logging/logging>
+#include <cassert>
+#include <utility>
+
+namespace {
+    const std::string _loggerCat = "ParticleStore";
+}
+
+ParticleStore::ParticleStore(size_t capacity)
+    : _size(0)
+    , _capacity(0)
+    , _positions(nullptr)
+    , _velocities(nullptr)
+    , _ages(nullptr)
+    , _lifetimes(nullptr)
+    , _slots(nullptr)
+    , _slotIndices(nullptr)
+    , _slotGenerations(nullptr)
+    , _freeSlots(nullptr)
+    , _numberOfFreeSlots(0)
+    , _firstUnusedSlot(0)
+{
+    // Round the capacity up so that the vectorized kernels never have to deal with partial
+    // batches at the end of the arrays
+    _capacity = ((capacity + BatchSize - 1) / BatchSize) * BatchSize;
+
+    _positions = alignedArray<glm::vec3>(_capacity, Alignment);
+    _velocities = alignedArray<glm::vec3>(_capacity, Alignment);
+    _ages = alignedArray<float>(_capacity, Alignment);
+    _lifetimes = alignedArray<float>(_capacity, Alignment);
+    _slots = alignedArray<uint32_t>(_capacity, Alignment);
+    _slotIndices = alignedArray<uint32_t>(_capacity, Alignment);
+    _slotGenerations = alignedArray<uint32_t>(_capacity, Alignment);
+    _freeSlots = alignedArray<uint32_t>(_capacity, Alignment);
+
+    if ((_positions == nullptr) || (_velocities == nullptr) ||
+        (_ages == nullptr) || (_lifetimes == nullptr) || (_slots == nullptr) ||
+        (_slotIndices == nullptr) || (_slotGenerations == nullptr) || (_freeSlots == nullptr))
+    {
+        LFATAL("Could not allocate memory for " << _capacity << " particles");
+        // Leave the store in a valid, but unusable, state
+        _capacity = 0;
+        return;
+    }
+
+    // All slots are unused, so the first particles get the first slots
+    for (size_t i = 0; i < _capacity; ++i) {
+        _slotIndices[i] = 0;
+        _slotGenerations[i] = 0;
+    }
+}
+
+ParticleStore::~ParticleStore() {
+    alignedFree(_positions);
+    alignedFree(_velocities);
+    alignedFree(_ages);
+    alignedFree(_lifetimes);
+    alignedFree(_slots);
+    alignedFree(_slotIndices);
+    alignedFree(_slotGenerations);
+    alignedFree(_freeSlots);
+}
+
+size_t ParticleStore::size() const {
+    return _size;
+}
+
+size_t ParticleStore::capacity() const {
+    return _capacity;
+}
+
+size_t ParticleStore::available() const {
+    return _capacity - _size;
+}
+
+size_t ParticleStore::allocate(size_t count) {
+    const size_t added = (count < available()) ? count : available();
+
+    // Take the slots from the top of the free stack first and then the unused ones. A slot
+    // that is used for the first time since a 'clear' might still carry the generation of a
+    // particle that was cleared, so its generation is advanced to invalidate those handles
+    const size_t fromStack = (added < _numberOfFreeSlots) ? added : _numberOfFreeSlots;
+    for (size_t i = 0; i < fromStack; ++i) {
+        const uint32_t slot = _freeSlots[_numberOfFreeSlots - 1 - i];
+        _slots[_size + i] = slot;
+        _slotIndices[slot] = static_cast<uint32_t>(_size + i);
+    }
+    _numberOfFreeSlots -= fromStack;
+    for (size_t i = fromStack; i < added; ++i) {
+        const uint32_t slot = static_cast<uint32_t>(_firstUnusedSlot++);
+        ++_slotGenerations[slot];
+        _slots[_size + i] = slot;
+        _slotIndices[slot] = static_cast<uint32_t>(_size + i);
+    }
+    _size += added;
+    return added;
+}
+
+void ParticleStore::remove(size_t index) {
+    assert(index < _size);
+
+    // Invalidate all handles to the particle and return its slot to the free stack
+    const uint32_t freedSlot = _slots[index];
+    ++_slotGenerations[freedSlot];
+    _freeSlots[_numberOfFreeSlots++] = freedSlot;
+
+    // Move the last particle into the hole; this is a no-op if index is the last one
+    const size_t last = _size - 1;
+    _positions[index] = _positions[last];
+    _velocities[index] = _velocities[last];
+    _ages[index] = _ages[last];
+    _lifetimes[index] = _lifetimes[last];
+    _slots[index] = _slots[last];
+    _slotIndices[_slots[index]] = static_cast<uint32_t>(index);
+    --_size;
+}
+
+void ParticleStore::kill(ParticleHandle handle) {
+    if (!isAlive(handle))
+        return;
+    const size_t index = _slotIndices[handle.slot];
+    _ages[index] = _lifetimes[index];
+}
+
+size_t ParticleStore::removeExpired() {
+    const size_t oldSize = _size;
+    size_t i = 0;
+    while (i < _size) {
+        // Don't advance i after a removal, as the particle that was moved into the hole has
+        // not been tested yet
+        if (_ages[i] >= _lifetimes[i])
+            remove(i);
+        else
+            ++i;
+    }
+    return oldSize - _size;
+}
+
+void ParticleStore::clear() {
+    // Instead of returning the slot of every particle to the free stack, all slots become
+    // unused again. The handles to the cleared particles are rejected by 'isAlive' because
+    // their slots are no longer part of the live range, and by their generation once the
+    // slots are handed out again
+    _size = 0;
+    _numberOfFreeSlots = 0;
+    _firstUnusedSlot = 0;
+}
+
+glm::vec3* ParticleStore::positions() {
+    return _positions;
+}
+
+const glm::vec3* ParticleStore::positions() const {
+    return _positions;
+}
+
+glm::vec3* ParticleStore::velocities() {
+    return _velocities;
+}
+
+const glm::vec3* ParticleStore::velocities() const {
+    return _velocities;
+}
+
+float* ParticleStore::ages() {
+    return _ages;
+}
+
+const float* ParticleStore::ages() const {
+    return _ages;
+}
+
+float* ParticleStore::lifetimes() {
+    return _lifetimes;
+}
+
+const float* ParticleStore::lifetimes() const {
+    return _lifetimes;
+}
+
+PositionView ParticleStore::positionView() const {
+    // The view references our members directly, so it will follow any change in size
+    return PositionView(&_positions, &_size);
+}
+
+ParticleHandle ParticleStore::handle(size_t index) const {
+    assert(index < _size);
+    const ParticleHandle result = { _slots[index], _slotGenerations[_slots[index]] };
+    return result;
+}
+
+bool ParticleStore::isAlive(ParticleHandle handle) const {
+    if ((handle.slot >= _capacity) || (_slotGenerations[handle.slot] != handle.generation))
+        return false;
+    // A slot is only in use if the particle it points to points back at it
+    const size_t index = _slotIndices[handle.slot];
+    return (index < _size) && (_slots[index] == handle.slot);
+}
+
+size_t ParticleStore::indexOf(ParticleHandle handle) const {
+    assert(isAlive(handle));
+    return _slotIndices[handle.slot];
+}
+
+uint32_t* ParticleStore::particleSlots() {
+    return _slots;
+}
+
+const uint32_t* ParticleStore::particleSlots() const {
+    return _slots;
+}
+
+void ParticleStore::updateHandles(size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+        _slotIndices[_slots[i]] = static_cast<uint32_t>(i);
+}
+
+void ParticleStore::swapPositions(glm::vec3*& other) {
+    std::swap(_positions, other);
+}
+
+void ParticleStore::swapVelocities(glm::vec3*& other) {
+    std::swap(_velocities, other);
+}
+
+void ParticleStore::swapAges(float*& other) {
+    std::swap(_ages, other);
+}
+
+void ParticleStore::swapLifetimes(float*& other) {
+    std::swap(_lifetimes, other);
+}
+
+void ParticleStore::swapSlots(uint32_t*& other) {
+    std::swap(_slots, other);
+}
@@ -0,0 +1,165 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __PARTICLESTORE_H__
+#define __PARTICLESTORE_H__
+
+#include "positionview.h"
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+// A stable reference to a particle. The index of a particle changes whenever other particles are
+// removed or the store is sorted, but a handle stays valid for the whole life of the particle.
+// Slots are reused once a particle is removed; the generation tells the old and new occupant of
+// a slot apart, so a handle to a removed particle is detected instead of silently aliasing
+struct ParticleHandle {
+    uint32_t slot;
+    uint32_t generation;
+};
+
+// The ParticleStore holds the complete simulation state as a structure of arrays. Each attribute
+// lives in its own tightly packed array, so that a loop only has to stream through the attributes
+// it actually touches. All arrays are allocated once with a fixed capacity and are aligned to
+// 'Alignment' bytes. The capacity is rounded up to a multiple of 'BatchSize' so that vectorized
+// kernels can always operate on full batches. The particles [0, size()) are alive, the order of
+// the particles is not stable as removal is done by moving the last particle into the hole.
+// Every particle also occupies a slot of a fixed table that maps handles to indices. The slots
+// that were freed are kept on a stack, and the slots that have not been used since the last
+// 'clear' are handed out in order after the stack is empty, so spawning and removing a particle
+// is O(1) and never allocates, and clearing the whole store is O(1) as well
+class ParticleStore {
+public:
+    // The alignment in bytes of each of the attribute arrays (one AVX register)
+    static const size_t Alignment = 32;
+    // The number of particles that the vectorized kernels process at once
+    static const size_t BatchSize = 8;
+
+    // Allocates all attribute arrays for (at least) 'capacity' particles
+    explicit ParticleStore(size_t capacity);
+
+    // Frees all the attribute arrays
+    ~ParticleStore();
+
+    // Returns the number of particles that are currently alive
+    size_t size() const;
+    // Returns the maximum number of particles that can be stored
+    size_t capacity() const;
+    // Returns the number of particles that can still be added before the store is full
+    size_t available() const;
+
+    // Appends up to 'count' particles at the end of the store and returns the number of particles
+    // that were actually added. The new particles occupy [size() - added, size()) and their
+    // attributes are left uninitialized. If the store is full, fewer than 'count' are added
+    size_t allocate(size_t count);
+
+    // Removes the particle at 'index' by moving the last particle into its place
+    void remove(size_t index);
+
+    // Marks the particle referenced by 'handle' as expired. It is removed together with all
+    // other dead particles in the next 'removeExpired', so killing is O(1) and does not move
+    // any particles. Does nothing if the particle is already gone
+    void kill(ParticleHandle handle);
+
+    // Removes all particles whose age has reached their lifetime in one batch and returns how
+    // many particles were removed. Only the age and lifetime arrays are read until a dead
+    // particle is found
+    size_t removeExpired();
+
+    // Removes all particles in constant time by dropping all slots at once. Every handle
+    // becomes invalid, the capacity and the arrays are kept
+    void clear();
+
+    // Access to the individual attribute arrays. Each array has capacity() elements
+    glm::vec3* positions();
+    const glm::vec3* positions() const;
+    glm::vec3* velocities();
+    const glm::vec3* velocities() const;
+    float* ages();
+    const float* ages() const;
+    float* lifetimes();
+    const float* lifetimes() const;
+
+    // Returns a view onto the position array that will always reflect the current size
+    PositionView positionView() const;
+
+    // Returns the handle of the particle at 'index'
+    ParticleHandle handle(size_t index) const;
+    // Returns true if the particle referenced by 'handle' has not been removed yet
+    bool isAlive(ParticleHandle handle) const;
+    // Returns the current index of the particle referenced by 'handle', which has to be alive
+    size_t indexOf(ParticleHandle handle) const;
+
+    // The slot of each particle. Reordering code has to move it along with the attributes and
+    // call 'updateHandles' afterwards
+    uint32_t* particleSlots();
+    const uint32_t* particleSlots() const;
+    // Updates the handle table for the particles [begin, end) after they have been moved.
+    // Different ranges can be updated concurrently
+    void updateHandles(size_t begin, size_t end);
+
+    // Exchange one of the attribute arrays with 'other', which has to be allocated with at least
+    // capacity() elements and an alignment of 'Alignment'. This allows reordering the particles
+    // into a scratch array and adopting it without another copy. Views stay valid
+    void swapPositions(glm::vec3*& other);
+    void swapVelocities(glm::vec3*& other);
+    void swapAges(float*& other);
+    void swapLifetimes(float*& other);
+    void swapSlots(uint32_t*& other);
+
+private:
+    // The store owns raw memory, so copying it is not allowed
+    ParticleStore(const ParticleStore&) = delete;
+    ParticleStore& operator=(const ParticleStore&) = delete;
+
+    // The number of particles currently alive
+    size_t _size;
+    // The maximum number of particles
+    size_t _capacity;
+
+    // The position of each particle in world coordinates
+    glm::vec3* _positions;
+    // The velocity of each particle in units per second
+    glm::vec3* _velocities;
+    // The time in seconds each particle has been alive
+    float* _ages;
+    // The time in seconds after which each particle will be removed
+    float* _lifetimes;
+    // The slot in the handle table that belongs to each particle
+    uint32_t* _slots;
+
+    // The current index of the particle in each slot
+    uint32_t* _slotIndices;
+    // The generation of each slot, incremented every time its particle is removed
+    uint32_t* _slotGenerations;
+    // The stack of slots that were freed since the last 'clear'
+    uint32_t* _freeSlots;
+    // The number of slots on _freeSlots
+    size_t _numberOfFreeSlots;
+    // The slots from this one on have not been used since the last 'clear'. As every particle
+    // holds exactly one slot, these and the stack always add up to capacity() - size() slots
+    size_t _firstUnusedSlot;
+};
+
+#endif // __PARTICLESTORE_H__
@@ -0,0 +1,80 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __PHILOX_H__
+#define __PHILOX_H__
+
+#include <cstdint>
+
+// Philox4x32-10 is a counter-based random number generator (Salmon et al., "Parallel Random
+// Numbers: As Easy as 1, 2, 3", 2011). Instead of advancing a hidden state, it maps a 128 bit
+// counter and a 64 bit key to 128 random bits. Any thread can therefore compute the random
+// numbers of any particle directly from the particle's index without sharing, locking, or
+// storing a generator. The rounds are branch-free, so a loop over independent counters can be
+// vectorized by the compiler
+namespace philox {
+
+// The number of random 32 bit words that are generated per counter
+const int NumberOfWords = 4;
+
+// Replaces the four words in 'counter' with the random words for 'counter' and the key
+// 'key0', 'key1'
+inline void generate(uint32_t counter[NumberOfWords], uint32_t key0, uint32_t key1) {
+    const uint32_t multiplier0 = 0xD2511F53;
+    const uint32_t multiplier1 = 0xCD9E8D57;
+    const uint32_t weyl0 = 0x9E3779B9;
+    const uint32_t weyl1 = 0xBB67AE85;
+
+    uint32_t c0 = counter[0];
+    uint32_t c1 = counter[1];
+    uint32_t c2 = counter[2];
+    uint32_t c3 = counter[3];
+    for (int round = 0; round < 10; ++round) {
+        const uint64_t product0 = static_cast<uint64_t>(multiplier0) * c0;
+        const uint64_t product1 = static_cast<uint64_t>(multiplier1) * c2;
+        const uint32_t high0 = static_cast<uint32_t>(product0 >> 32);
+        const uint32_t low0 = static_cast<uint32_t>(product0);
+        const uint32_t high1 = static_cast<uint32_t>(product1 >> 32);
+        const uint32_t low1 = static_cast<uint32_t>(product1);
+        c0 = high1 ^ c1 ^ key0;
+        c1 = low1;
+        c2 = high0 ^ c3 ^ key1;
+        c3 = low0;
+        key0 += weyl0;
+        key1 += weyl1;
+    }
+    counter[0] = c0;
+    counter[1] = c1;
+    counter[2] = c2;
+    counter[3] = c3;
+}
+
+// Converts a random word into a float that is uniformly distributed in [0, 1)
+inline float toUnitFloat(uint32_t word) {
+    // Only 24 bits fit into the mantissa without rounding up to 1
+    return static_cast<float>(word >> 8) * (1.f / 16777216.f);
+}
+
+} // namespace philox
+
+#endif // __PHILOX_H__
@@ -0,0 +1,434 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "positioncodec.h"
+
+#include "spatialhash.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+    // The size of a chunk, which precedes the chunks in the frame
+    struct ChunkHeader {
+        uint32_t numberOfParticles;
+        uint32_t numberOfBytes;
+    };
+
+    // The code of the particles outside of the grid. The other codes are the zigzag encoded
+    // differences of the Morton keys plus one. The outside particles are skipped when the
+    // differences are computed, so the far jumps to and from them do not widen the group
+    const uint32_t _outsideCode = 0;
+
+    // The largest number of bits of a code
+    const int _maximumCodeBits = 17;
+
+    // Maps differences of small magnitude to small numbers, regardless of their sign
+    uint32_t zigzag(int32_t value) {
+        return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+    }
+
+    int32_t unzigzag(uint32_t value) {
+        return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+    }
+
+    // Returns the number of bits that are needed to store 'value'
+    int bitWidth(uint32_t value) {
+        int width = 0;
+        while ((value >> width) != 0)
+            ++width;
+        return width;
+    }
+
+    // Returns the number of bytes of a group of 'count' particles with 'changes' codes of
+    // 'width' bits, including the byte with the width
+    size_t groupBytes(size_t count, size_t changes, int width, int precisionBits) {
+        const size_t bits = count * (1 + 3 * static_cast<size_t>(precisionBits)) +
+            changes * static_cast<size_t>(width);
+        return 1 + (bits + 7) / 8;
+    }
+
+    // Writes values of up to 32 bits into memory, least significant bit first
+    class BitWriter {
+    public:
+        explicit BitWriter(char* data)
+            : _data(data)
+            , _bits(0)
+            , _numberOfBits(0)
+        {}
+
+        // Appends the lower 'numberOfBits' bits of 'value', which must not have other bits set
+        void write(uint32_t value, int numberOfBits) {
+            _bits |= static_cast<uint64_t>(value) << _numberOfBits;
+            _numberOfBits += numberOfBits;
+            while (_numberOfBits >= 8) {
+                *_data++ = static_cast<char>(_bits & 0xff);
+                _bits >>= 8;
+                _numberOfBits -= 8;
+            }
+        }
+
+        // Writes the bits that do not fill a whole byte yet, padded with zeros
+        void flush() {
+            if (_numberOfBits > 0)
+                *_data++ = static_cast<char>(_bits & 0xff);
+            _bits = 0;
+            _numberOfBits = 0;
+        }
+
+        // Returns the byte after the last one that was written
+        char* end() const {
+            return _data;
+        }
+
+    private:
+        char* _data;
+        uint64_t _bits;
+        int _numberOfBits;
+    };
+
+    // Reads the values written by a BitWriter. It only reads the bytes that contain the bits it
+    // returns
+    class BitReader {
+    public:
+        explicit BitReader(const char* data)
+            : _data(data)
+            , _bits(0)
+            , _numberOfBits(0)
+        {}
+
+        // Returns the next 'numberOfBits' bits
+        uint32_t read(int numberOfBits) {
+            while (_numberOfBits < numberOfBits) {
+                _bits |= static_cast<uint64_t>(static_cast<uint8_t>(*_data++)) << _numberOfBits;
+                _numberOfBits += 8;
+            }
+            const uint32_t value =
+                static_cast<uint32_t>(_bits & ((uint64_t(1) << numberOfBits) - 1));
+            _bits >>= numberOfBits;
+            _numberOfBits -= numberOfBits;
+            return value;
+        }
+
+    private:
+        const char* _data;
+        uint64_t _bits;
+        int _numberOfBits;
+    };
+}
+
+const size_t PositionCodec::ParticlesPerGroup;
+const size_t PositionCodec::ParticlesPerChunk;
+
+PositionCodec::PositionCodec(const PositionQuantizer& quantizer, int precisionBits)
+    : _quantizer(quantizer)
+    , _precisionBits(std::max(1, std::min(precisionBits, 16)))
+{
+    const int bits = quantizer.resolutionBits();
+    const int resolution = 1 << bits;
+    _keys.resize(size_t(1) << (3 * bits));
+    _cells.resize(_keys.size());
+    for (int z = 0; z < resolution; ++z) {
+        for (int y = 0; y < resolution; ++y) {
+            for (int x = 0; x < resolution; ++x) {
+                const uint16_t cell = static_cast<uint16_t>(x | (y << bits) | (z << (2 * bits)));
+                const uint16_t key = static_cast<uint16_t>(SpatialHash::key(glm::ivec3(x, y, z)));
+                _keys[cell] = key;
+                _cells[key] = cell;
+            }
+        }
+    }
+}
+
+size_t PositionCodec::encode(const QuantizedPosition* positions, size_t count, size_t stride,
+    ThreadPool& pool, std::vector<char>& frame)
+{
+    stride = std::max(stride, size_t(1));
+    const size_t numberOfParticles = (count + stride - 1) / stride;
+    const size_t numberOfChunks = (numberOfParticles + ParticlesPerChunk - 1) / ParticlesPerChunk;
+    if (_chunks.size() < numberOfChunks)
+        _chunks.resize(numberOfChunks);
+
+    const int shift = 16 - _precisionBits;
+    // The three offsets of a particle are written at once if they fit
+    const bool packsOffsets = (3 * _precisionBits <= 32);
+    const size_t largestGroup =
+        groupBytes(ParticlesPerGroup, ParticlesPerGroup, _maximumCodeBits, _precisionBits);
+    pool.parallelFor(0, numberOfChunks, 1, [&](size_t begin, size_t end) {
+        uint32_t codes[ParticlesPerGroup];
+        uint32_t isChanged[ParticlesPerGroup];
+        for (size_t c = begin; c < end; ++c) {
+            const size_t first = c * ParticlesPerChunk;
+            const size_t last = std::min(first + ParticlesPerChunk, numberOfParticles);
+            std::vector<char>& chunk = _chunks[c];
+            chunk.resize((last - first + ParticlesPerGroup - 1) / ParticlesPerGroup * largestGroup);
+
+            BitWriter writer(chunk.data());
+            uint32_t previous = 0;
+            for (size_t group = first; group < last; group += ParticlesPerGroup) {
+                const size_t n = std::min(ParticlesPerGroup, last - group);
+                // The width of the largest code is that of all of them combined
+                uint32_t combined = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    const QuantizedPosition& p = positions[(group + i) * stride];
+                    isChanged[i] = 1;
+                    codes[i] = _outsideCode;
+                    if (p.cell & PositionQuantizer::OutsideFlag)
+                        continue;
+                    const uint32_t key = _keys[p.cell];
+                    isChanged[i] = (key != previous) ? 1 : 0;
+                    codes[i] = zigzag(static_cast<int32_t>(key) -
+                        static_cast<int32_t>(previous)) + 1;
+                    combined |= codes[i] * isChanged[i];
+                    previous = key;
+                }
+                const int width = bitWidth(combined);
+                writer.write(static_cast<uint32_t>(width), 8);
+                for (size_t i = 0; i < n; i += 32) {
+                    uint32_t flags = 0;
+                    const size_t flagCount = std::min(n - i, size_t(32));
+                    for (size_t j = 0; j < flagCount; ++j)
+                        flags |= isChanged[i + j] << j;
+                    writer.write(flags, static_cast<int>(flagCount));
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    if (isChanged[i])
+                        writer.write(codes[i], width);
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    const QuantizedPosition& p = positions[(group + i) * stride];
+                    const uint32_t x = static_cast<uint32_t>(p.x >> shift);
+                    const uint32_t y = static_cast<uint32_t>(p.y >> shift);
+                    const uint32_t z = static_cast<uint32_t>(p.z >> shift);
+                    if (packsOffsets) {
+                        writer.write(x | (y << _precisionBits) | (z << (2 * _precisionBits)),
+                            3 * _precisionBits);
+                    }
+                    else {
+                        writer.write(x, _precisionBits);
+                        writer.write(y, _precisionBits);
+                        writer.write(z, _precisionBits);
+                    }
+                }
+                writer.flush();
+            }
+            chunk.resize(static_cast<size_t>(writer.end() - chunk.data()));
+        }
+    });
+
+    size_t numberOfBytes = sizeof(uint32_t) + numberOfChunks * sizeof(ChunkHeader);
+    for (size_t c = 0; c < numberOfChunks; ++c)
+        numberOfBytes += _chunks[c].size();
+    const size_t offset = frame.size();
+    frame.resize(offset + numberOfBytes);
+
+    char* out = frame.data() + offset;
+    const uint32_t chunks = static_cast<uint32_t>(numberOfChunks);
+    std::memcpy(out, &chunks, sizeof(chunks));
+    out += sizeof(chunks);
+    for (size_t c = 0; c < numberOfChunks; ++c) {
+        const size_t first = c * ParticlesPerChunk;
+        const ChunkHeader header = {
+            static_cast<uint32_t>(std::min(ParticlesPerChunk, numberOfParticles - first)),
+            static_cast<uint32_t>(_chunks[c].size())
+        };
+        std::memcpy(out, &header, sizeof(header));
+        out += sizeof(header);
+    }
+    for (size_t c = 0; c < numberOfChunks; ++c) {
+        std::memcpy(out, _chunks[c].data(), _chunks[c].size());
+        out += _chunks[c].size();
+    }
+    return numberOfParticles;
+}
+
+bool PositionCodec::decode(const char* data, size_t size, size_t capacity, ThreadPool& pool,
+    QuantizedPosition* positions, size_t& count)
+{
+    return decodeFrame(data, size, capacity, pool, positions, count,
+        [](QuantizedPosition& position, const QuantizedPosition& quantized) {
+            position = quantized;
+        });
+}
+
+bool PositionCodec::decode(const char* data, size_t size, size_t capacity, ThreadPool& pool,
+    glm::vec3* positions, size_t& count)
+{
+    const PositionQuantizer& quantizer = _quantizer;
+    return decodeFrame(data, size, capacity, pool, positions, count,
+        [&quantizer](glm::vec3& position, const QuantizedPosition& quantized) {
+            if (quantized.cell & PositionQuantizer::OutsideFlag)
+                position = glm::vec3(std::numeric_limits<float>::quiet_NaN());
+            else
+                position = quantizer.decode(quantized);
+        });
+}
+
+template <typename Output, typename Store>
+bool PositionCodec::decodeFrame(const char* data, size_t size, size_t capacity,
+    ThreadPool& pool, Output* positions, size_t& count, Store store)
+{
+    count = 0;
+    uint32_t numberOfChunks = 0;
+    if (size < sizeof(numberOfChunks))
+        return false;
+    std::memcpy(&numberOfChunks, data, sizeof(numberOfChunks));
+    if (numberOfChunks > (size - sizeof(numberOfChunks)) / sizeof(ChunkHeader))
+        return false;
+
+    // Check the layout before anything is decoded, so the chunks only have to check their
+    // own bytes. All chunks but the last are full, so each knows where its particles go
+    const char* headers = data + sizeof(numberOfChunks);
+    const char* chunks = headers + numberOfChunks * sizeof(ChunkHeader);
+    _chunkOffsets.resize(numberOfChunks + 1);
+    _chunkOffsets[0] = 0;
+    size_t numberOfParticles = 0;
+    for (uint32_t c = 0; c < numberOfChunks; ++c) {
+        ChunkHeader header;
+        std::memcpy(&header, headers + c * sizeof(ChunkHeader), sizeof(header));
+        const bool isLast = (c + 1 == numberOfChunks);
+        if ((header.numberOfParticles == 0) || (header.numberOfParticles > ParticlesPerChunk) ||
+            (!isLast && (header.numberOfParticles != ParticlesPerChunk)))
+        {
+            return false;
+        }
+        numberOfParticles += header.numberOfParticles;
+        _chunkOffsets[c + 1] = _chunkOffsets[c] + header.numberOfBytes;
+    }
+    if ((numberOfParticles > capacity) ||
+        (_chunkOffsets[numberOfChunks] != static_cast<size_t>(data + size - chunks)))
+    {
+        return false;
+    }
+
+    const int shift = 16 - _precisionBits;
+    // The offsets are restored to the middle of the range that was cut off
+    const uint32_t half = (shift > 0) ? (1u << (shift - 1)) : 0u;
+    const bool packsOffsets = (3 * _precisionBits <= 32);
+    const uint32_t mask = (1u << _precisionBits) - 1;
+    const uint32_t numberOfCells = static_cast<uint32_t>(_cells.size());
+    _chunkFailed.assign(numberOfChunks, 0);
+    pool.parallelFor(0, numberOfChunks, 1, [&](size_t begin, size_t end) {
+        uint32_t isChanged[ParticlesPerGroup];
+        uint16_t cells[ParticlesPerGroup];
+        for (size_t c = begin; c < end; ++c) {
+            const char* in = chunks + _chunkOffsets[c];
+            const char* chunkEnd = chunks + _chunkOffsets[c + 1];
+            const size_t first = c * ParticlesPerChunk;
+            const size_t last = std::min(first + ParticlesPerChunk, numberOfParticles);
+            uint32_t previous = 0;
+            for (size_t group = first; group < last; group += ParticlesPerGroup) {
+                const size_t n = std::min(ParticlesPerGroup, last - group);
+                // The flags tell how many codes there are, and so how long the group is
+                const size_t available = static_cast<size_t>(chunkEnd - in);
+                const int width = (available > 0) ? static_cast<uint8_t>(*in) : 0xff;
+                if ((width > _maximumCodeBits) ||
+                    (groupBytes(n, 0, width, _precisionBits) > available))
+                {
+                    _chunkFailed[c] = 1;
+                    break;
+                }
+                BitReader reader(in + 1);
+                size_t changes = 0;
+                for (size_t i = 0; i < n; i += 32) {
+                    const size_t flagCount = std::min(n - i, size_t(32));
+                    const uint32_t flags = reader.read(static_cast<int>(flagCount));
+                    for (size_t j = 0; j < flagCount; ++j) {
+                        isChanged[i + j] = (flags >> j) & 1;
+                        changes += isChanged[i + j];
+                    }
+                }
+                const size_t bytes = groupBytes(n, changes, width, _precisionBits);
+                if (bytes > available) {
+                    _chunkFailed[c] = 1;
+                    break;
+                }
+
+                bool isValid = true;
+                uint16_t cell = (previous < numberOfCells) ? _cells[previous] : 0;
+                for (size_t i = 0; i < n; ++i) {
+                    if (!isChanged[i]) {
+                        cells[i] = cell;
+                        continue;
+                    }
+                    const uint32_t code = reader.read(width);
+                    if (code == _outsideCode) {
+                        cells[i] = PositionQuantizer::OutsideFlag;
+                        continue;
+                    }
+                    previous += static_cast<uint32_t>(unzigzag(code - 1));
+                    if (previous >= numberOfCells) {
+                        isValid = false;
+                        break;
+                    }
+                    cell = _cells[previous];
+                    cells[i] = cell;
+                }
+                if (!isValid) {
+                    _chunkFailed[c] = 1;
+                    break;
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    uint32_t x;
+                    uint32_t y;
+                    uint32_t z;
+                    if (packsOffsets) {
+                        const uint32_t offsets = reader.read(3 * _precisionBits);
+                        x = offsets & mask;
+                        y = (offsets >> _precisionBits) & mask;
+                        z = offsets >> (2 * _precisionBits);
+                    }
+                    else {
+                        x = reader.read(_precisionBits);
+                        y = reader.read(_precisionBits);
+                        z = reader.read(_precisionBits);
+                    }
+                    x = (x << shift) | half;
+                    y = (y << shift) | half;
+                    z = (z << shift) | half;
+                    const QuantizedPosition quantized = { static_cast<uint16_t>(x),
+                        static_cast<uint16_t>(y), static_cast<uint16_t>(z), cells[i] };
+                    store(positions[group + i], quantized);
+                }
+                in += bytes;
+            }
+            if (in != chunkEnd)
+                _chunkFailed[c] = 1;
+        }
+    });
+
+    if (std::find(_chunkFailed.begin(), _chunkFailed.end(), 1) != _chunkFailed.end())
+        return false;
+    count = numberOfParticles;
+    return true;
+}
+
+const PositionQuantizer& PositionCodec::quantizer() const {
+    return _quantizer;
+}
+
+int PositionCodec::precisionBits() const {
+    return _precisionBits;
+}
@@ -0,0 +1,102 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __POSITIONCODEC_H__
+#define __POSITIONCODEC_H__
+
+#include "positionquantizer.h"
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+// The PositionCodec compresses QuantizedPositions for the stream from a server to a remote
+// viewer. Only the upper 'precisionBits' of the offsets within the cells are kept. The spatial
+// hash sorts the particles along the Morton curve, so consecutive particles are mostly in the
+// same cell, and otherwise in one whose Morton key is close. The particles are packed in
+// groups of ParticlesPerGroup: a byte with the bit width of the group's codes, one bit per
+// particle that tells whether its cell differs from the previous one, a code with that width
+// for each of those particles (the zigzag encoded difference of the Morton keys, or the
+// particle is outside of the grid), and finally the offsets. At 8 bits of precision, a
+// particle takes about 3.3 instead of 8 bytes. The chunks of ParticlesPerChunk particles do not
+// depend on each other, so they are encoded and decoded in parallel. A frame starts with the
+// number of chunks, then the number of particles and of bytes of each chunk, then the chunks
+class PositionCodec {
+public:
+    // The number of particles that share the bit width of their codes
+    static const size_t ParticlesPerGroup = 128;
+    // The number of particles that are encoded independently of the others
+    static const size_t ParticlesPerChunk = 64 * 1024;
+
+    // Encodes the positions of 'quantizer', keeping 'precisionBits' of each offset, which is
+    // clamped to [1, 16]. The quantizer has to outlive the codec
+    PositionCodec(const PositionQuantizer& quantizer, int precisionBits);
+
+    // Appends every 'stride'-th of the first 'count' elements of 'positions' to 'frame'.
+    // Returns the number of positions that were encoded
+    size_t encode(const QuantizedPosition* positions, size_t count, size_t stride,
+        ThreadPool& pool, std::vector<char>& frame);
+
+    // Decodes the 'size' bytes of the frame at 'data' into 'positions', which has room for
+    // 'capacity' positions, and stores their number in 'count'. The position of a particle
+    // that was outside of the grid is the OutsideFlag, or NaN for glm::vec3s. Returns false if
+    // the frame is malformed or does not fit
+    bool decode(const char* data, size_t size, size_t capacity, ThreadPool& pool,
+        QuantizedPosition* positions, size_t& count);
+    bool decode(const char* data, size_t size, size_t capacity, ThreadPool& pool,
+        glm::vec3* positions, size_t& count);
+
+    // Returns the quantization that the offsets are relative to
+    const PositionQuantizer& quantizer() const;
+
+    // Returns the number of bits that are kept of each offset
+    int precisionBits() const;
+
+private:
+    PositionCodec(const PositionCodec&) = delete;
+    PositionCodec& operator=(const PositionCodec&) = delete;
+
+    // Decodes a frame into 'positions', storing each position through 'store(position,
+    // quantized)'
+    template <typename Output, typename Store>
+    bool decodeFrame(const char* data, size_t size, size_t capacity, ThreadPool& pool,
+        Output* positions, size_t& count, Store store);
+
+    // The cells the offsets are relative to
+    const PositionQuantizer& _quantizer;
+    // The number of bits that are kept of each offset
+    int _precisionBits;
+    // The Morton key of each cell of the quantizer, and the cell of each Morton key
+    std::vector<uint16_t> _keys;
+    std::vector<uint16_t> _cells;
+    // The encoded bytes of each chunk, which are kept to reuse their memory
+    std::vector<std::vector<char>> _chunks;
+    // The offset of each chunk in the frame that is decoded, and whether it was malformed
+    std::vector<size_t> _chunkOffsets;
+    std::vector<char> _chunkFailed;
+};
+
+#endif // __POSITIONCODEC_H__
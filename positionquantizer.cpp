@@ -0,0 +1,110 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "positionquantizer.h"
+
+#include "spatialhash.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+    // The number of steps within a cell; the largest offset is the far side of the cell
+    const float _steps = 65535.f;
+}
+
+const int PositionQuantizer::MaximumResolutionBits;
+const uint16_t PositionQuantizer::OutsideFlag;
+
+PositionQuantizer::PositionQuantizer(const SpatialHash& grid)
+    : _minimum(grid.minimum())
+    , _resolutionBits(0)
+    , _resolution(1)
+{
+    // Merging cells keeps the box of the grid the same
+    int bits = 0;
+    while ((1 << bits) < grid.resolution())
+        ++bits;
+    _resolutionBits = std::min(bits, MaximumResolutionBits);
+    _resolution = 1 << _resolutionBits;
+    _cellSize = grid.cellSize() * (static_cast<float>(grid.resolution()) / _resolution);
+    _inverseCellSize = 1.f / _cellSize;
+}
+
+void PositionQuantizer::encode(const glm::vec3* positions, const glm::vec3* velocities,
+    float offset, size_t count, QuantizedPosition* quantized) const
+{
+    const float resolution = static_cast<float>(_resolution);
+    for (size_t i = 0; i < count; ++i) {
+        // The continuous cell coordinates; the integer part is the cell, the rest the offset
+        const glm::vec3 p = (positions[i] + velocities[i] * offset - _minimum) * _inverseCellSize;
+        if (!(p.x >= 0.f && p.y >= 0.f && p.z >= 0.f &&
+            p.x < resolution && p.y < resolution && p.z < resolution))
+        {
+            // Also catches NaNs
+            quantized[i] = { 0, 0, 0, OutsideFlag };
+            continue;
+        }
+
+        // The coordinates are not negative, so truncating them is the same as rounding down
+        const int x = static_cast<int>(p.x);
+        const int y = static_cast<int>(p.y);
+        const int z = static_cast<int>(p.z);
+        const glm::vec3 fraction = (p - glm::vec3(x, y, z)) * _steps + 0.5f;
+        quantized[i].x = static_cast<uint16_t>(std::min(fraction.x, _steps));
+        quantized[i].y = static_cast<uint16_t>(std::min(fraction.y, _steps));
+        quantized[i].z = static_cast<uint16_t>(std::min(fraction.z, _steps));
+        quantized[i].cell = static_cast<uint16_t>(x | (y << _resolutionBits) |
+            (z << (2 * _resolutionBits)));
+    }
+}
+
+glm::vec3 PositionQuantizer::decode(const QuantizedPosition& quantized) const {
+    const int mask = _resolution - 1;
+    const glm::vec3 cell(
+        quantized.cell & mask,
+        (quantized.cell >> _resolutionBits) & mask,
+        (quantized.cell >> (2 * _resolutionBits)) & mask
+    );
+    const glm::vec3 fraction = glm::vec3(quantized.x, quantized.y, quantized.z) / _steps;
+    return _minimum + (cell + fraction) * _cellSize;
+}
+
+glm::vec3 PositionQuantizer::maximumError() const {
+    // Half a step from rounding, plus the rounding of the float arithmetic in the grid
+    const glm::vec3 extent = glm::abs(_minimum) + _cellSize * static_cast<float>(_resolution);
+    return _cellSize * (0.5f / _steps) + extent * 4.f * std::numeric_limits<float>::epsilon();
+}
+
+glm::vec3 PositionQuantizer::minimum() const {
+    return _minimum;
+}
+
+glm::vec3 PositionQuantizer::cellSize() const {
+    return _cellSize;
+}
+
+int PositionQuantizer::resolutionBits() const {
+    return _resolutionBits;
+}
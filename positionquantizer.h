@@ -0,0 +1,90 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __POSITIONQUANTIZER_H__
+#define __POSITIONQUANTIZER_H__
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+class SpatialHash;
+
+// A particle position in 8 instead of 12 bytes. 'x', 'y', and 'z' are the fixed point offset
+// within a grid cell, where 65535 is the far side of the cell. The lower bits of 'cell' are
+// the cell coordinates, x first, with PositionQuantizer::resolutionBits() bits each. If the
+// OutsideFlag is set, the particle was outside of the grid and has no position
+struct QuantizedPosition {
+    uint16_t x;
+    uint16_t y;
+    uint16_t z;
+    uint16_t cell;
+};
+static_assert(sizeof(QuantizedPosition) == 8, "QuantizedPositions have to be tightly packed");
+
+// The PositionQuantizer packs the particle positions into QuantizedPositions relative to the
+// cells of a SpatialHash, so that the precision is the same everywhere in the grid. Rounding
+// to the closest of the 65536 steps per cell moves a position by at most maximumError() along
+// each axis. Only the copies that are handed to the renderer are quantized; the simulation
+// keeps its full precision, so the error does not accumulate from step to step
+class PositionQuantizer {
+public:
+    // The cell coordinates of all three axes have to fit next to the OutsideFlag
+    static const int MaximumResolutionBits = 5;
+    static const uint16_t OutsideFlag = 0x8000;
+
+    // Uses the box of 'grid'. Grids with more than 2^MaximumResolutionBits cells along each
+    // axis are quantized with correspondingly larger cells
+    explicit PositionQuantizer(const SpatialHash& grid);
+
+    // Writes 'positions' + 'velocities' * 'offset' of 'count' particles into 'quantized'
+    void encode(const glm::vec3* positions, const glm::vec3* velocities, float offset,
+        size_t count, QuantizedPosition* quantized) const;
+
+    // Returns the position that 'quantized' stands for. Must not be called for positions with
+    // the OutsideFlag
+    glm::vec3 decode(const QuantizedPosition& quantized) const;
+
+    // Returns the largest difference along each axis between a position inside the grid and
+    // its decoded quantization
+    glm::vec3 maximumError() const;
+
+    // Returns the lower corner of the grid
+    glm::vec3 minimum() const;
+    // Returns the edge length of the cells along each axis
+    glm::vec3 cellSize() const;
+    // Returns the number of bits per axis of the cell coordinates
+    int resolutionBits() const;
+
+private:
+    // The lower corner of the grid
+    glm::vec3 _minimum;
+    // The edge length of the cells and its inverse
+    glm::vec3 _cellSize;
+    glm::vec3 _inverseCellSize;
+    // The number of bits per axis of the cell coordinates and the number of cells per axis
+    int _resolutionBits;
+    int _resolution;
+};
+
+#endif // __POSITIONQUANTIZER_H__
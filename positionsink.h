@@ -0,0 +1,66 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __POSITIONSINK_H__
+#define __POSITIONSINK_H__
+
+#include "particleattributes.h"
+
+#include <glm/glm.hpp>
+#include <cstddef>
+
+struct QuantizedPosition;
+
+// A PositionSink provides memory that the simulation writes the particle positions of a step
+// into directly, for example a persistently mapped buffer of the renderer. Both functions are
+// called on the thread that owns the sink (the GUI thread); the memory itself is written by
+// the simulation thread in between the two calls. A sink can also ask for QuantizedPositions,
+// which are written through 'beginWriteQuantized' instead, and memory for the attribute
+// channels that accompany the positions
+class PositionSink {
+public:
+    virtual ~PositionSink() {}
+
+    // Returns memory for as many positions as the simulation has capacity for, which stays
+    // valid until the matching 'endWrite'. Might block until the memory is no longer in use.
+    // Returns a nullptr if the sink is not able to provide memory (yet)
+    virtual glm::vec3* beginWrite() = 0;
+
+    // Returns true if the positions should be written through 'beginWriteQuantized' instead of
+    // 'beginWrite'
+    virtual bool quantizesPositions() const { return false; }
+
+    // Like 'beginWrite', but returns memory for QuantizedPositions
+    virtual QuantizedPosition* beginWriteQuantized() { return nullptr; }
+
+    // Returns memory for the values of 'channel' that accompany the positions of the last
+    // 'beginWrite', which stays valid until the matching 'endWrite'. Returns a nullptr if the
+    // sink does not take that channel
+    virtual void* beginWriteAttribute(AttributeChannel /*channel*/) { return nullptr; }
+
+    // Signals that the memory from the last 'beginWrite' contains the positions of 'count'
+    // particles and can be consumed
+    virtual void endWrite(size_t count) = 0;
+};
+
+#endif // __POSITIONSINK_H__
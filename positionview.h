@@ -0,0 +1,86 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __POSITIONVIEW_H__
+#define __POSITIONVIEW_H__
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+// A non-owning, read-only view onto an array of particle positions. Instead of the values
+// themselves, the view stores pointers to the owner's data pointer and element count, so that it
+// always reflects the current state of the owner without having to be reassigned or copying data.
+// An owner that knows when its positions change can also hand out a version that it increments
+// with every change, so that readers can skip data they have already seen. The owner has to
+// outlive every view that was created from it
+class PositionView {
+public:
+    // Creates an empty view that does not reference any data
+    PositionView()
+        : _data(nullptr)
+        , _size(nullptr)
+        , _version(nullptr)
+    {}
+
+    // Creates a view onto the array pointed to by '*data' with '*size' elements. If 'version'
+    // is not a nullptr, the owner increments '*version' whenever the positions change
+    PositionView(const glm::vec3* const* data, const size_t* size,
+        const uint64_t* version = nullptr)
+        : _data(data)
+        , _size(size)
+        , _version(version)
+    {}
+
+    // Returns the pointer to the first position or nullptr if there is no data
+    const glm::vec3* data() const {
+        return (_data != nullptr) ? *_data : nullptr;
+    }
+
+    // Returns the number of positions that are currently in the array
+    size_t size() const {
+        return (_size != nullptr) ? *_size : 0;
+    }
+
+    // Returns true if the view does not reference any positions at the moment
+    bool empty() const {
+        return (data() == nullptr) || (size() == 0);
+    }
+
+    // Returns true if the owner tracks the changes of the positions with a version
+    bool isVersioned() const {
+        return _version != nullptr;
+    }
+
+    // Returns the current version of the positions, or 0 if the owner does not track them
+    uint64_t version() const {
+        return (_version != nullptr) ? *_version : 0;
+    }
+
+private:
+    const glm::vec3* const* _data;
+    const size_t* _size;
+    const uint64_t* _version;
+};
+
+#endif // __POSITIONVIEW_H__
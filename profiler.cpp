@@ -0,0 +1,108 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "profiler.h"
+
+#include <algorithm>
+
+Profiler::ScopedTimer::ScopedTimer(Profiler* profiler, Section section)
+    : _profiler(profiler)
+    , _section(section)
+{
+    if (_profiler != nullptr)
+        _start = std::chrono::steady_clock::now();
+}
+
+Profiler::ScopedTimer::~ScopedTimer() {
+    if (_profiler == nullptr)
+        return;
+    const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    const std::chrono::duration<float, std::milli> duration = end - _start;
+    _profiler->record(_section, duration.count());
+}
+
+Profiler::Profiler() {
+    for (Samples& samples : _samples) {
+        samples.values.fill(0.f);
+        samples.next = 0;
+        samples.count = 0;
+    }
+}
+
+void Profiler::record(Section section, float milliseconds) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Samples& samples = _samples[static_cast<int>(section)];
+    samples.values[samples.next] = milliseconds;
+    samples.next = (samples.next + 1) % NumberOfSamples;
+    samples.count = std::min(samples.count + 1, static_cast<int>(NumberOfSamples));
+}
+
+Profiler::Statistics Profiler::statistics(Section section) const {
+    // Sort a copy, so that the lock is not held while sorting
+    std::array<float, NumberOfSamples> values;
+    int count = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const Samples& samples = _samples[static_cast<int>(section)];
+        values = samples.values;
+        count = samples.count;
+    }
+
+    Statistics result = { 0.f, 0.f, 0.f, count };
+    if (count == 0)
+        return result;
+
+    // Until the ring buffer is full, the valid values are the first 'count' ones
+    std::sort(values.begin(), values.begin() + count);
+    result.median = values[count / 2];
+    result.percentile99 = values[std::min((count * 99) / 100, count - 1)];
+    result.maximum = values[count - 1];
+    return result;
+}
+
+std::string Profiler::name(Section section) {
+    switch (section) {
+    case Section::Update:
+        return "Update";
+    case Section::Step:
+        return "Step";
+    case Section::Emit:
+        return "Emit";
+    case Section::Effects:
+        return "Effects";
+    case Section::Sort:
+        return "Sort";
+    case Section::Integrate:
+        return "Integrate";
+    case Section::Upload:
+        return "Upload";
+    case Section::Draw:
+        return "Draw";
+    case Section::GpuDraw:
+        return "Draw (GPU)";
+    case Section::Frame:
+        return "Frame";
+    default:
+        return "Unknown";
+    }
+}
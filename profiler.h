@@ -0,0 +1,123 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+// The Profiler collects the durations of the subsystems of a frame. Each section keeps the last
+// 'NumberOfSamples' durations in a ring buffer from which rolling percentiles are computed.
+// Recording is cheap and never blocks on the GPU: CPU sections are measured with ScopedTimer,
+// GPU durations are measured with timestamp queries elsewhere and passed to 'record' once they
+// are available. Sections may be recorded and read from different threads
+class Profiler {
+public:
+    // The subsystems that are measured
+    enum class Section {
+        // The update callback on the GUI thread
+        Update,
+        // A complete simulation step
+        Step,
+        // Spawning new particles
+        Emit,
+        // Applying the effects to the particles
+        Effects,
+        // Sorting the particles into the spatial hash
+        Sort,
+        // Integrating the particles
+        Integrate,
+        // Getting the particle positions into the vertex buffer
+        Upload,
+        // Issuing the draw calls on the CPU
+        Draw,
+        // Executing the draw calls on the GPU
+        GpuDraw,
+        // The time between two buffer swaps
+        Frame
+    };
+    // The number of values in Section
+    static const int NumberOfSections = 10;
+    // The number of durations per section that the statistics are computed from
+    static const int NumberOfSamples = 128;
+
+    // The summary of the recent durations of a section, all values in milliseconds
+    struct Statistics {
+        float median;
+        float percentile99;
+        float maximum;
+        // The number of durations the values are based on
+        int numberOfSamples;
+    };
+
+    // Measures the time between its construction and destruction and records it in 'section'.
+    // Passing a nullptr as 'profiler' disables the measurement
+    class ScopedTimer {
+    public:
+        ScopedTimer(Profiler* profiler, Section section);
+        ~ScopedTimer();
+
+    private:
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+        Profiler* _profiler;
+        Section _section;
+        std::chrono::steady_clock::time_point _start;
+    };
+
+    // Creates a profiler without any samples
+    Profiler();
+
+    // Adds the 'milliseconds' that 'section' took to the statistics
+    void record(Section section, float milliseconds);
+
+    // Returns the statistics of the recent durations of 'section'
+    Statistics statistics(Section section) const;
+
+    // Returns a human readable name for 'section'
+    static std::string name(Section section);
+
+private:
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    // The recent durations of a single section
+    struct Samples {
+        std::array<float, NumberOfSamples> values;
+        // The position the next value is written to
+        int next;
+        // The number of valid values; stops growing at NumberOfSamples
+        int count;
+    };
+
+    // Guards _samples, as sections are recorded from the GUI and the simulation threads
+    mutable std::mutex _mutex;
+    std::array<Samples, NumberOfSections> _samples;
+};
+
+#endif // __PROFILER_H__
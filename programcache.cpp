@@ -0,0 +1,211 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "programcache.h"
+
+#include <ghoul/logging/logging>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace ghoul::opengl;
+
+namespace {
+    const std::string _loggerCat = "ProgramCache";
+
+    // Identifies the binary files
+    const char _magic[8] = { 'P', 'R', 'O', 'G', 'B', 'I', 'N', '\0' };
+
+    // The start of each binary file
+    struct Header {
+        char magic[8];
+        // The format of the binary as returned by the driver
+        uint32_t format;
+        // The number of bytes of the binary that follow the header
+        uint32_t length;
+    };
+
+    // Adds 'text' and its terminating zero to the FNV-1a hash 'hash', so that consecutive
+    // strings cannot be shifted into each other
+    uint64_t hashString(uint64_t hash, const std::string& text) {
+        const uint64_t prime = 1099511628211ull;
+        for (char c : text)
+            hash = (hash ^ static_cast<unsigned char>(c)) * prime;
+        return hash * prime;
+    }
+
+    // Returns the string OpenGL returns for 'name', or an empty string
+    std::string glString(GLenum name) {
+        const GLubyte* value = glGetString(name);
+        return (value != nullptr) ? reinterpret_cast<const char*>(value) : "";
+    }
+
+    // Reads the complete file at 'path' into 'contents'. Returns false if that failed
+    bool readFile(const std::string& path, std::string& contents) {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file)
+            return false;
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return true;
+    }
+}
+
+ProgramCache::ProgramCache(const std::string& directory)
+    : _directory(directory)
+    , _directoryExists(false)
+{}
+
+bool ProgramCache::isSupported() {
+    if (!GLEW_ARB_get_program_binary)
+        return false;
+    // Some drivers support the extension, but not a single format
+    GLint numberOfFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numberOfFormats);
+    return numberOfFormats > 0;
+}
+
+ProgramObject* ProgramCache::createProgram(const Description& description) {
+    ProgramObject* program = new ProgramObject(description.name);
+    const GLuint id = *program;
+
+    const std::string path = isSupported() ? binaryPath(description) : "";
+    if (!path.empty() && loadBinary(id, path)) {
+        LDEBUG("Loaded the binary of '" << description.name << "'");
+        return program;
+    }
+
+    // errors that occur during either step will be written to the Logmanager by the
+    // ProgramObject and ShaderObject
+    program->attachObject(
+        new ShaderObject(ShaderObject::ShaderTypeVertex, description.vertexShader));
+    program->attachObject(
+        new ShaderObject(ShaderObject::ShaderTypeFragment, description.fragmentShader));
+    // The output and attribute locations only take effect when the program is linked
+    if (!description.fragmentOutput.empty())
+        program->bindFragDataLocation(description.fragmentOutput, 0);
+    if (!description.vertexAttribute.empty())
+        program->bindAttributeLocation(description.vertexAttribute, 0);
+    if (!path.empty())
+        glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    if (!program->compileShaderObjects() || !program->linkProgramObject()) {
+        delete program;
+        return nullptr;
+    }
+
+    if (!path.empty())
+        storeBinary(id, path);
+    return program;
+}
+
+std::string ProgramCache::binaryPath(const Description& description) const {
+    std::string vertexSource;
+    std::string fragmentSource;
+    if (!readFile(description.vertexShader, vertexSource) ||
+        !readFile(description.fragmentShader, fragmentSource))
+    {
+        return "";
+    }
+
+    // The binary is only valid for exactly these inputs on exactly this driver
+    uint64_t hash = 14695981039346656037ull;
+    hash = hashString(hash, std::to_string(Version));
+    hash = hashString(hash, glString(GL_VENDOR));
+    hash = hashString(hash, glString(GL_RENDERER));
+    hash = hashString(hash, glString(GL_VERSION));
+    hash = hashString(hash, vertexSource);
+    hash = hashString(hash, fragmentSource);
+    hash = hashString(hash, description.fragmentOutput);
+    hash = hashString(hash, description.vertexAttribute);
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+    return _directory + "/" + description.name + "_" + name + ".bin";
+}
+
+bool ProgramCache::loadBinary(GLuint program, const std::string& path) const {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file)
+        return false;
+
+    Header header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        (std::memcmp(header.magic, _magic, sizeof(_magic)) != 0))
+    {
+        LWARNING("Ignoring the invalid program binary '" << path << "'");
+        return false;
+    }
+    std::vector<char> binary(header.length);
+    if (!file.read(binary.data(), binary.size())) {
+        LWARNING("Ignoring the truncated program binary '" << path << "'");
+        return false;
+    }
+
+    glProgramBinary(program, header.format, binary.data(), header.length);
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked == GL_FALSE) {
+        LINFO("The driver rejected the program binary '" << path << "'; recompiling");
+        return false;
+    }
+    return true;
+}
+
+void ProgramCache::storeBinary(GLuint program, const std::string& path) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    Header header;
+    std::memcpy(header.magic, _magic, sizeof(_magic));
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    header.format = format;
+    header.length = static_cast<uint32_t>(written);
+
+    if (!_directoryExists) {
+        // Fails harmlessly if the directory already exists
+#ifdef _WIN32
+        _mkdir(_directory.c_str());
+#else
+        mkdir(_directory.c_str(), 0755);
+#endif
+        _directoryExists = true;
+    }
+
+    std::ofstream file(path.c_str(), std::ios::binary);
+    if (!file.write(reinterpret_cast<const char*>(&header), sizeof(header)) ||
+        !file.write(binary.data(), written))
+    {
+        LWARNING("Could not store the program binary '" << path << "'");
+    }
+}
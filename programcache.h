@@ -0,0 +1,85 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __PROGRAMCACHE_H__
+#define __PROGRAMCACHE_H__
+
+// Need to include opengl first, as the other headers might include gl, but not glew
+#include <ghoul/opengl/opengl>
+
+#include <cstdint>
+#include <string>
+
+// The ProgramCache keeps the binaries of linked programs (ARB_get_program_binary) in a
+// directory, so that the shaders only have to be compiled the first time a program is used.
+// Each binary is stored under a hash of the shader sources, the bound locations, and the
+// driver, so a changed shader or a driver update never loads a stale binary. If the driver
+// rejects a binary anyway, the program is compiled and the binary replaced. All functions
+// have to be called with the OpenGL context current
+class ProgramCache {
+public:
+    // A program made of a vertex and a fragment shader
+    struct Description {
+        // The name of the ProgramObject, which is also part of the file name of its binary
+        std::string name;
+        // The absolute paths of the shaders
+        std::string vertexShader;
+        std::string fragmentShader;
+        // The fragment output and the vertex attribute that are bound to location 0 before
+        // linking; empty if the shaders give their locations themselves
+        std::string fragmentOutput;
+        std::string vertexAttribute;
+    };
+
+    // The version of the binary files; part of the hash, so older files are ignored
+    static const uint32_t Version = 1;
+
+    // Stores the binaries in 'directory', which is created when the first binary is stored
+    explicit ProgramCache(const std::string& directory);
+
+    // Returns true if the driver can return program binaries
+    static bool isSupported();
+
+    // Creates the program of 'description' from its binary if one is cached; otherwise the
+    // shaders are compiled and linked and the binary is cached. Returns nullptr if the program
+    // could not be created, in which case the errors have been logged
+    ghoul::opengl::ProgramObject* createProgram(const Description& description);
+
+private:
+    // Returns the file of the binary for 'description', or an empty string if a shader could
+    // not be read
+    std::string binaryPath(const Description& description) const;
+
+    // Loads the binary in 'path' into 'program'. Returns true if the driver accepted it
+    bool loadBinary(GLuint program, const std::string& path) const;
+
+    // Stores the binary of the linked 'program' in 'path'
+    void storeBinary(GLuint program, const std::string& path);
+
+    // The directory of the binaries
+    std::string _directory;
+    // True once the directory has been created
+    bool _directoryExists;
+};
+
+#endif // __PROGRAMCACHE_H__
@@ -23,6 +23,16 @@
 
 #include "renderer.h"
 
+#include "computesimulation.h"
+#include "depthsorter.h"
+#include "drawcommand.h"
+#include "frameexporter.h"
+#include "particleculler.h"
+#include "profiler.h"
+#include "statschannel.h"
+#include "weightedblending.h"
+#include "worldgeometry.h"
+
 #include <ghoul/filesystem/filesystem>
 #include <ghoul/logging/logging>
 #include <glm/gtc/matrix_transform.hpp>
@@ -31,8 +41,8 @@
 #include <QGLFormat>
 #include <QMouseEvent>
 #include <chrono>
-
-using std::chrono::high_resolution_clock;
+#include <cstddef>
+#include <cstring>
 
 using namespace ghoul::opengl;
 
@@ -40,13 +50,13 @@ namespace {
     // Category used for the logging mechanism to print out debug/error messages
     const std::string _loggerCat = "Renderer";
 
-    // Skybox size
-    const float _skyboxSize = 5.f;
+    // Skybox size; the simulation keeps the particles inside of it
+    const float _skyboxSize = worldgeometry::SkyboxSize;
     
     // Linear scaling factor for the rotational part of the interaction
     const float _rotationalFactor = 60.f;
     // Minimum height for the camera to not pass though the ground texture
-    const float _minimumHeight = 0.1f;
+    const float _minimumHeight = worldgeometry::GroundHeight + 0.1f;
     // Minimum distance of the camera from the focus point
     const float _minimumDistance = 0.25f;
     // Maximum distance of the camera to the focus point
@@ -64,51 +74,194 @@ namespace {
     const float _nearPlane = 0.1f;
     const float _farPlane = 500.f;
     const glm::vec3 _defaultLightPosition = glm::vec3(0.f, 2.f, 10.f);
+
+    // The edge length of the billboards in world space
+    const float _billboardSize = 0.02f;
+
+    // The attribute locations and names of the channels in all particle programs. Locations 0
+    // and 1 hold the positions and the corners of the billboards. The ids are only read by the
+    // culler, so no program declares them
+    const GLuint _attributeLocations[NumberOfAttributeChannels] = { 2, 3, 4, 5 };
+    const char* const _attributeNames[NumberOfAttributeChannels] = {
+        "in_color", "in_size", "in_age", "in_id"
+    };
+    // The vertices of the interleaved layout are padded to multiples of this many bytes
+    const size_t _vertexAlignment = 16;
+    // The number of frames of each layout in the benchmark whose costs are ignored, so that
+    // the GPU times of the previous layout have left the profiler
+    const int _benchmarkWarmupFrames = Profiler::NumberOfSamples;
+    // The number of frames of each layout in the benchmark after the warmup
+    const int _benchmarkMeasuredFrames = Profiler::NumberOfSamples;
+
+    // The depths up to which the sort distinguishes the particles. Seen from inside the
+    // skybox, nothing in it is further away than its diagonal
+    const float _sortingFarDepth = 4.f * _skyboxSize;
+
+    // The images that are decoded by the TextureLoader. The faces of the skybox follow each
+    // other in the order of the cube map faces, starting with SkyboxFaceTexture
+    enum TextureId : unsigned int {
+        ParticleTexture,
+        GroundTexture,
+        GroundNormalTexture,
+        SkyboxFaceTexture
+    };
+    const char* const _skyboxFaces[6] = {
+        "xpos.png", "xneg.png", "ypos.png", "yneg.png", "zpos.png", "zneg.png"
+    };
+    // The number of threads that decode the images
+    const unsigned int _numberOfDecodingThreads = 4;
+
+    // Returns a human readable name for 'layout'
+    const char* layoutName(AttributeLayout layout) {
+        return (layout == AttributeLayout::Separate) ? "separate" : "interleaved";
+    }
+
+    // Fills 'sources' with the 'channels' that 'compactor', a ParticleCuller or a DepthSorter,
+    // has written into buffers of its own
+    template <typename Compactor>
+    void compactedAttributeSources(const Compactor& compactor, uint32_t channels,
+        AttributeSource* sources)
+    {
+        for (int i = 0; i < NumberOfAttributeChannels; ++i) {
+            const AttributeChannel channel = attributeChannel(i);
+            const bool compacted = ((channels & channel) != 0);
+            sources[i] = { compacted ? compactor.attributeBuffer(channel) : 0, 0, 1 };
+        }
+    }
 }
 
 Renderer::Renderer(const QGLFormat& format, QWidget* parent, Qt::WindowFlags f)
     : QGLWidget(format, parent, nullptr, f)
     , _limitCameraPosition(true)
-    , _particleData(nullptr)
+    , _globalsChanged(true)
+    , _uploadedDataIsCurrent(false)
+    , _uploadedVersion(0)
     , _renderGround(true)
     , _groundVBO(0)
-    , _groundTexture(nullptr)
-    , _groundTextureNormal(nullptr)
+    , _groundVAO(0)
+    , _groundTexture(0)
+    , _groundTextureNormal(0)
     , _groundProgram(nullptr)
     , _groundProgramReady(false)
     , _renderSkybox(true)
     , _skyboxVBO(0)
     , _skyboxIBO(0)
+    , _skyboxVAO(0)
     , _skyboxTexture(0)
+    , _numberOfSkyboxFaces(0)
     , _skyboxProgram(nullptr)
     , _skyboxProgramReady(false)
     , _particleVBO(0)
-    , _particleTexture(nullptr)
+    , _nextParticleVertexArray(0)
+    , _particleCapacity(0)
+    , _uploadMode(UploadMode::Orphaning)
+    , _mappedParticles(nullptr)
+    , _positionQuantizer(nullptr)
+    , _drawRegion(-1)
+    , _writeRegion(-1)
+    , _firstParticle(0)
+    , _particleTexture(0)
+    , _requestedAttributeChannels(0)
+    , _attributeChannels(0)
+    , _attributeLayout(AttributeLayout::Separate)
+    , _benchmarkLayoutsRequested(false)
+    , _benchmarkedLayout(-1)
+    , _benchmarkFrames(0)
+    , _benchmarkUploadMilliseconds(0.0)
+    , _benchmarkUploads(0)
     , _particleProgram(nullptr)
     , _particleProgramReady(false)
+    , _particleMode(ParticleMode::Points)
+    , _billboardVBO(0)
+    , _billboardIndirectBuffer(0)
+    , _billboardProgram(nullptr)
+    , _billboardProgramReady(false)
+    , _billboardBlendingProgram(nullptr)
+    , _billboardBlendingProgramReady(false)
     , _numberOfParticles(0)
-{}
+    , _computeSimulationRequested(false)
+    , _computeSimulation(nullptr)
+    , _culler(nullptr)
+    , _cullingEnabled(true)
+    , _blendMode(BlendMode::Unsorted)
+    , _depthSorter(nullptr)
+    , _weightedBlending(nullptr)
+    , _visibilityChanged(true)
+    , _frameExporter(nullptr)
+    , _programCache(FileSys.absolutePath("${ASSETS}/programcache"))
+    , _textureLoader(nullptr)
+    , _firstFrameDrawn(false)
+    , _sceneryInitialized(false)
+    , _profiler(nullptr)
+    , _stats(nullptr)
+{
+    for (int i = 0; i < NumMappedRegions; ++i)
+        _regionFences[i] = 0;
+    for (ParticleVertexArray& vertexArray : _particleVertexArrays) {
+        vertexArray.buffer = 0;
+        vertexArray.offset = 0;
+        vertexArray.pointVAO = 0;
+        vertexArray.billboardVAO = 0;
+    }
+    for (int i = 0; i < NumberOfAttributeChannels; ++i) {
+        _attributeVBOs[i] = 0;
+        _mappedAttributes[i] = nullptr;
+    }
+    _benchmarkCosts[0] = _benchmarkCosts[1] = 0.f;
+}
 
 Renderer::~Renderer() {
     // we don't own _particleData, so we don't delete it
-    _particleData = nullptr;
+    _particleData = PositionView();
 
+    // Writes the frames that are still being read back
+    delete _frameExporter;
+    // Drops the images that are still being decoded
+    delete _textureLoader;
+
+    glDeleteVertexArrays(1, &_groundVAO);
     glDeleteBuffers(1, &_groundVBO);
-    delete _groundTexture;
-    delete _groundTextureNormal;
+    glDeleteTextures(1, &_groundTexture);
+    glDeleteTextures(1, &_groundTextureNormal);
     delete _groundProgram;
     _groundProgramReady = false;
 
+    glDeleteVertexArrays(1, &_skyboxVAO);
     glDeleteBuffers(1, &_skyboxVBO);
     glDeleteBuffers(1, &_skyboxIBO);
     glDeleteTextures(1, &_skyboxTexture);
     delete _skyboxProgram;
     _skyboxProgramReady = false;
 
+    for (int i = 0; i < NumMappedRegions; ++i)
+        glDeleteSync(_regionFences[i]);
+    if (_mappedParticles != nullptr) {
+        glBindBuffer(GL_ARRAY_BUFFER, _particleVBO);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        _mappedParticles = nullptr;
+    }
+    releaseParticleVertexArrays();
     glDeleteBuffers(1, &_particleVBO);
-    delete _particleTexture;
+    // Deleting the mapped buffers of the channels unmaps them
+    glDeleteBuffers(NumberOfAttributeChannels, _attributeVBOs);
+    for (int i = 0; i < NumberOfAttributeChannels; ++i)
+        _mappedAttributes[i] = nullptr;
+    glDeleteTextures(1, &_particleTexture);
     delete _particleProgram;
     _particleProgramReady = false;
+
+    glDeleteBuffers(1, &_billboardVBO);
+    glDeleteBuffers(1, &_billboardIndirectBuffer);
+    delete _billboardProgram;
+    _billboardProgramReady = false;
+    delete _billboardBlendingProgram;
+    _billboardBlendingProgramReady = false;
+
+    delete _weightedBlending;
+    delete _depthSorter;
+    delete _culler;
+    delete _computeSimulation;
+    delete _positionQuantizer;
 }
 
 void Renderer::initializeGL() {
@@ -126,10 +279,35 @@ void Renderer::initializeGL() {
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    // Initialize the textures, Vertex Buffer Objects, Index Buffer Objects and ProgramObjects
-    initializeGround();
-    initializeSkybox();
+    // The buffer for the per-frame globals is shared by all programs
+    _globalUniforms.initialize();
+
+    // The images are decoded in the background while the first frames are drawn and uploaded
+    // as they arrive. The particle texture comes first, as the particles are needed first
+    _textureLoader = new TextureLoader(_numberOfDecodingThreads);
+    generateSkyboxTexture();
+    _textureLoader->load(ParticleTexture, FileSys.absolutePath("${ASSETS}/particle.png"));
+    _textureLoader->load(GroundTexture, FileSys.absolutePath("${ASSETS}/dirt.jpg"));
+    _textureLoader->load(GroundNormalTexture, FileSys.absolutePath("${ASSETS}/dirt_n.jpg"));
+    for (unsigned int i = 0; i < 6; ++i) {
+        _textureLoader->load(SkyboxFaceTexture + i,
+            FileSys.absolutePath(std::string("${ASSETS}/") + _skyboxFaces[i]));
+    }
+
+    // Initialize the Vertex Buffer Objects and ProgramObjects of the particles. The ground and
+    // the skybox follow after the first frame, so that the simulation can start without them.
+    // The culler comes first, as the format of the particle buffer depends on it
+    initializeCulling();
     initializeParticle();
+    initializeBillboard();
+    initializeBlending();
+    initializeAttributes();
+    _gpuTimer.initialize();
+    if ((_frameExporter != nullptr) && !_frameExporter->initialize()) {
+        LERROR("The frames will not be exported");
+        delete _frameExporter;
+        _frameExporter = nullptr;
+    }
 
     // Initialize the default camera and light position
     _position = _defaultPosition;
@@ -145,33 +323,17 @@ void Renderer::initializeGround() {
     // Generate the VBO for the ground quad
     generateGroundBuffer();
 
-    // loadTexture will return a nullptr if the texture could not be loaded
-    _groundTexture = loadTexture(FileSys.absolutePath("${ASSETS}/dirt.jpg"));
-    if (_groundTexture != nullptr) {
-        _groundTexture->enable();
-        _groundTexture->bind();
-        _groundTexture->uploadTexture();
-    }
-
-    // loadTexture will return a nullptr if the texture could not be loaded
-    _groundTextureNormal = loadTexture(FileSys.absolutePath("${ASSETS}/dirt_n.jpg"));
-    if (_groundTextureNormal != nullptr) {
-        _groundTextureNormal->enable();
-        _groundTextureNormal->bind();
-        _groundTextureNormal->uploadTexture();
-    }
+    // The textures have been requested in 'initializeGL' and are uploaded once they are decoded
 
     // Generate the ProgramObject that holds the ShaderObjects used to render the ground
-    // _groundProgramReady is true if both the compiling and linking succeeded; errors that occur
-    // during either step will be written to the Logmanager by the ProgramObject and ShaderObject
-    _groundProgram = new ProgramObject("Ground");
-    _groundProgram->attachObject(new ShaderObject(ShaderObject::ShaderTypeVertex, FileSys.absolutePath("${ASSETS}/ground.vert")));
-    _groundProgram->attachObject(new ShaderObject(ShaderObject::ShaderTypeFragment, FileSys.absolutePath("${ASSETS}/ground.frag")));
-    bool groundCompileSuccess = _groundProgram->compileShaderObjects();
-    if (groundCompileSuccess) {
-        bool linkSuccess = _groundProgram->linkProgramObject();
-        _groundProgramReady = linkSuccess;
-    }
+    // _groundProgramReady is true if the program could be loaded from the cache or compiled and
+    // linked; errors will be written to the Logmanager
+    _groundProgram = _programCache.createProgram({ "Ground",
+        FileSys.absolutePath("${ASSETS}/ground.vert"),
+        FileSys.absolutePath("${ASSETS}/ground.frag"), "fragColor", "in_position" });
+    _groundProgramReady = (_groundProgram != nullptr);
+    if (_groundProgramReady)
+        _groundState.initialize(*_groundProgram);
 }
 
 void Renderer::initializeSkybox() {
@@ -179,18 +341,19 @@ void Renderer::initializeSkybox() {
     generateSkyboxBuffer();
 
     // Create the ProgramObject that holds the ShaderObjects used to render the skybox
-    // _skyboxProgramReady is true if both the compiling and linking succeeded; errors that occur
-    // during either step will be written to the Logmanager by the ProgramObject and ShaderObject
-    _skyboxProgram = new ProgramObject("Skybox");
-    _skyboxProgram->attachObject(new ShaderObject(ShaderObject::ShaderTypeVertex, FileSys.absolutePath("${ASSETS}/skybox.vert")));
-    _skyboxProgram->attachObject(new ShaderObject(ShaderObject::ShaderTypeFragment, FileSys.absolutePath("${ASSETS}/skybox.frag")));
-    bool skyboxCompileSuccess = _skyboxProgram->compileShaderObjects();
-    if (skyboxCompileSuccess) {
-        bool linkSuccess = _skyboxProgram->linkProgramObject();
-        _skyboxProgramReady = linkSuccess;
-    }
-
-    // This is a bit uglier as Ghoul does not support loading cubemaps (yet)
+    // _skyboxProgramReady is true if the program could be loaded from the cache or compiled and
+    // linked; errors will be written to the Logmanager
+    _skyboxProgram = _programCache.createProgram({ "Skybox",
+        FileSys.absolutePath("${ASSETS}/skybox.vert"),
+        FileSys.absolutePath("${ASSETS}/skybox.frag"), "fragColor", "in_position" });
+    _skyboxProgramReady = (_skyboxProgram != nullptr);
+    if (_skyboxProgramReady)
+        _skyboxState.initialize(*_skyboxProgram);
+}
+
+void Renderer::generateSkyboxTexture() {
+    // This is a bit uglier as Ghoul does not support loading cubemaps (yet). The six faces are
+    // uploaded into the cube map as they are decoded
     glEnable(GL_TEXTURE_CUBE_MAP);
     glGenTextures(1, &_skyboxTexture);
     glBindTexture(GL_TEXTURE_CUBE_MAP, _skyboxTexture);
@@ -199,165 +362,338 @@ void Renderer::initializeSkybox() {
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
 
-    // Take a little detour through Ghoul to use DevIL library to load textures
-    // Load the textures and assign the data pointer of each texture to be used as the
-    // corresponding face texture
-    Texture* xPos = loadTexture(FileSys.absolutePath("${ASSETS}/xpos.png"));
-    Texture* xNeg = loadTexture(FileSys.absolutePath("${ASSETS}/xneg.png"));
-    Texture* yPos = loadTexture(FileSys.absolutePath("${ASSETS}/ypos.png"));
-    Texture* yNeg = loadTexture(FileSys.absolutePath("${ASSETS}/yneg.png"));
-    Texture* zPos = loadTexture(FileSys.absolutePath("${ASSETS}/zpos.png"));
-    Texture* zNeg = loadTexture(FileSys.absolutePath("${ASSETS}/zneg.png"));
-    if ((xPos == nullptr) || (xNeg == nullptr) || (yPos == nullptr) || (yNeg == nullptr) ||
-        (zPos == nullptr) || (zNeg == nullptr))
-    {
-        // If any of the texture is not loadable, delete all (it's safe to delete a nullptr)
-        // and abort. 'loadTexture' will write an error message if it fails
-        delete xPos;
-        delete xNeg;
-        delete yPos;
-        delete yNeg;
-        delete zPos;
-        delete zNeg;
+void Renderer::uploadDecodedTextures() {
+    TextureLoader::Image image;
+    while (_textureLoader->takeDecoded(image)) {
+        // The loader has reported the error already
+        if (!image.pixels.empty())
+            uploadTexture(image);
+    }
+}
+
+void Renderer::uploadTexture(const TextureLoader::Image& image) {
+    // The pixels are ARGB words, which is the native order of most drivers
+    if (image.id >= SkyboxFaceTexture) {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, _skyboxTexture);
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + (image.id - SkyboxFaceTexture), 0, GL_RGBA,
+            image.width, image.height, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV,
+            image.pixels.data());
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        ++_numberOfSkyboxFaces;
         return;
     }
 
-    // create and upload the six faces of the cubemap
-    glTexImage2D(
-        GL_TEXTURE_CUBE_MAP_POSITIVE_X,
-        0,
-        GL_RGBA,
-        static_cast<GLsizei>(xPos->width()),
-        static_cast<GLsizei>(xPos->height()),
-        0,
-        xPos->format(),
-        GL_UNSIGNED_BYTE,
-        xPos->pixelData());
-
-    glTexImage2D(
-        GL_TEXTURE_CUBE_MAP_NEGATIVE_X,
-        0,
-        GL_RGBA,
-        static_cast<GLsizei>(xNeg->width()),
-        static_cast<GLsizei>(xNeg->height()),
-        0,
-        xNeg->format(),
-        GL_UNSIGNED_BYTE,
-        xNeg->pixelData());
-    
-    glTexImage2D(
-        GL_TEXTURE_CUBE_MAP_POSITIVE_Y,
-        0,
-        GL_RGBA,
-        static_cast<GLsizei>(yPos->width()),
-        static_cast<GLsizei>(yPos->height()),
-        0, yPos->format(),
-        GL_UNSIGNED_BYTE,
-        yPos->pixelData());
-
-    glTexImage2D(
-        GL_TEXTURE_CUBE_MAP_NEGATIVE_Y,
-        0,
-        GL_RGBA,
-        static_cast<GLsizei>(yNeg->width()),
-        static_cast<GLsizei>(yNeg->height()),
-        0, yNeg->format(),
-        GL_UNSIGNED_BYTE,
-        yNeg->pixelData());
-
-    glTexImage2D(
-        GL_TEXTURE_CUBE_MAP_POSITIVE_Z,
-        0,
-        GL_RGBA,
-        static_cast<GLsizei>(zPos->width()),
-        static_cast<GLsizei>(zPos->height()),
-        0, zPos->format(),
-        GL_UNSIGNED_BYTE,
-        zPos->pixelData());
-
-    glTexImage2D(
-        GL_TEXTURE_CUBE_MAP_NEGATIVE_Z,
-        0,
-        GL_RGBA,
-        static_cast<GLsizei>(zNeg->width()),
-        static_cast<GLsizei>(zNeg->height()),
-        0, zNeg->format(),
-        GL_UNSIGNED_BYTE,
-        zNeg->pixelData());
-
-    // Now OpenGL has taken a copy of the data in the textures and we can delete our versions
-    delete xPos;
-    delete xNeg;
-    delete yPos;
-    delete yNeg;
-    delete zPos;
-    delete zNeg;
+    GLuint& texture = (image.id == ParticleTexture) ? _particleTexture :
+        ((image.id == GroundTexture) ? _groundTexture : _groundTextureNormal);
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_BGRA,
+        GL_UNSIGNED_INT_8_8_8_8_REV, image.pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 void Renderer::initializeParticle() {
-    // loadTexture will return a nullptr if the texture could not be loaded
-    _particleTexture = loadTexture(FileSys.absolutePath("${ASSETS}/particle.png"));
-    if (_particleTexture != nullptr) {
-        _particleTexture->enable();
-        _particleTexture->bind();
-        _particleTexture->uploadTexture();
+    // Create the VBO up front, as its size is determined by the maximum number of particles
+    generateParticleBuffer();
+
+    // Create the ProgramObject that holds the ShaderObjects used to render the particles
+    // _particleProgramReady is true if the program could be loaded from the cache or compiled
+    // and linked; errors will be written to the Logmanager
+    _particleProgram = _programCache.createProgram({ "Particle",
+        FileSys.absolutePath("${ASSETS}/particle.vert"),
+        FileSys.absolutePath("${ASSETS}/particle.frag"), "fragColor", "in_position" });
+    _particleProgramReady = (_particleProgram != nullptr);
+    if (_particleProgramReady)
+        _particleState.initialize(*_particleProgram);
+
+    // The GPU simulation owns its own particle buffers that we render from directly
+    if (_computeSimulationRequested) {
+        _computeSimulation = new ComputeSimulation(_particleCapacity);
+        if (!_computeSimulation->initialize()) {
+            LWARNING("Compute simulation is not available. Falling back to the CPU simulation");
+            delete _computeSimulation;
+            _computeSimulation = nullptr;
+        }
+        else
+            LINFO("Simulating particles on the GPU");
     }
+}
 
-    // Create the ProgramObject that holds the ShaderObjects used to render the skybox
-    // _particleProgramReady is true if both the compiling and linking succeeded; errors that occur
-    // during either step will be written to the Logmanager by the ProgramObject and ShaderObject
-    _particleProgram = new ProgramObject("Particle");
-    _particleProgram->attachObject(new ShaderObject(ShaderObject::ShaderTypeVertex, FileSys.absolutePath("${ASSETS}/particle.vert")));
-    _particleProgram->attachObject(new ShaderObject(ShaderObject::ShaderTypeFragment, FileSys.absolutePath("${ASSETS}/particle.frag")));
-    bool particleCompileSuccess = _particleProgram->compileShaderObjects();
-    if (particleCompileSuccess) {
-        bool linkSuccess = _particleProgram->linkProgramObject();
-        _particleProgramReady = linkSuccess;
+void Renderer::initializeBillboard() {
+    // The billboards share the particle buffer and texture and only add the quad
+    generateBillboardBuffer();
+
+    // The instance count for the GPU simulation is only known on the GPU, so it gets its own
+    // command that the count is copied into
+    if (_computeSimulation != nullptr) {
+        const DrawArraysIndirectCommand command = { 4, 0, 0, 0 };
+        glGenBuffers(1, &_billboardIndirectBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _billboardIndirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(command), &command, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    // Create the ProgramObject that holds the ShaderObjects used to render the billboards
+    // _billboardProgramReady is true if the program could be loaded from the cache or compiled
+    // and linked; errors will be written to the Logmanager. The attribute locations are given
+    // in the shader
+    _billboardProgram = _programCache.createProgram({ "Billboard",
+        FileSys.absolutePath("${ASSETS}/billboard.vert"),
+        FileSys.absolutePath("${ASSETS}/billboard.frag"), "fragColor", "" });
+    _billboardProgramReady = (_billboardProgram != nullptr);
+    if (_billboardProgramReady)
+        _billboardState.initialize(*_billboardProgram);
+}
+
+void Renderer::initializeCulling() {
+    if (!ParticleCuller::isSupported()) {
+        LINFO("All particles are drawn, as culling needs compute shaders");
+        if (_positionQuantizer != nullptr) {
+            LWARNING("The positions are not quantized, as the culler decodes them");
+            delete _positionQuantizer;
+            _positionQuantizer = nullptr;
+        }
+        return;
+    }
+
+    _culler = new ParticleCuller(_particleCapacity);
+    if (!_culler->initialize()) {
+        LWARNING("Culling is not available. Drawing all particles");
+        delete _culler;
+        _culler = nullptr;
+        if (_positionQuantizer != nullptr) {
+            LWARNING("The positions are not quantized, as the culler decodes them");
+            delete _positionQuantizer;
+            _positionQuantizer = nullptr;
+        }
     }
 }
 
+bool Renderer::cullingIsActive() const {
+    return _cullingEnabled && (_culler != nullptr);
+}
+
+bool Renderer::cullerIsUsed() const {
+    return cullingIsActive() || positionsAreQuantized();
+}
+
+void Renderer::cullParticles() {
+    // The GPU simulation only knows an upper bound for its number of particles on the CPU; the
+    // exact number is the count of its indirect draw command. Its positions are vec4s
+    AttributeSource attributes[NumberOfAttributeChannels];
+    if (_computeSimulation != nullptr) {
+        // The GPU simulation has no id of its own, but the lifetime in the w of each velocity is
+        // random per particle and never changes, so its bits serve just as well
+        for (AttributeSource& source : attributes)
+            source = { 0, 0, 0 };
+        const int ids = attributeChannelIndex(IdChannel);
+        attributes[ids] = { _computeSimulation->velocityBuffer(), 3, 4 };
+        _culler->cull(_computeSimulation->positionBuffer(), 0, 4,
+            _computeSimulation->upperBound(), _computeSimulation->drawIndirectBuffer(),
+            _viewProjectionMatrix, _position, attributes);
+    }
+    else if (positionsAreQuantized()) {
+        // The positions have to be decoded even if they are not culled. While frames are
+        // exported, all of them are kept, so that the exported positions are complete
+        const bool onlyVisible = cullingIsActive() && (_frameExporter == nullptr);
+        particleAttributeSources(attributes);
+        _culler->cullQuantized(_particleVBO, _firstParticle, _numberOfParticles,
+            *_positionQuantizer, onlyVisible, _viewProjectionMatrix, _position, attributes);
+    }
+    else {
+        particleAttributeSources(attributes);
+        const size_t stride = particleVertexSize() / sizeof(float);
+        _culler->cull(_particleVBO, _firstParticle * stride, stride, _numberOfParticles, 0,
+            _viewProjectionMatrix, _position, attributes);
+    }
+}
+
+void Renderer::initializeBlending() {
+    if (DepthSorter::isSupported()) {
+        _depthSorter = new DepthSorter(_particleCapacity);
+        if (!_depthSorter->initialize()) {
+            LWARNING("Sorting is not available. Particles can only be blended unsorted");
+            delete _depthSorter;
+            _depthSorter = nullptr;
+        }
+    }
+    else
+        LINFO("The particles cannot be sorted, as sorting needs compute shaders");
+
+    // Blending the two targets differently needs glBlendFunci
+    if (!GLEW_VERSION_4_0 && !GLEW_ARB_draw_buffers_blend) {
+        LINFO("Weighted blending needs separate blend functions per draw buffer");
+        return;
+    }
+    _weightedBlending = new WeightedBlending;
+    if (!_weightedBlending->initialize()) {
+        LWARNING("Weighted blending is not available");
+        delete _weightedBlending;
+        _weightedBlending = nullptr;
+        return;
+    }
+
+    // The billboards get a second fragment shader that writes into the accumulation target.
+    // The outputs are given in the shader, as there are two of them
+    _billboardBlendingProgram = _programCache.createProgram({ "BillboardBlending",
+        FileSys.absolutePath("${ASSETS}/billboard.vert"),
+        FileSys.absolutePath("${ASSETS}/billboardoit.frag"), "", "" });
+    _billboardBlendingProgramReady = (_billboardBlendingProgram != nullptr);
+    if (_billboardBlendingProgramReady)
+        _billboardBlendingState.initialize(*_billboardBlendingProgram);
+}
+
+bool Renderer::sortingIsActive() const {
+    return (_blendMode == BlendMode::Sorted) && (_depthSorter != nullptr);
+}
+
+bool Renderer::weightedBlendingIsActive() const {
+    return (_blendMode == BlendMode::WeightedBlended) && (_weightedBlending != nullptr) &&
+        _billboardBlendingProgramReady;
+}
+
+void Renderer::sortParticles() {
+    // If the particles were culled, only the visible ones are sorted. Their number is only
+    // known on the GPU, just like the number of particles of the GPU simulation
+    const size_t upperBound = (_computeSimulation != nullptr) ?
+        _computeSimulation->upperBound() : static_cast<size_t>(_numberOfParticles);
+    AttributeSource attributes[NumberOfAttributeChannels];
+    if (cullerIsUsed()) {
+        compactedAttributeSources(*_culler, _attributeChannels, attributes);
+        _depthSorter->sort(_culler->visibleBuffer(), 0, 4, upperBound, _culler->commandBuffer(),
+            _viewProjectionMatrix, _nearPlane, _sortingFarDepth, attributes);
+    }
+    else if (_computeSimulation != nullptr) {
+        _depthSorter->sort(_computeSimulation->positionBuffer(), 0, 4, upperBound,
+            _computeSimulation->drawIndirectBuffer(), _viewProjectionMatrix, _nearPlane,
+            _sortingFarDepth);
+    }
+    else {
+        particleAttributeSources(attributes);
+        const size_t stride = particleVertexSize() / sizeof(float);
+        _depthSorter->sort(_particleVBO, _firstParticle * stride, stride, upperBound, 0,
+            _viewProjectionMatrix, _nearPlane, _sortingFarDepth, attributes);
+    }
+}
+
+GLuint Renderer::drawCommandBuffer() const {
+    // The sort consumes the culled particles, so its result is the last step
+    if (sortingIsActive())
+        return _depthSorter->commandBuffer();
+    if (cullerIsUsed())
+        return _culler->commandBuffer();
+    return 0;
+}
+
 void Renderer::resizeGL(int width, int height) {
     // A resize event is not expected for this program, but just to be sure
     glViewport(0, 0, width, height);
+    if (_weightedBlending != nullptr)
+        _weightedBlending->resize(width, height);
     updateViewProjectionMatrix();
 }
 
 bool Renderer::groundIsReady() const {
     return ((_groundVBO != 0) && (_groundProgram != nullptr) &&
-        _groundProgramReady && (_groundTexture != nullptr) && (_groundTextureNormal != nullptr));
+        _groundProgramReady && (_groundTexture != 0) && (_groundTextureNormal != 0));
 }
 
 bool Renderer::skyboxIsReady() const {
     return ((_skyboxVBO != 0) && (_skyboxIBO != 0) &&
-        (_skyboxProgram != nullptr) && _skyboxProgramReady && (_skyboxTexture != 0));
+        (_skyboxProgram != nullptr) && _skyboxProgramReady && (_skyboxTexture != 0) &&
+        (_numberOfSkyboxFaces == 6));
 }
 
 bool Renderer::particlesAreReady() const {
     return ((_particleVBO != 0) && (_particleProgram != nullptr) &&
-        _particleProgramReady);
+        _particleProgramReady && (_particleTexture != 0));
+}
+
+bool Renderer::billboardsAreReady() const {
+    return ((_particleVBO != 0) && (_billboardVBO != 0) && (_billboardProgram != nullptr) &&
+        _billboardProgramReady && (_particleTexture != 0) &&
+        ((_computeSimulation == nullptr) || (_billboardIndirectBuffer != 0)));
 }
 
 void Renderer::paintGL() {
-#ifdef PERFORMANCE_MEASUREMENTS
-    glFinish();
-    high_resolution_clock::time_point t0 = high_resolution_clock::now();
-#endif
+    Profiler::ScopedTimer timer(_profiler, Profiler::Section::Draw);
+    // Pick up the GPU times of earlier frames that have finished in the meantime
+    if (_profiler != nullptr)
+        _gpuTimer.collect(*_profiler, Profiler::Section::GpuDraw);
+    _gpuTimer.begin();
+
+    // The ground and the skybox are only created once the first frame is on the screen
+    if (_firstFrameDrawn && !_sceneryInitialized) {
+        initializeGround();
+        initializeSkybox();
+        _sceneryInitialized = true;
+    }
+    // Upload the images that have been decoded since the last frame
+    uploadDecodedTextures();
+
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    // The globals are uploaded once per frame for all programs, and only if the camera moved
+    if (_globalsChanged) {
+        _globalUniforms.update(_globals);
+        _globalsChanged = false;
+    }
+
     if (_renderGround && groundIsReady())
         drawGround();
     if (_renderSkybox && skyboxIsReady())
         drawSkybox();
 
-    if (particlesAreReady())
-        drawParticles();
-#ifdef PERFORMANCE_MEASUREMENTS
-    //glFlush();
-    glFinish();
-    high_resolution_clock::time_point t1 = high_resolution_clock::now();
-    LINFO(std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count());
-#endif
+    // Both paths draw from the same particle buffer, so they can be compared on the same scene
+    const bool drawAsBillboards =
+        (_particleMode == ParticleMode::Billboards) && billboardsAreReady();
+    const bool drawsParticles = drawAsBillboards || particlesAreReady();
+    if (drawsParticles) {
+        // The culled and sorted particles stay valid until the camera or the particles change
+        if (_visibilityChanged) {
+            if (cullerIsUsed())
+                cullParticles();
+            if (sortingIsActive())
+                sortParticles();
+            _visibilityChanged = false;
+        }
+
+        if (drawAsBillboards && weightedBlendingIsActive()) {
+            _weightedBlending->begin();
+            drawBillboards(_billboardBlendingProgram, _billboardBlendingState);
+            _weightedBlending->end();
+            _weightedBlending->composite();
+        }
+        else if (drawAsBillboards)
+            drawBillboards(_billboardProgram, _billboardState);
+        else
+            drawParticles();
+    }
+
+    // The export copies the positions out of the mapped region, so it has to come before the
+    // fence that releases the region
+    if (_frameExporter != nullptr)
+        exportFrame();
+
+    if (drawsParticles && (_uploadMode == UploadMode::PersistentMapped) && (_drawRegion != -1)) {
+        // The simulation may only write into this region again once the GPU is done with it
+        glDeleteSync(_regionFences[_drawRegion]);
+        _regionFences[_drawRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    _gpuTimer.end();
+    _firstFrameDrawn = true;
+
+    // Switching the layout respecifies the buffers, so it waits until this frame is drawn
+    if (_benchmarkLayoutsRequested || (_benchmarkedLayout != -1))
+        advanceLayoutBenchmark();
 }
 
 void Renderer::drawGround() {
@@ -367,39 +703,27 @@ void Renderer::drawGround() {
     // Bind the ground texture in the first available texture unit
     TextureUnit groundTextureUnit;
     groundTextureUnit.activate();
-    _groundTexture->enable();
-    _groundTexture->bind();
+    glBindTexture(GL_TEXTURE_2D, _groundTexture);
 
     // Bind the normal texture in the next free texture unit
     TextureUnit groundTextureNormalUnit;
     groundTextureNormalUnit.activate();
-    _groundTextureNormal->enable();
-    _groundTextureNormal->bind();
+    glBindTexture(GL_TEXTURE_2D, _groundTextureNormal);
 
-    // We are using 'fragColor' as the output variable from the FragmentShader
-    _groundProgram->bindFragDataLocation("fragColor", 0);
+    // The vertex array holds the vertex state that was set up in 'generateGroundBuffer'
+    glBindVertexArray(_groundVAO);
 
-    // Enable and bind the VBO holding the vertices for the ground and assign them a location
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, _groundVBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    _groundProgram->bindAttributeLocation("in_position", _groundVBO);
-    
-    // Set the rest of the uniforms
-    // It would be faster to cache the uniform location and reuse that, but this is more readable
-    _groundProgram->setUniform("_viewProjectionMatrix", _viewProjectionMatrix);
-    _groundProgram->setUniform("_cameraPosition", _position);
-    _groundProgram->setUniform("_lightPosition", _lightPosition);
-    _groundProgram->setUniform("_texture", groundTextureUnit.unitNumber());
-    _groundProgram->setUniform("_textureNormal", groundTextureNormalUnit.unitNumber());
+    // Set the uniforms through the locations that were resolved after linking
+    _groundState.setGlobals(_globals);
+    _groundState.setUniform(ProgramState::Uniform::Texture, groundTextureUnit.unitNumber());
+    _groundState.setUniform(ProgramState::Uniform::TextureNormal,
+        groundTextureNormalUnit.unitNumber());
 
     // Draw one quad 
     glDrawArrays(GL_QUADS, 0, 4);
 
     // And disable everything again to be a good citizen
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    _groundTexture->disable();
-    _groundTextureNormal->disable();
+    glBindVertexArray(0);
     _groundProgram->deactivate();
 }
 
@@ -413,33 +737,150 @@ void Renderer::drawSkybox() {
     glEnable(GL_TEXTURE_CUBE_MAP);
     glBindTexture(GL_TEXTURE_CUBE_MAP, _skyboxTexture);
 
-    // We are using 'fragColor' as the output variable from the FragmentShader
-    _skyboxProgram->bindFragDataLocation("fragColor", 0);
+    // The vertex array holds the vertex buffer and the index buffer of the skybox
+    glBindVertexArray(_skyboxVAO);
 
-    // Enable and bind the VBO holding the vertices for the ground and assign them a location
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, _skyboxVBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    _skyboxProgram->bindAttributeLocation("in_position", _skyboxVBO);
-
-    // Use _skyboxIBO as our element array buffer to handle the indexed rendering
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _skyboxIBO);
-
-    // Set the rest of the uniforms
-    // It would be faster to cache the uniform location and reuse that, but this is more readable
-    _skyboxProgram->setUniform("_viewProjectionMatrix", _viewProjectionMatrix);
-    _skyboxProgram->setUniform("_texture", cubeMapTextureUnit.unitNumber());
+    // Set the uniforms through the locations that were resolved after linking
+    _skyboxState.setGlobals(_globals);
+    _skyboxState.setUniform(ProgramState::Uniform::Texture, cubeMapTextureUnit.unitNumber());
 
     // Render the 4 quads
     glDrawElements(GL_QUADS, _numSkyboxIndices, GL_UNSIGNED_SHORT, 0);
 
     // And disable everything again to be a good citizen
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
     glDisable(GL_TEXTURE_CUBE_MAP);
     _skyboxProgram->deactivate();
 }
 
+const Renderer::ParticleVertexArray& Renderer::particleVertexArray() {
+    // The sorted and the culled particles are gathered into buffers of their own, together
+    // with their attribute channels
+    AttributeSource attributes[NumberOfAttributeChannels];
+    if (sortingIsActive()) {
+        compactedAttributeSources(*_depthSorter, _attributeChannels, attributes);
+        return particleVertexArray(_depthSorter->sortedBuffer(), 0, sizeof(glm::vec4),
+            attributes);
+    }
+    if (cullerIsUsed()) {
+        compactedAttributeSources(*_culler, _attributeChannels, attributes);
+        return particleVertexArray(_culler->visibleBuffer(), 0, sizeof(glm::vec4), attributes);
+    }
+
+    // The positions of the GPU simulation are vec4s, of which we only need xyz. The region of
+    // the persistently mapped buffer is selected by the offset of the attribute, so that the
+    // billboards don't need the base instance of glDrawArraysInstancedBaseInstance. The
+    // vertices of _particleVBO are larger than a position if the attributes are interleaved
+    const bool isComputeSimulation = (_computeSimulation != nullptr);
+    const GLuint buffer = isComputeSimulation ? _computeSimulation->positionBuffer() : _particleVBO;
+    const GLsizei vertexSize = static_cast<GLsizei>(particleVertexSize());
+    const GLintptr offset = isComputeSimulation ? 0 : _firstParticle * vertexSize;
+    const GLsizei stride = isComputeSimulation ? sizeof(glm::vec4) : vertexSize;
+    particleAttributeSources(attributes);
+    return particleVertexArray(buffer, offset, stride, attributes);
+}
+
+const Renderer::ParticleVertexArray& Renderer::particleVertexArray(GLuint buffer,
+    GLintptr offset, GLsizei stride, const AttributeSource* attributes)
+{
+    for (const ParticleVertexArray& vertexArray : _particleVertexArrays) {
+        if ((vertexArray.buffer == buffer) && (vertexArray.offset == offset))
+            return vertexArray;
+    }
+
+    // There are never more sources than entries, so this only replaces an entry if the
+    // particle buffer has been recreated
+    ParticleVertexArray& vertexArray = _particleVertexArrays[_nextParticleVertexArray];
+    _nextParticleVertexArray = (_nextParticleVertexArray + 1) % NumParticleVertexArrays;
+    if (vertexArray.pointVAO == 0) {
+        glGenVertexArrays(1, &vertexArray.pointVAO);
+        glGenVertexArrays(1, &vertexArray.billboardVAO);
+    }
+    vertexArray.buffer = buffer;
+    vertexArray.offset = offset;
+    const GLvoid* pointer = reinterpret_cast<const GLvoid*>(offset);
+
+    // The GPU simulation has no attribute channels
+    const bool hasAttributes = (_attributeChannels != 0);
+
+    // The point sprites have the positions at location 0
+    glBindVertexArray(vertexArray.pointVAO);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, pointer);
+    if (hasAttributes)
+        bindAttributes(attributes, 0);
+
+    // The billboards have the corners of the quad at location 0, which are the same for every
+    // instance, and the positions at location 1, which advance once per instance
+    glBindVertexArray(vertexArray.billboardVAO);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, _billboardVBO);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(1);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, pointer);
+    glVertexAttribDivisor(1, 1);
+    if (hasAttributes)
+        bindAttributes(attributes, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return vertexArray;
+}
+
+void Renderer::particleAttributeSources(AttributeSource* sources) const {
+    // Interleaved, the channel follows the position within each vertex. Otherwise every channel
+    // has its own buffer, whose regions are those of _particleVBO if it is mapped
+    const size_t vertexWords = particleVertexSize() / AttributeChannelSize;
+    const size_t first = static_cast<size_t>(_firstParticle);
+    for (int i = 0; i < NumberOfAttributeChannels; ++i) {
+        const AttributeChannel channel = attributeChannel(i);
+        if ((_attributeChannels & channel) == 0)
+            sources[i] = { 0, 0, 0 };
+        else if (interleavesAttributes()) {
+            sources[i] = { _particleVBO,
+                first * vertexWords + interleavedOffset(channel) / AttributeChannelSize,
+                vertexWords };
+        }
+        else
+            sources[i] = { _attributeVBOs[i], first, 1 };
+    }
+}
+
+void Renderer::bindAttributes(const AttributeSource* sources, GLuint divisor) {
+    for (int i = 0; i < NumberOfAttributeChannels; ++i) {
+        const AttributeChannel channel = attributeChannel(i);
+        if ((sources[i].buffer == 0) || (channel == IdChannel))
+            continue;
+
+        const GLuint location = _attributeLocations[i];
+        const GLsizei stride = static_cast<GLsizei>(sources[i].stride * AttributeChannelSize);
+        const GLvoid* pointer =
+            reinterpret_cast<const GLvoid*>(sources[i].first * AttributeChannelSize);
+        glEnableVertexAttribArray(location);
+        glBindBuffer(GL_ARRAY_BUFFER, sources[i].buffer);
+        // The colors are four normalized bytes, the other channels single floats
+        if (channel == ColorChannel)
+            glVertexAttribPointer(location, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, pointer);
+        else
+            glVertexAttribPointer(location, 1, GL_FLOAT, GL_FALSE, stride, pointer);
+        glVertexAttribDivisor(location, divisor);
+    }
+}
+
+void Renderer::releaseParticleVertexArrays() {
+    for (ParticleVertexArray& vertexArray : _particleVertexArrays) {
+        glDeleteVertexArrays(1, &vertexArray.pointVAO);
+        glDeleteVertexArrays(1, &vertexArray.billboardVAO);
+        vertexArray.buffer = 0;
+        vertexArray.offset = 0;
+        vertexArray.pointVAO = 0;
+        vertexArray.billboardVAO = 0;
+    }
+    _nextParticleVertexArray = 0;
+}
+
 void Renderer::drawParticles() {
     // We want to be able to set the point size from the shader
     // and let OpenGL generate texture coordinates for each point
@@ -452,38 +893,106 @@ void Renderer::drawParticles() {
     // Bind the only one texture that is used as the color and normal texture
     TextureUnit textureUnit;
     textureUnit.activate();
-    _particleTexture->enable();
-    _particleTexture->bind();
-
-    // We are using 'fragColor' as the output variable from the FragmentShader
-    _particleProgram->bindFragDataLocation("fragColor", 0);
-
-    // Enable and bind the VBO holding the vertices for the ground and assign them a location
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, _particleVBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_TRUE, 0, 0);
-    _particleProgram->bindAttributeLocation("in_position", _particleVBO);
-
-    // Set the rest of the uniforms
-    // It would be faster to cache the uniform location and reuse that, but this is more readable
-    _particleProgram->setUniform("_viewProjectionMatrix", _viewProjectionMatrix);
-    _particleProgram->setUniform("_cameraPosition", _position);
-    _particleProgram->setUniform("_lightPosition", _lightPosition);
-    _particleProgram->setUniform("_texture", textureUnit.unitNumber());
-
-    // _particleData holds the xyz coordinates, so it has thrice the amount of data
-    // than it has points. And since we test for the correct amount of data elsewhere,
-    // it is safe to assume that everything is fine
-    glDrawArrays(GL_POINTS, 0, _numberOfParticles);
+    glBindTexture(GL_TEXTURE_2D, _particleTexture);
+
+    // The vertex array already points at the first particle of the current source
+    glBindVertexArray(particleVertexArray().pointVAO);
+
+    // Set the uniforms through the locations that were resolved after linking
+    _particleState.setGlobals(_globals);
+    _particleState.setUniform(ProgramState::Uniform::Texture, textureUnit.unitNumber());
+
+    const GLuint commandBuffer = drawCommandBuffer();
+    if (commandBuffer != 0) {
+        // Only the culler and the sorter know how many particles are drawn
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glDrawArraysIndirect(GL_POINTS,
+            reinterpret_cast<const GLvoid*>(offsetof(ParticleDrawCommands, points)));
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    else if (_computeSimulation != nullptr) {
+        // The number of particles is only known on the GPU
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _computeSimulation->drawIndirectBuffer());
+        glDrawArraysIndirect(GL_POINTS, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    else
+        glDrawArrays(GL_POINTS, 0, _numberOfParticles);
 
     // Be a good citizen and disable everything again
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    _particleTexture->disable();
+    glBindVertexArray(0);
     _particleProgram->deactivate();
     glDisable(GL_POINT_SPRITE);
     glDisable(GL_PROGRAM_POINT_SIZE);
 }
 
+void Renderer::drawBillboards(ProgramObject* program, const ProgramState& state) {
+    // Activate the ProgramObject
+    program->activate();
+
+    // The billboards use the same texture as the point sprites
+    TextureUnit textureUnit;
+    textureUnit.activate();
+    glBindTexture(GL_TEXTURE_2D, _particleTexture);
+
+    // The vertex array already points at the first particle of the current source
+    glBindVertexArray(particleVertexArray().billboardVAO);
+
+    // Set the uniforms through the locations that were resolved after linking
+    state.setGlobals(_globals);
+    state.setUniform(ProgramState::Uniform::BillboardSize, _billboardSize);
+    state.setUniform(ProgramState::Uniform::Texture, textureUnit.unitNumber());
+
+    // Every particle is one instance of the quad, drawn as a triangle strip
+    const GLuint commandBuffer = drawCommandBuffer();
+    if (commandBuffer != 0) {
+        // The culler or sorter has already written the number of particles into the command
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glDrawArraysIndirect(GL_TRIANGLE_STRIP,
+            reinterpret_cast<const GLvoid*>(offsetof(ParticleDrawCommands, billboards)));
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    else if (_computeSimulation != nullptr) {
+        // Copy the particle count of the simulation's command into our instance count, without
+        // reading it back to the CPU
+        glBindBuffer(GL_COPY_READ_BUFFER, _computeSimulation->drawIndirectBuffer());
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _billboardIndirectBuffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_DRAW_INDIRECT_BUFFER,
+            offsetof(DrawArraysIndirectCommand, count),
+            offsetof(DrawArraysIndirectCommand, instanceCount), sizeof(GLuint));
+        glDrawArraysIndirect(GL_TRIANGLE_STRIP, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+    else
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, _numberOfParticles);
+
+    // Be a good citizen and disable everything again
+    glBindVertexArray(0);
+    program->deactivate();
+}
+
+void Renderer::exportFrame() {
+    // The positions of all particles are exported, not only the culled or sorted ones
+    if (_computeSimulation != nullptr) {
+        // The number of particles is only known on the GPU and is the first element of the
+        // draw command
+        _frameExporter->capture(width(), height(), _computeSimulation->positionBuffer(), 0,
+            sizeof(glm::vec4), _computeSimulation->upperBound(),
+            _computeSimulation->drawIndirectBuffer());
+    }
+    else if (positionsAreQuantized()) {
+        // The culler has decoded all positions, see 'cullParticles'
+        _frameExporter->capture(width(), height(), _culler->visibleBuffer(), 0,
+            sizeof(glm::vec4), _numberOfParticles, _culler->commandBuffer());
+    }
+    else {
+        const GLsizei stride = static_cast<GLsizei>(particleVertexSize());
+        _frameExporter->capture(width(), height(), _particleVBO, _firstParticle * stride, stride,
+            _numberOfParticles, 0);
+    }
+}
+
 void Renderer::mousePressEvent(QMouseEvent* event) {
     // Just store the current mouse position
     _oldMousePosition = scaledMouse(glm::ivec2(event->x(), event->y()));
@@ -523,6 +1032,17 @@ void Renderer::updateViewProjectionMatrix() {
 
     // Multiply them for ready-usage in the shaders
     _viewProjectionMatrix = projectionMatrix * viewMatrix;
+
+    // Collect the values that all programs share; they are uploaded with the next frame. The
+    // rows of the view matrix's rotation are the camera axes in world space
+    _globals.viewProjectionMatrix = _viewProjectionMatrix;
+    _globals.cameraPosition = glm::vec4(_position, 1.f);
+    _globals.lightPosition = glm::vec4(_lightPosition, 1.f);
+    _globals.cameraRight = glm::vec4(viewMatrix[0][0], viewMatrix[1][0], viewMatrix[2][0], 0.f);
+    _globals.cameraUp = glm::vec4(viewMatrix[0][1], viewMatrix[1][1], viewMatrix[2][1], 0.f);
+    _globalsChanged = true;
+    // Rotating and zooming changes which particles are visible and their order
+    _visibilityChanged = true;
 }
 
 glm::vec2 Renderer::scaledMouse(const glm::ivec2& mousePos) const {
@@ -554,7 +1074,8 @@ void Renderer::rotate(const glm::vec2& newMouse) {
 
     // We don't want _position to coincide with _upVector, since the _upVector x _position would
     // be numerically unstable in that case
-    const float currentTilt = glm::acos(glm::dot(glm::normalize(_upVector), glm::normalize(_position)));
+    const float currentTilt =
+        glm::acos(glm::dot(glm::normalize(_upVector), glm::normalize(_position)));
     const bool closeToTop = ((currentTilt < _minimumTilt) && (phi.y < 0.f));
     const bool closeToBottom = ((currentTilt >  _maximumTilt) && (phi.y > 0.f));
     if (closeToBottom || closeToTop)
@@ -610,29 +1131,463 @@ void Renderer::zoom(const glm::vec2& newMouse) {
     updateViewProjectionMatrix();
 }
 
-void Renderer::setData(const std::vector<glm::vec3>* particleData) {
+void Renderer::setData(PositionView particleData, size_t maximumNumberOfParticles) {
     // Update the data for the particles. We don't own any of the data, so no delete is necessary
     _particleData = particleData;
+    _particleCapacity = maximumNumberOfParticles;
+    _uploadedDataIsCurrent = false;
 }
 
 void Renderer::updateData() {
+    Profiler::ScopedTimer timer(_profiler, Profiler::Section::Upload);
+
+    // The GPU simulation's buffers are rendered directly; only the counter has to be updated
+    if (_computeSimulation != nullptr) {
+        _numberOfParticles = static_cast<GLsizei>(_computeSimulation->numberOfParticles());
+        _visibilityChanged = true;
+        _uploadedDataIsCurrent = false;
+        return;
+    }
+
+    // Once the simulation writes directly into the mapped buffer, there is nothing to upload;
+    // 'endWrite' has already selected the region and number of particles
+    if ((_uploadMode == UploadMode::PersistentMapped) && (_drawRegion != -1))
+        return;
+
     // Don't do anything if there isn't any data available
-    if (_particleData == 0 || _particleData->size() == 0) {
+    if (_particleData.empty() || (_uploadMode == UploadMode::PersistentMapped)) {
         _numberOfParticles = 0;
+        _uploadedDataIsCurrent = false;
+        return;
+    }
+
+    // Re-uploading is only necessary if a new step has become visible since the last upload;
+    // the GUI updates more often than the simulation finishes its steps
+    if (_uploadedDataIsCurrent && _particleData.isVersioned() &&
+        (_particleData.version() == _uploadedVersion))
+    {
         return;
     }
 
     // If there is no buffer object, create a new one
     if (_particleVBO == 0)
-        glGenBuffers(1, &_particleVBO);
+        generateParticleBuffer();
+
+    // The buffer has to be able to hold all particles, even if we were given a wrong capacity
+    const size_t numberOfParticles = _particleData.size();
+    if (numberOfParticles > _particleCapacity)
+        _particleCapacity = numberOfParticles;
+
+    // The layout benchmark only counts the uploads after its warmup
+    const std::chrono::steady_clock::time_point uploadStart = std::chrono::steady_clock::now();
+    const size_t uploadedBytes = uploadParticleData(numberOfParticles);
+    if ((_benchmarkedLayout != -1) && (_benchmarkFrames >= _benchmarkWarmupFrames)) {
+        _benchmarkUploadMilliseconds += std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - uploadStart).count();
+        ++_benchmarkUploads;
+    }
+    if (_stats != nullptr)
+        _stats->add(StatsChannel::Counter::UploadBytes, uploadedBytes);
+    _firstParticle = 0;
+    _numberOfParticles = static_cast<GLsizei>(numberOfParticles);
+    _visibilityChanged = true;
+    _uploadedDataIsCurrent = true;
+    _uploadedVersion = _particleData.version();
+}
 
-    // Assign the data in _particleData to the _particleVBO
+size_t Renderer::uploadParticleData(size_t count) {
+    // Orphan the old storage of the _particleVBO by respecifying it without data. The driver can
+    // then hand us fresh memory instead of waiting until the last draw call has finished with
+    // the old contents. Since the size stays the same, no real reallocation takes place
     // GL_STREAM_DRAW signals to OpenGL that the data will change a lot
-    glEnableVertexAttribArray(0);
+    const size_t vertexSize = particleVertexSize();
     glBindBuffer(GL_ARRAY_BUFFER, _particleVBO);
-    glBufferData(GL_ARRAY_BUFFER, _particleData->size() * 3 * sizeof(float), &(_particleData->at(0)), GL_STREAM_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    _numberOfParticles = static_cast<GLsizei>(_particleData->size());
+    glBufferData(GL_ARRAY_BUFFER, _particleCapacity * vertexSize, nullptr, GL_STREAM_DRAW);
+
+    if (!interleavesAttributes()) {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::vec3), _particleData.data());
+        size_t bytes = count * sizeof(glm::vec3);
+
+        // Every channel is copied as it is into its own buffer, which is orphaned the same way
+        for (int i = 0; i < NumberOfAttributeChannels; ++i) {
+            const void* values = _attributeData.data(attributeChannel(i));
+            if ((_attributeVBOs[i] == 0) || (values == nullptr))
+                continue;
+            glBindBuffer(GL_ARRAY_BUFFER, _attributeVBOs[i]);
+            glBufferData(GL_ARRAY_BUFFER, _particleCapacity * AttributeChannelSize, nullptr,
+                GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, count * AttributeChannelSize, values);
+            bytes += count * AttributeChannelSize;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return bytes;
+    }
+
+    // The vertices are assembled channel by channel, so that each source array is read in
+    // order. The padding at the end of each vertex is never read
+    if (_interleavedVertices.size() < _particleCapacity * vertexSize)
+        _interleavedVertices.resize(_particleCapacity * vertexSize);
+    char* vertices = _interleavedVertices.data();
+    const glm::vec3* positions = _particleData.data();
+    for (size_t i = 0; i < count; ++i)
+        std::memcpy(vertices + i * vertexSize, positions + i, sizeof(glm::vec3));
+    for (int c = 0; c < NumberOfAttributeChannels; ++c) {
+        const AttributeChannel channel = attributeChannel(c);
+        const char* values = static_cast<const char*>(_attributeData.data(channel));
+        if (((_attributeChannels & channel) == 0) || (values == nullptr))
+            continue;
+        char* target = vertices + interleavedOffset(channel);
+        for (size_t i = 0; i < count; ++i) {
+            std::memcpy(target + i * vertexSize, values + i * AttributeChannelSize,
+                AttributeChannelSize);
+        }
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * vertexSize, vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return count * vertexSize;
+}
+
+glm::vec3* Renderer::beginWrite() {
+    // The regions are too small for vec3s if they were made for QuantizedPositions
+    if (_positionQuantizer != nullptr)
+        return nullptr;
+    return reinterpret_cast<glm::vec3*>(beginRegionWrite());
+}
+
+bool Renderer::quantizesPositions() const {
+    return positionsAreQuantized();
+}
+
+QuantizedPosition* Renderer::beginWriteQuantized() {
+    if (!positionsAreQuantized())
+        return nullptr;
+    return reinterpret_cast<QuantizedPosition*>(beginRegionWrite());
+}
+
+char* Renderer::beginRegionWrite() {
+    if (_mappedParticles == nullptr)
+        return nullptr;
+
+    // Use the regions in order. The region after the one that is drawn right now is the one
+    // that was drawn the longest time ago, so the GPU will most likely be finished with it
+    const int region = (_drawRegion + 1) % NumMappedRegions;
+    if (_regionFences[region] != 0) {
+        GLenum result = glClientWaitSync(_regionFences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        while ((result != GL_ALREADY_SIGNALED) && (result != GL_CONDITION_SATISFIED)) {
+            if (result == GL_WAIT_FAILED) {
+                LERROR("Waiting for the particle buffer fence failed");
+                break;
+            }
+            // Wait in steps of 1ms
+            result = glClientWaitSync(_regionFences[region], 0, 1000000);
+        }
+        glDeleteSync(_regionFences[region]);
+        _regionFences[region] = 0;
+    }
+
+    _writeRegion = region;
+    return _mappedParticles + region * _particleCapacity * mappedPositionSize();
+}
+
+void* Renderer::beginWriteAttribute(AttributeChannel channel) {
+    if ((_writeRegion == -1) || ((_attributeChannels & channel) == 0))
+        return nullptr;
+
+    // The region of the positions is the same region in the buffer of each channel, so the
+    // fence of the region protects the channels as well
+    for (int i = 0; i < NumberOfAttributeChannels; ++i) {
+        if ((attributeChannel(i) == channel) && (_mappedAttributes[i] != nullptr))
+            return _mappedAttributes[i] + _writeRegion * _particleCapacity * AttributeChannelSize;
+    }
+    return nullptr;
+}
+
+void Renderer::endWrite(size_t count) {
+    if (_writeRegion == -1) {
+        LERROR("endWrite called without a matching beginWrite");
+        return;
+    }
+
+    // Draw from the newly written region from now on. As the buffer is mapped coherently, the
+    // writes are visible to the GPU without an explicit flush
+    _drawRegion = _writeRegion;
+    _writeRegion = -1;
+    _firstParticle = static_cast<GLint>(_drawRegion * _particleCapacity);
+    _numberOfParticles = static_cast<GLsizei>(count);
+    _visibilityChanged = true;
+    _uploadedDataIsCurrent = false;
+    if (_stats != nullptr) {
+        // All channels that are streamed are mapped as well
+        const size_t attributeSize =
+            numberOfAttributeChannels(_attributeChannels) * AttributeChannelSize;
+        _stats->add(StatsChannel::Counter::UploadBytes,
+            count * (mappedPositionSize() + attributeSize));
+    }
+}
+
+void Renderer::generateParticleBuffer() {
+    // The vertex arrays reference the old buffer
+    releaseParticleVertexArrays();
+    _uploadedDataIsCurrent = false;
+
+    // If there is no buffer object, create a new one
+    if (_particleVBO == 0)
+        glGenBuffers(1, &_particleVBO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, _particleVBO);
+
+    // Persistent mapping needs to know the size of the buffer in advance. The simulation can
+    // write the separate attribute channels into mapped buffers of their own, but not into
+    // vertices that the renderer assembles
+    const bool useBufferStorage = GLEW_ARB_buffer_storage && (_particleCapacity > 0) &&
+        !assemblesAttributes();
+    if (useBufferStorage) {
+        const GLsizeiptr size = NumMappedRegions * _particleCapacity * mappedPositionSize();
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+        _mappedParticles = static_cast<char*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+    }
+
+    if (_mappedParticles != nullptr) {
+        _uploadMode = UploadMode::PersistentMapped;
+        LINFO("Streaming particles through a persistently mapped buffer");
+        if (positionsAreQuantized())
+            LINFO("The positions are quantized to " << mappedPositionSize() << " bytes");
+    }
+    else {
+        if (useBufferStorage) {
+            // The storage of the buffer is immutable now, so we need a new one for orphaning
+            LWARNING("Mapping the particle buffer failed");
+            glDeleteBuffers(1, &_particleVBO);
+            glGenBuffers(1, &_particleVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, _particleVBO);
+        }
+        if (_particleCapacity > 0) {
+            glBufferData(GL_ARRAY_BUFFER, _particleCapacity * particleVertexSize(), nullptr,
+                GL_STREAM_DRAW);
+        }
+        _uploadMode = UploadMode::Orphaning;
+        LINFO("Streaming particles by orphaning the buffer");
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+bool Renderer::positionsAreQuantized() const {
+    // Only the CPU simulation writes into the mapped regions
+    return (_positionQuantizer != nullptr) && (_uploadMode == UploadMode::PersistentMapped) &&
+        (_computeSimulation == nullptr);
+}
+
+size_t Renderer::mappedPositionSize() const {
+    return (_positionQuantizer != nullptr) ? sizeof(QuantizedPosition) : sizeof(glm::vec3);
+}
+
+void Renderer::initializeAttributes() {
+    // The locations without an array read the current values of the context, so the programs
+    // can declare all channels
+    glVertexAttrib4f(_attributeLocations[0], 1.f, 1.f, 1.f, 1.f);
+    glVertexAttrib1f(_attributeLocations[1], 1.f);
+    glVertexAttrib1f(_attributeLocations[2], 0.f);
+
+    if (_requestedAttributeChannels == 0)
+        return;
+    if (_computeSimulation != nullptr) {
+        LWARNING("The attribute channels are not available for the GPU simulation");
+        return;
+    }
+
+    // A channel that no program reads would only cost bandwidth. The linker removes the inputs
+    // that a shader declares but does not use, so those do not have a location
+    ProgramObject* const programs[] = {
+        _particleProgram, _billboardProgram, _billboardBlendingProgram
+    };
+    uint32_t readChannels = 0;
+    for (ProgramObject* program : programs) {
+        if (program == nullptr)
+            continue;
+        for (int i = 0; i < NumberOfAttributeChannels; ++i) {
+            if (program->attributeLocation(_attributeNames[i]) != -1)
+                readChannels |= attributeChannel(i);
+        }
+    }
+    // The culler reads the ids, whether or not it is enabled at the moment
+    if (_culler != nullptr)
+        readChannels |= IdChannel;
+    _attributeChannels = _requestedAttributeChannels & _attributeData.channels() & readChannels;
+    if (_attributeChannels != _requestedAttributeChannels) {
+        LINFO("Skipping the attribute channels " <<
+            attributeChannelNames(_requestedAttributeChannels & ~_attributeChannels) <<
+            ", as no program reads them or they are not provided");
+    }
+    if (_attributeChannels == 0)
+        return;
+
+    LINFO("Streaming the attribute channels " << attributeChannelNames(_attributeChannels) <<
+        " in the " << layoutName(_attributeLayout) << " layout");
+    generateAttributeBuffers();
+
+    // The culled and sorted particles keep their channels, except for the ids
+    if (_culler != nullptr)
+        _culler->setAttributeChannels(_attributeChannels);
+    if (_depthSorter != nullptr)
+        _depthSorter->setAttributeChannels(_attributeChannels);
+}
+
+bool Renderer::assemblesAttributes() const {
+    // While the layouts are benchmarked, both are uploaded the same way, so that only the
+    // layouts are compared
+    return (_requestedAttributeChannels != 0) &&
+        ((_attributeLayout == AttributeLayout::Interleaved) || _benchmarkLayoutsRequested);
+}
+
+bool Renderer::interleavesAttributes() const {
+    return (_attributeChannels != 0) && (_attributeLayout == AttributeLayout::Interleaved);
+}
+
+size_t Renderer::particleVertexSize() const {
+    if (!interleavesAttributes())
+        return sizeof(glm::vec3);
+    const size_t size = sizeof(glm::vec3) +
+        numberOfAttributeChannels(_attributeChannels) * AttributeChannelSize;
+    return (size + _vertexAlignment - 1) / _vertexAlignment * _vertexAlignment;
+}
+
+size_t Renderer::interleavedOffset(AttributeChannel channel) const {
+    // The channels follow the position in the order of their bits
+    const uint32_t previousChannels = _attributeChannels & (static_cast<uint32_t>(channel) - 1);
+    return sizeof(glm::vec3) + numberOfAttributeChannels(previousChannels) * AttributeChannelSize;
+}
+
+void Renderer::generateAttributeBuffers() {
+    // The vertex arrays reference the old buffers and strides
+    releaseParticleVertexArrays();
+    _uploadedDataIsCurrent = false;
+
+    // Deleting the mapped buffers unmaps them
+    glDeleteBuffers(NumberOfAttributeChannels, _attributeVBOs);
+    for (int i = 0; i < NumberOfAttributeChannels; ++i) {
+        _attributeVBOs[i] = 0;
+        _mappedAttributes[i] = nullptr;
+    }
+
+    const bool mapped = (_uploadMode == UploadMode::PersistentMapped);
+    if (_attributeLayout == AttributeLayout::Separate) {
+        for (int i = 0; i < NumberOfAttributeChannels; ++i) {
+            const AttributeChannel channel = attributeChannel(i);
+            if ((_attributeChannels & channel) == 0)
+                continue;
+            glGenBuffers(1, &_attributeVBOs[i]);
+            glBindBuffer(GL_ARRAY_BUFFER, _attributeVBOs[i]);
+            if (!mapped) {
+                glBufferData(GL_ARRAY_BUFFER, _particleCapacity * AttributeChannelSize, nullptr,
+                    GL_STREAM_DRAW);
+                continue;
+            }
+
+            // The simulation writes the channel into the same region as the positions
+            const GLsizeiptr size = NumMappedRegions * _particleCapacity * AttributeChannelSize;
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+            _mappedAttributes[i] =
+                static_cast<char*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+            if (_mappedAttributes[i] == nullptr) {
+                LWARNING("Mapping the buffer of the " << attributeChannelNames(channel) <<
+                    " channel failed. Drawing it with the default value");
+                glDeleteBuffers(1, &_attributeVBOs[i]);
+                _attributeVBOs[i] = 0;
+                _attributeChannels &= ~channel;
+            }
+        }
+        std::vector<char>().swap(_interleavedVertices);
+    }
+    else
+        _interleavedVertices.resize(_particleCapacity * particleVertexSize());
+
+    // The size of the vertices of _particleVBO depends on the layout. The storage of the
+    // mapped buffer is immutable, but it only ever holds the positions
+    if (!mapped) {
+        glBindBuffer(GL_ARRAY_BUFFER, _particleVBO);
+        glBufferData(GL_ARRAY_BUFFER, _particleCapacity * particleVertexSize(), nullptr,
+            GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Renderer::advanceLayoutBenchmark() {
+    if (_benchmarkedLayout == -1) {
+        // The creation of the scenery after the first frame is not measured
+        if (!_sceneryInitialized)
+            return;
+        _benchmarkLayoutsRequested = false;
+        if (_attributeChannels == 0) {
+            LWARNING("There are no attribute channels whose layouts could be compared");
+            return;
+        }
+        if (_profiler == nullptr) {
+            LWARNING("The attribute layouts can only be compared with a profiler");
+            return;
+        }
+        _benchmarkedLayout = static_cast<int>(AttributeLayout::Separate);
+        _benchmarkFrames = 0;
+        _benchmarkUploadMilliseconds = 0.0;
+        _benchmarkUploads = 0;
+        setAttributeLayout(AttributeLayout::Separate);
+        return;
+    }
+
+    if (++_benchmarkFrames < _benchmarkWarmupFrames + _benchmarkMeasuredFrames)
+        return;
+
+    // The profiler only holds the GPU times of the frames after the warmup by now. Which layout
+    // wins depends on the GPU, so the cost of the whole frame is compared
+    const AttributeLayout layout = static_cast<AttributeLayout>(_benchmarkedLayout);
+    const float gpuMilliseconds = _profiler->statistics(Profiler::Section::GpuDraw).median;
+    const float uploadMilliseconds = (_benchmarkUploads > 0) ?
+        static_cast<float>(_benchmarkUploadMilliseconds / _benchmarkUploads) : 0.f;
+    _benchmarkCosts[_benchmarkedLayout] = gpuMilliseconds + uploadMilliseconds;
+    LINFO("The " << layoutName(layout) << " attribute layout takes " << uploadMilliseconds <<
+        " ms per upload and " << gpuMilliseconds << " ms per frame on the GPU");
+
+    if (layout == AttributeLayout::Separate) {
+        _benchmarkedLayout = static_cast<int>(AttributeLayout::Interleaved);
+        _benchmarkFrames = 0;
+        _benchmarkUploadMilliseconds = 0.0;
+        _benchmarkUploads = 0;
+        setAttributeLayout(AttributeLayout::Interleaved);
+        return;
+    }
+
+    _benchmarkedLayout = -1;
+    const AttributeLayout fastest = (_benchmarkCosts[1] < _benchmarkCosts[0]) ?
+        AttributeLayout::Interleaved : AttributeLayout::Separate;
+    LINFO("Keeping the faster " << layoutName(fastest) << " attribute layout");
+    setAttributeLayout(fastest);
+}
+
+void Renderer::generateBillboardBuffer() {
+    // If there is no buffer object, create a new one
+    if (_billboardVBO == 0)
+        glGenBuffers(1, &_billboardVBO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, _billboardVBO);
+
+    //     2-----------3
+    //     |           |         y
+    //     |     o     |         |
+    //     |           |         |
+    //     0-----------1         o----->x
+    //
+    // in the order of a triangle strip; the shader maps the corners to texture coordinates
+
+    GLfloat corners[] = {
+        -1.f, -1.f, // 0
+         1.f, -1.f, // 1
+        -1.f,  1.f, // 2
+         1.f,  1.f, // 3
+    };
+
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void Renderer::generateGroundBuffer() {
@@ -640,6 +1595,11 @@ void Renderer::generateGroundBuffer() {
     if (_groundVBO == 0)
         glGenBuffers(1, &_groundVBO);
 
+    // The vertex array records the attribute setup, so it does not have to be repeated per draw
+    if (_groundVAO == 0)
+        glGenVertexArrays(1, &_groundVAO);
+    glBindVertexArray(_groundVAO);
+
     // Fill the ground buffer with static vertices that will not change
     glEnableVertexAttribArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, _groundVBO);
@@ -655,14 +1615,17 @@ void Renderer::generateGroundBuffer() {
     // grid[i + 2] = z
 
     GLfloat vertices[] = {
-        -_skyboxSize, -_skyboxSize, 0.f, // 0
-         _skyboxSize, -_skyboxSize, 0.f, // 1
-         _skyboxSize,  _skyboxSize, 0.f, // 2
-        -_skyboxSize,  _skyboxSize, 0.f, // 3
+        -_skyboxSize, -_skyboxSize, worldgeometry::GroundHeight, // 0
+         _skyboxSize, -_skyboxSize, worldgeometry::GroundHeight, // 1
+         _skyboxSize,  _skyboxSize, worldgeometry::GroundHeight, // 2
+        -_skyboxSize,  _skyboxSize, worldgeometry::GroundHeight, // 3
     };
 
     glBufferData(GL_ARRAY_BUFFER, 3 * 4 * sizeof(float), vertices, GL_STATIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void Renderer::generateSkyboxBuffer() {
@@ -670,6 +1633,11 @@ void Renderer::generateSkyboxBuffer() {
     if (_skyboxVBO == 0)
         glGenBuffers(1, &_skyboxVBO);
 
+    // The vertex array records the attribute setup and the index buffer
+    if (_skyboxVAO == 0)
+        glGenVertexArrays(1, &_skyboxVAO);
+    glBindVertexArray(_skyboxVAO);
+
     // Fill the skybox vertex buffer with the 8 vertices of the cube
     glEnableVertexAttribArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, _skyboxVBO);
@@ -717,6 +1685,10 @@ void Renderer::generateSkyboxBuffer() {
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _skyboxIBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+    // The element array binding is part of the vertex array, so it has to be unbound first
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void Renderer::showGroundRendering(bool showRendering) {
@@ -731,6 +1703,96 @@ void Renderer::limitCameraPosition(bool limitDistance) {
     _limitCameraPosition = limitDistance;
 }
 
+void Renderer::enableCulling(bool enabled) {
+    _cullingEnabled = enabled;
+    _visibilityChanged = true;
+}
+
+void Renderer::setBlendMode(int mode) {
+    if ((mode < 0) || (mode > static_cast<int>(BlendMode::WeightedBlended))) {
+        LERROR("Unknown blend mode " << mode);
+        return;
+    }
+
+    _blendMode = static_cast<BlendMode>(mode);
+    if ((_blendMode == BlendMode::Sorted) && (_depthSorter == nullptr))
+        LWARNING("Sorting is not available. Particles are blended unsorted");
+    if ((_blendMode == BlendMode::WeightedBlended) && !weightedBlendingIsActive())
+        LWARNING("Weighted blending is not available. Particles are blended unsorted");
+    _visibilityChanged = true;
+}
+
+void Renderer::showBillboardRendering(bool showBillboards) {
+    _particleMode = showBillboards ? ParticleMode::Billboards : ParticleMode::Points;
+}
+
 unsigned int Renderer::numberOfParticles() const {
     return _numberOfParticles;
 }
+
+void Renderer::requestComputeSimulation(bool enabled) {
+    _computeSimulationRequested = enabled;
+}
+
+ComputeSimulation* Renderer::computeSimulation() {
+    return _computeSimulation;
+}
+
+void Renderer::requestFrameExport(const FrameExportSettings& settings) {
+    delete _frameExporter;
+    _frameExporter = new FrameExporter(settings);
+}
+
+void Renderer::requestQuantizedPositions(const PositionQuantizer& quantizer) {
+    delete _positionQuantizer;
+    _positionQuantizer = new PositionQuantizer(quantizer);
+}
+
+void Renderer::requestAttributes(AttributeView attributes, uint32_t channels,
+    AttributeLayout layout, bool benchmarkLayouts)
+{
+    _attributeData = attributes;
+    _requestedAttributeChannels = channels & AllAttributeChannels;
+    _attributeLayout = layout;
+    _benchmarkLayoutsRequested = benchmarkLayouts;
+}
+
+uint32_t Renderer::attributeChannels() const {
+    return _attributeChannels;
+}
+
+AttributeLayout Renderer::attributeLayout() const {
+    return _attributeLayout;
+}
+
+void Renderer::setAttributeLayout(AttributeLayout layout) {
+    if (layout == _attributeLayout)
+        return;
+    if ((_uploadMode == UploadMode::PersistentMapped) && (layout == AttributeLayout::Interleaved)) {
+        LWARNING("The attribute channels in the mapped buffers cannot be interleaved");
+        return;
+    }
+    _attributeLayout = layout;
+    if (_attributeChannels != 0)
+        generateAttributeBuffers();
+}
+
+Renderer::UploadMode Renderer::uploadMode() const {
+    return _uploadMode;
+}
+
+Renderer::ParticleMode Renderer::particleMode() const {
+    return _particleMode;
+}
+
+Renderer::BlendMode Renderer::blendMode() const {
+    return _blendMode;
+}
+
+void Renderer::setProfiler(Profiler* profiler) {
+    _profiler = profiler;
+}
+
+void Renderer::setStatsChannel(StatsChannel* stats) {
+    _stats = stats;
+}
@@ -27,12 +27,63 @@
 // Need to include opengl first, as QGLWidget will include gl, but not glew
 #include <ghoul/opengl/opengl>
 
+#include "attributesource.h"
+#include "gputimer.h"
+#include "particleattributes.h"
+#include "positionquantizer.h"
+#include "positionsink.h"
+#include "positionview.h"
+#include "programcache.h"
+#include "renderstate.h"
+#include "textureloader.h"
+
 #include <QGLWidget>
 #include <glm/glm.hpp>
+#include <vector>
+
+class ComputeSimulation;
+class DepthSorter;
+class FrameExporter;
+class ParticleCuller;
+class Profiler;
+class StatsChannel;
+class WeightedBlending;
+struct FrameExportSettings;
 
-class Renderer : public QGLWidget {
+class Renderer : public QGLWidget, public PositionSink {
 Q_OBJECT
 public:
+    // The ways in which the particle positions can get into the vertex buffer object
+    enum class UploadMode {
+        // Each update orphans the buffer storage and copies the data with glBufferSubData
+        Orphaning,
+        // The buffer is persistently mapped (ARB_buffer_storage) and split into three regions
+        // that are written directly by the simulation through the PositionSink interface;
+        // glFenceSync guarantees that the GPU has finished with a region before it is reused
+        PersistentMapped
+    };
+
+    // The ways in which the particles are drawn
+    enum class ParticleMode {
+        // One GL_POINTS point sprite per particle, sized by the vertex shader
+        Points,
+        // One camera-facing quad per particle, drawn as an instance of a single shared quad. Its
+        // size is not limited by the implementation's maximum point size
+        Billboards
+    };
+
+    // The ways in which the translucent particles are blended over each other
+    enum class BlendMode {
+        // In the order of the particle buffer; cheapest, but the result depends on that order
+        Unsorted,
+        // Back to front after a radix sort by view depth on the GPU. The sort only runs again
+        // when the camera moved or the particles changed. Needs compute shaders
+        Sorted,
+        // Weighted blended order-independent transparency, which needs no sorting but only
+        // approximates the correct result. Only available for the billboards
+        WeightedBlended
+    };
+
     // Default destructor. Nothing fancy
     Renderer(const QGLFormat& format, QWidget* parent = 0, Qt::WindowFlags f = 0);
 
@@ -40,17 +91,95 @@ public:
     ~Renderer();
 
     // Assigns the data in 'particleData' to this renderer to be used as a data source
-    // This function will call 'updateData' after setting the new data source
-    void setData(const std::vector<glm::vec3>* particleData);
+    // This function will call 'updateData' after setting the new data source.
+    // 'maximumNumberOfParticles' determines the size of the vertex buffer object
+    void setData(PositionView particleData, size_t maximumNumberOfParticles);
 
     // Recreate the VertexBufferObjects from the data previously stored in particleData
-    // Since 'setData' takes in a pointer, this method should be called if the underlying data
-    // has changed.
+    // Since 'setData' takes in a view, this method should be called if the underlying data
+    // has changed. If the view has a version, nothing is uploaded while it stays the same
     void updateData();
 
     // Returns the number of particles currently in the rendering system
     unsigned int numberOfParticles() const;
 
+    // Requests that the particles are simulated on the GPU by a ComputeSimulation. Has to be
+    // called before the OpenGL context is initialized. If the driver does not support compute
+    // shaders, the renderer falls back to rendering the data passed in 'setData'
+    void requestComputeSimulation(bool enabled);
+
+    // Returns the ComputeSimulation, or nullptr if the particles are not simulated on the GPU
+    ComputeSimulation* computeSimulation();
+
+    // Requests that every rendered frame and its particle positions are exported as selected
+    // by 'settings'. Has to be called before the OpenGL context is initialized
+    void requestFrameExport(const FrameExportSettings& settings);
+
+    // Requests that the simulation writes its positions as QuantizedPositions of 'quantizer'
+    // into the persistently mapped buffer, which has to move a third fewer bytes. They are
+    // decoded by the culler, so culling has to be supported; particles outside of the grid of
+    // 'quantizer' are not drawn. Has to be called before the OpenGL context is initialized
+    void requestQuantizedPositions(const PositionQuantizer& quantizer);
+
+    // Requests that the attribute 'channels' of 'attributes' are streamed to the shaders along
+    // with the positions of 'setData', laid out as 'layout'. Only the channels that one of the
+    // particle programs reads are uploaded, and the ids if there is a culler. In the separate
+    // layout, the simulation writes each channel into a persistently mapped buffer of its own,
+    // just like the positions. The interleaved vertices are assembled by the renderer, so they
+    // are uploaded by orphaning, which is also used for both layouts if 'benchmarkLayouts' is
+    // true. In that case both layouts are measured after the first frames and the faster one is
+    // kept. The culler and the sorter carry the channels other than the ids along with the
+    // positions. Has to be called before the OpenGL context is initialized
+    void requestAttributes(AttributeView attributes, uint32_t channels, AttributeLayout layout,
+        bool benchmarkLayouts);
+
+    // Returns the channels that are uploaded. Only valid after the OpenGL context has been
+    // initialized
+    uint32_t attributeChannels() const;
+
+    // Returns the current layout of the attribute channels
+    AttributeLayout attributeLayout() const;
+
+    // Lays the attribute channels out as 'layout' from the next upload on. The channels in the
+    // mapped buffers cannot be interleaved. Has to be called with the OpenGL context current
+    void setAttributeLayout(AttributeLayout layout);
+
+    // Returns the way the particle data is transferred to the GPU. Only valid after the OpenGL
+    // context has been initialized
+    UploadMode uploadMode() const;
+
+    // Sets the profiler that the upload and draw times are recorded in. Pass a nullptr to
+    // disable the measurements
+    void setProfiler(Profiler* profiler);
+
+    // Sets the channel that the number of uploaded position bytes is published in. Pass a
+    // nullptr to stop publishing
+    void setStatsChannel(StatsChannel* stats);
+
+    // Returns the way the particles are drawn
+    ParticleMode particleMode() const;
+
+    // Returns the way the particles are blended
+    BlendMode blendMode() const;
+
+    // Returns the next region of the persistently mapped particle buffer, waiting for the GPU to
+    // finish reading it if necessary. Returns a nullptr if the buffer is not persistently mapped
+    glm::vec3* beginWrite() override;
+
+    // Returns true if the positions are written through 'beginWriteQuantized'
+    bool quantizesPositions() const override;
+
+    // Like 'beginWrite', but for QuantizedPositions. Returns a nullptr if the positions are
+    // not quantized
+    QuantizedPosition* beginWriteQuantized() override;
+
+    // Returns the part of the mapped buffer of 'channel' that belongs to the region of the last
+    // 'beginWrite'. Returns a nullptr if that channel is not streamed through a mapped buffer
+    void* beginWriteAttribute(AttributeChannel channel) override;
+
+    // Makes the region of the last 'beginWrite' the one that is rendered
+    void endWrite(size_t count) override;
+
 public slots:
     // Determines if the ground plane should be rendered or not
     void showGroundRendering(bool showRendering);
@@ -58,9 +187,17 @@ public slots:
     void showSkyboxRendering(bool showRendering);
     // Sets a state if the distance of the camera is limited to the skybox
     void limitCameraPosition(bool limitCamera);
+    // Determines if the particles are drawn as instanced billboards instead of point sprites
+    void showBillboardRendering(bool showBillboards);
+    // Determines if only the particles in the view frustum are drawn, thinned out with the
+    // distance. Has no effect if the driver does not support compute shaders
+    void enableCulling(bool enabled);
+    // Selects how the particles are blended; 'mode' is the index of a BlendMode
+    void setBlendMode(int mode);
 
 protected:
-    // creates all the necessary OpenGL objects (VBOs, IBOs, Textures, Shaders, etc)
+    // creates the OpenGL objects that are needed to draw the particles and starts decoding the
+    // textures. The ground and the skybox are created after the first frame
     void initializeGL();
     
     // Draws the ground, the skybox and the particles
@@ -95,18 +232,117 @@ private:
     void initializeSkybox();
     // Creates the VBO and IBO to render the skybox
     void generateSkyboxBuffer();
+    // Creates the cube map that the faces of the skybox are uploaded into
+    void generateSkyboxTexture();
     // Draws the skybox
     void drawSkybox();
     // Returns true if all objects for the skybox have been created
     bool skyboxIsReady() const;
 
+    // Uploads the images that the TextureLoader has decoded since the last frame
+    void uploadDecodedTextures();
+    // Creates the texture of 'image' or uploads it into its face of the skybox
+    void uploadTexture(const TextureLoader::Image& image);
+
     // Creates the objects necessary to render the particles
     void initializeParticle();
+    // Creates the VBO for the particles, persistently mapped if the driver supports it
+    void generateParticleBuffer();
+    // Returns true if the mapped regions hold QuantizedPositions instead of vec3s
+    bool positionsAreQuantized() const;
+    // Returns the number of bytes per particle in the mapped regions
+    size_t mappedPositionSize() const;
+    // Returns the next mapped region once the GPU has finished reading it, or a nullptr if
+    // the buffer is not mapped
+    char* beginRegionWrite();
+    // Decides which of the requested attribute channels are uploaded and creates their buffers
+    void initializeAttributes();
+    // Returns true if the renderer combines the requested attribute channels with the positions
+    // itself, so that the simulation cannot write into mapped buffers
+    bool assemblesAttributes() const;
+    // Returns true if the attribute channels follow the positions in the vertices of
+    // _particleVBO
+    bool interleavesAttributes() const;
+    // Returns the number of bytes per particle in _particleVBO when it is not mapped
+    size_t particleVertexSize() const;
+    // Returns the byte offset of 'channel' in an interleaved vertex
+    size_t interleavedOffset(AttributeChannel channel) const;
+    // Recreates the storage of _particleVBO and the buffers of the channels for the current
+    // attribute layout. If _particleVBO is mapped, the channels are mapped as well
+    void generateAttributeBuffers();
+    // Orphans the buffers and uploads the positions and attributes of the first 'count'
+    // particles from the views. Returns the number of bytes that were uploaded
+    size_t uploadParticleData(size_t count);
+    // Fills 'sources' with the attribute channels of the particles in _particleVBO that are
+    // drawn
+    void particleAttributeSources(AttributeSource* sources) const;
+    // Points the attribute locations of the bound vertex array at the channels in 'sources';
+    // with a 'divisor' of 1 they advance once per instance
+    void bindAttributes(const AttributeSource* sources, GLuint divisor);
+    // Counts a frame of the layout benchmark and moves on to the next layout when the current
+    // one has been measured long enough
+    void advanceLayoutBenchmark();
     // Draws the particles
     void drawParticles();
     // Returns true, if all objects for the particles have been created and particle data exists
     bool particlesAreReady() const;
 
+    // The vertex arrays that draw the particles from one position buffer, starting at a byte
+    // offset into it
+    struct ParticleVertexArray {
+        // The buffer with the positions, or 0 if the entry is unused
+        GLuint buffer;
+        GLintptr offset;
+        // The positions at location 0
+        GLuint pointVAO;
+        // The billboard corners at location 0 and the instanced positions at location 1
+        GLuint billboardVAO;
+    };
+    // Returns the vertex arrays for the positions that are drawn this frame
+    const ParticleVertexArray& particleVertexArray();
+    // Returns the vertex arrays for the positions in 'buffer' starting at 'offset' bytes with
+    // 'stride' bytes between them and the attribute channels in 'attributes', creating them the
+    // first time a buffer and offset are used
+    const ParticleVertexArray& particleVertexArray(GLuint buffer, GLintptr offset,
+        GLsizei stride, const AttributeSource* attributes);
+    // Deletes the vertex arrays of all particle position sources
+    void releaseParticleVertexArrays();
+
+    // Creates the objects necessary to render the particles as instanced billboards
+    void initializeBillboard();
+    // Creates the VBO holding the corners of the shared billboard quad
+    void generateBillboardBuffer();
+    // Draws the particles as instanced billboards with 'program', whose uniform locations are
+    // in 'state'
+    void drawBillboards(ghoul::opengl::ProgramObject* program, const ProgramState& state);
+    // Returns true, if all objects for the billboards have been created
+    bool billboardsAreReady() const;
+
+    // Creates the ParticleCuller, if the driver supports it
+    void initializeCulling();
+    // Returns true if the particles are culled before they are drawn
+    bool cullingIsActive() const;
+    // Returns true if the positions go through the culler, either to be culled or to be
+    // decoded
+    bool cullerIsUsed() const;
+    // Compacts the visible particles of this frame
+    void cullParticles();
+
+    // Creates the DepthSorter and the weighted blending target, if the driver supports them
+    void initializeBlending();
+    // Returns true if the particles are sorted before they are drawn
+    bool sortingIsActive() const;
+    // Returns true if the billboards are drawn with weighted blended transparency
+    bool weightedBlendingIsActive() const;
+    // Sorts the particles of this frame, or the visible ones if culling is active
+    void sortParticles();
+    // Returns the buffer with the ParticleDrawCommands of the sorted or the culled particles,
+    // or 0 if the particles are drawn straight from their source
+    GLuint drawCommandBuffer() const;
+
+    // Reads back the frame that has just been drawn, together with the unculled positions
+    void exportFrame();
+
     // Recreate the view matrix and projection matrix from the current position, focus, upVector
     // and window sizes
     void updateViewProjectionMatrix();
@@ -132,23 +368,37 @@ private:
     // The cached premultiplied view-projection matrix
     glm::mat4 _viewProjectionMatrix;
 
+    // The values that are shared by all programs and if they changed since the last upload
+    GlobalUniforms _globals;
+    bool _globalsChanged;
+    // The uniform buffer that the programs read _globals from
+    GlobalUniformBuffer _globalUniforms;
+
     // The current position of the light
     glm::vec3 _lightPosition;
 
-    // Our local copy of the particle position data. This cannot be changed and we don't own
+    // Our view onto the particle position data. This cannot be changed and we don't own
     // this data
-    const std::vector<glm::vec3>* _particleData;
+    PositionView _particleData;
+    // True if _particleVBO holds the version _uploadedVersion of _particleData, so that
+    // 'updateData' can skip the upload until the owner changes the positions
+    bool _uploadedDataIsCurrent;
+    uint64_t _uploadedVersion;
 
     // Should the ground be rendered or not
     bool _renderGround;
     // The vertex buffer object storing the vertices for the ground plane
     GLuint _groundVBO;
-    // The color texture used for the ground plane
-    ghoul::opengl::Texture* _groundTexture;
-    // The normal texture used for the ground plane
-    ghoul::opengl::Texture* _groundTextureNormal;
+    // The vertex array object that sources the vertices from _groundVBO
+    GLuint _groundVAO;
+    // The color texture used for the ground plane, or 0 until it has been decoded
+    GLuint _groundTexture;
+    // The normal texture used for the ground plane, or 0 until it has been decoded
+    GLuint _groundTextureNormal;
     // The ProgramObject that is used to render the ground plane
     ghoul::opengl::ProgramObject* _groundProgram;
+    // The uniform locations of _groundProgram
+    ProgramState _groundState;
     // True, if the ground plane subcomponent is ready to render
     bool _groundProgramReady;
 
@@ -158,26 +408,144 @@ private:
     GLuint _skyboxVBO;
     // The index buffer object storing the faces of the skybox
     GLuint _skyboxIBO;
+    // The vertex array object that sources the vertices and indices of the skybox
+    GLuint _skyboxVAO;
     // The number of indices (24) for the skybox
     int _numSkyboxIndices;
     // The color texture used for the skybox
     GLuint _skyboxTexture;
+    // The number of faces of _skyboxTexture that have been uploaded
+    int _numberOfSkyboxFaces;
     // The ProgramObject that is used to render the skybox
     ghoul::opengl::ProgramObject* _skyboxProgram;
+    // The uniform locations of _skyboxProgram
+    ProgramState _skyboxState;
     // True, if the skybox subcomponent is ready to render
     bool _skyboxProgramReady;
     
     // The vertex buffer object storing the vertices for the particles
     GLuint _particleVBO;
-    // The color texture used for the particles
-    ghoul::opengl::Texture* _particleTexture;
+    // The number of position sources that can be drawn from: the regions of the mapped buffer,
+    // the two buffers of the GPU simulation, or the orphaned buffer, the culled particles, and
+    // the sorted particles
+    static const int NumParticleVertexArrays = 5;
+    // The vertex arrays of the position sources that have been drawn so far
+    ParticleVertexArray _particleVertexArrays[NumParticleVertexArrays];
+    // The entry of _particleVertexArrays that is used for the next new source
+    int _nextParticleVertexArray;
+    // The maximum number of particles that the vertex buffer object can hold (per region)
+    size_t _particleCapacity;
+    // How the particle data gets into _particleVBO
+    UploadMode _uploadMode;
+    // The number of regions in the persistently mapped buffer
+    static const int NumMappedRegions = 3;
+    // The start of the persistently mapped _particleVBO, or nullptr if it is not mapped
+    char* _mappedParticles;
+    // The quantization of the positions in the mapped regions, or nullptr if they are vec3s
+    PositionQuantizer* _positionQuantizer;
+    // Signaled once the GPU has finished the last draw call that read a region
+    GLsync _regionFences[NumMappedRegions];
+    // The region that is currently rendered, or -1 if none has been written yet
+    int _drawRegion;
+    // The region the simulation writes into between beginWrite and endWrite, or -1
+    int _writeRegion;
+    // The index of the first vertex that is rendered from _particleVBO
+    GLint _firstParticle;
+    // The color texture used for the particles, or 0 until it has been decoded
+    GLuint _particleTexture;
+    // The attributes that accompany _particleData and the channels that were requested of them
+    AttributeView _attributeData;
+    uint32_t _requestedAttributeChannels;
+    // The requested channels that one of the programs reads, which are the ones uploaded
+    uint32_t _attributeChannels;
+    // How the attribute channels are laid out
+    AttributeLayout _attributeLayout;
+    // The buffer of each channel in the Separate layout, or 0
+    GLuint _attributeVBOs[NumberOfAttributeChannels];
+    // The start of each persistently mapped buffer of _attributeVBOs, which has as many
+    // regions as _particleVBO, or nullptr if it is not mapped
+    char* _mappedAttributes[NumberOfAttributeChannels];
+    // The interleaved vertices are assembled in here before they are uploaded
+    std::vector<char> _interleavedVertices;
+    // True if the layouts should be measured once the first frames have been drawn
+    bool _benchmarkLayoutsRequested;
+    // The layout that is measured right now, or -1 if the benchmark is not running
+    int _benchmarkedLayout;
+    // The number of frames that have been drawn with the measured layout
+    int _benchmarkFrames;
+    // The time spent in the uploads of the measured layout and their number
+    double _benchmarkUploadMilliseconds;
+    int _benchmarkUploads;
+    // The cost of a frame in milliseconds with each of the layouts that were measured
+    float _benchmarkCosts[2];
     // The Programobject that is used to render the particles
     ghoul::opengl::ProgramObject* _particleProgram;
+    // The uniform locations of _particleProgram
+    ProgramState _particleState;
     // True, if the particle subcomponent is ready to render
     bool _particleProgramReady;
 
+    // How the particles are drawn
+    ParticleMode _particleMode;
+    // The vertex buffer object storing the four corners of the quad that every billboard shares
+    GLuint _billboardVBO;
+    // The indirect draw command (4, count, 0, 0) for drawing the GPU simulation's particles as
+    // billboards; the count is copied from that simulation's own command every frame
+    GLuint _billboardIndirectBuffer;
+    // The ProgramObject that is used to render the billboards
+    ghoul::opengl::ProgramObject* _billboardProgram;
+    // The uniform locations of _billboardProgram
+    ProgramState _billboardState;
+    // True, if the billboard subcomponent is ready to render
+    bool _billboardProgramReady;
+    // The ProgramObject that renders the billboards into the weighted blending target
+    ghoul::opengl::ProgramObject* _billboardBlendingProgram;
+    // The uniform locations of _billboardBlendingProgram
+    ProgramState _billboardBlendingState;
+    // True, if the weighted blending of the billboards is ready to render
+    bool _billboardBlendingProgramReady;
+
     // Current number of particles in the rendering system
     GLsizei _numberOfParticles;
+
+    // Should the particles be simulated on the GPU
+    bool _computeSimulationRequested;
+    // The GPU simulation that owns the particle buffers, if it is used
+    ComputeSimulation* _computeSimulation;
+
+    // Compacts the visible particles before they are drawn, if it is supported
+    ParticleCuller* _culler;
+    // Should the particles be culled if the culler is available
+    bool _cullingEnabled;
+
+    // How the particles are blended
+    BlendMode _blendMode;
+    // Orders the particles back to front, if it is supported
+    DepthSorter* _depthSorter;
+    // The offscreen target of the weighted blended transparency, if it is supported
+    WeightedBlending* _weightedBlending;
+    // True if the camera or the particles changed since the visible particles were last culled
+    // and sorted. The results of both persist until then
+    bool _visibilityChanged;
+
+    // Reads back and writes the rendered frames, if they are exported
+    FrameExporter* _frameExporter;
+
+    // Creates the programs from the binaries of earlier runs where possible
+    ProgramCache _programCache;
+    // Decodes the textures in the background
+    TextureLoader* _textureLoader;
+    // True once the first frame has been drawn
+    bool _firstFrameDrawn;
+    // True once the ground and the skybox have been created
+    bool _sceneryInitialized;
+
+    // Receives the CPU and GPU times of uploading and drawing, if it is set
+    Profiler* _profiler;
+    // Receives the number of uploaded bytes, if it is set
+    StatsChannel* _stats;
+    // Measures the GPU time of each frame without stalling
+    GpuTimer _gpuTimer;
 };
 
 #endif // __RENDERER_H__
\ No newline at end of file
@@ -0,0 +1,124 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "renderstate.h"
+
+#include <ghoul/logging/logging>
+
+namespace {
+    const std::string _loggerCat = "RenderState";
+
+    // The name of the uniform block holding the GlobalUniforms
+    const std::string _globalsBlockName = "Globals";
+
+    // The names of the ProgramState::Uniform values in the shaders
+    const char* _uniformNames[ProgramState::NumberOfUniforms] = {
+        "_viewProjectionMatrix",
+        "_cameraPosition",
+        "_lightPosition",
+        "_cameraRight",
+        "_cameraUp",
+        "_texture",
+        "_textureNormal",
+        "_billboardSize"
+    };
+}
+
+GlobalUniformBuffer::GlobalUniformBuffer()
+    : _buffer(0)
+{}
+
+GlobalUniformBuffer::~GlobalUniformBuffer() {
+    glDeleteBuffers(1, &_buffer);
+}
+
+void GlobalUniformBuffer::initialize() {
+    if (_buffer == 0)
+        glGenBuffers(1, &_buffer);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(GlobalUniforms), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    // The binding stays in place, so every program connected to BindingPoint sees the buffer
+    glBindBufferBase(GL_UNIFORM_BUFFER, BindingPoint, _buffer);
+}
+
+void GlobalUniformBuffer::update(const GlobalUniforms& globals) {
+    glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(GlobalUniforms), &globals);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+ProgramState::ProgramState()
+    : _usesGlobalBuffer(false)
+{
+    for (int i = 0; i < NumberOfUniforms; ++i)
+        _locations[i] = -1;
+}
+
+void ProgramState::initialize(ghoul::opengl::ProgramObject& program) {
+    for (int i = 0; i < NumberOfUniforms; ++i)
+        _locations[i] = program.uniformLocation(_uniformNames[i]);
+
+    const GLuint id = program;
+    const GLuint blockIndex = glGetUniformBlockIndex(id, _globalsBlockName.c_str());
+    _usesGlobalBuffer = (blockIndex != GL_INVALID_INDEX);
+    if (_usesGlobalBuffer)
+        glUniformBlockBinding(id, blockIndex, GlobalUniformBuffer::BindingPoint);
+    else
+        LDEBUG("Program does not declare the '" << _globalsBlockName << "' block");
+}
+
+void ProgramState::setGlobals(const GlobalUniforms& globals) const {
+    if (_usesGlobalBuffer)
+        return;
+
+    const GLint viewProjection = _locations[static_cast<int>(Uniform::ViewProjectionMatrix)];
+    if (viewProjection != -1)
+        glUniformMatrix4fv(viewProjection, 1, GL_FALSE, &globals.viewProjectionMatrix[0][0]);
+    const GLint cameraPosition = _locations[static_cast<int>(Uniform::CameraPosition)];
+    if (cameraPosition != -1)
+        glUniform3fv(cameraPosition, 1, &globals.cameraPosition[0]);
+    const GLint lightPosition = _locations[static_cast<int>(Uniform::LightPosition)];
+    if (lightPosition != -1)
+        glUniform3fv(lightPosition, 1, &globals.lightPosition[0]);
+    const GLint cameraRight = _locations[static_cast<int>(Uniform::CameraRight)];
+    if (cameraRight != -1)
+        glUniform3fv(cameraRight, 1, &globals.cameraRight[0]);
+    const GLint cameraUp = _locations[static_cast<int>(Uniform::CameraUp)];
+    if (cameraUp != -1)
+        glUniform3fv(cameraUp, 1, &globals.cameraUp[0]);
+}
+
+void ProgramState::setUniform(Uniform uniform, GLint value) const {
+    const GLint location = _locations[static_cast<int>(uniform)];
+    if (location != -1)
+        glUniform1i(location, value);
+}
+
+void ProgramState::setUniform(Uniform uniform, GLfloat value) const {
+    const GLint location = _locations[static_cast<int>(uniform)];
+    if (location != -1)
+        glUniform1f(location, value);
+}
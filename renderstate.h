@@ -0,0 +1,112 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __RENDERSTATE_H__
+#define __RENDERSTATE_H__
+
+#include <ghoul/opengl/opengl>
+#include <glm/glm.hpp>
+
+// The values that are the same for every program during a frame. The layout matches the std140
+// uniform block 'Globals' in the shaders, which is why the vectors are padded to vec4s
+struct GlobalUniforms {
+    glm::mat4 viewProjectionMatrix;
+    // xyz: the position of the camera
+    glm::vec4 cameraPosition;
+    // xyz: the position of the light
+    glm::vec4 lightPosition;
+    // xyz: the world space directions of the screen's x and y axes
+    glm::vec4 cameraRight;
+    glm::vec4 cameraUp;
+};
+
+// The uniform buffer that holds the GlobalUniforms for all programs. It is bound to
+// 'BindingPoint' once and only has to be updated when the globals change
+class GlobalUniformBuffer {
+public:
+    // The uniform buffer binding point that the 'Globals' blocks are connected to
+    static const GLuint BindingPoint = 0;
+
+    // Creates an object without a buffer; 'initialize' has to be called with a current context
+    GlobalUniformBuffer();
+
+    // Deletes the buffer
+    ~GlobalUniformBuffer();
+
+    // Creates the buffer and binds it to BindingPoint
+    void initialize();
+
+    // Uploads 'globals' into the buffer
+    void update(const GlobalUniforms& globals);
+
+private:
+    GlobalUniformBuffer(const GlobalUniformBuffer&) = delete;
+    GlobalUniformBuffer& operator=(const GlobalUniformBuffer&) = delete;
+
+    // The uniform buffer object
+    GLuint _buffer;
+};
+
+// The uniform locations of a ProgramObject, resolved once after it has been linked instead of
+// by name on every draw. If the program declares the 'Globals' block, it is connected to the
+// GlobalUniformBuffer and 'setGlobals' does nothing; otherwise the globals are set as plain
+// uniforms through the cached locations
+class ProgramState {
+public:
+    // The uniforms used by any of the programs. Uniforms that a program does not have are
+    // ignored when they are set
+    enum class Uniform {
+        ViewProjectionMatrix,
+        CameraPosition,
+        LightPosition,
+        CameraRight,
+        CameraUp,
+        Texture,
+        TextureNormal,
+        BillboardSize
+    };
+    // The number of values in Uniform
+    static const int NumberOfUniforms = 8;
+
+    // Creates a state in which all uniforms are missing
+    ProgramState();
+
+    // Resolves the locations of all uniforms of the linked 'program'
+    void initialize(ghoul::opengl::ProgramObject& program);
+
+    // Sets the globals, unless the program reads them from the GlobalUniformBuffer. The
+    // program has to be active
+    void setGlobals(const GlobalUniforms& globals) const;
+
+    // Sets 'uniform' to 'value'. The program has to be active
+    void setUniform(Uniform uniform, GLint value) const;
+    void setUniform(Uniform uniform, GLfloat value) const;
+
+private:
+    // The location of each Uniform, or -1 if the program does not have it
+    GLint _locations[NumberOfUniforms];
+    // True if the program reads the globals from the GlobalUniformBuffer
+    bool _usesGlobalBuffer;
+};
+
+#endif // __RENDERSTATE_H__
@@ -0,0 +1,166 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+// The headless server of the remote viewer. It runs the simulation in real time without the GUI
+// or an OpenGL context and streams the positions to a ParticleSimulator that was started with
+// '--connect', which also sends the sources and effects that are added in it back here. Usage:
+//   ParticleServer [--port P] [--capacity C] [--rate R] [--threads T] [--precision B]
+//                  [--snapshot file] [--duration seconds]
+// '--port' is the port the viewers connect to (default 7090), '--capacity' the maximum number
+// of particles, and '--rate' the number of steps per second. '--precision' is the number of
+// bits of each offset within a cell of the spatial hash that are sent (default 8, at most 16),
+// which trades the accuracy of the positions for bandwidth. '--snapshot' starts the
+// simulation from a snapshot saved by the GUI, and '--duration' stops the server after that
+// many seconds instead of running until it is killed
+
+#include <ghoul/logging/logging>
+
+#include "callbackrecorder.h"
+#include "fixedtimestep.h"
+#include "simulation.h"
+#include "snapshot.h"
+#include "streamserver.h"
+#include "threadpool.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ghoul::logging;
+
+namespace {
+    const std::string _loggerCat = "ParticleServer";
+
+    // The seconds between two status messages
+    const double _statusInterval = 10.0;
+}
+
+int main(int argc, char** argv) {
+    LogManager::initialize(LogManager::LogLevelInfo);
+    LogMgr.addLog(new ConsoleLog);
+
+    std::string port = "7090";
+    long long capacity = 5000000;
+    float rate = 60.f;
+    unsigned int numberOfWorkers = ThreadPool::defaultNumberOfWorkers();
+    int precisionBits = 8;
+    std::string snapshotPath;
+    double duration = -1.0;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if (i + 1 >= argc) {
+            LFATAL("Missing value for argument '" << argument << "'");
+            return EXIT_FAILURE;
+        }
+        const char* value = argv[++i];
+        if (argument == "--port")
+            port = value;
+        else if (argument == "--capacity")
+            capacity = std::atoll(value);
+        else if (argument == "--rate")
+            rate = static_cast<float>(std::atof(value));
+        else if (argument == "--threads") {
+            // The calling thread is working as well
+            const int threads = std::atoi(value);
+            numberOfWorkers = (threads > 1) ? static_cast<unsigned int>(threads - 1) : 0;
+        }
+        else if (argument == "--precision")
+            precisionBits = std::atoi(value);
+        else if (argument == "--snapshot")
+            snapshotPath = value;
+        else if (argument == "--duration")
+            duration = std::atof(value);
+        else {
+            LFATAL("Unknown argument '" << argument << "'");
+            return EXIT_FAILURE;
+        }
+    }
+    if ((capacity <= 0) || (rate <= 0.f)) {
+        LFATAL("The capacity and the rate have to be positive");
+        return EXIT_FAILURE;
+    }
+
+    ThreadPool pool(numberOfWorkers);
+    Simulation simulation(static_cast<size_t>(capacity), pool);
+    if (!snapshotPath.empty()) {
+        Snapshot snapshot;
+        if (!snapshot.open(snapshotPath) || !snapshot.restore(simulation))
+            return EXIT_FAILURE;
+        LINFO("Restored " << snapshot.numberOfParticles() << " particles from the snapshot");
+    }
+
+    StreamServer server(simulation, precisionBits);
+    if (!server.start(port))
+        return EXIT_FAILURE;
+
+    // The simulation keeps up with the real time, like in the GUI, and the viewer receives
+    // the state after the most recent step
+    typedef std::chrono::steady_clock Clock;
+    FixedTimestep timestep(rate);
+    const Clock::time_point start = Clock::now();
+    Clock::time_point last = start;
+    Clock::time_point nextStatus = start + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(_statusInterval));
+    uint64_t statusFrames = 0;
+    uint64_t statusBytes = 0;
+    std::vector<CallbackRecorder::Event> events;
+    while (true) {
+        const Clock::time_point now = Clock::now();
+        if ((duration >= 0.0) && (std::chrono::duration<double>(now - start).count() >= duration))
+            break;
+        timestep.accumulate(std::chrono::duration<float>(now - last).count());
+        last = now;
+
+        server.takeEvents(events);
+        for (CallbackRecorder::Event& event : events) {
+            event.step = simulation.numberOfSteps();
+            CallbackRecorder::apply(event, simulation);
+        }
+        events.clear();
+
+        const int numberOfSteps = timestep.consumeSteps();
+        for (int i = 0; i < numberOfSteps; ++i)
+            simulation.step(timestep.stepSize());
+        if (numberOfSteps > 0)
+            server.publish();
+
+        if (now >= nextStatus) {
+            const uint64_t frames = server.numberOfFrames();
+            const uint64_t bytes = server.numberOfBytes();
+            LINFO(simulation.store().size() << " particles, " <<
+                (frames - statusFrames) / _statusInterval << " frames/s, " <<
+                (bytes - statusBytes) / (_statusInterval * 1024.0 * 1024.0) << " MB/s");
+            statusFrames = frames;
+            statusBytes = bytes;
+            nextStatus += std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(_statusInterval));
+        }
+
+        // Sleep for the rest of the next step
+        const float untilStep = (1.f - timestep.interpolation()) * timestep.stepSize();
+        std::this_thread::sleep_for(std::chrono::duration<float>(untilStep));
+    }
+    return EXIT_SUCCESS;
+}
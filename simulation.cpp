@@ -0,0 +1,343 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "simulation.h"
+
+#include "allocationcounter.h"
+#include "profiler.h"
+#include "statschannel.h"
+#include "threadpool.h"
+#include "worldgeometry.h"
+
+#include <ghoul/logging/logging>
+#include <vector>
+
+namespace {
+    const std::string _loggerCat = "Simulation";
+
+    // The number of particles that are processed as one job by the thread pool. Large enough to
+    // amortize the scheduling overhead, small enough to balance the load across the cores. It
+    // is a multiple of ParticleStore::BatchSize so that only the last chunk has a partial batch
+    const size_t _chunkSize = 16 * 1024;
+    static_assert(_chunkSize % ParticleStore::BatchSize == 0, "Chunks must hold whole batches");
+    // The chunks start at the flags of their own batches of 4 particles in _outsideFlags
+    static_assert(_chunkSize % 4 == 0, "Chunks must start at a flag");
+
+    // The FNV-1a parameters of the checksum
+    const uint64_t _hashBasis = 14695981039346656037ull;
+    const uint64_t _hashPrime = 1099511628211ull;
+
+    // Adds the 'size' bytes at 'data' to the FNV-1a hash 'hash'
+    uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i)
+            hash = (hash ^ bytes[i]) * _hashPrime;
+        return hash;
+    }
+
+    // Half the edge length of the box the spatial hash covers. This is the size of the skybox,
+    // which the particles cannot leave
+    const float _domainExtent = worldgeometry::SkyboxSize;
+
+    // How the particles bounce off the ground and off the walls of the skybox
+    const CollisionSystem::Material _groundMaterial = {
+        worldgeometry::GroundRestitution, worldgeometry::GroundFriction };
+    const CollisionSystem::Material _wallMaterial = {
+        worldgeometry::WallRestitution, worldgeometry::WallFriction };
+
+    // The speed at which the exported colors reach the color of the fast particles
+    const float _fastSpeed = 2.f;
+    // The exported colors of resting and of fast particles
+    const glm::vec3 _restingColor = glm::vec3(0.3f, 0.5f, 1.f);
+    const glm::vec3 _fastColor = glm::vec3(1.f, 0.6f, 0.1f);
+    // The exported size at the end of the lifetime
+    const float _finalSize = 0.5f;
+
+    // Packs 'color' in [0,1]^3 into RGBA8 with red in the lowest byte and an opaque alpha
+    uint32_t packColor(const glm::vec3& color) {
+        const glm::uvec3 bytes = glm::uvec3(color * 255.f + 0.5f);
+        return bytes.x | (bytes.y << 8) | (bytes.z << 16) | (0xFFu << 24);
+    }
+}
+
+Simulation::Simulation(size_t capacity, ThreadPool& pool)
+    : _store(capacity)
+    , _pool(pool)
+    , _outsideFlags((_store.capacity() + 3) / 4)
+    , _spatialHash(glm::vec3(-_domainExtent), glm::vec3(_domainExtent))
+    , _positionQuantizer(_spatialHash)
+    , _numberOfSteps(0)
+    , _profiler(nullptr)
+    , _stats(nullptr)
+{
+    // The same ground and skybox that the renderer draws
+    _collisions.addPlane(glm::vec3(0.f, 0.f, 1.f), worldgeometry::GroundHeight, _groundMaterial);
+    _collisions.addBounds(glm::vec3(-_domainExtent), glm::vec3(_domainExtent), _wallMaterial);
+}
+
+void Simulation::step(float deltaT, glm::vec3* exportPositions, float exportOffset) {
+    advance(deltaT, exportPositions, nullptr, exportOffset);
+}
+
+void Simulation::step(float deltaT, QuantizedPosition* exportPositions, float exportOffset) {
+    advance(deltaT, nullptr, exportPositions, exportOffset);
+}
+
+void Simulation::advance(float deltaT, glm::vec3* exportPositions,
+    QuantizedPosition* quantizedPositions, float exportOffset)
+{
+    // All memory of the simulation has a fixed size, so a step should never have to allocate.
+    // This is only checked in debug builds and only for the calling thread
+    const size_t allocationsBefore = allocationcounter::thisThread();
+    size_t spawned = 0;
+    size_t expired = 0;
+    {
+        Profiler::ScopedTimer stepTimer(_profiler, Profiler::Section::Step);
+
+        // Remove the particles that have died during the last step first, so that the exported
+        // positions match the state of the store after this step
+        expired = _store.removeExpired();
+
+        // The new particles are integrated in the same step, so they already move when they
+        // appear
+        {
+            Profiler::ScopedTimer timer(_profiler, Profiler::Section::Emit);
+            spawned = _emitters.spawn(_store, _pool, deltaT);
+        }
+
+        // Sort the particles into the grid; this also keeps particles that are close in space
+        // close in memory, which benefits all following passes
+        {
+            Profiler::ScopedTimer timer(_profiler, Profiler::Section::Sort);
+            _spatialHash.build(_store, _pool);
+        }
+
+        // The effects only have to visit the cells around them, which needs the grid
+        {
+            Profiler::ScopedTimer timer(_profiler, Profiler::Section::Effects);
+            _effects.apply(_store, _spatialHash, _pool, deltaT);
+        }
+
+        // Advance all remaining particles. The chunks are independent of each other. The
+        // collisions are resolved while the chunk is still in the cache, before anything reads
+        // the new positions. If the colliders leave a free box, the integration already finds
+        // the few batches that left it, and only those are tested against the colliders
+        Profiler::ScopedTimer timer(_profiler, Profiler::Section::Integrate);
+        glm::vec3 freeMinimum;
+        glm::vec3 freeMaximum;
+        const bool hasFreeBox = _collisions.freeBox(freeMinimum, freeMaximum);
+        _pool.parallelFor(0, _store.size(), _chunkSize,
+            [this, deltaT, exportPositions, quantizedPositions, exportOffset, hasFreeBox,
+             freeMinimum, freeMaximum]
+            (size_t begin, size_t end) {
+                if (hasFreeBox) {
+                    uint8_t* outside = _outsideFlags.data() + begin / 4;
+                    _integrator.integrate(_store, begin, end, glm::vec3(0.f), deltaT,
+                        exportPositions, exportOffset, freeMinimum, freeMaximum, outside);
+                    _collisions.collide(_store, begin, end, exportPositions, outside);
+                }
+                else {
+                    _integrator.integrate(_store, begin, end, glm::vec3(0.f), deltaT,
+                        exportPositions, exportOffset);
+                    _collisions.collide(_store, begin, end, exportPositions);
+                }
+                if (quantizedPositions != nullptr) {
+                    _positionQuantizer.encode(_store.positions() + begin,
+                        _store.velocities() + begin, exportOffset, end - begin,
+                        quantizedPositions + begin);
+                }
+            }
+        );
+    }
+
+    const size_t allocations = allocationcounter::thisThread() - allocationsBefore;
+    if ((_numberOfSteps > 0) && (allocations > 0))
+        LWARNING("Step " << _numberOfSteps << " allocated memory " << allocations << " times");
+    ++_numberOfSteps;
+
+    if (_stats != nullptr)
+        publishStats(spawned, expired);
+}
+
+void Simulation::publishStats(size_t spawned, size_t expired) {
+    _stats->add(StatsChannel::Counter::Spawned, spawned);
+    _stats->add(StatsChannel::Counter::Expired, expired);
+    _stats->set(StatsChannel::Counter::Live, _store.size());
+    _stats->add(StatsChannel::Counter::Steps, 1);
+
+    // The emitters count their particles themselves, so only the tracked ones are copied
+    const std::vector<EmitterSystem::Emitter>& emitters = _emitters.emitters();
+    _stats->setNumberOfEmitters(emitters.size());
+    for (size_t i = 0; i < _stats->numberOfTrackedEmitters(); ++i)
+        _stats->setEmitterSpawned(i, emitters[i].emitted);
+
+    // The costs are ordered like the effects, the gravities first
+    const std::vector<EffectSystem::Cost>& costs = _effects.costs();
+    const size_t numberOfGravities = _effects.gravities().size();
+    _stats->setNumberOfEffects(costs.size());
+    for (size_t i = 0; i < costs.size(); ++i) {
+        const EffectSystem::Type type = (i < numberOfGravities) ?
+            EffectSystem::Type::Gravity : EffectSystem::Type::Wind;
+        _stats->addEffectCost(i, static_cast<int>(type), costs[i].particles,
+            static_cast<uint64_t>(costs[i].milliseconds * 1e6f));
+    }
+}
+
+void Simulation::exportPositions(glm::vec3* positions, float offset) const {
+    const glm::vec3* storePositions = _store.positions();
+    const glm::vec3* velocities = _store.velocities();
+    _pool.parallelFor(0, _store.size(), _chunkSize,
+        [positions, storePositions, velocities, offset](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+                positions[i] = storePositions[i] + velocities[i] * offset;
+        }
+    );
+}
+
+void Simulation::exportPositions(QuantizedPosition* positions, float offset) const {
+    const glm::vec3* storePositions = _store.positions();
+    const glm::vec3* velocities = _store.velocities();
+    const PositionQuantizer& quantizer = _positionQuantizer;
+    _pool.parallelFor(0, _store.size(), _chunkSize,
+        [positions, storePositions, velocities, offset, &quantizer](size_t begin, size_t end) {
+            quantizer.encode(storePositions + begin, velocities + begin, offset, end - begin,
+                positions + begin);
+        }
+    );
+}
+
+void Simulation::exportAttributes(uint32_t* colors, float* sizes, float* ages,
+    uint32_t* ids) const
+{
+    const glm::vec3* velocities = _store.velocities();
+    const float* storeAges = _store.ages();
+    const float* lifetimes = _store.lifetimes();
+    const uint32_t* slots = _store.particleSlots();
+    _pool.parallelFor(0, _store.size(), _chunkSize,
+        [colors, sizes, ages, ids, velocities, storeAges, lifetimes, slots]
+        (size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const float age = glm::clamp(storeAges[i] / lifetimes[i], 0.f, 1.f);
+                if (colors != nullptr) {
+                    const float t = glm::min(glm::length(velocities[i]) / _fastSpeed, 1.f);
+                    colors[i] = packColor(glm::mix(_restingColor, _fastColor, t));
+                }
+                if (sizes != nullptr)
+                    sizes[i] = glm::mix(1.f, _finalSize, age);
+                if (ages != nullptr)
+                    ages[i] = age;
+                if (ids != nullptr)
+                    ids[i] = slots[i];
+            }
+        }
+    );
+}
+
+void Simulation::removeAll() {
+    _store.clear();
+    _emitters.removeAll();
+    _effects.removeAll();
+}
+
+EmitterSystem& Simulation::emitters() {
+    return _emitters;
+}
+
+const EmitterSystem& Simulation::emitters() const {
+    return _emitters;
+}
+
+EffectSystem& Simulation::effects() {
+    return _effects;
+}
+
+const EffectSystem& Simulation::effects() const {
+    return _effects;
+}
+
+CollisionSystem& Simulation::collisions() {
+    return _collisions;
+}
+
+const CollisionSystem& Simulation::collisions() const {
+    return _collisions;
+}
+
+ParticleStore& Simulation::store() {
+    return _store;
+}
+
+const ParticleStore& Simulation::store() const {
+    return _store;
+}
+
+Integrator& Simulation::integrator() {
+    return _integrator;
+}
+
+ThreadPool& Simulation::threadPool() {
+    return _pool;
+}
+
+size_t Simulation::numberOfSteps() const {
+    return _numberOfSteps;
+}
+
+uint64_t Simulation::checksum() const {
+    const size_t size = _store.size();
+    std::vector<uint64_t> chunkHashes((size + _chunkSize - 1) / _chunkSize);
+    uint64_t* hashes = chunkHashes.data();
+    const ParticleStore& store = _store;
+    _pool.parallelFor(0, size, _chunkSize,
+        [hashes, &store](size_t begin, size_t end) {
+            const size_t count = end - begin;
+            uint64_t hash = _hashBasis;
+            hash = hashBytes(hash, store.positions() + begin, count * sizeof(glm::vec3));
+            hash = hashBytes(hash, store.velocities() + begin, count * sizeof(glm::vec3));
+            hash = hashBytes(hash, store.ages() + begin, count * sizeof(float));
+            hash = hashBytes(hash, store.lifetimes() + begin, count * sizeof(float));
+            hashes[begin / _chunkSize] = hash;
+        }
+    );
+
+    uint64_t result = hashBytes(_hashBasis, &size, sizeof(size));
+    for (uint64_t hash : chunkHashes)
+        result = hashBytes(result, &hash, sizeof(hash));
+    return result;
+}
+
+const SpatialHash& Simulation::spatialHash() const {
+    return _spatialHash;
+}
+
+const PositionQuantizer& Simulation::positionQuantizer() const {
+    return _positionQuantizer;
+}
+
+void Simulation::setProfiler(Profiler* profiler) {
+    _profiler = profiler;
+}
+
+void Simulation::setStatsChannel(StatsChannel* stats) {
+    _stats = stats;
+}
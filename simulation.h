@@ -0,0 +1,170 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __SIMULATION_H__
+#define __SIMULATION_H__
+
+#include "collisionsystem.h"
+#include "effectsystem.h"
+#include "emittersystem.h"
+#include "integrator.h"
+#include "particlestore.h"
+#include "positionquantizer.h"
+#include "spatialhash.h"
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Profiler;
+class StatsChannel;
+class ThreadPool;
+
+// The Simulation owns the complete particle state and advances it one step at a time. The
+// particle range is split into chunks that are processed in parallel by a ThreadPool. The
+// result does not depend on the number of threads down to the last bit: the chunks have fixed
+// boundaries, every particle draws its random numbers from its own Philox counter, the emitters
+// spawn in the order they were added, the spatial hash is a stable sort, and every particle
+// receives the effects one after the other in the same order. The Simulation itself is not
+// thread-safe; all calls have to come from the same thread
+class Simulation {
+public:
+    // Creates a simulation for at most 'capacity' particles that uses 'pool' for its loops
+    Simulation(size_t capacity, ThreadPool& pool);
+
+    // Advances the simulation by 'deltaT' seconds. If 'exportPositions' is not a nullptr, the
+    // positions of all particles after the step are also written into it, moved along their
+    // velocity by 'exportOffset' seconds. It has to have room for capacity() positions
+    void step(float deltaT, glm::vec3* exportPositions = nullptr, float exportOffset = 0.f);
+
+    // Like the other 'step', but exports the positions quantized by positionQuantizer(). Each
+    // chunk is quantized right after it has been integrated, while it is still in the cache
+    void step(float deltaT, QuantizedPosition* exportPositions, float exportOffset);
+
+    // Writes the positions of all particles, moved along their velocity by 'offset' seconds,
+    // into 'positions' without advancing the simulation. As the positions are integrated with
+    // the new velocities, a negative offset of up to one step interpolates between the last
+    // two steps
+    void exportPositions(glm::vec3* positions, float offset) const;
+    void exportPositions(QuantizedPosition* positions, float offset) const;
+
+    // Writes the attribute channels of all particles into the arrays that are not a nullptr,
+    // in the order of the positions; see particleattributes.h. The colors run from blue for
+    // resting to orange for fast particles, the sizes shrink to half over the lifetime, and
+    // the ages are fractions of the lifetime. The ids are the slots of the particles, which
+    // they keep for their whole life. Each array has to have room for capacity() values
+    void exportAttributes(uint32_t* colors, float* sizes, float* ages, uint32_t* ids) const;
+
+    // Removes all particles, all emitters, and all effects
+    void removeAll();
+
+    // Returns the sources that spawn new particles at the beginning of each step
+    EmitterSystem& emitters();
+    const EmitterSystem& emitters() const;
+
+    // Returns the effects that change the velocities of the particles each step
+    EffectSystem& effects();
+    const EffectSystem& effects() const;
+
+    // Returns the colliders that the particles bounce off after each integration. They start
+    // with the ground and the walls of the skybox, and are not removed by 'removeAll'
+    CollisionSystem& collisions();
+    const CollisionSystem& collisions() const;
+
+    // Returns the particle state
+    ParticleStore& store();
+    const ParticleStore& store() const;
+
+    // Returns the integrator to allow the selection of a kernel
+    Integrator& integrator();
+
+    // Returns the thread pool the simulation uses for its loops
+    ThreadPool& threadPool();
+
+    // Returns the number of steps that have been done so far
+    size_t numberOfSteps() const;
+
+    // Returns a hash of the positions, velocities, ages, and lifetimes of all particles in
+    // their current order, so that the states of two runs can be compared bit by bit. The
+    // chunks are hashed in parallel and combined in order, so the hash does not depend on the
+    // number of threads either
+    uint64_t checksum() const;
+
+    // Returns the grid that the particles were sorted into during the last step
+    const SpatialHash& spatialHash() const;
+
+    // Returns the quantization of the exported QuantizedPositions, which uses the grid of the
+    // spatial hash
+    const PositionQuantizer& positionQuantizer() const;
+
+    // Sets the profiler that the durations of the phases of each step are recorded in. Pass a
+    // nullptr to disable the measurements. Must not be called while a step is running
+    void setProfiler(Profiler* profiler);
+
+    // Sets the channel that the counts of each step are published in. Pass a nullptr to stop
+    // publishing. Must not be called while a step is running
+    void setStatsChannel(StatsChannel* stats);
+
+private:
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    // Advances the simulation and exports the positions into whichever of 'exportPositions'
+    // and 'quantizedPositions' is not a nullptr
+    void advance(float deltaT, glm::vec3* exportPositions, QuantizedPosition* quantizedPositions,
+        float exportOffset);
+
+    // Publishes the counts of the step that has just finished, which spawned 'spawned' and
+    // removed 'expired' particles
+    void publishStats(size_t spawned, size_t expired);
+
+    // The particle state
+    ParticleStore _store;
+    // The pool that processes the chunks of each step
+    ThreadPool& _pool;
+    // The vectorized integration kernels
+    Integrator _integrator;
+    // The sources of new particles
+    EmitterSystem _emitters;
+    // The forces acting on the particles
+    EffectSystem _effects;
+    // The geometry the particles cannot pass through
+    CollisionSystem _collisions;
+    // For each batch of 4 particles, whether any of them left the free box of the colliders
+    // during the integration. Only those batches are tested against the colliders
+    std::vector<uint8_t> _outsideFlags;
+    // Sorts the particles by position each step, so that localized queries only have to visit
+    // the particles in nearby cells
+    SpatialHash _spatialHash;
+    // Packs the exported positions relative to the cells of the spatial hash
+    PositionQuantizer _positionQuantizer;
+    // The number of steps so far; the first step is allowed to allocate the scratch memory
+    size_t _numberOfSteps;
+    // Receives the durations of the phases of each step, if it is set
+    Profiler* _profiler;
+    // Receives the counts of each step, if it is set
+    StatsChannel* _stats;
+};
+
+#endif // __SIMULATION_H__
@@ -0,0 +1,291 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "simulationscheduler.h"
+
+#include "alignedmemory.h"
+#include "particlestore.h"
+#include "positionsink.h"
+#include "simulation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace {
+    // The weight of the newest measurement in the smoothed duration of a step
+    const float _durationSmoothing = 0.2f;
+}
+
+SimulationScheduler::SimulationScheduler(Simulation& simulation)
+    : _simulation(simulation)
+    , _front(nullptr)
+    , _frontSize(0)
+    , _frontVersion(0)
+    , _back(nullptr)
+    , _backSize(0)
+    , _frontAttributes()
+    , _backAttributes()
+    , _attributeChannels(0)
+    , _sink(nullptr)
+    , _stepBudget(0.f)
+    , _state(State::Idle)
+    , _numberOfSteps(0)
+    , _stepSize(0.f)
+    , _exportOffset(0.f)
+    , _target(nullptr)
+    , _quantizedTarget(nullptr)
+    , _stepSink(nullptr)
+    , _stepAttributes()
+    , _stepDuration(0.f)
+    , _quit(false)
+{
+    const size_t capacity = _simulation.store().capacity();
+    _front = alignedArray<glm::vec3>(capacity, ParticleStore::Alignment);
+    _back = alignedArray<glm::vec3>(capacity, ParticleStore::Alignment);
+
+    // Start the thread last, as it accesses the members
+    _thread = std::thread(&SimulationScheduler::run, this);
+}
+
+SimulationScheduler::~SimulationScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _wakeUp.notify_one();
+    _thread.join();
+
+    alignedFree(_front);
+    alignedFree(_back);
+    freeAttributes(_frontAttributes);
+    freeAttributes(_backAttributes);
+}
+
+void SimulationScheduler::freeAttributes(AttributeArrays& arrays) {
+    alignedFree(arrays.colors);
+    alignedFree(arrays.sizes);
+    alignedFree(arrays.ages);
+    alignedFree(arrays.ids);
+    arrays = AttributeArrays();
+}
+
+void SimulationScheduler::enqueue(std::function<void()> command) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _commands.push_back(std::move(command));
+}
+
+void SimulationScheduler::requestStep(float elapsed) {
+    _timestep.accumulate(elapsed);
+    float stepDuration;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        // The back buffer is still in use, or has not been handed to the renderer yet
+        if (_state != State::Idle)
+            return;
+        stepDuration = _stepDuration;
+    }
+
+    // If the steps would not finish before they are collected, the renderer would show the
+    // same positions again and the steps would fall further behind
+    int limit = _timestep.maximumSteps();
+    if ((_stepBudget > 0.f) && (stepDuration > 0.f)) {
+        const float affordable = std::min(_stepBudget / stepDuration, static_cast<float>(limit));
+        limit = std::max(static_cast<int>(affordable), 1);
+    }
+
+    // The positions are integrated with the new velocities, so moving them back by the part of
+    // the step that has not passed yet gives the state between the last two steps
+    const int numberOfSteps = _timestep.consumeSteps(limit);
+    const float exportOffset = -(1.f - _timestep.interpolation()) * _timestep.stepSize();
+
+    // Only this thread can leave the Idle state, so we can ask the sink for memory without
+    // holding the lock, as the sink might have to wait for the GPU
+    glm::vec3* sinkMemory = nullptr;
+    QuantizedPosition* quantizedMemory = nullptr;
+    if ((_sink != nullptr) && _sink->quantizesPositions())
+        quantizedMemory = _sink->beginWriteQuantized();
+    else if (_sink != nullptr)
+        sinkMemory = _sink->beginWrite();
+    const bool writesIntoSink = (sinkMemory != nullptr) || (quantizedMemory != nullptr);
+    AttributeArrays sinkAttributes = AttributeArrays();
+    if (writesIntoSink && ((_attributeChannels & ColorChannel) != 0))
+        sinkAttributes.colors = static_cast<uint32_t*>(_sink->beginWriteAttribute(ColorChannel));
+    if (writesIntoSink && ((_attributeChannels & SizeChannel) != 0))
+        sinkAttributes.sizes = static_cast<float*>(_sink->beginWriteAttribute(SizeChannel));
+    if (writesIntoSink && ((_attributeChannels & AgeChannel) != 0))
+        sinkAttributes.ages = static_cast<float*>(_sink->beginWriteAttribute(AgeChannel));
+    if (writesIntoSink && ((_attributeChannels & IdChannel) != 0))
+        sinkAttributes.ids = static_cast<uint32_t*>(_sink->beginWriteAttribute(IdChannel));
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _target = writesIntoSink ? sinkMemory : _back;
+    _quantizedTarget = quantizedMemory;
+    _stepSink = writesIntoSink ? _sink : nullptr;
+    _stepAttributes = sinkAttributes;
+    _numberOfSteps = numberOfSteps;
+    _stepSize = _timestep.stepSize();
+    _exportOffset = exportOffset;
+    _state = State::Running;
+    _wakeUp.notify_one();
+}
+
+bool SimulationScheduler::collect() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_state != State::Finished)
+        return false;
+
+    if (_stepSink == nullptr) {
+        // The finished step becomes visible to the renderer and the old front buffer will be
+        // overwritten by the next step
+        std::swap(_front, _back);
+        std::swap(_frontAttributes, _backAttributes);
+        _frontSize = _backSize;
+        ++_frontVersion;
+    }
+    else {
+        // The positions are already in the sink's memory
+        _stepSink->endWrite(_backSize);
+    }
+    _target = nullptr;
+    _quantizedTarget = nullptr;
+    _stepSink = nullptr;
+    _stepAttributes = AttributeArrays();
+    _state = State::Idle;
+    return true;
+}
+
+void SimulationScheduler::finish() {
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _stepFinished.wait(lock, [this]() { return _state != State::Running; });
+    }
+    collect();
+}
+
+void SimulationScheduler::setPositionSink(PositionSink* sink) {
+    // A step that is currently writing into the old sink will still be handed to it in
+    // 'collect', as the sink is remembered for each step
+    _sink = sink;
+}
+
+void SimulationScheduler::setAttributeChannels(uint32_t channels) {
+    // Only the channels that are asked for take up memory and time
+    _attributeChannels = channels;
+    const size_t capacity = _simulation.store().capacity();
+    for (AttributeArrays* arrays : { &_frontAttributes, &_backAttributes }) {
+        freeAttributes(*arrays);
+        if ((channels & ColorChannel) != 0)
+            arrays->colors = alignedArray<uint32_t>(capacity, ParticleStore::Alignment);
+        if ((channels & SizeChannel) != 0)
+            arrays->sizes = alignedArray<float>(capacity, ParticleStore::Alignment);
+        if ((channels & AgeChannel) != 0)
+            arrays->ages = alignedArray<float>(capacity, ParticleStore::Alignment);
+        if ((channels & IdChannel) != 0)
+            arrays->ids = alignedArray<uint32_t>(capacity, ParticleStore::Alignment);
+    }
+}
+
+FixedTimestep& SimulationScheduler::timestep() {
+    return _timestep;
+}
+
+void SimulationScheduler::setStepBudget(float seconds) {
+    _stepBudget = std::max(seconds, 0.f);
+}
+
+PositionView SimulationScheduler::positionView() const {
+    // _front and _frontSize are only changed on the GUI thread, so the renderer can read them
+    // without synchronization
+    return PositionView(&_front, &_frontSize, &_frontVersion);
+}
+
+AttributeView SimulationScheduler::attributeView() const {
+    // Swapped together with _front, so the same holds for the attributes
+    return AttributeView(&_frontAttributes.colors, &_frontAttributes.sizes,
+        &_frontAttributes.ages, &_frontAttributes.ids);
+}
+
+void SimulationScheduler::run() {
+    std::vector<std::function<void()>> commands;
+    while (true) {
+        int numberOfSteps;
+        float stepSize;
+        float exportOffset;
+        glm::vec3* target;
+        QuantizedPosition* quantizedTarget;
+        AttributeArrays attributes;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wakeUp.wait(lock, [this]() { return _quit || (_state == State::Running); });
+            if (_quit)
+                return;
+            numberOfSteps = _numberOfSteps;
+            stepSize = _stepSize;
+            exportOffset = _exportOffset;
+            target = _target;
+            quantizedTarget = _quantizedTarget;
+            attributes = (_stepSink == nullptr) ? _backAttributes : _stepAttributes;
+            commands.swap(_commands);
+        }
+
+        // Apply the changes that were requested by the GUI since the last step
+        for (const std::function<void()>& command : commands)
+            command();
+        commands.clear();
+
+        // Only the last step has to export its positions
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < numberOfSteps; ++i) {
+            const bool isLastStep = (i == numberOfSteps - 1);
+            if (isLastStep && (quantizedTarget != nullptr))
+                _simulation.step(stepSize, quantizedTarget, exportOffset);
+            else
+                _simulation.step(stepSize, isLastStep ? target : nullptr, exportOffset);
+        }
+        if ((numberOfSteps == 0) && (quantizedTarget != nullptr))
+            _simulation.exportPositions(quantizedTarget, exportOffset);
+        else if (numberOfSteps == 0)
+            _simulation.exportPositions(target, exportOffset);
+        if ((attributes.colors != nullptr) || (attributes.sizes != nullptr) ||
+            (attributes.ages != nullptr) || (attributes.ids != nullptr))
+        {
+            _simulation.exportAttributes(attributes.colors, attributes.sizes, attributes.ages,
+                attributes.ids);
+        }
+        _backSize = _simulation.store().size();
+        const std::chrono::duration<float> duration = std::chrono::steady_clock::now() - start;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            // The export is counted into the steps, as it has to fit into the budget as well
+            if (numberOfSteps > 0) {
+                const float perStep = duration.count() / numberOfSteps;
+                _stepDuration = (_stepDuration == 0.f) ? perStep :
+                    _stepDuration + _durationSmoothing * (perStep - _stepDuration);
+            }
+            _state = State::Finished;
+        }
+        _stepFinished.notify_all();
+    }
+}
@@ -0,0 +1,196 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __SIMULATIONSCHEDULER_H__
+#define __SIMULATIONSCHEDULER_H__
+
+#include "fixedtimestep.h"
+#include "particleattributes.h"
+#include "positionview.h"
+
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class PositionSink;
+class Simulation;
+struct QuantizedPosition;
+
+// The SimulationScheduler runs a Simulation on its own thread, so that the time a step takes is not
+// added to the frame time of the GUI thread. The simulation runs one step ahead of the renderer:
+// while the renderer draws the positions of step N from the front buffer, step N+1 writes its
+// positions into the back buffer. 'collect' swaps the buffers once a step has finished. If a
+// PositionSink is set, the steps write into the memory of the sink instead, which avoids the copy
+// into the renderer; if the sink asks for it, the positions are quantized on the way. The real time
+// that passes is divided into steps of a fixed size by a FixedTimestep, and the exported positions
+// are interpolated between the last two steps by the time left over. All public functions are meant
+// to be called from the GUI thread
+class SimulationScheduler {
+public:
+    // Starts the simulation thread for 'simulation'. The scheduler does not own the simulation
+    explicit SimulationScheduler(Simulation& simulation);
+
+    // Waits for the current step to finish and stops the simulation thread
+    ~SimulationScheduler();
+
+    // Queues 'command' to be executed on the simulation thread before the next step. This is the
+    // only way in which the simulation may be modified while the scheduler is running
+    void enqueue(std::function<void()> command);
+
+    // Adds 'elapsed' seconds of real time and starts as many fixed steps as are due. If a step
+    // is still running or has not been collected yet, the time waits for the next request. If
+    // no whole step is due, only the interpolated positions are exported again. This function
+    // never blocks on the simulation
+    void requestStep(float elapsed);
+
+    // Returns the timestep that determines the step size and the maximum number of steps per
+    // request
+    FixedTimestep& timestep();
+
+    // Limits the steps that the following requests start to those that are expected to finish
+    // within 'seconds', judged by how long the recent steps took. At least one step is started
+    // if one is due, and the time of the others is dropped like that of the steps beyond the
+    // maximum of the timestep. 0 removes the limit
+    void setStepBudget(float seconds);
+
+    // Makes the positions of the most recently finished step available through positionView().
+    // Returns false, and leaves the front buffer unchanged, if no new step has finished
+    bool collect();
+
+    // Blocks until the running step, if any, has finished and collects it. Has to be called
+    // before a PositionSink that the running step might write into is destroyed
+    void finish();
+
+    // Returns a view onto the front buffer. It stays valid for the lifetime of the scheduler.
+    // Steps that were written into a PositionSink do not update the front buffer. The version
+    // of the view changes whenever a new step becomes visible in the front buffer
+    PositionView positionView() const;
+
+    // Lets the following steps write into the memory provided by 'sink'. If the sink cannot
+    // provide memory for a step, the scheduler's own back buffer is used for that step. Passing
+    // a nullptr returns to the double buffer. The sink has to outlive the scheduler
+    void setPositionSink(PositionSink* sink);
+
+    // Lets the following steps also export the attribute 'channels' into arrays of their own,
+    // which are double buffered like the positions. Steps that write into a PositionSink write
+    // the channels into the memory the sink provides for them instead, and skip the channels
+    // the sink has no memory for. Has to be called before the first step is requested
+    void setAttributeChannels(uint32_t channels);
+
+    // Returns a view onto the attributes of the front buffer, in the order of positionView().
+    // It stays valid for the lifetime of the scheduler
+    AttributeView attributeView() const;
+
+private:
+    // The states a step goes through
+    enum class State {
+        Idle,     // No step is running and the last one was collected
+        Running,  // The simulation thread is computing a step
+        Finished  // The step has finished, but has not been collected yet
+    };
+
+    SimulationScheduler(const SimulationScheduler&) = delete;
+    SimulationScheduler& operator=(const SimulationScheduler&) = delete;
+
+    // The arrays of the attribute channels of one buffer; the channels that are not exported
+    // have a nullptr
+    struct AttributeArrays {
+        uint32_t* colors;
+        float* sizes;
+        float* ages;
+        uint32_t* ids;
+    };
+
+    // The main function of the simulation thread
+    void run();
+
+    // Frees all arrays of 'arrays' and sets them to nullptr
+    static void freeAttributes(AttributeArrays& arrays);
+
+    // The simulation that is advanced
+    Simulation& _simulation;
+
+    // The position buffer the renderer reads from and the number of valid positions in it. Only
+    // changed by the GUI thread in 'collect'
+    glm::vec3* _front;
+    size_t _frontSize;
+    // Incremented whenever _front receives the positions of a new step
+    uint64_t _frontVersion;
+    // The double buffer that the steps write into if there is no sink. Only used by the
+    // simulation thread while a step is running
+    glm::vec3* _back;
+    size_t _backSize;
+    // The attributes that accompany _front and _back, swapped together with them
+    AttributeArrays _frontAttributes;
+    AttributeArrays _backAttributes;
+    // The channels that the steps export
+    uint32_t _attributeChannels;
+
+    // The sink that steps write into instead of the back buffer, if one is set. Only used by
+    // the GUI thread
+    PositionSink* _sink;
+
+    // Turns the requested real time into steps. Only used by the GUI thread
+    FixedTimestep _timestep;
+    // The time in seconds the started steps may take, 0 if there is no limit. Only used by the
+    // GUI thread
+    float _stepBudget;
+
+    // Guards all of the following members
+    std::mutex _mutex;
+    // Signaled when a new step should be started or the thread should quit
+    std::condition_variable _wakeUp;
+    // Signaled when a step has finished
+    std::condition_variable _stepFinished;
+    // The state of the current step
+    State _state;
+    // The running steps: their number, the time each advances the simulation by, and the
+    // offset in seconds along the velocities of the exported positions
+    int _numberOfSteps;
+    float _stepSize;
+    float _exportOffset;
+    // The memory the running step writes its positions into, either _back or from a sink.
+    // _quantizedTarget is used instead if the sink quantizes the positions
+    glm::vec3* _target;
+    QuantizedPosition* _quantizedTarget;
+    // The sink that provided _target or a nullptr if the step writes into _back
+    PositionSink* _stepSink;
+    // The memory of _stepSink that the running step writes its attributes into
+    AttributeArrays _stepAttributes;
+    // The smoothed time in seconds that a single step took recently, 0 before the first step
+    float _stepDuration;
+    // The commands that are executed before the next step
+    std::vector<std::function<void()>> _commands;
+    // Set when the simulation thread should terminate
+    bool _quit;
+
+    // The thread that advances the simulation
+    std::thread _thread;
+};
+
+#endif // __SIMULATIONSCHEDULER_H__
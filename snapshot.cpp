@@ -0,0 +1,386 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "snapshot.h"
+
+#include "simulation.h"
+
+#include <ghoul/logging/logging>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    const std::string _loggerCat = "Snapshot";
+
+    // Identifies snapshot files
+    const char _magic[8] = { 'P', 'S', 'N', 'A', 'P', 'S', 'H', 'T' };
+    // Reads differently on a machine with the other byte order
+    const uint32_t _byteOrderMark = 0x01020304;
+
+    // The beginning of every snapshot. All offsets are in bytes from the start of the file
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint64_t fileSize;
+        uint64_t numberOfParticles;
+        uint64_t numberOfEmitters;
+        uint64_t numberOfEffects;
+        // The state of the EmitterSystem that is not part of a single emitter
+        uint32_t emitterSeed;
+        uint32_t emitterNextId;
+        // The sections
+        uint64_t positions;
+        uint64_t velocities;
+        uint64_t ages;
+        uint64_t lifetimes;
+        uint64_t emitters;
+        uint64_t effects;
+    };
+
+    // An EmitterSystem::Emitter with a fixed layout
+    struct EmitterRecord {
+        uint32_t type;
+        float position[3];
+        float rate;
+        float remainder;
+        uint64_t emitted;
+        uint32_t id;
+        uint32_t unused;
+    };
+
+    // An effect of any type with a fixed layout
+    struct EffectRecord {
+        uint32_t type;
+        float position[3];
+        float strength;
+    };
+
+    // Returns 'offset' rounded up to the alignment of the sections
+    uint64_t align(uint64_t offset) {
+        return (offset + Snapshot::Alignment - 1) / Snapshot::Alignment * Snapshot::Alignment;
+    }
+
+    // Appends the 'effects' of one 'type' to 'records'
+    template <typename Effect>
+    EffectRecord* writeEffects(const std::vector<Effect>& effects, EffectSystem::Type type,
+        EffectRecord* records)
+    {
+        for (const Effect& effect : effects) {
+            records->type = static_cast<uint32_t>(type);
+            records->position[0] = effect.position.x;
+            records->position[1] = effect.position.y;
+            records->position[2] = effect.position.z;
+            records->strength = effect.strength;
+            ++records;
+        }
+        return records;
+    }
+}
+
+Snapshot::Snapshot()
+    : _data(nullptr)
+    , _size(0)
+    , _mapping(nullptr)
+{}
+
+Snapshot::~Snapshot() {
+    close();
+}
+
+void Snapshot::serialize(const Simulation& simulation, std::vector<char>& buffer) {
+    const ParticleStore& store = simulation.store();
+    const EmitterSystem& emitterSystem = simulation.emitters();
+    const EffectSystem& effectSystem = simulation.effects();
+    const std::vector<EmitterSystem::Emitter>& emitters = emitterSystem.emitters();
+    const size_t numberOfParticles = store.size();
+
+    Header header;
+    std::memcpy(header.magic, _magic, sizeof(_magic));
+    header.version = Version;
+    header.byteOrder = _byteOrderMark;
+    header.numberOfParticles = numberOfParticles;
+    header.numberOfEmitters = emitters.size();
+    header.numberOfEffects = effectSystem.numberOfEffects();
+    header.emitterSeed = emitterSystem.seed();
+    header.emitterNextId = emitterSystem.nextId();
+    header.positions = align(sizeof(Header));
+    header.velocities = align(header.positions + numberOfParticles * sizeof(glm::vec3));
+    header.ages = align(header.velocities + numberOfParticles * sizeof(glm::vec3));
+    header.lifetimes = align(header.ages + numberOfParticles * sizeof(float));
+    header.emitters = align(header.lifetimes + numberOfParticles * sizeof(float));
+    header.effects = align(header.emitters + header.numberOfEmitters * sizeof(EmitterRecord));
+    header.fileSize = header.effects + header.numberOfEffects * sizeof(EffectRecord);
+
+    // The padding between the sections is zeroed, so that equal states give equal files
+    buffer.assign(static_cast<size_t>(header.fileSize), 0);
+    char* data = buffer.data();
+    std::memcpy(data, &header, sizeof(header));
+    std::memcpy(data + header.positions, store.positions(), numberOfParticles * sizeof(glm::vec3));
+    std::memcpy(data + header.velocities, store.velocities(),
+        numberOfParticles * sizeof(glm::vec3));
+    std::memcpy(data + header.ages, store.ages(), numberOfParticles * sizeof(float));
+    std::memcpy(data + header.lifetimes, store.lifetimes(), numberOfParticles * sizeof(float));
+
+    EmitterRecord* emitterRecords = reinterpret_cast<EmitterRecord*>(data + header.emitters);
+    for (const EmitterSystem::Emitter& emitter : emitters) {
+        emitterRecords->type = static_cast<uint32_t>(emitter.type);
+        emitterRecords->position[0] = emitter.position.x;
+        emitterRecords->position[1] = emitter.position.y;
+        emitterRecords->position[2] = emitter.position.z;
+        emitterRecords->rate = emitter.rate;
+        emitterRecords->remainder = emitter.remainder;
+        emitterRecords->emitted = emitter.emitted;
+        emitterRecords->id = emitter.id;
+        emitterRecords->unused = 0;
+        ++emitterRecords;
+    }
+
+    EffectRecord* effectRecords = reinterpret_cast<EffectRecord*>(data + header.effects);
+    effectRecords = writeEffects(effectSystem.gravities(), EffectSystem::Type::Gravity,
+        effectRecords);
+    writeEffects(effectSystem.winds(), EffectSystem::Type::Wind, effectRecords);
+}
+
+bool Snapshot::open(const std::string& path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        LERROR("Could not open snapshot '" << path << "'");
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || (fileSize.QuadPart == 0)) {
+        LERROR("Snapshot '" << path << "' is empty");
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    // The mapping keeps the file open on its own
+    CloseHandle(file);
+    if (mapping == nullptr) {
+        LERROR("Could not map snapshot '" << path << "'");
+        return false;
+    }
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr) {
+        LERROR("Could not map snapshot '" << path << "'");
+        CloseHandle(mapping);
+        return false;
+    }
+    _mapping = mapping;
+    _size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    const int file = ::open(path.c_str(), O_RDONLY);
+    if (file == -1) {
+        LERROR("Could not open snapshot '" << path << "'");
+        return false;
+    }
+    struct stat status;
+    if ((fstat(file, &status) != 0) || (status.st_size == 0)) {
+        LERROR("Snapshot '" << path << "' is empty");
+        ::close(file);
+        return false;
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE,
+        file, 0);
+    // The mapping keeps the file open on its own
+    ::close(file);
+    if (data == MAP_FAILED) {
+        LERROR("Could not map snapshot '" << path << "'");
+        return false;
+    }
+    // The arrays are read front to back when they are restored
+    madvise(data, static_cast<size_t>(status.st_size), MADV_SEQUENTIAL);
+    _size = static_cast<size_t>(status.st_size);
+#endif
+    _data = static_cast<const char*>(data);
+
+    // Check the header before anything else is read
+    const Header* header = reinterpret_cast<const Header*>(_data);
+    const char* error = nullptr;
+    if ((_size < sizeof(Header)) || (std::memcmp(header->magic, _magic, sizeof(_magic)) != 0))
+        error = "is not a snapshot";
+    else if (header->byteOrder != _byteOrderMark)
+        error = "was written on a machine with another byte order";
+    else if (header->version != Version)
+        error = "has an unsupported version";
+    else if (header->fileSize != _size)
+        error = "is truncated";
+    else {
+        // Every section has to lie inside the file. The counts are compared against the room
+        // behind the offset before anything is multiplied, as the products could wrap around
+        const uint64_t n = header->numberOfParticles;
+        const struct {
+            uint64_t offset;
+            uint64_t count;
+            uint64_t elementSize;
+        } sections[] = {
+            { header->positions, n, sizeof(glm::vec3) },
+            { header->velocities, n, sizeof(glm::vec3) },
+            { header->ages, n, sizeof(float) },
+            { header->lifetimes, n, sizeof(float) },
+            { header->emitters, header->numberOfEmitters, sizeof(EmitterRecord) },
+            { header->effects, header->numberOfEffects, sizeof(EffectRecord) }
+        };
+        for (const auto& s : sections) {
+            if ((s.offset % Alignment != 0) || (s.offset > _size) ||
+                (s.count > (_size - s.offset) / s.elementSize))
+            {
+                error = "has a corrupt section";
+            }
+        }
+    }
+    if (error == nullptr) {
+        // The types are cast to the enumerations when the snapshot is restored
+        const EmitterRecord* emitters = section<EmitterRecord>(header->emitters);
+        for (uint64_t i = 0; i < header->numberOfEmitters; ++i) {
+            if (emitters[i].type > static_cast<uint32_t>(EmitterSystem::Type::Cone))
+                error = "contains an unknown emitter type";
+        }
+        const EffectRecord* effects = section<EffectRecord>(header->effects);
+        for (uint64_t i = 0; i < header->numberOfEffects; ++i) {
+            if (effects[i].type > static_cast<uint32_t>(EffectSystem::Type::Wind))
+                error = "contains an unknown effect type";
+        }
+    }
+    if (error != nullptr) {
+        LERROR("File '" << path << "' " << error);
+        close();
+        return false;
+    }
+
+    LINFO("Mapped snapshot '" << path << "' with " << header->numberOfParticles << " particles");
+    return true;
+}
+
+void Snapshot::close() {
+    if (_data == nullptr)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+    CloseHandle(static_cast<HANDLE>(_mapping));
+#else
+    munmap(const_cast<char*>(_data), _size);
+#endif
+    _data = nullptr;
+    _size = 0;
+    _mapping = nullptr;
+}
+
+bool Snapshot::isOpen() const {
+    return _data != nullptr;
+}
+
+template <typename T>
+const T* Snapshot::section(uint64_t offset) const {
+    return reinterpret_cast<const T*>(_data + offset);
+}
+
+size_t Snapshot::numberOfParticles() const {
+    return isOpen() ? static_cast<size_t>(section<Header>(0)->numberOfParticles) : 0;
+}
+
+size_t Snapshot::numberOfEmitters() const {
+    return isOpen() ? static_cast<size_t>(section<Header>(0)->numberOfEmitters) : 0;
+}
+
+size_t Snapshot::numberOfEffects() const {
+    return isOpen() ? static_cast<size_t>(section<Header>(0)->numberOfEffects) : 0;
+}
+
+const glm::vec3* Snapshot::positions() const {
+    return isOpen() ? section<glm::vec3>(section<Header>(0)->positions) : nullptr;
+}
+
+const glm::vec3* Snapshot::velocities() const {
+    return isOpen() ? section<glm::vec3>(section<Header>(0)->velocities) : nullptr;
+}
+
+const float* Snapshot::ages() const {
+    return isOpen() ? section<float>(section<Header>(0)->ages) : nullptr;
+}
+
+const float* Snapshot::lifetimes() const {
+    return isOpen() ? section<float>(section<Header>(0)->lifetimes) : nullptr;
+}
+
+bool Snapshot::restore(Simulation& simulation) const {
+    if (!isOpen()) {
+        LERROR("No snapshot is open");
+        return false;
+    }
+    const Header* header = section<Header>(0);
+    ParticleStore& store = simulation.store();
+    const size_t numberOfParticles = static_cast<size_t>(header->numberOfParticles);
+    if (numberOfParticles > store.capacity()) {
+        LERROR("The snapshot has " << numberOfParticles << " particles, but the simulation " <<
+            "can only hold " << store.capacity());
+        return false;
+    }
+
+    // The particles get new handles, as the old ones belong to another store
+    store.clear();
+    store.allocate(numberOfParticles);
+    std::memcpy(store.positions(), positions(), numberOfParticles * sizeof(glm::vec3));
+    std::memcpy(store.velocities(), velocities(), numberOfParticles * sizeof(glm::vec3));
+    std::memcpy(store.ages(), ages(), numberOfParticles * sizeof(float));
+    std::memcpy(store.lifetimes(), lifetimes(), numberOfParticles * sizeof(float));
+
+    const EmitterRecord* emitterRecords = section<EmitterRecord>(header->emitters);
+    std::vector<EmitterSystem::Emitter> emitters(static_cast<size_t>(header->numberOfEmitters));
+    for (EmitterSystem::Emitter& emitter : emitters) {
+        emitter.type = static_cast<EmitterSystem::Type>(emitterRecords->type);
+        emitter.position = glm::vec3(emitterRecords->position[0], emitterRecords->position[1],
+            emitterRecords->position[2]);
+        emitter.rate = emitterRecords->rate;
+        emitter.remainder = emitterRecords->remainder;
+        emitter.emitted = emitterRecords->emitted;
+        emitter.id = emitterRecords->id;
+        ++emitterRecords;
+    }
+    simulation.emitters().restore(emitters.data(), emitters.size(), header->emitterSeed,
+        header->emitterNextId);
+
+    const EffectRecord* effectRecords = section<EffectRecord>(header->effects);
+    simulation.effects().removeAll();
+    for (uint64_t i = 0; i < header->numberOfEffects; ++i) {
+        const EffectRecord& effect = effectRecords[i];
+        simulation.effects().addEffect(static_cast<EffectSystem::Type>(effect.type),
+            glm::vec3(effect.position[0], effect.position[1], effect.position[2]),
+            effect.strength);
+    }
+    return true;
+}
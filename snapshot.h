@@ -0,0 +1,104 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Simulation;
+
+// A Snapshot is the complete state of a Simulation in a binary file: the attributes of all
+// particles, the emitters including the state of their random streams, and the effects. The
+// file starts with a versioned header, followed by the sections, each of which is aligned to
+// 'Alignment' bytes, so that the attribute arrays can be used in place. Opening a snapshot maps
+// the file into memory instead of reading it, so it is nearly instant even for millions of
+// particles; only the pages that are actually used are loaded, and the positions can be copied
+// into the ParticleStore or uploaded into a vertex buffer straight from the mapping. The file
+// uses the byte order of the machine it was written on; files with another byte order are
+// rejected
+class Snapshot {
+public:
+    // The version of the file format. Files of other versions are rejected
+    static const uint32_t Version = 1;
+    // The alignment of the sections in the file in bytes
+    static const size_t Alignment = 64;
+
+    // Creates an object without an open file
+    Snapshot();
+
+    // Unmaps the file, if one is open
+    ~Snapshot();
+
+    // Writes the state of 'simulation' in the file format into 'buffer', which is resized to
+    // the size of the file. Must not be called while a step is running
+    static void serialize(const Simulation& simulation, std::vector<char>& buffer);
+
+    // Maps the snapshot 'path' into memory and validates it. Returns false, and logs the
+    // reason, if the file cannot be opened or is not a valid snapshot
+    bool open(const std::string& path);
+
+    // Unmaps the file. All pointers into it become invalid
+    void close();
+
+    // Returns true if a valid snapshot is open
+    bool isOpen() const;
+
+    // Returns the number of particles, emitters, and effects in the snapshot
+    size_t numberOfParticles() const;
+    size_t numberOfEmitters() const;
+    size_t numberOfEffects() const;
+
+    // Returns the attribute arrays of the particles inside the mapping. Each array has
+    // numberOfParticles() elements and stays valid until the snapshot is closed
+    const glm::vec3* positions() const;
+    const glm::vec3* velocities() const;
+    const float* ages() const;
+    const float* lifetimes() const;
+
+    // Replaces the particles, emitters, and effects of 'simulation' with the ones in the
+    // snapshot. Returns false, and leaves 'simulation' unchanged, if it cannot hold all
+    // particles. Must not be called while a step is running
+    bool restore(Simulation& simulation) const;
+
+private:
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    // Returns a pointer to the section that starts 'offset' bytes into the file
+    template <typename T>
+    const T* section(uint64_t offset) const;
+
+    // The start of the mapped file, or nullptr if none is open
+    const char* _data;
+    // The size of the mapped file in bytes
+    size_t _size;
+    // The file mapping object on Windows; unused on other systems
+    void* _mapping;
+};
+
+#endif // __SNAPSHOT_H__
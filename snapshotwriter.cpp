@@ -0,0 +1,107 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "snapshotwriter.h"
+
+#include "snapshot.h"
+
+#include <ghoul/logging/logging>
+#include <chrono>
+#include <cstdio>
+#include <utility>
+
+namespace {
+    const std::string _loggerCat = "SnapshotWriter";
+}
+
+SnapshotWriter::SnapshotWriter()
+    : _writing(false)
+    , _quit(false)
+{
+    // Start the thread last, as it accesses the members
+    _thread = std::thread(&SnapshotWriter::run, this);
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _wakeUp.notify_one();
+    _thread.join();
+}
+
+void SnapshotWriter::save(const Simulation& simulation, const std::string& path) {
+    // Serialize outside of the lock, so the writer thread is never blocked by the copy
+    Job job;
+    job.path = path;
+    Snapshot::serialize(simulation, job.data);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.push_back(std::move(job));
+    }
+    _wakeUp.notify_one();
+}
+
+void SnapshotWriter::flush() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _idle.wait(lock, [this]() { return _jobs.empty() && !_writing; });
+}
+
+void SnapshotWriter::run() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wakeUp.wait(lock, [this]() { return _quit || !_jobs.empty(); });
+            // The queued snapshots are still written when the writer is destroyed
+            if (_jobs.empty())
+                return;
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+            _writing = true;
+        }
+
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::FILE* file = std::fopen(job.path.c_str(), "wb");
+        bool success = (file != nullptr);
+        if (success) {
+            success = (std::fwrite(job.data.data(), 1, job.data.size(), file) == job.data.size());
+            success = (std::fclose(file) == 0) && success;
+        }
+        const std::chrono::duration<float, std::milli> duration =
+            std::chrono::steady_clock::now() - start;
+        if (success) {
+            LINFO("Wrote snapshot '" << job.path << "' (" << job.data.size() << " bytes) in " <<
+                duration.count() << " ms");
+        }
+        else
+            LERROR("Could not write snapshot '" << job.path << "'");
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _writing = false;
+        }
+        _idle.notify_all();
+    }
+}
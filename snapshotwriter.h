@@ -0,0 +1,87 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __SNAPSHOTWRITER_H__
+#define __SNAPSHOTWRITER_H__
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Simulation;
+
+// The SnapshotWriter saves Snapshots on a thread of its own. 'save' only copies the state of
+// the simulation into memory, which is as fast as the memory bandwidth allows, and the much
+// slower writing of the file happens in the background, so the simulation is not stalled by
+// the disk. The snapshots are written in the order in which they were saved
+class SnapshotWriter {
+public:
+    // Starts the writer thread
+    SnapshotWriter();
+
+    // Writes all snapshots that are still queued and stops the writer thread
+    ~SnapshotWriter();
+
+    // Copies the state of 'simulation' and queues it to be written to 'path'. Must not be
+    // called while a step of 'simulation' is running
+    void save(const Simulation& simulation, const std::string& path);
+
+    // Blocks until all queued snapshots have been written
+    void flush();
+
+private:
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    // A snapshot that is waiting to be written
+    struct Job {
+        // The file the snapshot is written to
+        std::string path;
+        // The contents of the file
+        std::vector<char> data;
+    };
+
+    // The main function of the writer thread
+    void run();
+
+    // Guards all of the following members
+    std::mutex _mutex;
+    // Signaled when a job has been queued or the thread should quit
+    std::condition_variable _wakeUp;
+    // Signaled when the queue has been emptied
+    std::condition_variable _idle;
+    // The snapshots that have not been written yet
+    std::deque<Job> _jobs;
+    // True while the writer thread is writing a job that is not in _jobs anymore
+    bool _writing;
+    // Set when the writer thread should terminate
+    bool _quit;
+
+    // The thread that writes the files
+    std::thread _thread;
+};
+
+#endif // __SNAPSHOTWRITER_H__
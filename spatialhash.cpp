@@ -0,0 +1,365 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "spatialhash.h"
+
+#include "alignedmemory.h"
+#include "integrator.h"
+#include "particlestore.h"
+#include "threadpool.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SPATIALHASH_X86
+#include <immintrin.h>
+#endif
+
+// As in the integrator, the AVX2 kernel is compiled for its instruction set on its own and only
+// used if the CPU supports it
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace {
+    // The number of cells whose offsets are computed as one job
+    const size_t _cellChunkSize = 4096;
+    // The number of particles that are reordered as one job
+    const size_t _gatherChunkSize = 16 * 1024;
+
+    // Spreads the lower 10 bits of 'v' so that there are two zero bits between each of them
+    uint32_t spreadBits(uint32_t v) {
+        v &= 0x000003ff;
+        v = (v | (v << 16)) & 0xff0000ff;
+        v = (v | (v << 8)) & 0x0300f00f;
+        v = (v | (v << 4)) & 0x030c30c3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    // Returns the cell coordinate of 'value' along one axis, clamped to [0, last]. Clamping
+    // before converting also maps NaNs to 0
+    inline uint32_t axisCell(float value, float minimum, float inverseCellSize, float last) {
+        float c = (value - minimum) * inverseCellSize;
+        c = (c > 0.f) ? c : 0.f;
+        c = (c < last) ? c : last;
+        return static_cast<uint32_t>(static_cast<int32_t>(c));
+    }
+
+    // The parameters that map a position to its cell
+    struct GridMapping {
+        float minimum[3];
+        float inverseCellSize[3];
+        float last;
+        // The spread bits of each coordinate along one axis (see spreadBits)
+        const uint32_t* spreadTable;
+    };
+
+    // Computes the Morton keys of 'count' positions (as flat xyz floats) into 'keys'
+    void computeKeysScalar(const float* positions, uint32_t* keys, size_t count,
+        const GridMapping& m)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            const float* p = positions + i * 3;
+            keys[i] = m.spreadTable[axisCell(p[0], m.minimum[0], m.inverseCellSize[0], m.last)] |
+                (m.spreadTable[axisCell(p[1], m.minimum[1], m.inverseCellSize[1], m.last)] << 1) |
+                (m.spreadTable[axisCell(p[2], m.minimum[2], m.inverseCellSize[2], m.last)] << 2);
+        }
+    }
+
+#ifdef SPATIALHASH_X86
+    // Returns the cell coordinates of 8 values along one axis, the same as axisCell
+    TARGET_AVX2
+    inline __m256i axisCellAVX2(__m256 value, __m256 minimum, __m256 inverseCellSize,
+        __m256 last)
+    {
+        __m256 c = _mm256_mul_ps(_mm256_sub_ps(value, minimum), inverseCellSize);
+        // maxps returns the second operand for NaNs
+        c = _mm256_max_ps(c, _mm256_setzero_ps());
+        c = _mm256_min_ps(c, last);
+        return _mm256_cvttps_epi32(c);
+    }
+
+    // Spreads the lower 10 bits of each element of 'v' the same way as spreadBits
+    TARGET_AVX2
+    inline __m256i spreadBitsAVX2(__m256i v) {
+        v = _mm256_and_si256(v, _mm256_set1_epi32(0x000003ff));
+        v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 16)),
+            _mm256_set1_epi32(0xff0000ff));
+        v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 8)),
+            _mm256_set1_epi32(0x0300f00f));
+        v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 4)),
+            _mm256_set1_epi32(0x030c30c3));
+        v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 2)),
+            _mm256_set1_epi32(0x09249249));
+        return v;
+    }
+
+    TARGET_AVX2
+    void computeKeysAVX2(const float* positions, uint32_t* keys, size_t count,
+        const GridMapping& m)
+    {
+        // The positions are processed as flat floats, 8 particles in 3 registers, like in the
+        // integrator. Each register holds a rotated pattern of the x, y, and z components, so
+        // the grid parameters and the Morton shifts are rotated in the same way
+        __m256 minimum[3];
+        __m256 inverse[3];
+        __m256i shift[3];
+        for (int r = 0; r < 3; ++r) {
+            float minimumPattern[8];
+            float inversePattern[8];
+            int shiftPattern[8];
+            for (int i = 0; i < 8; ++i) {
+                const int axis = (r * 8 + i) % 3;
+                minimumPattern[i] = m.minimum[axis];
+                inversePattern[i] = m.inverseCellSize[axis];
+                shiftPattern[i] = axis;
+            }
+            minimum[r] = _mm256_loadu_ps(minimumPattern);
+            inverse[r] = _mm256_loadu_ps(inversePattern);
+            shift[r] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(shiftPattern));
+        }
+        const __m256 last = _mm256_set1_ps(m.last);
+
+        const size_t batches = count / 8;
+        for (size_t b = 0; b < batches; ++b) {
+            const float* p = positions + b * 24;
+            // The shifted Morton bits of each component; a key is the or of three of them
+            uint32_t bits[24];
+            for (int r = 0; r < 3; ++r) {
+                const __m256i c = axisCellAVX2(_mm256_loadu_ps(p + r * 8), minimum[r],
+                    inverse[r], last);
+                const __m256i spread = _mm256_sllv_epi32(spreadBitsAVX2(c), shift[r]);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(bits + r * 8), spread);
+            }
+            uint32_t* k = keys + b * 8;
+            for (int i = 0; i < 8; ++i)
+                k[i] = bits[i * 3] | bits[i * 3 + 1] | bits[i * 3 + 2];
+        }
+
+        // The remaining particles that don't fill a whole batch
+        const size_t done = batches * 8;
+        computeKeysScalar(positions + done * 3, keys + done, count - done, m);
+    }
+#endif // SPATIALHASH_X86
+
+    // Reorders 'source' into 'target' so that target[destination[i]] = source[i]
+    template <typename T>
+    void scatter(const T* source, T* target, const uint32_t* destination, size_t size,
+        ThreadPool& pool)
+    {
+        pool.parallelFor(0, size, _gatherChunkSize,
+            [source, target, destination](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i)
+                    target[destination[i]] = source[i];
+            }
+        );
+    }
+}
+
+SpatialHash::SpatialHash(const glm::vec3& minimum, const glm::vec3& maximum, int resolutionBits)
+    : _minimum(minimum)
+    , _resolutionBits(std::min(std::max(resolutionBits, 1), 10))
+    , _resolution(1 << _resolutionBits)
+    , _keys(nullptr)
+    , _destination(nullptr)
+    , _scratchVectors(nullptr)
+    , _scratchScalars(nullptr)
+    , _capacity(0)
+{
+    _inverseCellSize = glm::vec3(static_cast<float>(_resolution)) / (maximum - minimum);
+    _cellStart.resize(numberOfCells() + 1, 0);
+
+    _spreadTable.resize(_resolution);
+    for (int i = 0; i < _resolution; ++i)
+        _spreadTable[i] = spreadBits(static_cast<uint32_t>(i));
+    _useAVX2 = Integrator::isSupported(Integrator::Kernel::AVX2);
+}
+
+SpatialHash::~SpatialHash() {
+    alignedFree(_keys);
+    alignedFree(_destination);
+    alignedFree(_scratchVectors);
+    alignedFree(_scratchScalars);
+}
+
+void SpatialHash::reserve(size_t capacity) {
+    if (capacity <= _capacity)
+        return;
+
+    alignedFree(_keys);
+    alignedFree(_destination);
+    alignedFree(_scratchVectors);
+    alignedFree(_scratchScalars);
+    _keys = alignedArray<uint32_t>(capacity, ParticleStore::Alignment);
+    _destination = alignedArray<uint32_t>(capacity, ParticleStore::Alignment);
+    _scratchVectors = alignedArray<glm::vec3>(capacity, ParticleStore::Alignment);
+    _scratchScalars = alignedArray<float>(capacity, ParticleStore::Alignment);
+    _capacity = capacity;
+}
+
+void SpatialHash::build(ParticleStore& store, ThreadPool& pool) {
+    // The scratch arrays are swapped with the store's arrays, so they need the full capacity
+    reserve(store.capacity());
+
+    const size_t size = store.size();
+    const size_t numCells = numberOfCells();
+    // One block per thread keeps the memory for the histograms small
+    const size_t numBlocks = pool.numberOfThreads();
+    const size_t blockSize = std::max<size_t>((size + numBlocks - 1) / numBlocks, 1);
+    _blockCounts.assign(numBlocks * numCells, 0);
+
+    // 1. Compute the key of each particle and count the particles per cell for each block
+    const float* positions = reinterpret_cast<const float*>(store.positions());
+    GridMapping mapping;
+    for (int a = 0; a < 3; ++a) {
+        mapping.minimum[a] = _minimum[a];
+        mapping.inverseCellSize[a] = _inverseCellSize[a];
+    }
+    mapping.last = static_cast<float>(_resolution - 1);
+    mapping.spreadTable = &_spreadTable[0];
+    pool.parallelFor(0, size, blockSize,
+        [this, positions, &mapping, blockSize, numCells](size_t begin, size_t end) {
+            uint32_t* keys = _keys;
+#ifdef SPATIALHASH_X86
+            if (_useAVX2)
+                computeKeysAVX2(positions + begin * 3, keys + begin, end - begin, mapping);
+            else
+#endif
+                computeKeysScalar(positions + begin * 3, keys + begin, end - begin, mapping);
+
+            // The store is still sorted from the last step, so most particles are in the same
+            // cell as their predecessor. Counting runs avoids the dependency chain that repeated
+            // increments of the same counter would cause
+            uint32_t* counts = &_blockCounts[(begin / blockSize) * numCells];
+            uint32_t runKey = keys[begin];
+            uint32_t runLength = 0;
+            for (size_t i = begin; i < end; ++i) {
+                if (keys[i] == runKey)
+                    ++runLength;
+                else {
+                    counts[runKey] += runLength;
+                    runKey = keys[i];
+                    runLength = 1;
+                }
+            }
+            counts[runKey] += runLength;
+        }
+    );
+
+    // 2. Turn the counts into offsets. The particles of a cell are ordered by block, so the
+    //    offset of (cell, block) is the start of the cell plus the counts of the earlier blocks
+    uint32_t* blockCounts = &_blockCounts[0];
+    uint32_t* cellStart = &_cellStart[0];
+    pool.parallelFor(0, numCells, _cellChunkSize,
+        [blockCounts, cellStart, numCells, numBlocks](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; ++c) {
+                uint32_t total = 0;
+                for (size_t b = 0; b < numBlocks; ++b)
+                    total += blockCounts[b * numCells + c];
+                cellStart[c + 1] = total;
+            }
+        }
+    );
+    cellStart[0] = 0;
+    for (size_t c = 0; c < numCells; ++c)
+        cellStart[c + 1] += cellStart[c];
+    pool.parallelFor(0, numCells, _cellChunkSize,
+        [blockCounts, cellStart, numCells, numBlocks](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; ++c) {
+                uint32_t offset = cellStart[c];
+                for (size_t b = 0; b < numBlocks; ++b) {
+                    const uint32_t count = blockCounts[b * numCells + c];
+                    blockCounts[b * numCells + c] = offset;
+                    offset += count;
+                }
+            }
+        }
+    );
+
+    // 3. Each block hands out the destinations of its particles from its own offsets
+    pool.parallelFor(0, size, blockSize,
+        [this, blockSize, numCells](size_t begin, size_t end) {
+            uint32_t* offsets = &_blockCounts[(begin / blockSize) * numCells];
+            for (size_t i = begin; i < end; ++i)
+                _destination[i] = offsets[_keys[i]]++;
+        }
+    );
+
+    // 4. Move all attributes to their sorted position and adopt the reordered arrays
+    scatter(store.positions(), _scratchVectors, _destination, size, pool);
+    store.swapPositions(_scratchVectors);
+    scatter(store.velocities(), _scratchVectors, _destination, size, pool);
+    store.swapVelocities(_scratchVectors);
+    scatter(store.ages(), _scratchScalars, _destination, size, pool);
+    store.swapAges(_scratchScalars);
+    scatter(store.lifetimes(), _scratchScalars, _destination, size, pool);
+    store.swapLifetimes(_scratchScalars);
+    // The keys are not needed anymore, so their array serves as the scratch for the slots
+    scatter(store.particleSlots(), _keys, _destination, size, pool);
+    store.swapSlots(_keys);
+    pool.parallelFor(0, size, _gatherChunkSize,
+        [&store](size_t begin, size_t end) { store.updateHandles(begin, end); }
+    );
+}
+
+glm::vec3 SpatialHash::minimum() const {
+    return _minimum;
+}
+
+int SpatialHash::resolution() const {
+    return _resolution;
+}
+
+size_t SpatialHash::numberOfCells() const {
+    return static_cast<size_t>(1) << (3 * _resolutionBits);
+}
+
+glm::vec3 SpatialHash::cellSize() const {
+    return glm::vec3(1.f) / _inverseCellSize;
+}
+
+glm::ivec3 SpatialHash::cell(const glm::vec3& position) const {
+    const float last = static_cast<float>(_resolution - 1);
+    return glm::ivec3(
+        static_cast<int>(axisCell(position.x, _minimum.x, _inverseCellSize.x, last)),
+        static_cast<int>(axisCell(position.y, _minimum.y, _inverseCellSize.y, last)),
+        static_cast<int>(axisCell(position.z, _minimum.z, _inverseCellSize.z, last))
+    );
+}
+
+uint32_t SpatialHash::key(const glm::ivec3& cell) {
+    return spreadBits(static_cast<uint32_t>(cell.x)) |
+        (spreadBits(static_cast<uint32_t>(cell.y)) << 1) |
+        (spreadBits(static_cast<uint32_t>(cell.z)) << 2);
+}
+
+size_t SpatialHash::cellBegin(uint32_t key) const {
+    return _cellStart[key];
+}
+
+size_t SpatialHash::cellEnd(uint32_t key) const {
+    return _cellStart[key + 1];
+}
@@ -0,0 +1,150 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __SPATIALHASH_H__
+#define __SPATIALHASH_H__
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ParticleStore;
+class ThreadPool;
+
+// The SpatialHash divides an axis-aligned box into a uniform grid of 2^n cells per axis and
+// sorts the particles of a ParticleStore by the cell they are in. The cells are numbered in
+// Morton (Z-curve) order, so sorting by cell also puts particles that are close in space close
+// to each other in memory. After 'build', the particles of each cell form a contiguous range
+// of the store, so a query only has to look at the ranges of the cells it overlaps.
+// Particles outside of the box are sorted into the closest border cell
+class SpatialHash {
+public:
+    // Creates a grid covering [minimum, maximum] with 2^'resolutionBits' cells along each axis.
+    // 'resolutionBits' is clamped to [1, 10]
+    SpatialHash(const glm::vec3& minimum, const glm::vec3& maximum, int resolutionBits = 5);
+
+    // Frees the scratch memory
+    ~SpatialHash();
+
+    // Sorts the particles of 'store' by their cell and records the range of each cell. This is a
+    // parallel counting sort that is stable, so particles within a cell keep their order
+    void build(ParticleStore& store, ThreadPool& pool);
+
+    // Returns the lower corner of the grid
+    glm::vec3 minimum() const;
+    // Returns the number of cells along each axis
+    int resolution() const;
+    // Returns the total number of cells
+    size_t numberOfCells() const;
+    // Returns the edge length of the cells along each axis
+    glm::vec3 cellSize() const;
+
+    // Returns the cell that contains 'position', clamped to the grid
+    glm::ivec3 cell(const glm::vec3& position) const;
+    // Returns the Morton key of the cell with the coordinates 'cell', which has to be in the grid
+    static uint32_t key(const glm::ivec3& cell);
+
+    // Returns the first particle of the cell with the 'key' as of the last build
+    size_t cellBegin(uint32_t key) const;
+    // Returns one past the last particle of the cell with the 'key' as of the last build
+    size_t cellEnd(uint32_t key) const;
+
+    // Calls 'function(begin, end)' for ranges of particles that together contain all particles
+    // of the cells that overlap the sphere around 'center' with 'radius'. The particles in the
+    // ranges are only guaranteed to be near the sphere, so an exact test is still needed.
+    // Adjacent ranges are merged, so the function is called as few times as possible
+    template <typename Function>
+    void forEachInRadius(const glm::vec3& center, float radius, Function function) const;
+
+private:
+    SpatialHash(const SpatialHash&) = delete;
+    SpatialHash& operator=(const SpatialHash&) = delete;
+
+    // Makes sure the scratch arrays can hold 'capacity' particles
+    void reserve(size_t capacity);
+
+    // The lower corner of the grid
+    glm::vec3 _minimum;
+    // The number of cells along each axis divided by the extent; multiplied with an offset
+    // from _minimum it results in continuous cell coordinates
+    glm::vec3 _inverseCellSize;
+    // The number of bits per axis of a cell coordinate
+    int _resolutionBits;
+    // The number of cells along each axis
+    int _resolution;
+
+    // The Morton bits of each cell coordinate along a single axis
+    std::vector<uint32_t> _spreadTable;
+    // True if the keys can be computed with AVX2
+    bool _useAVX2;
+
+    // The first particle of each cell in the sorted store; has numberOfCells() + 1 elements
+    std::vector<uint32_t> _cellStart;
+    // The histograms of each block of particles over all cells, one after the other
+    std::vector<uint32_t> _blockCounts;
+
+    // The cell key of each particle; afterwards the scratch array for reordering the slots
+    uint32_t* _keys;
+    // The sorted position of each particle
+    uint32_t* _destination;
+    // Scratch arrays the attributes are reordered into before they are swapped into the store
+    glm::vec3* _scratchVectors;
+    float* _scratchScalars;
+    // The number of particles the scratch arrays can hold
+    size_t _capacity;
+};
+
+template <typename Function>
+void SpatialHash::forEachInRadius(const glm::vec3& center, float radius, Function function) const {
+    const glm::ivec3 low = cell(center - glm::vec3(radius));
+    const glm::ivec3 high = cell(center + glm::vec3(radius));
+
+    // Collect the ranges of consecutive cells and only report them once they are interrupted
+    size_t runBegin = 0;
+    size_t runEnd = 0;
+    for (int z = low.z; z <= high.z; ++z) {
+        for (int y = low.y; y <= high.y; ++y) {
+            for (int x = low.x; x <= high.x; ++x) {
+                const uint32_t k = key(glm::ivec3(x, y, z));
+                const size_t begin = _cellStart[k];
+                const size_t end = _cellStart[k + 1];
+                if (begin == end)
+                    continue;
+
+                if (begin == runEnd)
+                    runEnd = end;
+                else {
+                    if (runBegin != runEnd)
+                        function(runBegin, runEnd);
+                    runBegin = begin;
+                    runEnd = end;
+                }
+            }
+        }
+    }
+    if (runBegin != runEnd)
+        function(runBegin, runEnd);
+}
+
+#endif // __SPATIALHASH_H__
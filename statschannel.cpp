@@ -0,0 +1,253 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "statschannel.h"
+
+#include "effectsystem.h"
+
+#include <ghoul/logging/logging>
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+namespace {
+    const std::string _loggerCat = "StatsChannel";
+
+    // How a Counter is exported to Prometheus
+    struct Metric {
+        // The name of the metric
+        const char* name;
+        // The help text of the metric
+        const char* help;
+        // True for a gauge, false for a counter
+        bool isGauge;
+    };
+
+    // Indexed by StatsChannel::Counter
+    const Metric _metrics[StatsChannel::NumberOfCounters] = {
+        { "particles_live", "The number of particles alive after the last step", true },
+        { "particles_spawned_total", "The number of particles spawned", false },
+        { "particles_expired_total", "The number of particles removed after their lifetime",
+            false },
+        { "particles_effects_seconds_total", "The time all effects took", false },
+        { "particles_upload_bytes_total", "The position bytes handed to the GPU", false },
+        { "particles_steps_total", "The number of simulation steps", false },
+        { "particles_stream_bytes_total", "The bytes received from the stream server", false },
+        { "particles_stream_latency_seconds",
+            "The time from the request of the last streamed frame until it was decoded", true }
+    };
+
+    // Adds the label set of a sample with the labels of the sample and the common 'labels'
+    std::string labelSet(const std::string& own, const std::string& labels) {
+        if (own.empty() && labels.empty())
+            return "";
+        if (own.empty() || labels.empty())
+            return "{" + own + labels + "}";
+        return "{" + own + "," + labels + "}";
+    }
+
+    // Writes the HELP and TYPE lines of a metric
+    void header(std::ostringstream& stream, const char* name, const char* help, bool isGauge) {
+        stream << "# HELP " << name << " " << help << "\n";
+        stream << "# TYPE " << name << " " << (isGauge ? "gauge" : "counter") << "\n";
+    }
+}
+
+StatsChannel::StatsChannel(size_t maximumEmitters, size_t maximumEffects)
+    : _maximumEmitters(maximumEmitters)
+    , _emitterSpawned(new std::atomic<uint64_t>[maximumEmitters])
+    , _maximumEffects(maximumEffects)
+    , _effectTypes(new std::atomic<int>[maximumEffects])
+    , _effectParticles(new std::atomic<uint64_t>[maximumEffects])
+    , _effectNanoseconds(new std::atomic<uint64_t>[maximumEffects])
+{
+    // Atomics are not initialized by their default constructor
+    for (std::atomic<uint64_t>& counter : _counters)
+        counter.store(0, std::memory_order_relaxed);
+    _numberOfEmitters.store(0, std::memory_order_relaxed);
+    _numberOfEffects.store(0, std::memory_order_relaxed);
+    for (size_t i = 0; i < _maximumEmitters; ++i)
+        _emitterSpawned[i].store(0, std::memory_order_relaxed);
+    for (size_t i = 0; i < _maximumEffects; ++i) {
+        _effectTypes[i].store(0, std::memory_order_relaxed);
+        _effectParticles[i].store(0, std::memory_order_relaxed);
+        _effectNanoseconds[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+StatsChannel::~StatsChannel() {
+    delete[] _emitterSpawned;
+    delete[] _effectTypes;
+    delete[] _effectParticles;
+    delete[] _effectNanoseconds;
+}
+
+void StatsChannel::add(Counter counter, uint64_t amount) {
+    _counters[static_cast<int>(counter)].fetch_add(amount, std::memory_order_relaxed);
+}
+
+void StatsChannel::set(Counter counter, uint64_t value) {
+    _counters[static_cast<int>(counter)].store(value, std::memory_order_relaxed);
+}
+
+uint64_t StatsChannel::value(Counter counter) const {
+    return _counters[static_cast<int>(counter)].load(std::memory_order_relaxed);
+}
+
+void StatsChannel::setNumberOfEmitters(size_t count) {
+    const size_t previous = numberOfTrackedEmitters();
+    _numberOfEmitters.store(count, std::memory_order_relaxed);
+    for (size_t i = std::min(count, _maximumEmitters); i < previous; ++i)
+        _emitterSpawned[i].store(0, std::memory_order_relaxed);
+}
+
+void StatsChannel::setEmitterSpawned(size_t index, uint64_t spawned) {
+    if (index < _maximumEmitters)
+        _emitterSpawned[index].store(spawned, std::memory_order_relaxed);
+}
+
+size_t StatsChannel::numberOfEmitters() const {
+    return static_cast<size_t>(_numberOfEmitters.load(std::memory_order_relaxed));
+}
+
+size_t StatsChannel::numberOfTrackedEmitters() const {
+    return std::min(numberOfEmitters(), _maximumEmitters);
+}
+
+uint64_t StatsChannel::emitterSpawned(size_t index) const {
+    return (index < _maximumEmitters) ? _emitterSpawned[index].load(std::memory_order_relaxed) : 0;
+}
+
+void StatsChannel::setNumberOfEffects(size_t count) {
+    const size_t previous = numberOfTrackedEffects();
+    _numberOfEffects.store(count, std::memory_order_relaxed);
+    for (size_t i = std::min(count, _maximumEffects); i < previous; ++i) {
+        _effectParticles[i].store(0, std::memory_order_relaxed);
+        _effectNanoseconds[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void StatsChannel::addEffectCost(size_t index, int type, uint64_t particles,
+    uint64_t nanoseconds)
+{
+    add(Counter::EffectNanoseconds, nanoseconds);
+    if (index >= _maximumEffects)
+        return;
+    _effectTypes[index].store(type, std::memory_order_relaxed);
+    _effectParticles[index].fetch_add(particles, std::memory_order_relaxed);
+    _effectNanoseconds[index].fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+size_t StatsChannel::numberOfEffects() const {
+    return static_cast<size_t>(_numberOfEffects.load(std::memory_order_relaxed));
+}
+
+size_t StatsChannel::numberOfTrackedEffects() const {
+    return std::min(numberOfEffects(), _maximumEffects);
+}
+
+StatsChannel::Effect StatsChannel::effect(size_t index) const {
+    Effect result = { 0, 0, 0 };
+    if (index < _maximumEffects) {
+        result.type = _effectTypes[index].load(std::memory_order_relaxed);
+        result.particles = _effectParticles[index].load(std::memory_order_relaxed);
+        result.nanoseconds = _effectNanoseconds[index].load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+std::string StatsChannel::prometheusText(const std::string& labels) const {
+    std::ostringstream stream;
+    const std::string common = labelSet("", labels);
+    for (int i = 0; i < NumberOfCounters; ++i) {
+        const Counter counter = static_cast<Counter>(i);
+        header(stream, _metrics[i].name, _metrics[i].help, _metrics[i].isGauge);
+        stream << _metrics[i].name << common << " ";
+        if (counter == Counter::EffectNanoseconds)
+            stream << value(counter) * 1e-9 << "\n";
+        else if (counter == Counter::StreamLatencyMicroseconds)
+            stream << value(counter) * 1e-6 << "\n";
+        else
+            stream << value(counter) << "\n";
+    }
+
+    header(stream, "particles_emitters", "The number of emitters", true);
+    stream << "particles_emitters" << common << " " << numberOfEmitters() << "\n";
+    header(stream, "particles_emitter_spawned_total", "The particles spawned by an emitter",
+        false);
+    for (size_t i = 0; i < numberOfTrackedEmitters(); ++i) {
+        stream << "particles_emitter_spawned_total" <<
+            labelSet("emitter=\"" + std::to_string(i) + "\"", labels) << " " <<
+            emitterSpawned(i) << "\n";
+    }
+
+    header(stream, "particles_effects", "The number of effects", true);
+    stream << "particles_effects" << common << " " << numberOfEffects() << "\n";
+    header(stream, "particles_effect_tested_total", "The particles an effect has tested",
+        false);
+    const size_t numberOfTracked = numberOfTrackedEffects();
+    for (size_t i = 0; i < numberOfTracked; ++i) {
+        const Effect e = effect(i);
+        const std::string type =
+            (static_cast<EffectSystem::Type>(e.type) == EffectSystem::Type::Gravity) ?
+            "gravity" : "wind";
+        stream << "particles_effect_tested_total" << labelSet("effect=\"" +
+            std::to_string(i) + "\",type=\"" + type + "\"", labels) << " " << e.particles << "\n";
+    }
+    header(stream, "particles_effect_seconds_total", "The time an effect took", false);
+    for (size_t i = 0; i < numberOfTracked; ++i) {
+        stream << "particles_effect_seconds_total" <<
+            labelSet("effect=\"" + std::to_string(i) + "\"", labels) << " " <<
+            effect(i).nanoseconds * 1e-9 << "\n";
+    }
+    return stream.str();
+}
+
+bool StatsChannel::writePrometheusFile(const std::string& path, const std::string& labels) const
+{
+    // The file is replaced as a whole by renaming a complete temporary file over it
+    const std::string text = prometheusText(labels);
+    const std::string temporaryPath = path + ".tmp";
+    FILE* file = std::fopen(temporaryPath.c_str(), "wb");
+    if (file == nullptr) {
+        LERROR("Could not open '" << temporaryPath << "' for writing");
+        return false;
+    }
+    const bool written = (std::fwrite(text.data(), 1, text.size(), file) == text.size());
+    const bool closed = (std::fclose(file) == 0);
+    if (!written || !closed) {
+        LERROR("Could not write the metrics to '" << temporaryPath << "'");
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    // Renaming does not replace an existing file on Windows
+    std::remove(path.c_str());
+#endif
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        LERROR("Could not move the metrics to '" << path << "'");
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
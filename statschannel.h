@@ -0,0 +1,136 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __STATSCHANNEL_H__
+#define __STATSCHANNEL_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// The StatsChannel carries the counters of the simulation and the renderer to whoever displays
+// or exports them. Every value is a relaxed atomic in memory that is allocated once, so the
+// publishers never lock, never allocate, and never wait for a reader. The publishers coalesce
+// their updates and publish once per step or upload instead of once per particle. Each value is
+// consistent on its own, but a reader might see values of different steps next to each other.
+// Only the first 'maximumEmitters' emitters and 'maximumEffects' effects are tracked one by one;
+// the others still count towards the totals
+class StatsChannel {
+public:
+    // The values that are tracked for the whole system
+    enum class Counter {
+        // The number of particles that were alive after the last step (a gauge)
+        Live,
+        // The number of particles that have been spawned so far
+        Spawned,
+        // The number of particles that have been removed after their lifetime
+        Expired,
+        // The number of nanoseconds all effects took together
+        EffectNanoseconds,
+        // The number of position bytes that have been handed to the GPU
+        UploadBytes,
+        // The number of simulation steps
+        Steps,
+        // The number of bytes a remote viewer has received from the server
+        StreamBytes,
+        // The microseconds from the request of the last streamed frame until it was decoded in
+        // the remote viewer (a gauge)
+        StreamLatencyMicroseconds
+    };
+    // The number of values in Counter
+    static const int NumberOfCounters = 8;
+
+    // The values of a single effect
+    struct Effect {
+        // The EffectSystem::Type of the effect
+        int type;
+        // The number of particles the effect has tested so far
+        uint64_t particles;
+        // The time the effect has taken so far
+        uint64_t nanoseconds;
+    };
+
+    // Allocates the values for 'maximumEmitters' emitters and 'maximumEffects' effects
+    explicit StatsChannel(size_t maximumEmitters = 256, size_t maximumEffects = 256);
+
+    // Frees the values
+    ~StatsChannel();
+
+    // Adds 'amount' to 'counter'
+    void add(Counter counter, uint64_t amount);
+    // Replaces the value of 'counter' with 'value'
+    void set(Counter counter, uint64_t value);
+    // Returns the current value of 'counter'
+    uint64_t value(Counter counter) const;
+
+    // Sets the number of emitters whose values are valid. The values of the emitters that are
+    // no longer valid are reset
+    void setNumberOfEmitters(size_t count);
+    // Sets the number of particles that the emitter at 'index' has spawned so far
+    void setEmitterSpawned(size_t index, uint64_t spawned);
+    // Returns the number of emitters and the number of those that are tracked one by one
+    size_t numberOfEmitters() const;
+    size_t numberOfTrackedEmitters() const;
+    // Returns the number of particles the tracked emitter at 'index' has spawned so far
+    uint64_t emitterSpawned(size_t index) const;
+
+    // Sets the number of effects whose values are valid. The values of the effects that are no
+    // longer valid are reset
+    void setNumberOfEffects(size_t count);
+    // Adds the cost of one application of the effect at 'index' of 'type'
+    void addEffectCost(size_t index, int type, uint64_t particles, uint64_t nanoseconds);
+    // Returns the number of effects and the number of those that are tracked one by one
+    size_t numberOfEffects() const;
+    size_t numberOfTrackedEffects() const;
+    // Returns the values of the tracked effect at 'index'
+    Effect effect(size_t index) const;
+
+    // Returns all values in the text format that Prometheus scrapes. 'labels' are added to
+    // every sample, for example 'scenario="single"', or may be empty
+    std::string prometheusText(const std::string& labels) const;
+    // Writes prometheusText('labels') into the file at 'path', so that a scraper never reads a
+    // partially written file. Returns false if the file could not be written
+    bool writePrometheusFile(const std::string& path, const std::string& labels) const;
+
+private:
+    StatsChannel(const StatsChannel&) = delete;
+    StatsChannel& operator=(const StatsChannel&) = delete;
+
+    // The system wide values, indexed by Counter
+    std::atomic<uint64_t> _counters[NumberOfCounters];
+
+    // The number of valid emitters and the spawn counts of the tracked ones
+    std::atomic<uint64_t> _numberOfEmitters;
+    size_t _maximumEmitters;
+    std::atomic<uint64_t>* _emitterSpawned;
+
+    // The number of valid effects and the values of the tracked ones
+    std::atomic<uint64_t> _numberOfEffects;
+    size_t _maximumEffects;
+    std::atomic<int>* _effectTypes;
+    std::atomic<uint64_t>* _effectParticles;
+    std::atomic<uint64_t>* _effectNanoseconds;
+};
+
+#endif // __STATSCHANNEL_H__
@@ -0,0 +1,306 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "streamclient.h"
+
+#include "alignedmemory.h"
+#include "particlestore.h"
+#include "positioncodec.h"
+#include "positionquantizer.h"
+#include "positionsink.h"
+#include "spatialhash.h"
+#include "statschannel.h"
+#include "streamprotocol.h"
+
+#include <ghoul/logging/logging>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace {
+    const std::string _loggerCat = "StreamClient";
+}
+
+StreamClient::StreamClient(ThreadPool& pool)
+    : _pool(pool)
+    , _grid(nullptr)
+    , _quantizer(nullptr)
+    , _codec(nullptr)
+    , _capacity(0)
+    , _framesPerSecond(30.f)
+    , _maximumBytesPerSecond(0)
+    , _stats(nullptr)
+    , _front(nullptr)
+    , _frontSize(0)
+    , _frontVersion(0)
+    , _back(nullptr)
+    , _backSize(0)
+    , _sink(nullptr)
+    , _state(State::Idle)
+    , _target(nullptr)
+    , _quantizedTarget(nullptr)
+    , _frameSink(nullptr)
+    , _isConnected(false)
+    , _quit(false)
+{}
+
+StreamClient::~StreamClient() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _wakeUp.notify_one();
+    if (_thread.joinable())
+        _thread.join();
+
+    delete _codec;
+    delete _quantizer;
+    delete _grid;
+    alignedFree(_front);
+    alignedFree(_back);
+}
+
+bool StreamClient::connect(const std::string& address, float framesPerSecond,
+    uint32_t maximumBytesPerSecond, int timeoutSeconds)
+{
+    // The server is rank 0 and accepts this process as rank 1, which does not listen itself
+    const std::vector<std::string> addresses = { address, "" };
+    if (!_transport.connect(1, addresses, timeoutSeconds))
+        return false;
+    _framesPerSecond = framesPerSecond;
+    _maximumBytesPerSecond = maximumBytesPerSecond;
+
+    const StreamRequest request = { _framesPerSecond, _maximumBytesPerSecond, 0 };
+    std::vector<char> message(sizeof(request));
+    std::memcpy(message.data(), &request, sizeof(request));
+    std::vector<std::vector<char>> incoming;
+    StreamInfo info;
+    if (!_transport.broadcast(message, incoming) || (incoming[0].size() != sizeof(info))) {
+        LERROR("The server at " << address << " did not describe its stream");
+        return false;
+    }
+    std::memcpy(&info, incoming[0].data(), sizeof(info));
+    if (info.version != StreamVersion) {
+        LERROR("The server streams version " << info.version << " instead of " <<
+            StreamVersion);
+        return false;
+    }
+    if ((info.resolutionBits < 1) ||
+        (info.resolutionBits > PositionQuantizer::MaximumResolutionBits))
+    {
+        LERROR("The server uses an unsupported grid");
+        return false;
+    }
+    // The capacity bounds every decoded frame, so it has to fit into the buffers
+    const size_t maximumCapacity = std::numeric_limits<size_t>::max() / sizeof(glm::vec3);
+    if ((info.capacity > MaximumStreamCapacity) || (info.capacity > maximumCapacity)) {
+        LERROR("The server asks for room for " << info.capacity << " particles");
+        return false;
+    }
+
+    // The same grid as on the server gives the same quantization
+    const glm::vec3 minimum(info.minimum[0], info.minimum[1], info.minimum[2]);
+    const glm::vec3 cellSize(info.cellSize[0], info.cellSize[1], info.cellSize[2]);
+    const int resolution = 1 << info.resolutionBits;
+    _grid = new SpatialHash(minimum, minimum + cellSize * static_cast<float>(resolution),
+        info.resolutionBits);
+    _quantizer = new PositionQuantizer(*_grid);
+    _codec = new PositionCodec(*_quantizer, info.precisionBits);
+    _capacity = info.capacity;
+    _front = alignedArray<glm::vec3>(_capacity, ParticleStore::Alignment);
+    _back = alignedArray<glm::vec3>(_capacity, ParticleStore::Alignment);
+    if ((_front == nullptr) || (_back == nullptr)) {
+        LERROR("Could not allocate the buffers for " << _capacity << " particles");
+        alignedFree(_front);
+        alignedFree(_back);
+        _front = nullptr;
+        _back = nullptr;
+        _capacity = 0;
+        return false;
+    }
+    _isConnected = true;
+    LINFO("Streaming from " << address << " with room for " << _capacity << " particles");
+
+    // Start the thread last, as it accesses the members
+    _thread = std::thread(&StreamClient::run, this);
+    return true;
+}
+
+size_t StreamClient::capacity() const {
+    return _capacity;
+}
+
+const PositionQuantizer& StreamClient::quantizer() const {
+    return *_quantizer;
+}
+
+void StreamClient::send(CallbackRecorder::Event event) {
+    // The server records the step the event is applied at
+    event.step = 0;
+    std::lock_guard<std::mutex> lock(_mutex);
+    _events.push_back(event);
+}
+
+void StreamClient::requestFrame() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if ((_state != State::Idle) || !_isConnected)
+            return;
+    }
+
+    // Only this thread can leave the Idle state, so we can ask the sink for memory without
+    // holding the lock, as the sink might have to wait for the GPU
+    glm::vec3* sinkMemory = nullptr;
+    QuantizedPosition* quantizedMemory = nullptr;
+    if ((_sink != nullptr) && _sink->quantizesPositions())
+        quantizedMemory = _sink->beginWriteQuantized();
+    else if (_sink != nullptr)
+        sinkMemory = _sink->beginWrite();
+    const bool writesIntoSink = (sinkMemory != nullptr) || (quantizedMemory != nullptr);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _target = writesIntoSink ? sinkMemory : _back;
+    _quantizedTarget = quantizedMemory;
+    _frameSink = writesIntoSink ? _sink : nullptr;
+    _state = State::Receiving;
+    _wakeUp.notify_one();
+}
+
+bool StreamClient::collect() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_state != State::Received)
+        return false;
+
+    if (_frameSink == nullptr) {
+        std::swap(_front, _back);
+        _frontSize = _backSize;
+        ++_frontVersion;
+    }
+    else
+        _frameSink->endWrite(_backSize);
+    _target = nullptr;
+    _quantizedTarget = nullptr;
+    _frameSink = nullptr;
+    _state = State::Idle;
+    return true;
+}
+
+void StreamClient::finish() {
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _frameReceived.wait(lock, [this]() { return _state != State::Receiving; });
+    }
+    collect();
+}
+
+PositionView StreamClient::positionView() const {
+    // _front and _frontSize are only changed on the GUI thread, so the renderer can read them
+    // without synchronization
+    return PositionView(&_front, &_frontSize, &_frontVersion);
+}
+
+void StreamClient::setPositionSink(PositionSink* sink) {
+    _sink = sink;
+}
+
+void StreamClient::setStatsChannel(StatsChannel* stats) {
+    _stats = stats;
+}
+
+bool StreamClient::decodeFrame(const std::vector<char>& message, glm::vec3* target,
+    QuantizedPosition* quantizedTarget, size_t& count)
+{
+    count = 0;
+    if (message.size() < sizeof(StreamFrameHeader))
+        return false;
+    const char* data = message.data() + sizeof(StreamFrameHeader);
+    const size_t size = message.size() - sizeof(StreamFrameHeader);
+    if (quantizedTarget != nullptr)
+        return _codec->decode(data, size, _capacity, _pool, quantizedTarget, count);
+    return _codec->decode(data, size, _capacity, _pool, target, count);
+}
+
+void StreamClient::run() {
+    typedef std::chrono::steady_clock Clock;
+    const Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<float>(1.f / _framesPerSecond));
+    Clock::time_point nextRequest = Clock::now();
+
+    const std::vector<char> empty;
+    std::vector<char> request;
+    std::vector<std::vector<char>> incoming;
+    while (true) {
+        glm::vec3* target;
+        QuantizedPosition* quantizedTarget;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wakeUp.wait(lock, [this]() { return _quit || (_state == State::Receiving); });
+            if (_quit)
+                return;
+            target = _target;
+            quantizedTarget = _quantizedTarget;
+        }
+
+        // The frames are paced by their requests, so a slow frame does not cause a burst of
+        // frames afterwards
+        std::this_thread::sleep_until(nextRequest);
+        const Clock::time_point requestTime = Clock::now();
+        nextRequest = requestTime + period;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            const StreamRequest header = { _framesPerSecond, _maximumBytesPerSecond,
+                static_cast<uint32_t>(_events.size()) };
+            request.resize(sizeof(header) + _events.size() * sizeof(CallbackRecorder::Event));
+            std::memcpy(request.data(), &header, sizeof(header));
+            if (!_events.empty()) {
+                std::memcpy(request.data() + sizeof(header), _events.data(),
+                    _events.size() * sizeof(CallbackRecorder::Event));
+            }
+            _events.clear();
+        }
+
+        size_t count = 0;
+        const bool isReceived = _transport.broadcast(request, incoming) &&
+            _transport.broadcast(empty, incoming) &&
+            decodeFrame(incoming[0], target, quantizedTarget, count);
+        if (isReceived && (_stats != nullptr)) {
+            const uint64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(
+                Clock::now() - requestTime).count();
+            _stats->add(StatsChannel::Counter::StreamBytes, incoming[0].size());
+            _stats->set(StatsChannel::Counter::StreamLatencyMicroseconds, latency);
+        }
+        if (!isReceived)
+            LERROR("Could not receive a frame from the stream server");
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _backSize = count;
+            _state = State::Received;
+            _isConnected = isReceived;
+        }
+        _frameReceived.notify_all();
+        if (!isReceived)
+            return;
+    }
+}
@@ -0,0 +1,183 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __STREAMCLIENT_H__
+#define __STREAMCLIENT_H__
+
+#include "callbackrecorder.h"
+#include "positionview.h"
+#include "transport.h"
+
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class PositionCodec;
+class PositionQuantizer;
+class PositionSink;
+class SpatialHash;
+class StatsChannel;
+class ThreadPool;
+struct QuantizedPosition;
+
+// The StreamClient receives the particle positions from a StreamServer, so that a viewer can
+// render a simulation that runs on another machine, and sends the changes made in the viewer
+// back. It takes the place of the SimulationScheduler: while the renderer draws one frame, the
+// next is received on a thread of its own, either into the client's back buffer or into the
+// memory of a PositionSink, where it is decoded as QuantizedPositions if the sink asks for
+// them. The frames are requested at a fixed rate; the latency from each request until the
+// frame is decoded and the number of received bytes are published in a StatsChannel. All
+// public functions are meant to be called from the GUI thread
+class StreamClient {
+public:
+    // Creates a client that decodes the frames with the threads of 'pool', which must not be
+    // used for anything else while the client is connected
+    explicit StreamClient(ThreadPool& pool);
+
+    // Waits for the frame that is being received and disconnects
+    ~StreamClient();
+
+    // Connects to the server at 'address' ("host:port"), retrying for up to 'timeoutSeconds',
+    // and starts the thread that receives the frames. The server is asked for
+    // 'framesPerSecond' frames per second with at most 'maximumBytesPerSecond' bytes per
+    // second, or no limit if it is 0. Returns false if the connection failed
+    bool connect(const std::string& address, float framesPerSecond,
+        uint32_t maximumBytesPerSecond, int timeoutSeconds);
+
+    // Returns the number of particles the simulation of the server has room for. Only valid
+    // after 'connect'
+    size_t capacity() const;
+
+    // Returns the quantization of the server's positions. Only valid after 'connect'
+    const PositionQuantizer& quantizer() const;
+
+    // Sends 'event' to the server together with the next request. The server applies it to
+    // its simulation
+    void send(CallbackRecorder::Event event);
+
+    // Starts receiving the next frame, unless a frame is still being received or has not been
+    // collected yet. Never blocks on the network
+    void requestFrame();
+
+    // Makes the most recently received frame available through positionView(), or hands it to
+    // the PositionSink it was written into. Returns false if no new frame has been received
+    bool collect();
+
+    // Blocks until the frame that is being received, if any, has arrived, and collects it.
+    // Has to be called before a PositionSink that the frame might be written into is destroyed
+    void finish();
+
+    // Returns a view onto the front buffer, whose version changes with every frame that is
+    // collected into it. It stays valid for the lifetime of the client
+    PositionView positionView() const;
+
+    // Lets the following frames be written into the memory provided by 'sink', like
+    // SimulationScheduler::setPositionSink
+    void setPositionSink(PositionSink* sink);
+
+    // Sets the channel that the latency and the received bytes are published in. Must be
+    // called before 'connect'
+    void setStatsChannel(StatsChannel* stats);
+
+private:
+    // The states a frame goes through
+    enum class State {
+        Idle,       // No frame is being received and the last one was collected
+        Receiving,  // The thread is requesting and receiving a frame
+        Received    // The frame has been received, but has not been collected yet
+    };
+
+    StreamClient(const StreamClient&) = delete;
+    StreamClient& operator=(const StreamClient&) = delete;
+
+    // The main function of the thread that receives the frames
+    void run();
+
+    // Decodes the frame in 'message' into 'target' or 'quantizedTarget', whichever is not a
+    // nullptr, and stores the number of positions in 'count'. Returns false if the frame is
+    // malformed
+    bool decodeFrame(const std::vector<char>& message, glm::vec3* target,
+        QuantizedPosition* quantizedTarget, size_t& count);
+
+    // The threads that decode the frames
+    ThreadPool& _pool;
+    // The connection to the server. Only used by the thread once it has started
+    Transport _transport;
+
+    // The grid of the server, its quantization, and the decoder that uses it
+    SpatialHash* _grid;
+    PositionQuantizer* _quantizer;
+    PositionCodec* _codec;
+    // The number of particles the server has room for
+    size_t _capacity;
+    // The rate and bandwidth the server is asked for
+    float _framesPerSecond;
+    uint32_t _maximumBytesPerSecond;
+    // The channel the latency is published in, or nullptr
+    StatsChannel* _stats;
+
+    // The position buffer the renderer reads from, the number of valid positions in it, and
+    // its version. Only changed by the GUI thread in 'collect'
+    glm::vec3* _front;
+    size_t _frontSize;
+    uint64_t _frontVersion;
+    // The buffer the frames are decoded into if there is no sink, and the number of positions
+    // of the last frame
+    glm::vec3* _back;
+    size_t _backSize;
+
+    // The sink that frames are decoded into instead of the back buffer. Only used by the GUI
+    // thread
+    PositionSink* _sink;
+
+    // Guards all of the following members
+    std::mutex _mutex;
+    // Signaled when a frame should be received or the thread should quit
+    std::condition_variable _wakeUp;
+    // Signaled when a frame has been received
+    std::condition_variable _frameReceived;
+    // The state of the current frame
+    State _state;
+    // The memory the current frame is decoded into, either _back or from a sink, or
+    // _quantizedTarget if the sink quantizes the positions
+    glm::vec3* _target;
+    QuantizedPosition* _quantizedTarget;
+    // The sink that provided the memory or a nullptr if the frame is decoded into _back
+    PositionSink* _frameSink;
+    // The events that are sent with the next request
+    std::vector<CallbackRecorder::Event> _events;
+    // False once the connection to the server is lost
+    bool _isConnected;
+    // Set when the thread should terminate
+    bool _quit;
+
+    // The thread that receives the frames
+    std::thread _thread;
+};
+
+#endif // __STREAMCLIENT_H__
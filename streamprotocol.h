@@ -0,0 +1,81 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __STREAMPROTOCOL_H__
+#define __STREAMPROTOCOL_H__
+
+#include <cstdint>
+
+// The messages between a StreamServer and a StreamClient, which talk in the rounds of a
+// Transport. Once connected, the client sends a StreamRequest and receives the StreamInfo.
+// Every frame then takes two rounds: in the first, the client sends a StreamRequest followed
+// by the CallbackRecorder::Events that were triggered in the viewer, and receives an empty
+// message. In the second, it receives a StreamFrameHeader followed by a frame of the
+// PositionCodec and sends an empty message. Splitting the frame off the request lets the server
+// encode the most recent step after it knows that the client is waiting for it. All values are
+// little endian
+
+// The version of the messages. Clients do not accept servers of other versions
+const uint32_t StreamVersion = 1;
+
+// The largest capacity that clients accept from a server, far above what a simulation holds
+const uint32_t MaximumStreamCapacity = 1u << 26;
+
+// Describes the stream to the client
+struct StreamInfo {
+    // The StreamVersion of the server
+    uint32_t version;
+    // The number of particles the simulation of the server has room for
+    uint32_t capacity;
+    // The lower corner of the grid of the server's PositionQuantizer, the edge length of its
+    // cells, and the number of bits of each cell coordinate
+    float minimum[3];
+    float cellSize[3];
+    int32_t resolutionBits;
+    // The number of bits of each offset that the PositionCodec keeps
+    int32_t precisionBits;
+};
+
+// Asks for the next frame
+struct StreamRequest {
+    // The number of frames per second that the client asks for
+    float framesPerSecond;
+    // The number of bytes per second the client can receive, or 0 if there is no limit
+    uint32_t maximumBytesPerSecond;
+    // The number of CallbackRecorder::Events that follow the request
+    uint32_t numberOfEvents;
+};
+
+// Precedes the positions of each frame
+struct StreamFrameHeader {
+    // The number of steps the simulation of the server had done
+    uint64_t step;
+    // The number of particles of the server's simulation; the frame has every 'stride'-th
+    uint32_t numberOfParticles;
+    uint32_t stride;
+    // The microseconds from the request of the frame until it was encoded on the server
+    uint32_t serverMicroseconds;
+    uint32_t padding;
+};
+
+#endif // __STREAMPROTOCOL_H__
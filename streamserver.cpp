@@ -0,0 +1,235 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "streamserver.h"
+
+#include "alignedmemory.h"
+#include "particlestore.h"
+#include "simulation.h"
+
+#include <ghoul/logging/logging>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+    const std::string _loggerCat = "StreamServer";
+
+    // How long the thread waits for a viewer before it checks whether it should quit
+    const int _acceptTimeout = 250;
+
+    // The number of bytes per particle that is assumed before the first frame is encoded
+    const double _initialBytesPerParticle = 4.0;
+}
+
+StreamServer::StreamServer(Simulation& simulation, int precisionBits)
+    : _simulation(simulation)
+    , _codec(simulation.positionQuantizer(), precisionBits)
+    , _quantized(nullptr)
+    , _bytesPerParticle(_initialBytesPerParticle)
+    , _state(State::Idle)
+    , _frameBudget(0)
+    , _quit(false)
+    , _numberOfFrames(0)
+    , _numberOfBytes(0)
+{
+    const PositionQuantizer& quantizer = simulation.positionQuantizer();
+    const size_t capacity = simulation.store().capacity();
+    _info.version = StreamVersion;
+    _info.capacity = static_cast<uint32_t>(capacity);
+    for (int i = 0; i < 3; ++i) {
+        _info.minimum[i] = quantizer.minimum()[i];
+        _info.cellSize[i] = quantizer.cellSize()[i];
+    }
+    _info.resolutionBits = quantizer.resolutionBits();
+    _info.precisionBits = _codec.precisionBits();
+    _quantized = alignedArray<QuantizedPosition>(capacity, ParticleStore::Alignment);
+}
+
+StreamServer::~StreamServer() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _frameEncoded.notify_one();
+    if (_thread.joinable())
+        _thread.join();
+    alignedFree(_quantized);
+}
+
+bool StreamServer::start(const std::string& port) {
+    if (!_transport.listen(port))
+        return false;
+    LINFO("Waiting for viewers on port " << port);
+    _thread = std::thread(&StreamServer::run, this);
+    return true;
+}
+
+void StreamServer::takeEvents(std::vector<CallbackRecorder::Event>& events) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    events.insert(events.end(), _events.begin(), _events.end());
+    _events.clear();
+}
+
+void StreamServer::publish() {
+    size_t budget;
+    std::chrono::steady_clock::time_point requestTime;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_state != State::Requested)
+            return;
+        budget = _frameBudget;
+        requestTime = _requestTime;
+    }
+
+    // Thin out the particles so that the frame fits into the viewer's bandwidth, assuming
+    // that they compress as well as in the previous frame
+    const size_t count = _simulation.store().size();
+    size_t stride = 1;
+    if (budget > 0) {
+        const double bytes = count * _bytesPerParticle;
+        stride = std::max(static_cast<size_t>(std::ceil(bytes / budget)), size_t(1));
+    }
+
+    // The frame is only touched by the thread once it is in the Encoded state
+    _simulation.exportPositions(_quantized, 0.f);
+    _frame.resize(sizeof(StreamFrameHeader));
+    const size_t encoded = _codec.encode(_quantized, count, stride, _simulation.threadPool(),
+        _frame);
+    if (encoded > 0) {
+        const size_t bytes = _frame.size() - sizeof(StreamFrameHeader);
+        _bytesPerParticle = static_cast<double>(bytes) / encoded;
+    }
+
+    StreamFrameHeader header;
+    header.step = _simulation.numberOfSteps();
+    header.numberOfParticles = static_cast<uint32_t>(count);
+    header.stride = static_cast<uint32_t>(stride);
+    header.serverMicroseconds = static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - requestTime).count());
+    header.padding = 0;
+    std::memcpy(_frame.data(), &header, sizeof(header));
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _state = State::Encoded;
+    }
+    _frameEncoded.notify_one();
+}
+
+uint64_t StreamServer::numberOfFrames() const {
+    return _numberOfFrames.load(std::memory_order_relaxed);
+}
+
+uint64_t StreamServer::numberOfBytes() const {
+    return _numberOfBytes.load(std::memory_order_relaxed);
+}
+
+bool StreamServer::readRequest(const std::vector<char>& message) {
+    StreamRequest request = { 0.f, 0, 0 };
+    if (message.size() >= sizeof(request))
+        std::memcpy(&request, message.data(), sizeof(request));
+    const size_t eventBytes = request.numberOfEvents * sizeof(CallbackRecorder::Event);
+    if (message.size() != sizeof(request) + eventBytes) {
+        LERROR("The viewer sent a malformed request");
+        return false;
+    }
+    if (!std::isfinite(request.framesPerSecond) || (request.framesPerSecond < 0.f)) {
+        LERROR("The viewer sent an invalid frame rate");
+        return false;
+    }
+
+    // The events come from the network, so each one is checked before it reaches the
+    // simulation; a viewer that sends a single invalid one is disconnected
+    const char* eventData = message.data() + sizeof(request);
+    for (uint32_t i = 0; i < request.numberOfEvents; ++i) {
+        CallbackRecorder::Event event;
+        std::memcpy(&event, eventData + i * sizeof(event), sizeof(event));
+        if (!CallbackRecorder::isValid(event)) {
+            LERROR("The viewer sent an invalid event");
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    const size_t first = _events.size();
+    _events.resize(first + request.numberOfEvents);
+    if (request.numberOfEvents > 0)
+        std::memcpy(&_events[first], eventData, eventBytes);
+    _frameBudget = 0;
+    if ((request.maximumBytesPerSecond > 0) && (request.framesPerSecond > 0.f)) {
+        // A tiny rate makes the quotient too large for a size_t, so it is clamped before the
+        // conversion. No frame comes close to the upper bound anyway
+        const double budget =
+            static_cast<double>(request.maximumBytesPerSecond) / request.framesPerSecond;
+        const double maximumBudget = std::numeric_limits<uint32_t>::max();
+        _frameBudget = static_cast<size_t>(std::min(std::max(budget, 1.0), maximumBudget));
+    }
+    return true;
+}
+
+void StreamServer::run() {
+    const std::vector<char> empty;
+    std::vector<char> info(sizeof(StreamInfo));
+    std::memcpy(info.data(), &_info, sizeof(_info));
+    std::vector<std::vector<char>> incoming;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_quit)
+                return;
+        }
+        if (!_transport.accept(_acceptTimeout))
+            continue;
+        LINFO("A viewer connected");
+
+        // The viewer learns about the grid before the first frame
+        bool isConnected = _transport.broadcast(info, incoming) && readRequest(incoming[1]);
+        while (isConnected) {
+            isConnected = _transport.broadcast(empty, incoming) && readRequest(incoming[1]);
+            if (!isConnected)
+                break;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _state = State::Requested;
+                _requestTime = std::chrono::steady_clock::now();
+                _frameEncoded.wait(lock, [this]() {
+                    return _quit || (_state == State::Encoded);
+                });
+                if (_quit)
+                    return;
+            }
+
+            isConnected = _transport.broadcast(_frame, incoming);
+            if (isConnected) {
+                _numberOfFrames.fetch_add(1, std::memory_order_relaxed);
+                _numberOfBytes.fetch_add(_frame.size(), std::memory_order_relaxed);
+            }
+            std::lock_guard<std::mutex> lock(_mutex);
+            _state = State::Idle;
+        }
+        LINFO("The viewer disconnected");
+    }
+}
@@ -0,0 +1,134 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __STREAMSERVER_H__
+#define __STREAMSERVER_H__
+
+#include "callbackrecorder.h"
+#include "positioncodec.h"
+#include "streamprotocol.h"
+#include "transport.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Simulation;
+
+// The StreamServer sends the particle positions of a Simulation to a remote viewer, which
+// renders them with a StreamClient, and receives the changes that are made in the viewer. One
+// viewer is served at a time; once it disconnects, the next one can connect. The connection is
+// handled by a thread of its own, but a frame is only encoded when the viewer asks for it, on
+// the thread that steps the simulation. Frames are never queued, so the viewer always receives
+// the most recent step. If the viewer limits its bandwidth, only every n-th particle is sent,
+// with n chosen from the size of the previous frames (see streamprotocol.h and PositionCodec)
+class StreamServer {
+public:
+    // Streams the positions of 'simulation' with 'precisionBits' of each offset within the
+    // cells. The server does not own the simulation
+    StreamServer(Simulation& simulation, int precisionBits);
+
+    // Disconnects the viewer and stops the thread
+    ~StreamServer();
+
+    // Listens on 'port' and starts the thread that waits for viewers. Returns false if the port
+    // could not be opened
+    bool start(const std::string& port);
+
+    // Appends the changes that the viewer requested since the last call to 'events'. They have
+    // to be applied to the simulation before its next step
+    void takeEvents(std::vector<CallbackRecorder::Event>& events);
+
+    // Encodes the current positions of the simulation if the viewer is waiting for a frame.
+    // Has to be called between the steps, on the thread that advances the simulation
+    void publish();
+
+    // Returns the number of frames and the number of bytes that have been sent to viewers
+    uint64_t numberOfFrames() const;
+    uint64_t numberOfBytes() const;
+
+private:
+    // The progress of the next frame
+    enum class State {
+        Idle,       // The viewer has not asked for a frame
+        Requested,  // The viewer waits for the frame to be encoded
+        Encoded     // The frame is encoded and waits to be sent
+    };
+
+    StreamServer(const StreamServer&) = delete;
+    StreamServer& operator=(const StreamServer&) = delete;
+
+    // The main function of the thread that talks to the viewers
+    void run();
+
+    // Reads the StreamRequest in 'message', queues its events, and stores its bandwidth in
+    // _frameBudget. Returns false if the message is malformed
+    bool readRequest(const std::vector<char>& message);
+
+    // The simulation whose positions are sent
+    Simulation& _simulation;
+    // Compresses the positions of a frame
+    PositionCodec _codec;
+    // The description of the stream that every viewer receives first
+    StreamInfo _info;
+    // The connection to the current viewer. Only used by the thread once it has started
+    Transport _transport;
+
+    // The quantized positions of the simulation that are encoded into a frame
+    QuantizedPosition* _quantized;
+    // The average number of bytes per particle of the last frame
+    double _bytesPerParticle;
+
+    // Guards all of the following members
+    std::mutex _mutex;
+    // Signaled when a frame has been encoded or the thread should quit
+    std::condition_variable _frameEncoded;
+    // The progress of the next frame
+    State _state;
+    // The number of bytes the requested frame may have, or 0 if there is no limit
+    size_t _frameBudget;
+    // When the viewer asked for the frame
+    std::chrono::steady_clock::time_point _requestTime;
+    // The StreamFrameHeader and the positions of the frame. Written by 'publish' in the
+    // Requested state and sent by the thread in the Encoded state
+    std::vector<char> _frame;
+    // The changes that the viewer requested
+    std::vector<CallbackRecorder::Event> _events;
+    // Set when the thread should terminate
+    bool _quit;
+
+    // The number of frames and bytes that have been sent
+    std::atomic<uint64_t> _numberOfFrames;
+    std::atomic<uint64_t> _numberOfBytes;
+
+    // The thread that talks to the viewers
+    std::thread _thread;
+};
+
+#endif // __STREAMSERVER_H__
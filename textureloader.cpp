@@ -0,0 +1,113 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "textureloader.h"
+
+#include <ghoul/logging/logging>
+#include <QImage>
+#include <cstring>
+#include <utility>
+
+namespace {
+    const std::string _loggerCat = "TextureLoader";
+}
+
+TextureLoader::TextureLoader(unsigned int numberOfThreads)
+    : _quit(false)
+{
+    if (numberOfThreads == 0)
+        numberOfThreads = 1;
+    // Start the threads last, as they access the members
+    for (unsigned int i = 0; i < numberOfThreads; ++i)
+        _threads.push_back(std::thread(&TextureLoader::run, this));
+}
+
+TextureLoader::~TextureLoader() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+        _jobs.clear();
+    }
+    _wakeUp.notify_all();
+    for (std::thread& thread : _threads)
+        thread.join();
+}
+
+void TextureLoader::load(unsigned int id, const std::string& path) {
+    Job job;
+    job.id = id;
+    job.path = path;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.push_back(std::move(job));
+    }
+    _wakeUp.notify_one();
+}
+
+bool TextureLoader::takeDecoded(Image& image) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_decoded.empty())
+        return false;
+    image = std::move(_decoded.front());
+    _decoded.pop_front();
+    return true;
+}
+
+void TextureLoader::run() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wakeUp.wait(lock, [this]() { return _quit || !_jobs.empty(); });
+            if (_quit)
+                return;
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+        }
+
+        Image image;
+        image.id = job.id;
+        image.path = job.path;
+        image.width = 0;
+        image.height = 0;
+        // QImage is reentrant, so the threads can decode at the same time
+        const QImage decoded =
+            QImage(QString::fromStdString(job.path)).convertToFormat(QImage::Format_ARGB32);
+        if (!decoded.isNull()) {
+            image.width = decoded.width();
+            image.height = decoded.height();
+            const size_t rowSize = static_cast<size_t>(image.width) * 4;
+            image.pixels.resize(rowSize * image.height);
+            // The rows of a QImage might be padded
+            for (int row = 0; row < image.height; ++row) {
+                std::memcpy(image.pixels.data() + row * rowSize, decoded.constScanLine(row),
+                    rowSize);
+            }
+        }
+        else
+            LERROR("Could not decode the image '" << job.path << "'");
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _decoded.push_back(std::move(image));
+    }
+}
@@ -0,0 +1,95 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __TEXTURELOADER_H__
+#define __TEXTURELOADER_H__
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The TextureLoader decodes image files on worker threads, so that the renderer does not wait
+// for the decoding before it can draw the first frame. It does not touch OpenGL; the decoded
+// images are taken by the thread with the OpenGL context, which uploads them. The images are
+// decoded in the order in which they are requested, but several at the same time
+class TextureLoader {
+public:
+    // A decoded image
+    struct Image {
+        // The identifier that was passed to 'load'
+        unsigned int id;
+        // The file that was decoded
+        std::string path;
+        // The size in pixels
+        int width;
+        int height;
+        // width * height pixels as 32 bit ARGB words, which OpenGL reads as GL_BGRA with
+        // GL_UNSIGNED_INT_8_8_8_8_REV, top row first. Empty if the file could not be decoded
+        std::vector<char> pixels;
+    };
+
+    // Starts 'numberOfThreads' decoding threads
+    explicit TextureLoader(unsigned int numberOfThreads);
+
+    // Stops the threads; the images that have not been decoded yet are dropped
+    ~TextureLoader();
+
+    // Queues the file at 'path' to be decoded; the result is identified by 'id'
+    void load(unsigned int id, const std::string& path);
+
+    // Moves one of the images that have been decoded since the last call into 'image'. Returns
+    // false if no decoded image is waiting
+    bool takeDecoded(Image& image);
+
+private:
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    // A file that is waiting to be decoded
+    struct Job {
+        unsigned int id;
+        std::string path;
+    };
+
+    // The main function of each decoding thread
+    void run();
+
+    // Guards all of the following members
+    std::mutex _mutex;
+    // Signaled when a file has been queued or the threads should quit
+    std::condition_variable _wakeUp;
+    // The files that have not been taken by a thread yet
+    std::deque<Job> _jobs;
+    // The images that have been decoded but not taken yet
+    std::deque<Image> _decoded;
+    // Set when the threads should terminate
+    bool _quit;
+
+    // The threads that decode the images
+    std::vector<std::thread> _threads;
+};
+
+#endif // __TEXTURELOADER_H__
@@ -0,0 +1,174 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "threadpool.h"
+
+#include <algorithm>
+
+namespace {
+    // The number of jobs each queue has room for from the start, which covers the loops over
+    // the maximum number of particles without having to grow
+    const size_t _initialQueueCapacity = 256;
+}
+
+ThreadPool::ThreadPool(unsigned int numberOfWorkers)
+    : _numberOfQueuedJobs(0)
+    , _quit(false)
+{
+    for (unsigned int i = 0; i < numberOfWorkers + 1; ++i) {
+        Queue* queue = new Queue;
+        queue->jobs.resize(_initialQueueCapacity);
+        queue->front = 0;
+        queue->back = 0;
+        _queues.push_back(std::unique_ptr<Queue>(queue));
+    }
+
+    for (unsigned int i = 0; i < numberOfWorkers; ++i)
+        _workers.push_back(std::thread(&ThreadPool::work, this, i));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _quit = true;
+    }
+    _jobsAvailable.notify_all();
+    for (std::thread& worker : _workers)
+        worker.join();
+}
+
+unsigned int ThreadPool::defaultNumberOfWorkers() {
+    // hardware_concurrency is allowed to return 0 if it cannot determine the number
+    const unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    return (hardwareThreads > 1) ? hardwareThreads - 1 : 0;
+}
+
+unsigned int ThreadPool::numberOfThreads() const {
+    return static_cast<unsigned int>(_workers.size()) + 1;
+}
+
+void ThreadPool::run(size_t begin, size_t end, size_t grainSize, Invoker invoker,
+    const void* function)
+{
+    if (begin >= end)
+        return;
+    grainSize = std::max<size_t>(grainSize, 1);
+    const size_t numberOfChunks = (end - begin + grainSize - 1) / grainSize;
+
+    // There is nothing to gain from the other threads with just one chunk or no workers
+    if ((numberOfChunks == 1) || _workers.empty()) {
+        for (size_t b = begin; b < end; b += grainSize)
+            invoker(function, b, std::min(b + grainSize, end));
+        return;
+    }
+
+    std::lock_guard<std::mutex> loopLock(_loopMutex);
+    std::atomic<size_t> remaining(numberOfChunks);
+
+    // Deal the chunks out to all queues in turn; consecutive chunks end up in different queues
+    // so that the initial distribution is balanced and stealing is only needed to even out
+    // differences in the cost of the chunks
+    const size_t numberOfQueues = _queues.size();
+    const size_t jobsPerQueue = (numberOfChunks + numberOfQueues - 1) / numberOfQueues;
+    _numberOfQueuedJobs += numberOfChunks;
+    for (size_t q = 0; q < numberOfQueues; ++q) {
+        Queue& queue = *_queues[q];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        // Only loops with more chunks than all previous ones make the queues grow
+        if (queue.jobs.size() < jobsPerQueue)
+            queue.jobs.resize(jobsPerQueue);
+        queue.front = 0;
+        queue.back = 0;
+        for (size_t i = q; i < numberOfChunks; i += numberOfQueues) {
+            const size_t b = begin + i * grainSize;
+            const Job job = { invoker, function, b, std::min(b + grainSize, end), &remaining };
+            queue.jobs[queue.back++] = job;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _jobsAvailable.notify_all();
+    }
+
+    // The calling thread uses the last queue and helps until all chunks have been taken
+    const size_t ownQueue = _queues.size() - 1;
+    Job job;
+    while (remaining > 0) {
+        if (takeJob(ownQueue, job))
+            execute(job);
+        else {
+            // All jobs have been taken, so wait for the other threads to finish theirs
+            std::unique_lock<std::mutex> lock(_sleepMutex);
+            _loopFinished.wait(lock, [&remaining]() { return remaining == 0; });
+        }
+    }
+}
+
+bool ThreadPool::takeJob(size_t index, Job& job) {
+    // Our own queue first, from the front
+    {
+        Queue& queue = *_queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.front < queue.back) {
+            job = queue.jobs[queue.front++];
+            --_numberOfQueuedJobs;
+            return true;
+        }
+    }
+
+    // Then try to steal from the back of the other queues
+    for (size_t i = 1; i < _queues.size(); ++i) {
+        Queue& queue = *_queues[(index + i) % _queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.front < queue.back) {
+            job = queue.jobs[--queue.back];
+            --_numberOfQueuedJobs;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::execute(const Job& job) {
+    job.invoker(job.function, job.begin, job.end);
+
+    if (--(*job.remaining) == 0) {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _loopFinished.notify_all();
+    }
+}
+
+void ThreadPool::work(size_t index) {
+    Job job;
+    while (true) {
+        if (takeJob(index, job)) {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _jobsAvailable.wait(lock, [this]() { return _quit || (_numberOfQueuedJobs > 0); });
+        if (_quit)
+            return;
+    }
+}
@@ -0,0 +1,135 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A pool of worker threads that executes data-parallel loops. Every worker has its own queue of
+// jobs; it takes jobs from the front of its own queue and, once that is empty, steals jobs from
+// the back of the other queues. This keeps all cores busy even if the chunks of a loop have very
+// different costs. The thread calling 'parallelFor' takes part in the work as well. Once the
+// queues have grown to the largest loop, running a loop does not allocate any memory
+class ThreadPool {
+public:
+    // Creates a pool with 'numberOfWorkers' additional threads. If 0 is passed, all work will be
+    // done on the calling thread
+    explicit ThreadPool(unsigned int numberOfWorkers = defaultNumberOfWorkers());
+
+    // Stops and joins all worker threads
+    ~ThreadPool();
+
+    // Returns one less than the number of hardware threads, as the caller is working too
+    static unsigned int defaultNumberOfWorkers();
+
+    // Returns the number of threads that work on a loop, including the calling thread
+    unsigned int numberOfThreads() const;
+
+    // Splits [begin, end) into chunks of 'grainSize' elements (the last might be smaller) and calls
+    // 'function(chunkBegin, chunkEnd)' for each of them on any of the threads. Returns after all
+    // chunks are done. Only one thread at a time may call this function and it must not be called
+    // from inside 'function'. The function is only referenced, never copied
+    template <typename Function>
+    void parallelFor(size_t begin, size_t end, size_t grainSize, const Function& function);
+
+private:
+    // Calls the function object of type 'Function' that 'function' points to
+    typedef void (*Invoker)(const void* function, size_t begin, size_t end);
+    template <typename Function>
+    static void invoke(const void* function, size_t begin, size_t end);
+
+    // The type-erased implementation of 'parallelFor'
+    void run(size_t begin, size_t end, size_t grainSize, Invoker invoker, const void* function);
+
+    // A single chunk of a parallel loop
+    struct Job {
+        Invoker invoker;
+        const void* function;
+        size_t begin;
+        size_t end;
+        // The number of chunks of the loop that have not finished yet
+        std::atomic<size_t>* remaining;
+    };
+
+    // The job queue of a single thread. A loop only starts once the previous one has finished,
+    // so the queues are empty at that point and can be refilled from the start. The jobs in
+    // [front, back) have not been taken yet
+    struct Queue {
+        std::mutex mutex;
+        std::vector<Job> jobs;
+        size_t front;
+        size_t back;
+    };
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Takes a job from the queue 'index' or steals one from any other queue. Returns false if
+    // there was no job in any of the queues
+    bool takeJob(size_t index, Job& job);
+
+    // Executes 'job' and signals the waiting caller if it was the last one of its loop
+    void execute(const Job& job);
+
+    // The main function of the worker with the queue 'index'
+    void work(size_t index);
+
+    // The worker threads
+    std::vector<std::thread> _workers;
+    // One queue per worker and, at the end, one for the calling thread
+    std::vector<std::unique_ptr<Queue>> _queues;
+
+    // The number of jobs that are in any of the queues
+    std::atomic<size_t> _numberOfQueuedJobs;
+    // Guards the sleeping of the workers and the caller
+    std::mutex _sleepMutex;
+    // Signaled when new jobs are available or the pool is shutting down
+    std::condition_variable _jobsAvailable;
+    // Signaled when the last job of a loop has finished
+    std::condition_variable _loopFinished;
+    // Serializes calls to parallelFor
+    std::mutex _loopMutex;
+    // Set when the workers should terminate
+    bool _quit;
+};
+
+template <typename Function>
+void ThreadPool::parallelFor(size_t begin, size_t end, size_t grainSize,
+    const Function& function)
+{
+    run(begin, end, grainSize, &ThreadPool::invoke<Function>, &function);
+}
+
+template <typename Function>
+void ThreadPool::invoke(const void* function, size_t begin, size_t end) {
+    (*static_cast<const Function*>(function))(begin, end);
+}
+
+#endif // __THREADPOOL_H__
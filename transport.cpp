@@ -0,0 +1,523 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "transport.h"
+
+#include <ghoul/logging/logging>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    const std::string _loggerCat = "Transport";
+
+    const intptr_t _invalidSocket = -1;
+
+#ifdef _WIN32
+    typedef SOCKET NativeSocket;
+    typedef WSAPOLLFD PollDescriptor;
+    const int _sendFlags = 0;
+
+    NativeSocket native(intptr_t s) {
+        return (s == _invalidSocket) ? INVALID_SOCKET : static_cast<NativeSocket>(s);
+    }
+
+    intptr_t wrap(NativeSocket s) {
+        return (s == INVALID_SOCKET) ? _invalidSocket : static_cast<intptr_t>(s);
+    }
+
+    bool wouldBlock() {
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+    }
+
+    int pollSockets(PollDescriptor* descriptors, size_t count, int timeout) {
+        return WSAPoll(descriptors, static_cast<ULONG>(count), timeout);
+    }
+#else
+    typedef int NativeSocket;
+    typedef pollfd PollDescriptor;
+    // A peer that disconnects should be reported as an error instead of killing the process
+#ifdef MSG_NOSIGNAL
+    const int _sendFlags = MSG_NOSIGNAL;
+#else
+    const int _sendFlags = 0;
+#endif
+
+    NativeSocket native(intptr_t s) {
+        return static_cast<NativeSocket>(s);
+    }
+
+    intptr_t wrap(NativeSocket s) {
+        return (s < 0) ? _invalidSocket : static_cast<intptr_t>(s);
+    }
+
+    bool wouldBlock() {
+        return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+    }
+
+    int pollSockets(PollDescriptor* descriptors, size_t count, int timeout) {
+        return ::poll(descriptors, static_cast<nfds_t>(count), timeout);
+    }
+#endif
+
+    // Initializes the socket library once per process, which only Windows needs
+    bool initializeSockets() {
+#ifdef _WIN32
+        static bool initialized = false;
+        if (!initialized) {
+            WSADATA data;
+            initialized = (WSAStartup(MAKEWORD(2, 2), &data) == 0);
+        }
+        return initialized;
+#else
+        return true;
+#endif
+    }
+
+    void closeSocket(intptr_t s) {
+        if (s == _invalidSocket)
+            return;
+#ifdef _WIN32
+        closesocket(native(s));
+#else
+        ::close(native(s));
+#endif
+    }
+
+    // Switches 's' to nonblocking mode and disables Nagle's algorithm, as every message is
+    // sent completely and should leave right away
+    bool configureSocket(intptr_t s) {
+        int noDelay = 1;
+        setsockopt(native(s), IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay),
+            sizeof(noDelay));
+#ifdef SO_NOSIGPIPE
+        int noSignal = 1;
+        setsockopt(native(s), SOL_SOCKET, SO_NOSIGPIPE, &noSignal, sizeof(noSignal));
+#endif
+#ifdef _WIN32
+        u_long nonblocking = 1;
+        return ioctlsocket(native(s), FIONBIO, &nonblocking) == 0;
+#else
+        const int flags = fcntl(native(s), F_GETFL, 0);
+        return (flags != -1) && (fcntl(native(s), F_SETFL, flags | O_NONBLOCK) != -1);
+#endif
+    }
+
+    // Splits "host:port" into its parts. Returns false if there is no port
+    bool splitAddress(const std::string& address, std::string& host, std::string& port) {
+        const std::string::size_type colon = address.rfind(':');
+        if ((colon == std::string::npos) || (colon + 1 == address.size()))
+            return false;
+        host = address.substr(0, colon);
+        port = address.substr(colon + 1);
+        return true;
+    }
+
+    // Opens a socket that listens on 'port' of all interfaces
+    intptr_t listenOn(const std::string& port) {
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* info = nullptr;
+        if (getaddrinfo(nullptr, port.c_str(), &hints, &info) != 0)
+            return _invalidSocket;
+
+        intptr_t s = wrap(socket(info->ai_family, info->ai_socktype, info->ai_protocol));
+        if (s != _invalidSocket) {
+            int reuse = 1;
+            setsockopt(native(s), SOL_SOCKET, SO_REUSEADDR,
+                reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+            if ((bind(native(s), info->ai_addr, static_cast<int>(info->ai_addrlen)) != 0) ||
+                (listen(native(s), SOMAXCONN) != 0))
+            {
+                closeSocket(s);
+                s = _invalidSocket;
+            }
+        }
+        freeaddrinfo(info);
+        return s;
+    }
+
+    // Connects to 'host' and 'port', retrying until 'deadline'
+    intptr_t connectTo(const std::string& host, const std::string& port,
+        std::chrono::steady_clock::time_point deadline)
+    {
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        do {
+            addrinfo* info = nullptr;
+            if (getaddrinfo(host.c_str(), port.c_str(), &hints, &info) == 0) {
+                const intptr_t s = wrap(socket(info->ai_family, info->ai_socktype,
+                    info->ai_protocol));
+                const bool connected = (s != _invalidSocket) &&
+                    (::connect(native(s), info->ai_addr,
+                        static_cast<int>(info->ai_addrlen)) == 0);
+                freeaddrinfo(info);
+                if (connected)
+                    return s;
+                closeSocket(s);
+            }
+            // The other rank is probably not listening yet
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        } while (std::chrono::steady_clock::now() < deadline);
+        return _invalidSocket;
+    }
+
+    // Sends or receives exactly 'size' bytes on the blocking socket 's'
+    bool sendAll(intptr_t s, const void* data, size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            const int sent = static_cast<int>(send(native(s), bytes, static_cast<int>(size),
+                _sendFlags));
+            if (sent <= 0)
+                return false;
+            bytes += sent;
+            size -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    bool receiveAll(intptr_t s, void* data, size_t size) {
+        char* bytes = static_cast<char*>(data);
+        while (size > 0) {
+            const int received = static_cast<int>(recv(native(s), bytes,
+                static_cast<int>(size), 0));
+            if (received <= 0)
+                return false;
+            bytes += received;
+            size -= static_cast<size_t>(received);
+        }
+        return true;
+    }
+
+    // The largest number of bytes handed to a single send or recv call
+    const size_t _maximumTransfer = 1 << 30;
+    // The largest number of ranks a round can handle
+    const size_t _maximumRanks = 256;
+
+    // The progress of the message to and from one rank during a round
+    struct Peer {
+        // The length of the outgoing message, sent in front of it
+        uint64_t sendLength;
+        // The bytes of the length and the outgoing message that have been sent
+        size_t sent;
+        // The length of the incoming message, once it has been received
+        uint64_t receiveLength;
+        // The bytes of the length and the incoming message that have been received
+        size_t received;
+    };
+}
+
+Transport::Transport()
+    : _rank(0)
+    , _listener(_invalidSocket)
+{}
+
+Transport::~Transport() {
+    close();
+}
+
+void Transport::close() {
+    disconnect();
+    closeSocket(_listener);
+    _listener = _invalidSocket;
+}
+
+void Transport::disconnect() {
+    for (intptr_t s : _sockets)
+        closeSocket(s);
+    _sockets.clear();
+}
+
+bool Transport::connect(size_t rank, const std::vector<std::string>& addresses,
+    int timeoutSeconds)
+{
+    close();
+    if (rank >= addresses.size()) {
+        LERROR("Rank " << rank << " has no address among the " << addresses.size() << " ranks");
+        return false;
+    }
+    if (!initializeSockets()) {
+        LERROR("Could not initialize the sockets");
+        return false;
+    }
+    _rank = rank;
+    _sockets.assign(addresses.size(), _invalidSocket);
+
+    // Listen before connecting, so that the higher ranks can queue their connections while
+    // this rank is still connecting to the lower ones
+    std::string host;
+    std::string port;
+    if (rank + 1 < addresses.size()) {
+        if (!splitAddress(addresses[rank], host, port)) {
+            LERROR("The address '" << addresses[rank] << "' has no port");
+            return false;
+        }
+        _listener = listenOn(port);
+        if (_listener == _invalidSocket) {
+            LERROR("Could not listen on port " << port);
+            return false;
+        }
+    }
+
+    // Introduce this rank to each lower rank, as the accepting side does not know which of
+    // the higher ranks connected
+    const std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(timeoutSeconds);
+    for (size_t r = 0; r < rank; ++r) {
+        if (!splitAddress(addresses[r], host, port)) {
+            LERROR("The address '" << addresses[r] << "' has no port");
+            return false;
+        }
+        _sockets[r] = connectTo(host, port, deadline);
+        const uint32_t ownRank = static_cast<uint32_t>(rank);
+        if ((_sockets[r] == _invalidSocket) || !sendAll(_sockets[r], &ownRank, sizeof(ownRank))) {
+            LERROR("Could not connect to rank " << r << " at " << addresses[r]);
+            return false;
+        }
+    }
+
+    for (size_t i = rank + 1; i < addresses.size(); ++i) {
+        const intptr_t s = wrap(::accept(native(_listener), nullptr, nullptr));
+        uint32_t peerRank = 0;
+        if ((s == _invalidSocket) || !receiveAll(s, &peerRank, sizeof(peerRank)) ||
+            (peerRank <= rank) || (peerRank >= addresses.size()) ||
+            (_sockets[peerRank] != _invalidSocket))
+        {
+            LERROR("Could not accept the connection of a higher rank");
+            closeSocket(s);
+            return false;
+        }
+        _sockets[peerRank] = s;
+    }
+    closeSocket(_listener);
+    _listener = _invalidSocket;
+
+    for (size_t r = 0; r < _sockets.size(); ++r) {
+        if ((r != rank) && !configureSocket(_sockets[r])) {
+            LERROR("Could not configure the connection to rank " << r);
+            return false;
+        }
+    }
+    LINFO("Connected rank " << rank << " to " << addresses.size() - 1 << " other ranks");
+    return true;
+}
+
+bool Transport::listen(const std::string& port) {
+    close();
+    if (!initializeSockets()) {
+        LERROR("Could not initialize the sockets");
+        return false;
+    }
+    _listener = listenOn(port);
+    if (_listener == _invalidSocket) {
+        LERROR("Could not listen on port " << port);
+        return false;
+    }
+    return true;
+}
+
+bool Transport::accept(int timeoutMilliseconds) {
+    disconnect();
+    if (_listener == _invalidSocket)
+        return false;
+
+    PollDescriptor descriptor;
+    descriptor.fd = native(_listener);
+    descriptor.events = POLLIN;
+    descriptor.revents = 0;
+    if (pollSockets(&descriptor, 1, timeoutMilliseconds) <= 0)
+        return false;
+
+    // The peer introduces itself like the higher ranks in 'connect'
+    const intptr_t s = wrap(::accept(native(_listener), nullptr, nullptr));
+    uint32_t peerRank = 0;
+    if ((s == _invalidSocket) || !receiveAll(s, &peerRank, sizeof(peerRank)) ||
+        (peerRank != 1) || !configureSocket(s))
+    {
+        closeSocket(s);
+        return false;
+    }
+    _rank = 0;
+    _sockets.assign(2, _invalidSocket);
+    _sockets[1] = s;
+    return true;
+}
+
+size_t Transport::rank() const {
+    return _rank;
+}
+
+size_t Transport::numberOfRanks() const {
+    // An unconnected transport is a single rank on its own
+    return _sockets.empty() ? 1 : _sockets.size();
+}
+
+bool Transport::exchange(const std::vector<std::vector<char>>& outgoing,
+    std::vector<std::vector<char>>& incoming)
+{
+    return round([&outgoing](size_t r) -> const std::vector<char>& { return outgoing[r]; },
+        incoming);
+}
+
+bool Transport::broadcast(const std::vector<char>& message,
+    std::vector<std::vector<char>>& incoming)
+{
+    return round([&message](size_t) -> const std::vector<char>& { return message; }, incoming);
+}
+
+template <typename Outgoing>
+bool Transport::round(Outgoing outgoing, std::vector<std::vector<char>>& incoming) {
+    const size_t ranks = numberOfRanks();
+    incoming.resize(ranks);
+    incoming[_rank].clear();
+    if (ranks == 1)
+        return true;
+
+    // The state of the round lives on the stack, so that a round does not allocate
+    if (ranks > _maximumRanks) {
+        LERROR("At most " << _maximumRanks << " ranks are supported");
+        return false;
+    }
+    Peer peers[_maximumRanks];
+    PollDescriptor descriptors[_maximumRanks];
+    size_t descriptorRanks[_maximumRanks];
+    for (size_t r = 0; r < ranks; ++r) {
+        peers[r].sendLength = outgoing(r).size();
+        peers[r].sent = 0;
+        peers[r].receiveLength = 0;
+        peers[r].received = 0;
+    }
+
+    const size_t header = sizeof(uint64_t);
+    size_t pending = 2 * (ranks - 1);
+    while (pending > 0) {
+        size_t count = 0;
+        for (size_t r = 0; r < ranks; ++r) {
+            if (r == _rank)
+                continue;
+            const Peer& peer = peers[r];
+            const bool sending = peer.sent < header + peer.sendLength;
+            const bool receiving = (peer.received < header) ||
+                (peer.received < header + peer.receiveLength);
+            if (!sending && !receiving)
+                continue;
+            descriptors[count].fd = native(_sockets[r]);
+            descriptors[count].events = static_cast<short>((sending ? POLLOUT : 0) |
+                (receiving ? POLLIN : 0));
+            descriptors[count].revents = 0;
+            descriptorRanks[count] = r;
+            ++count;
+        }
+        if (pollSockets(descriptors, count, -1) < 0) {
+            if (wouldBlock())
+                continue;
+            LERROR("Waiting for the other ranks failed");
+            return false;
+        }
+
+        for (size_t d = 0; d < count; ++d) {
+            const size_t r = descriptorRanks[d];
+            Peer& peer = peers[r];
+            const intptr_t s = _sockets[r];
+            const short events = descriptors[d].revents;
+
+            if (events & POLLOUT) {
+                // The length goes first, then the message itself
+                const char* data;
+                size_t left;
+                if (peer.sent < header) {
+                    data = reinterpret_cast<const char*>(&peer.sendLength) + peer.sent;
+                    left = header - peer.sent;
+                }
+                else {
+                    data = outgoing(r).data() + (peer.sent - header);
+                    left = header + peer.sendLength - peer.sent;
+                }
+                const int sent = static_cast<int>(send(native(s), data,
+                    static_cast<int>(std::min(left, _maximumTransfer)), _sendFlags));
+                if ((sent < 0) && !wouldBlock()) {
+                    LERROR("Sending to rank " << r << " failed");
+                    return false;
+                }
+                if (sent > 0) {
+                    peer.sent += static_cast<size_t>(sent);
+                    if (peer.sent == header + peer.sendLength)
+                        --pending;
+                }
+            }
+
+            if (events & (POLLIN | POLLERR | POLLHUP)) {
+                char* data;
+                size_t left;
+                if (peer.received < header) {
+                    data = reinterpret_cast<char*>(&peer.receiveLength) + peer.received;
+                    left = header - peer.received;
+                }
+                else {
+                    data = incoming[r].data() + (peer.received - header);
+                    left = header + peer.receiveLength - peer.received;
+                }
+                const int received = static_cast<int>(recv(native(s), data,
+                    static_cast<int>(std::min(left, _maximumTransfer)), 0));
+                if ((received == 0) || ((received < 0) && !wouldBlock())) {
+                    LERROR("Rank " << r << " disconnected");
+                    return false;
+                }
+                if (received > 0) {
+                    const bool hadLength = peer.received >= header;
+                    peer.received += static_cast<size_t>(received);
+                    if (!hadLength && (peer.received == header))
+                        incoming[r].resize(static_cast<size_t>(peer.receiveLength));
+                    if ((peer.received >= header) &&
+                        (peer.received == header + peer.receiveLength))
+                    {
+                        --pending;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,104 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __TRANSPORT_H__
+#define __TRANSPORT_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The Transport connects the ranks of a distributed simulation with plain TCP sockets. Every
+// rank has a direct connection to every other rank, and all communication happens in rounds in
+// which each rank sends a single message to each other rank and receives one from each of
+// them. The sends and receives of a round are interleaved on nonblocking sockets, so large
+// messages cannot deadlock on full socket buffers. Messages are framed by their length, so
+// they can have any size, including 0. All functions have to be called from the same thread
+class Transport {
+public:
+    // Creates a transport that is not connected yet
+    Transport();
+
+    // Closes all connections
+    ~Transport();
+
+    // Connects this process as rank 'rank' to all other ranks. 'addresses' holds the
+    // "host:port" of each rank, and this rank listens on the port of its own address. The
+    // lower ranks are connected to, retrying for up to 'timeoutSeconds' until they are
+    // listening, and the connections of the higher ranks are accepted. Returns false if any
+    // connection could not be established
+    bool connect(size_t rank, const std::vector<std::string>& addresses, int timeoutSeconds);
+
+    // Listens on 'port' for a single peer, like a viewer that connects to a server, so that
+    // this process becomes rank 0 of two once 'accept' succeeds. The peer connects with
+    // 'connect' as rank 1 and an address list that starts with the address of this process.
+    // Returns false if the port could not be opened
+    bool listen(const std::string& port);
+
+    // Waits up to 'timeoutMilliseconds' for the peer of 'listen' to connect and replaces the
+    // previous peer, if there was one. Returns false, without logging, if nobody connected in
+    // time, and also if the connection failed
+    bool accept(int timeoutMilliseconds);
+
+    // Returns the rank of this process
+    size_t rank() const;
+    // Returns the number of ranks, including this one
+    size_t numberOfRanks() const;
+
+    // Sends 'outgoing[r]' to every other rank r and replaces 'incoming[r]' with the message
+    // that rank r sent to this one. Both need one entry per rank; the entries of this rank
+    // are ignored and cleared. The capacity of 'incoming' is reused, so a round does not
+    // allocate once the messages have reached their size. Blocks until the round is
+    // complete and returns false if a connection failed
+    bool exchange(const std::vector<std::vector<char>>& outgoing,
+        std::vector<std::vector<char>>& incoming);
+
+    // Sends the same 'message' to every other rank and receives one message from each into
+    // 'incoming', like 'exchange'
+    bool broadcast(const std::vector<char>& message, std::vector<std::vector<char>>& incoming);
+
+private:
+    Transport(const Transport&) = delete;
+    Transport& operator=(const Transport&) = delete;
+
+    // Closes all sockets
+    void close();
+
+    // Closes the connections to the other ranks, but not the listening socket
+    void disconnect();
+
+    // Runs one round with 'outgoing(r)' being the message for rank r
+    template <typename Outgoing>
+    bool round(Outgoing outgoing, std::vector<std::vector<char>>& incoming);
+
+    // The rank of this process
+    size_t _rank;
+    // The native socket connected to each rank, or -1 for this rank
+    std::vector<intptr_t> _sockets;
+    // The socket this rank listens on while it is connecting or, after 'listen', until it is
+    // destroyed
+    intptr_t _listener;
+};
+
+#endif // __TRANSPORT_H__
@@ -0,0 +1,189 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "weightedblending.h"
+
+#include <ghoul/filesystem/filesystem>
+#include <ghoul/logging/logging>
+
+using namespace ghoul::opengl;
+
+namespace {
+    const std::string _loggerCat = "WeightedBlending";
+}
+
+WeightedBlending::WeightedBlending()
+    : _compositeProgram(nullptr)
+    , _compositeVAO(0)
+    , _framebuffer(0)
+    , _accumulationTexture(0)
+    , _revealageTexture(0)
+    , _depthTexture(0)
+    , _width(0)
+    , _height(0)
+    , _previousFramebuffer(0)
+{}
+
+WeightedBlending::~WeightedBlending() {
+    releaseTargets();
+    glDeleteVertexArrays(1, &_compositeVAO);
+    delete _compositeProgram;
+}
+
+bool WeightedBlending::initialize() {
+    // Errors that occur during compiling or linking will be written to the Logmanager by the
+    // ProgramObject and ShaderObject
+    _compositeProgram = new ProgramObject("WeightedBlendingComposite");
+    _compositeProgram->attachObject(new ShaderObject(ShaderObject::ShaderTypeVertex,
+        FileSys.absolutePath("${ASSETS}/oitcomposite.vert")));
+    _compositeProgram->attachObject(new ShaderObject(ShaderObject::ShaderTypeFragment,
+        FileSys.absolutePath("${ASSETS}/oitcomposite.frag")));
+    _compositeProgram->bindFragDataLocation("fragColor", 0);
+    if (!_compositeProgram->compileShaderObjects() || !_compositeProgram->linkProgramObject()) {
+        delete _compositeProgram;
+        _compositeProgram = nullptr;
+        return false;
+    }
+
+    // The accumulation textures are bound to fixed units while compositing
+    _compositeProgram->activate();
+    _compositeProgram->setUniform("_accumulation", 0);
+    _compositeProgram->setUniform("_revealage", 1);
+    _compositeProgram->deactivate();
+
+    glGenVertexArrays(1, &_compositeVAO);
+    return true;
+}
+
+void WeightedBlending::releaseTargets() {
+    glDeleteFramebuffers(1, &_framebuffer);
+    glDeleteTextures(1, &_accumulationTexture);
+    glDeleteTextures(1, &_revealageTexture);
+    glDeleteTextures(1, &_depthTexture);
+    _framebuffer = 0;
+    _accumulationTexture = 0;
+    _revealageTexture = 0;
+    _depthTexture = 0;
+}
+
+void WeightedBlending::resize(int width, int height) {
+    releaseTargets();
+    _width = width;
+    _height = height;
+    if ((width <= 0) || (height <= 0))
+        return;
+
+    // The sums need more range and precision than 8 bits, the revealage doesn't
+    const struct {
+        GLuint* texture;
+        GLint internalFormat;
+        GLenum format;
+        GLenum type;
+    } targets[] = {
+        { &_accumulationTexture, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT },
+        { &_revealageTexture, GL_R8, GL_RED, GL_UNSIGNED_BYTE },
+        { &_depthTexture, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT }
+    };
+    for (const auto& target : targets) {
+        glGenTextures(1, target.texture);
+        glBindTexture(GL_TEXTURE_2D, *target.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, target.internalFormat, width, height, 0, target.format,
+            target.type, nullptr);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGenFramebuffers(1, &_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+        _accumulationTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+        _revealageTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, _depthTexture, 0);
+    const GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, buffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        LERROR("The accumulation framebuffer is incomplete");
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+        releaseTargets();
+        return;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+}
+
+void WeightedBlending::begin() {
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &_previousFramebuffer);
+    if (_framebuffer == 0)
+        return;
+
+    // Copy the depth of the opaque geometry. Unlike glBlitFramebuffer, glCopyTexSubImage2D
+    // converts between depth formats, so it works with whatever the window's format is
+    glBindTexture(GL_TEXTURE_2D, _depthTexture);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, _width, _height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    const GLfloat zero[] = { 0.f, 0.f, 0.f, 0.f };
+    const GLfloat one[] = { 1.f, 1.f, 1.f, 1.f };
+    glClearBufferfv(GL_COLOR, 0, zero);
+    glClearBufferfv(GL_COLOR, 1, one);
+
+    // The fragments are tested against the opaque depth, but don't hide each other
+    glDepthMask(GL_FALSE);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+}
+
+void WeightedBlending::end() {
+    glBindFramebuffer(GL_FRAMEBUFFER, _previousFramebuffer);
+    glDepthMask(GL_TRUE);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void WeightedBlending::composite() {
+    if ((_framebuffer == 0) || (_compositeProgram == nullptr))
+        return;
+
+    // The fullscreen triangle must neither be hidden by nor write the depth
+    glDisable(GL_DEPTH_TEST);
+    _compositeProgram->activate();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _accumulationTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, _revealageTexture);
+
+    // The shader outputs the average color with an alpha of (1 - revealage), which the
+    // default blend function composites correctly
+    glBindVertexArray(_compositeVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    _compositeProgram->deactivate();
+    glEnable(GL_DEPTH_TEST);
+}
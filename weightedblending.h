@@ -0,0 +1,92 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __WEIGHTEDBLENDING_H__
+#define __WEIGHTEDBLENDING_H__
+
+// Need to include opengl first, as the other headers might include gl, but not glew
+#include <ghoul/opengl/opengl>
+
+// The WeightedBlending implements weighted blended order-independent transparency (McGuire
+// and Bavoil, 2013). Between 'begin' and 'end', the translucent geometry is rendered into an
+// offscreen accumulation target: the first color output of the fragment shader is the
+// premultiplied color times a depth-based weight, which is summed, and the second is the
+// alpha, whose complements are multiplied into the revealage. 'composite' then blends the
+// weighted average color over the current framebuffer. The result does not depend on the
+// order of the fragments, so the particles don't have to be sorted. The depth of the opaque
+// geometry is copied from the current framebuffer, so the particles are still hidden by it.
+// All functions have to be called with the OpenGL context current
+class WeightedBlending {
+public:
+    // Creates an object without any OpenGL objects; 'initialize' has to be called before it
+    // can be used
+    WeightedBlending();
+
+    // Deletes all OpenGL objects
+    ~WeightedBlending();
+
+    // Compiles the compositing program. Returns false if that failed
+    bool initialize();
+
+    // Recreates the offscreen targets for a framebuffer of 'width' x 'height' pixels
+    void resize(int width, int height);
+
+    // Copies the depth of the current framebuffer, clears the accumulation target and binds
+    // it together with the blend state for accumulating
+    void begin();
+
+    // Restores the framebuffer and blend state that were in use before 'begin'
+    void end();
+
+    // Blends the accumulated fragments over the current framebuffer
+    void composite();
+
+private:
+    WeightedBlending(const WeightedBlending&) = delete;
+    WeightedBlending& operator=(const WeightedBlending&) = delete;
+
+    // Deletes the framebuffer and its textures
+    void releaseTargets();
+
+    // The program that resolves the accumulation target
+    ghoul::opengl::ProgramObject* _compositeProgram;
+    // An empty vertex array; the fullscreen triangle is generated from gl_VertexID
+    GLuint _compositeVAO;
+
+    // The framebuffer with the two color targets and the copied depth
+    GLuint _framebuffer;
+    // The sum of the weighted premultiplied colors (rgb) and the weighted alphas (a)
+    GLuint _accumulationTexture;
+    // The product of (1 - alpha) of all fragments
+    GLuint _revealageTexture;
+    // The depth of the opaque geometry
+    GLuint _depthTexture;
+    // The size of the targets
+    int _width;
+    int _height;
+
+    // The framebuffer that was bound when 'begin' was called
+    GLint _previousFramebuffer;
+};
+
+#endif // __WEIGHTEDBLENDING_H__
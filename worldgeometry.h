@@ -0,0 +1,44 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * TNM090 Particle System                                                                         *
+ *                                                                                                *
+ * Copyright (c) 2013 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef __WORLDGEOMETRY_H__
+#define __WORLDGEOMETRY_H__
+
+// The extent of the world that the renderer draws and the simulations keep the particles in.
+// All of them include this header, so the particles bounce off the ground and the walls exactly
+// where they are visible, and in the same way on the CPU and on the GPU. The z axis points up
+namespace worldgeometry {
+    // Half the edge length of the skybox, which is a cube centered at the origin
+    const float SkyboxSize = 5.f;
+    // The height of the ground plane
+    const float GroundHeight = 0.f;
+
+    // How the particles bounce off the ground and off the walls of the skybox, see
+    // CollisionSystem::Material
+    const float GroundRestitution = 0.4f;
+    const float GroundFriction = 0.3f;
+    const float WallRestitution = 0.6f;
+    const float WallFriction = 0.1f;
+}
+
+#endif // __WORLDGEOMETRY_H__